@@ -29,6 +29,7 @@
 #include "core_mqtt.h"
 #include "core_mqtt_agent_manager.h"
 #include "core_mqtt_agent_manager_events.h"
+#include "core_mqtt_agent_command_pool.h"
 #include "core2forAWS.h"
 #include "device_tracking/device_tracking_config.h"
 #include "device_tracking/iot.h"
@@ -68,6 +69,13 @@ bool g_paused = false;
 #define MQTT_TOPIC_NAME_LEN (128)
 char g_mqtt_topic_name[MQTT_TOPIC_NAME_LEN] = "<UNK>";
 
+// GPS point message. Kept free of whitespace; with payloads this small, every byte is a noticeable share of the
+// PUBLISH packet.
+#define GPS_POINT_MSG_FORMAT "{\"SampleTime\":%lld,\"Position\":[%lf,%lf]}"
+
+// Typical length of a formatted GPS point message, used to ask the agent for publish credit before formatting it.
+#define GPS_POINT_MSG_LEN_ESTIMATE (64)
+
 static MQTTAgentContext_t* g_mqtt_agent = NULL;
 static EventGroupHandle_t mqtt_agent_event_group = NULL;
 
@@ -278,16 +286,60 @@ static void ProduceGpsPointsTask(void* param) {
 
 
 
+// Size of an MQTT 3.1.1 PUBLISH packet at DT_MQTT_QOS: fixed header, topic length prefix and name,
+// packet identifier (QoS 1 and 2 only), payload.
+static size_t PublishPacketSize(size_t topic_len, size_t msg_len) {
+  size_t remaining_len = 2 + topic_len + ((DT_MQTT_QOS > MQTTQoS0) ? 2 : 0) + msg_len;
+  size_t len_bytes = (remaining_len < 128) ? 1 : (remaining_len < 16384) ? 2 : 3;
+
+  return(1 + len_bytes + remaining_len);
+}
+
+
+
 static MQTTStatus_t UploadOneGpsPoint(IotContext* iot_context, struct GpsPoint* gps_point) {
+#if DT_IOT_AGENT
+  // Format the message straight into a publish buffer; the agent owns it until the publish completes, so there is
+  // neither a copy nor a wait for the PUBACK here.
+  (void) iot_context;
+
+  MQTTAgentPublishBuffer_t* pub_buf = IotReservePublishBuffer();
+
+  if(NULL == pub_buf) {
+    return(MQTTNoMemory);
+  }
+
+  int topic_len = snprintf(pub_buf->cTopic, sizeof(pub_buf->cTopic), "%s", g_mqtt_topic_name);
+
+  int msg_len = snprintf((char*) pub_buf->ucPayload, sizeof(pub_buf->ucPayload), GPS_POINT_MSG_FORMAT,
+    gps_point->sampleTime, gps_point->lon, gps_point->lat);
+
+  // snprintf() result excludes the terminator, which need not fit
+  if((topic_len <= 0) || ((size_t) topic_len >= sizeof(pub_buf->cTopic)) ||
+     (msg_len <= 0) || ((size_t) msg_len >= sizeof(pub_buf->ucPayload))) {
+    ESP_LOGW(TAG, "GPS point message too large for publish buffer");
+    vMQTTAgentPublishPoolRelease(pub_buf);
+    return(MQTTNoMemory);
+  }
+
+  ESP_LOGI(TAG, "Publishing MQTT Message: [%s] %s (%u bytes)", pub_buf->cTopic, (char*) pub_buf->ucPayload,
+    (unsigned int) PublishPacketSize((size_t) topic_len, (size_t) msg_len));
+
+  MQTTStatus_t rc = IotPublishBuffer(pub_buf, (uint16_t) topic_len, (size_t) msg_len);
+#else
   static const char example[] =
-    "{ 'SampleTime': 1652985753, 'Position': [ -93.274963, 44.984379 ] }";
+    "{'SampleTime':1652985753,'Position':[-93.274963,44.984379]}";
 
   static char msgBuf[sizeof(example) * 2];
 
-  sprintf(msgBuf, "{ \"SampleTime\": %lld, \"Position\": [ %lf, %lf ] }",
+  int msg_len = snprintf(msgBuf, sizeof(msgBuf), GPS_POINT_MSG_FORMAT,
     gps_point->sampleTime, gps_point->lon, gps_point->lat);
 
+  ESP_LOGD(TAG, "GPS point message: %u bytes", (unsigned int) PublishPacketSize(strlen(g_mqtt_topic_name),
+    (size_t) msg_len));
+
   MQTTStatus_t rc = IotPublish(iot_context, g_mqtt_topic_name, msgBuf);
+#endif
 
   return(rc);
 }
@@ -300,6 +352,9 @@ static void UploadGpsPointsTask(void* param) {
   MQTTStatus_t iot_rc = MQTTSuccess;
   struct GpsPoint gps_point = {0};
 
+  // Keep uploads within the telemetry share of the MQTT command pool.
+  (void)xMQTTAgentCommandPoolRegisterTask(NULL, eMQTTAgentCommandPoolCallerTelemetry);
+
   while(!giveUp) {
     // Read from queue. Must wake periodically to yield (see below).
     const TickType_t xBlockTime = pdMS_TO_TICKS(10000);
@@ -311,6 +366,16 @@ static void UploadGpsPointsTask(void* param) {
       // Do not pummel the MQTT Agent with messages if it is not in a state to xmit.
       WaitForMqttAgent();
 
+#if DT_IOT_AGENT
+      // While the agent is congested, leave the point in the queue, which holds the backlog, rather than blocking in
+      // the publish; it is sent once the agent signals it has caught up.
+      if(!IotCanPublish(g_mqtt_topic_name, GPS_POINT_MSG_LEN_ESTIMATE)) {
+        ESP_LOGD(TAG, "MQTT agent congested; %u points queued", (unsigned int) uxQueueMessagesWaiting(g_gps_points_queue));
+        IotWaitForCredit(g_mqtt_topic_name, 10000);
+        continue;
+      }
+#endif
+
       iot_rc = UploadOneGpsPoint(g_mqtt_agent, &gps_point);
 
       if(MQTTSuccess == iot_rc) {
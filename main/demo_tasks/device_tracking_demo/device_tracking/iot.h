@@ -19,6 +19,7 @@
 
 #if DT_IOT_AGENT
   #include "core_mqtt_agent.h"
+  #include "core_mqtt_agent_publish_pool.h"
   typedef MQTTAgentContext_t IotContext;
 #else
   #include "core_mqtt.h"
@@ -34,4 +35,16 @@
 MQTTStatus_t IotInit(IotContext* iot_context);
 MQTTStatus_t IotConnect(IotContext* iot_context, const char* client_id);
 MQTTStatus_t IotPublish(IotContext* iot_context, const char* topic, const char* msg);
-const char* IotGetClientId();
\ No newline at end of file
+const char* IotGetClientId();
+
+#if DT_IOT_AGENT
+  // Zero-copy publish: reserve a buffer, write the topic and message into it in place, then hand it to the agent,
+  // which returns it to the pool once the publish completes. Neither call waits for the PUBACK.
+  MQTTAgentPublishBuffer_t* IotReservePublishBuffer();
+  MQTTStatus_t IotPublishBuffer(MQTTAgentPublishBuffer_t* pub_buf, uint16_t topic_len, size_t msg_len);
+
+  // Back-pressure: check without blocking whether a publish would be accepted now and, if not, wait for the agent to
+  // signal it has caught up. Lets producers keep data queued instead of blocking inside the publish.
+  bool IotCanPublish(const char* topic, size_t msg_len);
+  bool IotWaitForCredit(const char* topic, uint32_t timeout_ms);
+#endif
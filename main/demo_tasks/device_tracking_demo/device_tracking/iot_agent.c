@@ -33,13 +33,8 @@
 // Logging identifier for this module.
 static const char* TAG = "iot";
 
-// Used to pass data between publish and publish-callback.
-struct MQTTAgentCommandContext
-{
-  TaskHandle_t xTaskToNotify;           // handle of publish request thread
-  uint32_t ulNotificationValue;         // task notification slot value
-  MQTTStatus_t xReturnStatus;           // publish result from publish callback
-};
+// Time to wait for a free publish buffer, which bounds how far producers run ahead of the broker.
+#define PUBLISH_BUFFER_WAIT_MS (1000)
 
 
 
@@ -47,33 +42,6 @@ struct MQTTAgentCommandContext
  * Function Definitions
  **********************************************************************************************************************/
 
-static void PublishCallback(MQTTAgentCommandContext_t* context, MQTTAgentReturnInfo_t* cb_info) {
-  // store the command result in the callback context for the requester
-  context->xReturnStatus = cb_info->returnCode;
-
-  // notify the requesting thread that the command is complete
-  if(context->xTaskToNotify != NULL )
-  {
-    xTaskNotify(context->xTaskToNotify,               // handle of task to notify
-                context->ulNotificationValue,         // notification slot value
-                eSetValueWithOverwrite );             // overwrite notification slot with new value
-  }
-}
-
-
-
-static BaseType_t WaitForCallback() {
-  BaseType_t rc = xTaskNotifyWait(
-    0,                        // notification slot bits to clear on entry
-    0,                        // notification slot bits to clear on exit
-    NULL,                     // notification slot value (not used)
-    portMAX_DELAY);           // wait forever
-
-  return(rc);
-}
-
-
-
 MQTTStatus_t IotInit(IotContext* iot_context) {
   // nothing to do when externally managed IoT agent is in use
   MQTTStatus_t rc = MQTTSuccess;
@@ -93,36 +61,49 @@ MQTTStatus_t IotConnect(IotContext* iot_context, const char* client_id) {
 MQTTStatus_t IotPublish(IotContext* iot_context, const char* topic, const char* msg) {
   ESP_LOGI(TAG, "Publishing MQTT Message: [%s] %s", topic, msg);
 
-  MQTTPublishInfo_t pub_info = {0};
+  // the manager routes the topic to its agent context (see pxCoreMqttAgentManagerGetContextForTopic())
+  (void) iot_context;
 
-  pub_info.qos             = DT_MQTT_QOS;
-  pub_info.retain          = false;
-  pub_info.dup             = false;
-  pub_info.pTopicName      = topic;
-  pub_info.topicNameLength = (uint16_t) strlen(pub_info.pTopicName);
-  pub_info.pPayload        = msg;
-  pub_info.payloadLength   = (uint16_t) strlen(pub_info.pPayload);
+  MQTTAgentPublishBuffer_t* pub_buf = IotReservePublishBuffer();
 
-  MQTTAgentCommandContext_t cmd_cxt = {0};
+  if(NULL == pub_buf) {
+    return(MQTTNoMemory);
+  }
 
-  cmd_cxt.xTaskToNotify = xTaskGetCurrentTaskHandle();
+  size_t topic_len = strlen(topic);
+  size_t msg_len = strlen(msg);
 
-  MQTTAgentCommandInfo_t cmd_info = {0};
+  if((topic_len > sizeof(pub_buf->cTopic)) || (msg_len > sizeof(pub_buf->ucPayload))) {
+    ESP_LOGW(TAG, "Message too large for publish buffer: topic %u, msg %u", (unsigned) topic_len, (unsigned) msg_len);
+    vMQTTAgentPublishPoolRelease(pub_buf);
+    return(MQTTNoMemory);
+  }
 
-  cmd_info.blockTimeMs = 1000;
-  cmd_info.cmdCompleteCallback = PublishCallback;
-  cmd_info.pCmdCompleteCallbackContext = &cmd_cxt;
+  memcpy(pub_buf->cTopic, topic, topic_len);
+  memcpy(pub_buf->ucPayload, msg, msg_len);
 
-  MQTTStatus_t rc = MQTTAgent_Publish(iot_context, &pub_info, &cmd_info );
+  return(IotPublishBuffer(pub_buf, (uint16_t) topic_len, msg_len));
+}
 
-  if(MQTTSuccess != rc) {
-    ESP_LOGW(TAG, "MQTTAgent_Publish failed: %d ", rc);
-  }
-  else {
-    WaitForCallback();
+
+
+MQTTAgentPublishBuffer_t* IotReservePublishBuffer() {
+  MQTTAgentPublishBuffer_t* pub_buf = pxMQTTAgentPublishPoolReserve(PUBLISH_BUFFER_WAIT_MS);
+
+  if(NULL == pub_buf) {
+    ESP_LOGW(TAG, "No free publish buffer");
   }
 
-  if(MQTTSuccess != cmd_cxt.xReturnStatus) {
+  return(pub_buf);
+}
+
+
+
+MQTTStatus_t IotPublishBuffer(MQTTAgentPublishBuffer_t* pub_buf, uint16_t topic_len, size_t msg_len) {
+  // ownership of pub_buf passes to the publish pool, whatever the result
+  MQTTStatus_t rc = xMQTTAgentPublishPoolSend(pub_buf, topic_len, msg_len, DT_MQTT_QOS);
+
+  if(MQTTSuccess != rc) {
     ESP_LOGW(TAG, "MQTTAgent_Publish failed: %d ", rc);
   }
 
@@ -131,6 +112,18 @@ MQTTStatus_t IotPublish(IotContext* iot_context, const char* topic, const char*
 
 
 
+bool IotCanPublish(const char* topic, size_t msg_len) {
+  return(pdTRUE == xCoreMqttAgentManagerCanPublish(topic, (uint16_t) strlen(topic), msg_len));
+}
+
+
+
+bool IotWaitForCredit(const char* topic, uint32_t timeout_ms) {
+  return(pdTRUE == xCoreMqttAgentManagerWaitForCredit(topic, (uint16_t) strlen(topic), pdMS_TO_TICKS(timeout_ms)));
+}
+
+
+
 const char* IotGetClientId() {
   return(xCoreMqttAgentManagerGetClientId());
 }
@@ -0,0 +1,1365 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/*
+ * This file implements a benchmark of the coreMQTT-Agent connection to the
+ * configured broker. Pointing the device at a local broker, such as a
+ * mosquitto instance with a TLS listener, gives repeatable figures.
+ *
+ * Once connected, the benchmark task runs once through:
+ * - publishes at QoS 0 and 1, for each configured payload size and number of
+ *   publishes kept in flight, measuring the message rate and the latency from
+ *   queuing each publish to its completion (sent for QoS 0, PUBACK for QoS 1);
+ * - the fan-in rate, by subscribing to a topic and measuring the rate at
+ *   which the broker delivers the publishes sent to it;
+ * - the latency of publishes while the fan-in subscriber is deliberately
+ *   slow, with its callback run on the coreMQTT-Agent task, then on a worker
+ *   task of the subscription dispatcher if queued dispatch is enabled;
+ * - the dispatch of incoming publishes by the subscription manager, for each
+ *   configured number of subscriptions, against matching every subscription
+ *   in turn with MQTT_MatchTopic(), then while another task keeps adding and
+ *   removing subscriptions.
+ * Reconnections are timed for as long as the application runs, from the
+ * disconnection to the next connection.
+ *
+ * Each result is printed as a single line of JSON, prefixed by "BENCH ", so it
+ * can be extracted from the console output for trend tracking.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
+
+/* ESP-IDF includes. */
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+/* coreMQTT library include. */
+#include "core_mqtt.h"
+
+/* coreMQTT-Agent include. */
+#include "core_mqtt_agent.h"
+
+/* coreMQTT-Agent network manager includes. */
+#include "core_mqtt_agent_manager.h"
+#include "core_mqtt_agent_manager_events.h"
+#include "core_mqtt_agent_manager_config.h"
+
+/* Subscription manager include. */
+#include "subscription_manager.h"
+
+/* Subscription dispatcher include. */
+#if configMQTT_AGENT_QUEUED_DISPATCH
+    #include "subscription_dispatcher.h"
+#endif /* configMQTT_AGENT_QUEUED_DISPATCH */
+
+/* Public functions include. */
+#include "mqtt_agent_benchmark.h"
+
+/* Benchmark configurations include. */
+#include "mqtt_agent_benchmark_config.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/* coreMQTT-Agent event group bit definitions */
+#define CORE_MQTT_AGENT_CONNECTED_BIT              ( 1 << 0 )
+#define CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT    ( 1 << 1 )
+#define BENCHMARK_FAN_IN_DONE_BIT                  ( 1 << 2 )
+
+/* Prefix of each result line. */
+#define BENCHMARK_OUTPUT_PREFIX                    "BENCH "
+
+/* Publishes in flight are bounded by the command pool. */
+#define BENCHMARK_MAX_WINDOW                       ( configMQTT_AGENT_COMMAND_POOL_SIZE )
+
+/* Maximum number of values in the payload size and window lists. */
+#define BENCHMARK_MAX_LIST_LENGTH                  ( 8 )
+
+#define BENCHMARK_TOPIC_LENGTH                     ( 128 )
+
+/* Topic filters of the dispatch benchmark, one in eight with a wildcard. */
+#define BENCHMARK_DISPATCH_FILTER_LENGTH           ( 40 )
+#define BENCHMARK_DISPATCH_WILDCARD_RATIO          ( 8 )
+
+/* Topics published to by the dispatch benchmark, in turn. */
+#define BENCHMARK_DISPATCH_TOPICS                  ( 64 )
+
+/* Dispatches timed for each number of subscriptions. */
+#define BENCHMARK_DISPATCHES_PER_RUN               ( benchmarkconfigMESSAGES_PER_RUN * 10U )
+
+#define MICROSECONDS_PER_SECOND                    ( 1000000ULL )
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief Defines the structure to use as the command callback context in this
+ * benchmark.
+ */
+struct MQTTAgentCommandContext
+{
+    MQTTPublishInfo_t xPublishInfo;             /**< Publishes only; must persist until completion. */
+    int64_t llQueuedUs;                         /**< When the publish was queued. */
+    MQTTStatus_t xReturnStatus;                 /**< Subscribes and unsubscribes only. */
+    TaskHandle_t xTaskToNotify;                 /**< Subscribes and unsubscribes only. */
+    MQTTAgentSubscribeArgs_t * pxSubscribeArgs; /**< Subscribes and unsubscribes only. */
+};
+
+/**
+ * @brief Outcome of a run of publishes. The completion counters are updated
+ * by the coreMQTT-Agent task, and read once the run is drained.
+ */
+typedef struct BenchmarkRun
+{
+    uint32_t ulCompleted;        /**< Publishes completed successfully. */
+    uint32_t ulFailed;           /**< Publishes completed with an error. */
+    uint32_t ulRejected;         /**< Publishes the coreMQTT-Agent did not accept. */
+    uint64_t ullTotalLatencyUs;  /**< Sum of the latencies of completed publishes. */
+    uint32_t ulMaxLatencyUs;     /**< Longest latency of a completed publish. */
+    int64_t llElapsedUs;         /**< Time from the first publish to the last completion. */
+} BenchmarkRun_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "mqtt_agent_benchmark";
+
+/**
+ * @brief The event group used to manage coreMQTT-Agent events.
+ */
+static EventGroupHandle_t xNetworkEventGroup;
+
+/**
+ * @brief Contexts of the publishes in flight, and the queue of the free ones.
+ */
+static MQTTAgentCommandContext_t xPublishContexts[ BENCHMARK_MAX_WINDOW ];
+static QueueHandle_t xFreePublishContexts;
+
+/**
+ * @brief Outcome of the current run of publishes.
+ */
+static BenchmarkRun_t xRun;
+
+/**
+ * @brief Payload of every publish; only its length varies.
+ */
+static uint8_t ucPayload[ benchmarkconfigMAX_PAYLOAD_SIZE ];
+
+/**
+ * @brief Topics of the benchmark. They must persist until the publishes
+ * complete and the subscription is removed.
+ */
+static char cPublishTopic[ BENCHMARK_TOPIC_LENGTH ];
+static char cFanInTopic[ BENCHMARK_TOPIC_LENGTH ];
+
+/**
+ * @brief Fan-in counters, updated by the coreMQTT-Agent task.
+ */
+static uint32_t ulFanInExpected;
+static uint32_t ulFanInReceived;
+static int64_t llFanInLastUs;
+
+/**
+ * @brief Callback and context registered for the fan-in topic, and the time
+ * prvFanInCallback() blocks for each publish to act as a slow subscriber.
+ */
+static IncomingPubCallback_t pxFanInCallback;
+static void * pvFanInContext;
+static uint32_t ulFanInDelayMs;
+
+#if configMQTT_AGENT_QUEUED_DISPATCH
+
+/**
+ * @brief Subscriber running prvFanInCallback() on a worker task, created by
+ * the first queued slow subscriber run.
+ */
+    static SubscriptionDispatcher_t * pxSlowDispatcher;
+#endif /* configMQTT_AGENT_QUEUED_DISPATCH */
+
+/**
+ * @brief When the connection was lost, 0 while connected.
+ */
+static int64_t llDisconnectedUs;
+
+/**
+ * @brief State shared with the writer task of the dispatch stress run.
+ */
+static volatile bool xStressStop;
+static TaskHandle_t xStressDispatcher;
+static volatile uint32_t ulStressWrites;
+static uint32_t ulStressChurnMatches;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief ESP Event Loop library handler for coreMQTT-Agent events. Also times
+ * reconnections.
+ *
+ * This handles events defined in core_mqtt_agent_events.h.
+ */
+static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
+                                          esp_event_base_t xEventBase,
+                                          int32_t lEventId,
+                                          void * pvEventData );
+
+/**
+ * @brief Parse a ';'-separated list of unsigned integers.
+ *
+ * @param[in] pcList List to parse.
+ * @param[out] pulValues Parsed values.
+ * @param[in] ulMaxValues Capacity of pulValues.
+ *
+ * @return Number of values parsed.
+ */
+static uint32_t prvParseList( const char * pcList,
+                              uint32_t * pulValues,
+                              uint32_t ulMaxValues );
+
+/**
+ * @brief Passed into MQTTAgent_Publish() as the callback to execute when the
+ * publish completes. Times the publish and returns its context to the free
+ * queue.
+ *
+ * @param[in] pxCommandContext Context of the initial command.
+ * @param[in] pxReturnInfo The result of the command.
+ */
+static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                       MQTTAgentReturnInfo_t * pxReturnInfo );
+
+/**
+ * @brief Passed into MQTTAgent_Subscribe() and MQTTAgent_Unsubscribe() as the
+ * callbacks to execute when the broker ACKs the command. They add or remove
+ * the fan-in subscription, then notify the task waiting for the command.
+ *
+ * @param[in] pxCommandContext Context of the initial command.
+ * @param[in] pxReturnInfo The result of the command.
+ */
+static void prvSubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                         MQTTAgentReturnInfo_t * pxReturnInfo );
+static void prvUnsubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                           MQTTAgentReturnInfo_t * pxReturnInfo );
+
+/**
+ * @brief Incoming publish callback of the fan-in subscription. Counts the
+ * publishes and signals the benchmark task once all of them were received.
+ * Blocks for ulFanInDelayMs first.
+ *
+ * @param[in] pvIncomingPublishCallbackContext Unused.
+ * @param[in] pxPublishInfo Deserialized publish.
+ */
+static void prvFanInCallback( void * pvIncomingPublishCallbackContext,
+                              MQTTPublishInfo_t * pxPublishInfo );
+
+/**
+ * @brief Wait for the coreMQTT-Agent to be connected and not performing an
+ * OTA update.
+ */
+static void prvWaitForConnection( void );
+
+/**
+ * @brief Subscribe to, or unsubscribe from, the fan-in topic and wait for the
+ * acknowledgement.
+ *
+ * @param[in] xSubscribe true to subscribe, false to unsubscribe.
+ *
+ * @return pdPASS if acknowledged, pdFAIL otherwise.
+ */
+static BaseType_t prvSubscribeFanIn( bool xSubscribe );
+
+/**
+ * @brief Publish benchmarkconfigMESSAGES_PER_RUN messages as fast as the
+ * coreMQTT-Agent accepts them, keeping up to ulWindow publishes in flight,
+ * then wait for all of them to complete. The outcome is left in xRun.
+ *
+ * @param[in] pcTopic Topic to publish to.
+ * @param[in] xQoS QoS of the publishes.
+ * @param[in] ulPayloadSize Payload size of the publishes.
+ * @param[in] ulWindow Number of publishes kept in flight.
+ *
+ * @return pdPASS if all publishes completed, pdFAIL if the run timed out.
+ */
+static BaseType_t prvRunPublishes( const char * pcTopic,
+                                   MQTTQoS_t xQoS,
+                                   uint32_t ulPayloadSize,
+                                   uint32_t ulWindow );
+
+/**
+ * @brief Benchmark publishes for each QoS, payload size and window.
+ *
+ * @return pdPASS if every run completed, pdFAIL otherwise.
+ */
+static BaseType_t prvBenchmarkPublishes( void );
+
+/**
+ * @brief Benchmark the rate of incoming publishes.
+ *
+ * @return pdPASS if the run completed, pdFAIL otherwise.
+ */
+static BaseType_t prvBenchmarkFanIn( void );
+
+/**
+ * @brief Payload size of the fan-in publishes, the first configured one.
+ *
+ * @return Payload size in bytes.
+ */
+static uint32_t prvGetFanInPayloadSize( void );
+
+/**
+ * @brief Publish to the fan-in topic while its subscriber is slow, and wait
+ * for the subscriber to receive or drop every publish.
+ *
+ * @param[in] pcMode Name of the dispatch mode, for the output.
+ * @param[in] pvDispatcher Subscriber queuing the publishes to a worker task,
+ * or NULL to run the callback on the coreMQTT-Agent task.
+ *
+ * @return pdPASS if the run completed, pdFAIL otherwise.
+ */
+static BaseType_t prvRunSlowSubscriber( const char * pcMode,
+                                        void * pvDispatcher );
+
+/**
+ * @brief Benchmark the latency of the coreMQTT-Agent with a slow subscriber,
+ * for each dispatch mode.
+ *
+ * @return pdPASS if every run completed, pdFAIL otherwise.
+ */
+static BaseType_t prvBenchmarkSlowSubscriber( void );
+
+/**
+ * @brief Incoming publish callback of the dispatch benchmark. Counts the
+ * publishes.
+ *
+ * @param[in] pvIncomingPublishCallbackContext Pointer to the counter.
+ * @param[in] pxPublishInfo Deserialized publish.
+ */
+static void prvDispatchCallback( void * pvIncomingPublishCallbackContext,
+                                 MQTTPublishInfo_t * pxPublishInfo );
+
+/**
+ * @brief Count the subscriptions of a list matching a publish by matching
+ * every subscription in turn with MQTT_MatchTopic(), as a reference for the
+ * subscription manager.
+ *
+ * @param[in] pxList Subscription list.
+ * @param[in] pxPublishInfo Publish to dispatch.
+ * @param[in,out] pulMatches Incremented for each match.
+ */
+static void prvDispatchLinear( SubscriptionList_t * pxList,
+                               MQTTPublishInfo_t * pxPublishInfo,
+                               uint32_t * pulMatches );
+
+/**
+ * @brief Task adding and removing subscriptions to the list being dispatched
+ * by the dispatch stress run, until xStressStop is set.
+ *
+ * @param[in] pvParameters The subscription list.
+ */
+static void prvStressWriterTask( void * pvParameters );
+
+/**
+ * @brief Dispatch publishes at full rate while prvStressWriterTask() changes
+ * the subscription list, checking that a subscription which is not changed
+ * is matched by every dispatch.
+ *
+ * @param[in] pxList Subscription list to use.
+ *
+ * @return pdPASS if every dispatch matched, pdFAIL otherwise.
+ */
+static BaseType_t prvRunDispatchStress( SubscriptionList_t * pxList );
+
+/**
+ * @brief Time the dispatch of incoming publishes with a number of
+ * subscriptions, by the subscription manager then by prvDispatchLinear().
+ *
+ * @param[in] pxList Subscription list to fill.
+ * @param[in] pcTopics Storage for the topics published to.
+ * @param[in] ulCount Number of subscriptions.
+ *
+ * @return pdPASS if both matched the same publishes, pdFAIL otherwise.
+ */
+static BaseType_t prvRunDispatch( SubscriptionList_t * pxList,
+                                  char * pcTopics,
+                                  uint32_t ulCount );
+
+/**
+ * @brief Benchmark the dispatch of incoming publishes by the subscription
+ * manager for each configured number of subscriptions. No network traffic is
+ * involved.
+ *
+ * @return pdPASS if every run completed, pdFAIL otherwise.
+ */
+static BaseType_t prvBenchmarkDispatch( void );
+
+/**
+ * @brief The function that implements the benchmark task.
+ */
+static void prvBenchmarkTask( void * pvParameters );
+
+/* Static function definitions ************************************************/
+
+static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
+                                          esp_event_base_t xEventBase,
+                                          int32_t lEventId,
+                                          void * pvEventData )
+{
+    ( void ) pvHandlerArg;
+    ( void ) xEventBase;
+    ( void ) pvEventData;
+
+    switch( lEventId )
+    {
+        case CORE_MQTT_AGENT_CONNECTED_EVENT:
+            xEventGroupSetBits( xNetworkEventGroup,
+                                CORE_MQTT_AGENT_CONNECTED_BIT );
+
+            if( llDisconnectedUs != 0 )
+            {
+                printf( BENCHMARK_OUTPUT_PREFIX "{\"test\":\"reconnect\",\"ms\":%"PRIu32"}\n",
+                        ( uint32_t ) ( ( esp_timer_get_time() - llDisconnectedUs ) / 1000 ) );
+                llDisconnectedUs = 0;
+            }
+
+            break;
+
+        case CORE_MQTT_AGENT_DISCONNECTED_EVENT:
+            xEventGroupClearBits( xNetworkEventGroup,
+                                  CORE_MQTT_AGENT_CONNECTED_BIT );
+
+            if( llDisconnectedUs == 0 )
+            {
+                llDisconnectedUs = esp_timer_get_time();
+            }
+
+            break;
+
+        case CORE_MQTT_AGENT_OTA_STARTED_EVENT:
+            xEventGroupClearBits( xNetworkEventGroup,
+                                  CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT );
+            break;
+
+        case CORE_MQTT_AGENT_OTA_STOPPED_EVENT:
+            xEventGroupSetBits( xNetworkEventGroup,
+                                CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT );
+            break;
+
+        default:
+            ESP_LOGE( TAG,
+                      "coreMQTT-Agent event handler received unexpected event: %"PRIu32"",
+                      lEventId );
+            break;
+    }
+}
+
+static uint32_t prvParseList( const char * pcList,
+                              uint32_t * pulValues,
+                              uint32_t ulMaxValues )
+{
+    const char * pcCursor = pcList;
+    char * pcEnd;
+    uint32_t ulCount = 0;
+    unsigned long ulValue;
+
+    while( ( *pcCursor != '\0' ) && ( ulCount < ulMaxValues ) )
+    {
+        ulValue = strtoul( pcCursor, &pcEnd, 10 );
+
+        if( pcEnd == pcCursor )
+        {
+            /* Skip separators and anything that is not a number. */
+            pcCursor++;
+        }
+        else
+        {
+            pulValues[ ulCount ] = ( uint32_t ) ulValue;
+            ulCount++;
+            pcCursor = pcEnd;
+        }
+    }
+
+    return ulCount;
+}
+
+static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                       MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    uint32_t ulLatencyUs = ( uint32_t ) ( esp_timer_get_time() - pxCommandContext->llQueuedUs );
+
+    if( pxReturnInfo->returnCode == MQTTSuccess )
+    {
+        xRun.ulCompleted++;
+        xRun.ullTotalLatencyUs += ulLatencyUs;
+
+        if( ulLatencyUs > xRun.ulMaxLatencyUs )
+        {
+            xRun.ulMaxLatencyUs = ulLatencyUs;
+        }
+    }
+    else
+    {
+        xRun.ulFailed++;
+    }
+
+    ( void ) xQueueSend( xFreePublishContexts, &pxCommandContext, 0 );
+}
+
+static void prvSubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                         MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    MQTTSubscribeInfo_t * pxSubscribeInfo = pxCommandContext->pxSubscribeArgs->pSubscribeInfo;
+    MQTTAgentContext_t * pxAgentContext;
+    bool xSubscriptionAdded;
+
+    pxCommandContext->xReturnStatus = pxReturnInfo->returnCode;
+
+    if( pxReturnInfo->returnCode == MQTTSuccess )
+    {
+        pxAgentContext = pxCoreMqttAgentManagerGetContextForTopic( pxSubscribeInfo->pTopicFilter,
+                                                                   pxSubscribeInfo->topicFilterLength );
+
+        xSubscriptionAdded = addSubscription( ( SubscriptionList_t * ) pxAgentContext->pIncomingCallbackContext,
+                                              pxSubscribeInfo->pTopicFilter,
+                                              pxSubscribeInfo->topicFilterLength,
+                                              pxFanInCallback,
+                                              pvFanInContext );
+
+        if( xSubscriptionAdded == false )
+        {
+            ESP_LOGE( TAG,
+                      "Failed to register an incoming publish callback for topic %.*s.",
+                      pxSubscribeInfo->topicFilterLength,
+                      pxSubscribeInfo->pTopicFilter );
+
+            pxCommandContext->xReturnStatus = MQTTNoMemory;
+        }
+    }
+
+    xTaskNotifyGive( pxCommandContext->xTaskToNotify );
+}
+
+static void prvUnsubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                           MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    MQTTSubscribeInfo_t * pxSubscribeInfo = pxCommandContext->pxSubscribeArgs->pSubscribeInfo;
+    MQTTAgentContext_t * pxAgentContext;
+
+    pxCommandContext->xReturnStatus = pxReturnInfo->returnCode;
+
+    if( pxReturnInfo->returnCode == MQTTSuccess )
+    {
+        pxAgentContext = pxCoreMqttAgentManagerGetContextForTopic( pxSubscribeInfo->pTopicFilter,
+                                                                   pxSubscribeInfo->topicFilterLength );
+
+        removeSubscription( ( SubscriptionList_t * ) pxAgentContext->pIncomingCallbackContext,
+                            pxSubscribeInfo->pTopicFilter,
+                            pxSubscribeInfo->topicFilterLength );
+    }
+
+    xTaskNotifyGive( pxCommandContext->xTaskToNotify );
+}
+
+static void prvFanInCallback( void * pvIncomingPublishCallbackContext,
+                              MQTTPublishInfo_t * pxPublishInfo )
+{
+    ( void ) pvIncomingPublishCallbackContext;
+    ( void ) pxPublishInfo;
+
+    if( ulFanInDelayMs > 0U )
+    {
+        vTaskDelay( pdMS_TO_TICKS( ulFanInDelayMs ) );
+    }
+
+    ulFanInReceived++;
+    llFanInLastUs = esp_timer_get_time();
+
+    if( ulFanInReceived == ulFanInExpected )
+    {
+        xEventGroupSetBits( xNetworkEventGroup,
+                            BENCHMARK_FAN_IN_DONE_BIT );
+    }
+}
+
+static void prvWaitForConnection( void )
+{
+    xEventGroupWaitBits( xNetworkEventGroup,
+                         CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT,
+                         pdFALSE,
+                         pdTRUE,
+                         portMAX_DELAY );
+}
+
+static BaseType_t prvSubscribeFanIn( bool xSubscribe )
+{
+    MQTTSubscribeInfo_t xSubscribeInfo = { 0 };
+    MQTTAgentSubscribeArgs_t xSubscribeArgs = { 0 };
+    MQTTAgentCommandContext_t xCommandContext = { 0 };
+    MQTTAgentCommandInfo_t xCommandParams = { 0 };
+    MQTTAgentContext_t * pxAgentContext;
+    MQTTStatus_t xCommandAdded;
+    BaseType_t xRet = pdFAIL;
+
+    xSubscribeInfo.qos = MQTTQoS0;
+    xSubscribeInfo.pTopicFilter = cFanInTopic;
+    xSubscribeInfo.topicFilterLength = ( uint16_t ) strlen( cFanInTopic );
+
+    xSubscribeArgs.pSubscribeInfo = &xSubscribeInfo;
+    xSubscribeArgs.numSubscriptions = 1;
+
+    xCommandContext.xReturnStatus = MQTTSendFailed;
+    xCommandContext.xTaskToNotify = xTaskGetCurrentTaskHandle();
+    xCommandContext.pxSubscribeArgs = &xSubscribeArgs;
+
+    xCommandParams.blockTimeMs = benchmarkconfigCOMMAND_TIMEOUT_MS;
+    xCommandParams.cmdCompleteCallback = xSubscribe ? prvSubscribeCommandCallback : prvUnsubscribeCommandCallback;
+    xCommandParams.pCmdCompleteCallbackContext = &xCommandContext;
+
+    pxAgentContext = pxCoreMqttAgentManagerGetContextForTopic( xSubscribeInfo.pTopicFilter,
+                                                               xSubscribeInfo.topicFilterLength );
+
+    ( void ) ulTaskNotifyTake( pdTRUE, 0 );
+
+    if( xSubscribe )
+    {
+        xCommandAdded = MQTTAgent_Subscribe( pxAgentContext, &xSubscribeArgs, &xCommandParams );
+    }
+    else
+    {
+        xCommandAdded = MQTTAgent_Unsubscribe( pxAgentContext, &xSubscribeArgs, &xCommandParams );
+    }
+
+    if( xCommandAdded == MQTTSuccess )
+    {
+        /* The context is on this stack, so wait for the callback however long
+         * it takes. */
+        ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+    }
+    else
+    {
+        xCommandContext.xReturnStatus = xCommandAdded;
+    }
+
+    if( xCommandContext.xReturnStatus != MQTTSuccess )
+    {
+        ESP_LOGE( TAG,
+                  "%s failed. Error code=%s",
+                  xSubscribe ? "Subscribe" : "Unsubscribe",
+                  MQTT_Status_strerror( xCommandContext.xReturnStatus ) );
+    }
+    else
+    {
+        xRet = pdPASS;
+    }
+
+    return xRet;
+}
+
+static BaseType_t prvRunPublishes( const char * pcTopic,
+                                   MQTTQoS_t xQoS,
+                                   uint32_t ulPayloadSize,
+                                   uint32_t ulWindow )
+{
+    MQTTAgentCommandContext_t * pxContext;
+    MQTTAgentCommandInfo_t xCommandParams = { 0 };
+    MQTTAgentContext_t * pxAgentContext;
+    MQTTStatus_t xCommandAdded;
+    BaseType_t xRet = pdPASS;
+    int64_t llStartUs;
+    uint32_t i;
+
+    memset( &xRun, 0x00, sizeof( xRun ) );
+
+    ( void ) xQueueReset( xFreePublishContexts );
+
+    for( i = 0; i < ulWindow; i++ )
+    {
+        pxContext = &( xPublishContexts[ i ] );
+        ( void ) xQueueSend( xFreePublishContexts, &pxContext, 0 );
+    }
+
+    pxAgentContext = pxCoreMqttAgentManagerGetContextForTopic( pcTopic, ( uint16_t ) strlen( pcTopic ) );
+
+    xCommandParams.blockTimeMs = benchmarkconfigCOMMAND_TIMEOUT_MS;
+    xCommandParams.cmdCompleteCallback = prvPublishCommandCallback;
+
+    llStartUs = esp_timer_get_time();
+
+    for( i = 0; ( xRet == pdPASS ) && ( i < benchmarkconfigMESSAGES_PER_RUN ); i++ )
+    {
+        if( xQueueReceive( xFreePublishContexts,
+                           &pxContext,
+                           pdMS_TO_TICKS( benchmarkconfigCOMMAND_TIMEOUT_MS ) ) != pdTRUE )
+        {
+            xRet = pdFAIL;
+        }
+        else
+        {
+            pxContext->xPublishInfo.qos = xQoS;
+            pxContext->xPublishInfo.pTopicName = pcTopic;
+            pxContext->xPublishInfo.topicNameLength = ( uint16_t ) strlen( pcTopic );
+            pxContext->xPublishInfo.pPayload = ucPayload;
+            pxContext->xPublishInfo.payloadLength = ulPayloadSize;
+            pxContext->llQueuedUs = esp_timer_get_time();
+
+            xCommandParams.pCmdCompleteCallbackContext = pxContext;
+
+            xCommandAdded = MQTTAgent_Publish( pxAgentContext,
+                                               &( pxContext->xPublishInfo ),
+                                               &xCommandParams );
+
+            if( xCommandAdded != MQTTSuccess )
+            {
+                xRun.ulRejected++;
+                ( void ) xQueueSend( xFreePublishContexts, &pxContext, 0 );
+            }
+        }
+    }
+
+    /* Wait for the publishes in flight to complete. */
+    for( i = 0; ( xRet == pdPASS ) && ( i < ulWindow ); i++ )
+    {
+        if( xQueueReceive( xFreePublishContexts,
+                           &pxContext,
+                           pdMS_TO_TICKS( benchmarkconfigCOMMAND_TIMEOUT_MS ) ) != pdTRUE )
+        {
+            xRet = pdFAIL;
+        }
+    }
+
+    xRun.llElapsedUs = esp_timer_get_time() - llStartUs;
+
+    if( xRet != pdPASS )
+    {
+        ESP_LOGE( TAG,
+                  "Timed out waiting for publishes on %s to complete.",
+                  pcTopic );
+    }
+
+    return xRet;
+}
+
+static BaseType_t prvBenchmarkPublishes( void )
+{
+    uint32_t ulPayloadSizes[ BENCHMARK_MAX_LIST_LENGTH ];
+    uint32_t ulWindows[ BENCHMARK_MAX_LIST_LENGTH ];
+    uint32_t ulPayloadSizeCount;
+    uint32_t ulWindowCount;
+    uint32_t ulSize, ulWindow;
+    MQTTQoS_t xQoS;
+    BaseType_t xRet = pdPASS;
+
+    ulPayloadSizeCount = prvParseList( benchmarkconfigPAYLOAD_SIZES, ulPayloadSizes, BENCHMARK_MAX_LIST_LENGTH );
+    ulWindowCount = prvParseList( benchmarkconfigWINDOWS, ulWindows, BENCHMARK_MAX_LIST_LENGTH );
+
+    for( xQoS = MQTTQoS0; ( xRet == pdPASS ) && ( xQoS <= MQTTQoS1 ); xQoS++ )
+    {
+        for( ulSize = 0; ( xRet == pdPASS ) && ( ulSize < ulPayloadSizeCount ); ulSize++ )
+        {
+            if( ulPayloadSizes[ ulSize ] > benchmarkconfigMAX_PAYLOAD_SIZE )
+            {
+                ESP_LOGW( TAG,
+                          "Skipping payload size %"PRIu32", larger than the payload buffer.",
+                          ulPayloadSizes[ ulSize ] );
+                continue;
+            }
+
+            for( ulWindow = 0; ( xRet == pdPASS ) && ( ulWindow < ulWindowCount ); ulWindow++ )
+            {
+                if( ( ulWindows[ ulWindow ] == 0U ) || ( ulWindows[ ulWindow ] > BENCHMARK_MAX_WINDOW ) )
+                {
+                    ESP_LOGW( TAG,
+                              "Skipping window %"PRIu32", outside 1 to the command pool size.",
+                              ulWindows[ ulWindow ] );
+                    continue;
+                }
+
+                prvWaitForConnection();
+
+                xRet = prvRunPublishes( cPublishTopic, xQoS, ulPayloadSizes[ ulSize ], ulWindows[ ulWindow ] );
+
+                if( xRet == pdPASS )
+                {
+                    printf( BENCHMARK_OUTPUT_PREFIX "{\"test\":\"publish\",\"qos\":%d,\"payload\":%"PRIu32","
+                            "\"window\":%"PRIu32",\"messages\":%u,\"completed\":%"PRIu32",\"failed\":%"PRIu32","
+                            "\"rejected\":%"PRIu32",\"elapsedMs\":%"PRIu32",\"msgPerS\":%"PRIu32","
+                            "\"latAvgUs\":%"PRIu32",\"latMaxUs\":%"PRIu32"}\n",
+                            ( int ) xQoS,
+                            ulPayloadSizes[ ulSize ],
+                            ulWindows[ ulWindow ],
+                            benchmarkconfigMESSAGES_PER_RUN,
+                            xRun.ulCompleted,
+                            xRun.ulFailed,
+                            xRun.ulRejected,
+                            ( uint32_t ) ( xRun.llElapsedUs / 1000 ),
+                            ( xRun.llElapsedUs > 0 ) ? ( uint32_t ) ( xRun.ulCompleted * MICROSECONDS_PER_SECOND / ( uint64_t ) xRun.llElapsedUs ) : 0U,
+                            ( xRun.ulCompleted > 0U ) ? ( uint32_t ) ( xRun.ullTotalLatencyUs / xRun.ulCompleted ) : 0U,
+                            xRun.ulMaxLatencyUs );
+                }
+            }
+        }
+    }
+
+    return xRet;
+}
+
+static BaseType_t prvBenchmarkFanIn( void )
+{
+    uint32_t ulPayloadSize = prvGetFanInPayloadSize();
+    int64_t llStartUs;
+    int64_t llElapsedUs;
+    EventBits_t xBits;
+    BaseType_t xRet;
+
+    prvWaitForConnection();
+
+    xRet = prvSubscribeFanIn( true );
+
+    if( xRet == pdPASS )
+    {
+        ulFanInReceived = 0U;
+        ulFanInExpected = benchmarkconfigMESSAGES_PER_RUN;
+        xEventGroupClearBits( xNetworkEventGroup, BENCHMARK_FAN_IN_DONE_BIT );
+
+        llStartUs = esp_timer_get_time();
+
+        xRet = prvRunPublishes( cFanInTopic, MQTTQoS0, ulPayloadSize, BENCHMARK_MAX_WINDOW );
+    }
+
+    if( xRet == pdPASS )
+    {
+        xBits = xEventGroupWaitBits( xNetworkEventGroup,
+                                     BENCHMARK_FAN_IN_DONE_BIT,
+                                     pdTRUE,
+                                     pdTRUE,
+                                     pdMS_TO_TICKS( benchmarkconfigCOMMAND_TIMEOUT_MS ) );
+
+        if( ( xBits & BENCHMARK_FAN_IN_DONE_BIT ) == 0U )
+        {
+            ESP_LOGW( TAG,
+                      "Received %"PRIu32" of %u fan-in publishes.",
+                      ulFanInReceived,
+                      benchmarkconfigMESSAGES_PER_RUN );
+        }
+
+        llElapsedUs = ( ulFanInReceived > 0U ) ? ( llFanInLastUs - llStartUs ) : 0;
+
+        printf( BENCHMARK_OUTPUT_PREFIX "{\"test\":\"fanin\",\"payload\":%"PRIu32",\"messages\":%u,"
+                "\"received\":%"PRIu32",\"elapsedMs\":%"PRIu32",\"msgPerS\":%"PRIu32"}\n",
+                ulPayloadSize,
+                benchmarkconfigMESSAGES_PER_RUN,
+                ulFanInReceived,
+                ( uint32_t ) ( llElapsedUs / 1000 ),
+                ( llElapsedUs > 0 ) ? ( uint32_t ) ( ulFanInReceived * MICROSECONDS_PER_SECOND / ( uint64_t ) llElapsedUs ) : 0U );
+
+        xRet = prvSubscribeFanIn( false );
+    }
+
+    return xRet;
+}
+
+static uint32_t prvGetFanInPayloadSize( void )
+{
+    uint32_t ulPayloadSize;
+
+    /* The smallest configured payload stresses the receive path the most. */
+    if( prvParseList( benchmarkconfigPAYLOAD_SIZES, &ulPayloadSize, 1 ) == 0U )
+    {
+        ulPayloadSize = 0U;
+    }
+
+    return ( ulPayloadSize > benchmarkconfigMAX_PAYLOAD_SIZE ) ? benchmarkconfigMAX_PAYLOAD_SIZE : ulPayloadSize;
+}
+
+static BaseType_t prvRunSlowSubscriber( const char * pcMode,
+                                        void * pvDispatcher )
+{
+    uint32_t ulDropped = 0;
+    int64_t llStartUs;
+    BaseType_t xRet;
+
+    #if configMQTT_AGENT_QUEUED_DISPATCH
+        SubscriptionDispatcherStats_t xBefore = { 0 }, xAfter = { 0 };
+
+        if( pvDispatcher != NULL )
+        {
+            vSubscriptionDispatcherGetStats( ( SubscriptionDispatcher_t * ) pvDispatcher, &xBefore );
+            pxFanInCallback = vSubscriptionDispatcherCallback;
+            pvFanInContext = pvDispatcher;
+        }
+    #else
+        ( void ) pvDispatcher;
+    #endif /* configMQTT_AGENT_QUEUED_DISPATCH */
+
+    prvWaitForConnection();
+
+    xRet = prvSubscribeFanIn( true );
+
+    if( xRet == pdPASS )
+    {
+        ulFanInReceived = 0U;
+        ulFanInExpected = benchmarkconfigMESSAGES_PER_RUN;
+        ulFanInDelayMs = benchmarkconfigSLOW_SUBSCRIBER_DELAY_MS;
+
+        /* Completions of QoS 0 publishes are reported by the coreMQTT-Agent
+         * task once sent, so their latency includes the time the task spent in
+         * incoming publish callbacks. */
+        xRet = prvRunPublishes( cFanInTopic, MQTTQoS0, prvGetFanInPayloadSize(), BENCHMARK_MAX_WINDOW );
+    }
+
+    if( xRet == pdPASS )
+    {
+        llStartUs = esp_timer_get_time();
+
+        /* A publish the broker did not deliver is neither received nor
+         * dropped, hence the timeout. */
+        while( ( ( ulFanInReceived + ulDropped ) < benchmarkconfigMESSAGES_PER_RUN ) &&
+               ( ( esp_timer_get_time() - llStartUs ) < ( benchmarkconfigCOMMAND_TIMEOUT_MS * 1000LL ) ) )
+        {
+            vTaskDelay( pdMS_TO_TICKS( 10 ) );
+
+            #if configMQTT_AGENT_QUEUED_DISPATCH
+                if( pvDispatcher != NULL )
+                {
+                    vSubscriptionDispatcherGetStats( ( SubscriptionDispatcher_t * ) pvDispatcher, &xAfter );
+                    ulDropped = ( xAfter.ulDropped - xBefore.ulDropped ) + ( xAfter.ulTooLarge - xBefore.ulTooLarge );
+                }
+            #endif /* configMQTT_AGENT_QUEUED_DISPATCH */
+        }
+
+        printf( BENCHMARK_OUTPUT_PREFIX "{\"test\":\"slow_subscriber\",\"mode\":\"%s\",\"delayMs\":%u,"
+                "\"messages\":%u,\"received\":%"PRIu32",\"dropped\":%"PRIu32","
+                "\"latAvgUs\":%"PRIu32",\"latMaxUs\":%"PRIu32"}\n",
+                pcMode,
+                benchmarkconfigSLOW_SUBSCRIBER_DELAY_MS,
+                benchmarkconfigMESSAGES_PER_RUN,
+                ulFanInReceived,
+                ulDropped,
+                ( xRun.ulCompleted > 0U ) ? ( uint32_t ) ( xRun.ullTotalLatencyUs / xRun.ulCompleted ) : 0U,
+                xRun.ulMaxLatencyUs );
+    }
+
+    ulFanInDelayMs = 0U;
+
+    if( xRet == pdPASS )
+    {
+        xRet = prvSubscribeFanIn( false );
+    }
+
+    pxFanInCallback = prvFanInCallback;
+    pvFanInContext = NULL;
+
+    return xRet;
+}
+
+static BaseType_t prvBenchmarkSlowSubscriber( void )
+{
+    BaseType_t xRet;
+
+    xRet = prvRunSlowSubscriber( "inline", NULL );
+
+    #if configMQTT_AGENT_QUEUED_DISPATCH
+        if( ( xRet == pdPASS ) && ( pxSlowDispatcher == NULL ) )
+        {
+            pxSlowDispatcher = pxSubscriptionDispatcherCreate( "MQTTBenchSlow",
+                                                               configMQTT_AGENT_DISPATCH_QUEUE_LENGTH,
+                                                               ( SubscriptionDispatcherOverflow_t ) configMQTT_AGENT_DISPATCH_OVERFLOW,
+                                                               prvFanInCallback,
+                                                               NULL );
+            xRet = ( pxSlowDispatcher != NULL ) ? pdPASS : pdFAIL;
+        }
+
+        if( xRet == pdPASS )
+        {
+            xRet = prvRunSlowSubscriber( "queued", pxSlowDispatcher );
+        }
+    #endif /* configMQTT_AGENT_QUEUED_DISPATCH */
+
+    return xRet;
+}
+
+static void prvDispatchCallback( void * pvIncomingPublishCallbackContext,
+                                 MQTTPublishInfo_t * pxPublishInfo )
+{
+    ( void ) pxPublishInfo;
+
+    ( *( ( uint32_t * ) pvIncomingPublishCallbackContext ) )++;
+}
+
+static void prvDispatchLinear( SubscriptionList_t * pxList,
+                               MQTTPublishInfo_t * pxPublishInfo,
+                               uint32_t * pulMatches )
+{
+    uint32_t ulElements = 0, i;
+    const SubscriptionElement_t * pxElements = acquireSubscriptions( pxList, &ulElements );
+    bool xMatch;
+
+    for( i = 0; i < ulElements; i++ )
+    {
+        if( pxElements[ i ].usFilterStringLength > 0 )
+        {
+            xMatch = false;
+            MQTT_MatchTopic( pxPublishInfo->pTopicName,
+                             pxPublishInfo->topicNameLength,
+                             pxElements[ i ].pcSubscriptionFilterString,
+                             pxElements[ i ].usFilterStringLength,
+                             &xMatch );
+
+            if( xMatch )
+            {
+                ( *pulMatches )++;
+            }
+        }
+    }
+
+    releaseSubscriptions( pxList, pxElements );
+}
+
+static void prvStressWriterTask( void * pvParameters )
+{
+    SubscriptionList_t * pxList = ( SubscriptionList_t * ) pvParameters;
+    const char * pcFilter;
+
+    while( !xStressStop )
+    {
+        /* Alternate between the hash table and the index. */
+        pcFilter = ( ( ulStressWrites % 2U ) == 0U ) ? "bench/stress/churn" : "bench/stress/+";
+
+        addSubscription( pxList, pcFilter, ( uint16_t ) strlen( pcFilter ), prvDispatchCallback, &ulStressChurnMatches );
+        removeSubscription( pxList, pcFilter, ( uint16_t ) strlen( pcFilter ) );
+        ulStressWrites += 2U;
+    }
+
+    xTaskNotifyGive( xStressDispatcher );
+    vTaskDelete( NULL );
+}
+
+static BaseType_t prvRunDispatchStress( SubscriptionList_t * pxList )
+{
+    static const char * pcFixedFilter = "bench/stress/fixed";
+    uint32_t ulFixedMatches = 0, ulExpected = 0, ulMissed = 0, i;
+    MQTTPublishInfo_t xPublishInfo = { 0 };
+    int64_t llStartUs, llElapsedUs;
+    BaseType_t xRet = pdPASS;
+
+    freeSubscriptionList( pxList );
+    addSubscription( pxList, pcFixedFilter, ( uint16_t ) strlen( pcFixedFilter ), prvDispatchCallback, &ulFixedMatches );
+
+    xStressStop = false;
+    xStressDispatcher = xTaskGetCurrentTaskHandle();
+    ulStressWrites = 0;
+    ulStressChurnMatches = 0;
+
+    /* At the same priority, the writer preempts dispatches at each tick. */
+    if( xTaskCreate( prvStressWriterTask,
+                     "MQTTBenchW",
+                     benchmarkconfigTASK_STACK_SIZE,
+                     pxList,
+                     benchmarkconfigTASK_PRIORITY,
+                     NULL ) != pdPASS )
+    {
+        ESP_LOGE( TAG, "Failed to create the dispatch stress writer task." );
+        xRet = pdFAIL;
+    }
+    else
+    {
+        llStartUs = esp_timer_get_time();
+
+        for( i = 0; i < BENCHMARK_DISPATCHES_PER_RUN; i++ )
+        {
+            xPublishInfo.pTopicName = ( ( i % 2U ) == 0U ) ? pcFixedFilter : "bench/stress/churn";
+            xPublishInfo.topicNameLength = ( uint16_t ) strlen( xPublishInfo.pTopicName );
+            handleIncomingPublishes( pxList, &xPublishInfo );
+
+            ulExpected += ( ( i % 2U ) == 0U ) ? 1U : 0U;
+
+            if( ulFixedMatches != ulExpected )
+            {
+                ulMissed++;
+                ulFixedMatches = ulExpected;
+            }
+        }
+
+        llElapsedUs = esp_timer_get_time() - llStartUs;
+
+        xStressStop = true;
+        ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+
+        if( ulMissed > 0U )
+        {
+            ESP_LOGE( TAG, "%"PRIu32" dispatches did not match the unchanged subscription exactly once.", ulMissed );
+            xRet = pdFAIL;
+        }
+
+        printf( BENCHMARK_OUTPUT_PREFIX "{\"test\":\"dispatch_stress\",\"dispatches\":%u,\"writes\":%"PRIu32","
+                "\"churnMatches\":%"PRIu32",\"missed\":%"PRIu32",\"ns\":%"PRIu32"}\n",
+                BENCHMARK_DISPATCHES_PER_RUN,
+                ulStressWrites,
+                ulStressChurnMatches,
+                ulMissed,
+                ( uint32_t ) ( ( llElapsedUs * 1000LL ) / BENCHMARK_DISPATCHES_PER_RUN ) );
+    }
+
+    return xRet;
+}
+
+static BaseType_t prvRunDispatch( SubscriptionList_t * pxList,
+                                  char * pcTopics,
+                                  uint32_t ulCount )
+{
+    char cFilter[ BENCHMARK_DISPATCH_FILTER_LENGTH ];
+    uint32_t ulIndexedMatches = 0, ulLinearMatches = 0, i;
+    MQTTPublishInfo_t xPublishInfo = { 0 };
+    SubscriptionMemory_t xMemory;
+    int64_t llStartUs, llIndexedUs, llLinearUs;
+    BaseType_t xRet = pdPASS;
+
+    freeSubscriptionList( pxList );
+
+    /* Mostly exact filters, as the application subscribes to. The list keeps
+     * its own copy of each. */
+    for( i = 0; i < ulCount; i++ )
+    {
+        if( ( i % BENCHMARK_DISPATCH_WILDCARD_RATIO ) == 0U )
+        {
+            snprintf( cFilter, sizeof( cFilter ), "bench/things/dev%"PRIu32"/+/state", i );
+        }
+        else
+        {
+            snprintf( cFilter, sizeof( cFilter ), "bench/things/dev%"PRIu32"/cmd", i );
+        }
+
+        addSubscription( pxList,
+                         cFilter,
+                         ( uint16_t ) strlen( cFilter ),
+                         prvDispatchCallback,
+                         &ulIndexedMatches );
+    }
+
+    getSubscriptionMemory( pxList, &xMemory );
+
+    /* Cycle through topics which may hit an exact filter, which may hit a
+     * wildcard filter, and which hit none. */
+    for( i = 0; i < BENCHMARK_DISPATCH_TOPICS; i++ )
+    {
+        if( ( i % 3U ) == 0U )
+        {
+            snprintf( &( pcTopics[ i * BENCHMARK_DISPATCH_FILTER_LENGTH ] ), BENCHMARK_DISPATCH_FILTER_LENGTH,
+                      "bench/things/dev%"PRIu32"/cmd", ( i * 7U ) % ulCount );
+        }
+        else if( ( i % 3U ) == 1U )
+        {
+            snprintf( &( pcTopics[ i * BENCHMARK_DISPATCH_FILTER_LENGTH ] ), BENCHMARK_DISPATCH_FILTER_LENGTH,
+                      "bench/things/dev%"PRIu32"/led/state", ( i * BENCHMARK_DISPATCH_WILDCARD_RATIO ) % ulCount );
+        }
+        else
+        {
+            snprintf( &( pcTopics[ i * BENCHMARK_DISPATCH_FILTER_LENGTH ] ), BENCHMARK_DISPATCH_FILTER_LENGTH,
+                      "bench/things/dev%"PRIu32"/none", i % ulCount );
+        }
+    }
+
+    llStartUs = esp_timer_get_time();
+
+    for( i = 0; i < BENCHMARK_DISPATCHES_PER_RUN; i++ )
+    {
+        xPublishInfo.pTopicName = &( pcTopics[ ( i % BENCHMARK_DISPATCH_TOPICS ) * BENCHMARK_DISPATCH_FILTER_LENGTH ] );
+        xPublishInfo.topicNameLength = ( uint16_t ) strlen( xPublishInfo.pTopicName );
+        handleIncomingPublishes( pxList, &xPublishInfo );
+    }
+
+    llIndexedUs = esp_timer_get_time() - llStartUs;
+
+    llStartUs = esp_timer_get_time();
+
+    for( i = 0; i < BENCHMARK_DISPATCHES_PER_RUN; i++ )
+    {
+        xPublishInfo.pTopicName = &( pcTopics[ ( i % BENCHMARK_DISPATCH_TOPICS ) * BENCHMARK_DISPATCH_FILTER_LENGTH ] );
+        xPublishInfo.topicNameLength = ( uint16_t ) strlen( xPublishInfo.pTopicName );
+        prvDispatchLinear( pxList, &xPublishInfo, &ulLinearMatches );
+    }
+
+    llLinearUs = esp_timer_get_time() - llStartUs;
+
+    if( ulIndexedMatches != ulLinearMatches )
+    {
+        ESP_LOGE( TAG, "Subscription manager matched %"PRIu32" publishes, MQTT_MatchTopic() %"PRIu32".",
+                  ulIndexedMatches, ulLinearMatches );
+        xRet = pdFAIL;
+    }
+
+    printf( BENCHMARK_OUTPUT_PREFIX "{\"test\":\"dispatch\",\"subscriptions\":%"PRIu32",\"dispatches\":%u,"
+            "\"tableBytes\":%"PRIu32",\"arenaBytes\":%"PRIu32","
+            "\"matches\":%"PRIu32",\"indexedNs\":%"PRIu32",\"linearNs\":%"PRIu32"}\n",
+            ulCount,
+            BENCHMARK_DISPATCHES_PER_RUN,
+            xMemory.ulTableBytes,
+            xMemory.ulArenaBytes,
+            ulIndexedMatches,
+            ( uint32_t ) ( ( llIndexedUs * 1000LL ) / BENCHMARK_DISPATCHES_PER_RUN ),
+            ( uint32_t ) ( ( llLinearUs * 1000LL ) / BENCHMARK_DISPATCHES_PER_RUN ) );
+
+    return xRet;
+}
+
+static BaseType_t prvBenchmarkDispatch( void )
+{
+    uint32_t ulCounts[ BENCHMARK_MAX_LIST_LENGTH ];
+    uint32_t ulCountCount, ulRun;
+    SubscriptionList_t * pxList;
+    char * pcTopics;
+    BaseType_t xRet = pdPASS;
+
+    ulCountCount = prvParseList( benchmarkconfigDISPATCH_SUBSCRIPTIONS, ulCounts, BENCHMARK_MAX_LIST_LENGTH );
+
+    /* The subscription manager expects the list to be initialized to 0. */
+    pxList = calloc( 1, sizeof( SubscriptionList_t ) );
+    pcTopics = malloc( ( size_t ) BENCHMARK_DISPATCH_TOPICS * BENCHMARK_DISPATCH_FILTER_LENGTH );
+
+    if( ( pxList == NULL ) || ( pcTopics == NULL ) )
+    {
+        ESP_LOGE( TAG, "Failed to allocate the dispatch benchmark subscription list." );
+        xRet = pdFAIL;
+    }
+
+    for( ulRun = 0; ( xRet == pdPASS ) && ( ulRun < ulCountCount ); ulRun++ )
+    {
+        if( ( ulCounts[ ulRun ] == 0U ) || ( ulCounts[ ulRun ] > SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ) )
+        {
+            ESP_LOGW( TAG, "Skipping dispatch with %"PRIu32" subscriptions; "
+                           "raise GRI_SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS to run it.",
+                      ulCounts[ ulRun ] );
+        }
+        else
+        {
+            xRet = prvRunDispatch( pxList, pcTopics, ulCounts[ ulRun ] );
+        }
+    }
+
+    if( xRet == pdPASS )
+    {
+        xRet = prvRunDispatchStress( pxList );
+    }
+
+    if( pxList != NULL )
+    {
+        freeSubscriptionList( pxList );
+    }
+
+    free( pxList );
+    free( pcTopics );
+
+    return xRet;
+}
+
+static void prvBenchmarkTask( void * pvParameters )
+{
+    BaseType_t xRet;
+
+    ( void ) pvParameters;
+
+    memset( ucPayload, 'x', sizeof( ucPayload ) );
+
+    pxFanInCallback = prvFanInCallback;
+
+    snprintf( cPublishTopic, sizeof( cPublishTopic ), "%s/bench/publish", xCoreMqttAgentManagerGetClientId() );
+    snprintf( cFanInTopic, sizeof( cFanInTopic ), "%s/bench/fanin", xCoreMqttAgentManagerGetClientId() );
+
+    prvWaitForConnection();
+
+    printf( BENCHMARK_OUTPUT_PREFIX "{\"test\":\"config\",\"clientId\":\"%s\",\"queueLength\":%u,"
+            "\"commandPool\":%u,\"messages\":%u}\n",
+            xCoreMqttAgentManagerGetClientId(),
+            ( unsigned int ) configMQTT_AGENT_COMMAND_QUEUE_LENGTH,
+            ( unsigned int ) configMQTT_AGENT_COMMAND_POOL_SIZE,
+            benchmarkconfigMESSAGES_PER_RUN );
+
+    xRet = prvBenchmarkPublishes();
+
+    if( xRet == pdPASS )
+    {
+        xRet = prvBenchmarkFanIn();
+    }
+
+    if( xRet == pdPASS )
+    {
+        xRet = prvBenchmarkSlowSubscriber();
+    }
+
+    if( xRet == pdPASS )
+    {
+        xRet = prvBenchmarkDispatch();
+    }
+
+    if( xRet == pdPASS )
+    {
+        ESP_LOGI( TAG, "Benchmark completed." );
+    }
+    else
+    {
+        ESP_LOGE( TAG, "Benchmark aborted." );
+    }
+
+    vTaskDelete( NULL );
+}
+
+/* Public function definitions ************************************************/
+
+void vStartMqttAgentBenchmark( void )
+{
+    xNetworkEventGroup = xEventGroupCreate();
+    xFreePublishContexts = xQueueCreate( BENCHMARK_MAX_WINDOW, sizeof( MQTTAgentCommandContext_t * ) );
+
+    if( ( xNetworkEventGroup == NULL ) || ( xFreePublishContexts == NULL ) )
+    {
+        ESP_LOGE( TAG, "Failed to allocate the benchmark event group or queue." );
+    }
+    else
+    {
+        xCoreMqttAgentManagerRegisterHandler( prvCoreMqttAgentEventHandler );
+
+        /* Initialize the coreMQTT-Agent event group. */
+        xEventGroupSetBits( xNetworkEventGroup,
+                            CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT );
+
+        xTaskCreate( prvBenchmarkTask,
+                     "MQTTBench",
+                     benchmarkconfigTASK_STACK_SIZE,
+                     NULL,
+                     benchmarkconfigTASK_PRIORITY,
+                     NULL );
+    }
+}
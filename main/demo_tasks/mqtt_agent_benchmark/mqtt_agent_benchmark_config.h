@@ -0,0 +1,84 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef MQTT_AGENT_BENCHMARK_CONFIG_H
+#define MQTT_AGENT_BENCHMARK_CONFIG_H
+
+/* ESP-IDF sdkconfig include. */
+#include <sdkconfig.h>
+
+/**
+ * @brief ';'-separated list of payload sizes in bytes to benchmark publishes
+ * with.
+ */
+#define benchmarkconfigPAYLOAD_SIZES                ( CONFIG_GRI_MQTT_AGENT_BENCHMARK_PAYLOAD_SIZES )
+
+/**
+ * @brief ';'-separated list of the numbers of publishes kept in flight to
+ * benchmark publishes with.
+ */
+#define benchmarkconfigWINDOWS                      ( CONFIG_GRI_MQTT_AGENT_BENCHMARK_WINDOWS )
+
+/**
+ * @brief Size of the statically allocated payload buffer. Larger payload
+ * sizes are skipped.
+ */
+#define benchmarkconfigMAX_PAYLOAD_SIZE             ( ( unsigned int ) ( CONFIG_GRI_MQTT_AGENT_BENCHMARK_MAX_PAYLOAD_SIZE ) )
+
+/**
+ * @brief ';'-separated list of the numbers of subscriptions to benchmark the
+ * dispatch of incoming publishes with.
+ */
+#define benchmarkconfigDISPATCH_SUBSCRIPTIONS       ( CONFIG_GRI_MQTT_AGENT_BENCHMARK_DISPATCH_SUBSCRIPTIONS )
+
+/**
+ * @brief Number of messages published by each run.
+ */
+#define benchmarkconfigMESSAGES_PER_RUN             ( ( unsigned int ) ( CONFIG_GRI_MQTT_AGENT_BENCHMARK_MESSAGES_PER_RUN ) )
+
+/**
+ * @brief Time in milliseconds the slow subscriber blocks for each publish.
+ */
+#define benchmarkconfigSLOW_SUBSCRIBER_DELAY_MS     ( ( unsigned int ) ( CONFIG_GRI_MQTT_AGENT_BENCHMARK_SLOW_SUBSCRIBER_DELAY_MS ) )
+
+/**
+ * @brief The maximum amount of time in milliseconds to wait for a command to
+ * be posted to, or completed by, the coreMQTT-Agent before the benchmark is
+ * aborted.
+ */
+#define benchmarkconfigCOMMAND_TIMEOUT_MS           ( ( unsigned int ) ( CONFIG_GRI_MQTT_AGENT_BENCHMARK_COMMAND_TIMEOUT_MS ) )
+
+/**
+ * @brief The task priority of the benchmark task.
+ */
+#define benchmarkconfigTASK_PRIORITY                ( ( unsigned int ) ( CONFIG_GRI_MQTT_AGENT_BENCHMARK_TASK_PRIORITY ) )
+
+/**
+ * @brief The task stack size of the benchmark task.
+ */
+#define benchmarkconfigTASK_STACK_SIZE              ( ( unsigned int ) ( CONFIG_GRI_MQTT_AGENT_BENCHMARK_TASK_STACK_SIZE ) )
+
+#endif /* MQTT_AGENT_BENCHMARK_CONFIG_H */
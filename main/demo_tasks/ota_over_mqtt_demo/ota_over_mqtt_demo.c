@@ -49,11 +49,12 @@
 /* FreeRTOS includes. */
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/semphr.h"
 
 /* ESP-IDF includes. */
 #include "esp_log.h"
 #include "esp_event.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "sdkconfig.h"
 
 /* OTA library configuration include. */
@@ -83,6 +84,9 @@
 #include "core_mqtt_agent_manager_events.h"
 #include "core_mqtt_agent_manager.h"
 
+/* coreMQTT-Agent command pool include. */
+#include "core_mqtt_agent_command_pool.h"
+
 /* Public function include. */
 #include "ota_over_mqtt_demo.h"
 
@@ -114,15 +118,16 @@
 #define OTA_JOB_NOTIFY_TOPIC_FILTER_LENGTH               ( ( uint16_t ) ( sizeof( OTA_JOB_NOTIFY_TOPIC_FILTER ) - 1 ) )
 
 /**
- * @brief Job update response topics filter for OTA.
+ * @brief Format of the job update response topics filter for OTA, with the
+ * thing name substituted once the OTA demo starts.
  * This is used to route all the packets for OTA reserved topics which OTA agent has not subscribed for.
  */
-#define OTA_JOB_UPDATE_RESPONSE_TOPIC_FILTER             OTA_TOPIC_PREFIX "jobs/+/update/+"
+#define OTA_JOB_UPDATE_RESPONSE_TOPIC_FORMAT             "$aws/things/%s/jobs/+/update/+"
 
 /**
- * @brief Length of Job update response topics filter.
+ * @brief Size of the buffer holding the job update response topics filter.
  */
-#define OTA_JOB_UPDATE_RESPONSE_TOPIC_FILTER_LENGTH      ( ( uint16_t ) ( sizeof( OTA_JOB_UPDATE_RESPONSE_TOPIC_FILTER ) - 1 ) )
+#define OTA_JOB_UPDATE_RESPONSE_TOPIC_FILTER_SIZE        ( 128U )
 
 /**
  * @brief Wildcard topic filter for matching job response messages.
@@ -150,15 +155,33 @@
 #define OTA_DATA_STREAM_TOPIC_FILTER_LENGTH              ( ( uint16_t ) ( sizeof( OTA_DATA_STREAM_TOPIC_FILTER ) - 1 ) )
 
 /**
- * @brief Starting index of client identifier within OTA topic.
+ * @brief Formats of the job topic filters the OTA agent subscribes to, with
+ * the thing name substituted. They are registered as startup subscriptions.
+ */
+#define OTA_JOB_NOTIFY_TOPIC_FORMAT                      "$aws/things/%s/jobs/notify-next"
+#define OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FORMAT           "$aws/things/%s/jobs/$next/get/accepted"
+
+/**
+ * @brief Size of the buffer holding a job topic filter.
  */
-#define OTA_TOPIC_CLIENT_IDENTIFIER_START_IDX            ( 12U )
+#define OTA_JOB_TOPIC_FILTER_SIZE                        ( 128U )
 
 /**
  * @brief Used to clear bits in a task's notification value.
  */
 #define MAX_UINT32                                       ( 0xffffffff )
 
+/**
+ * @brief Mask with one bit set for each OTA event buffer.
+ */
+#define OTA_EVENT_BUFFERS_ALL_FREE                                      \
+    ( ( otaconfigMAX_NUM_OTA_DATA_BUFFERS == 32 ) ? UINT32_MAX :        \
+      ( ( 1UL << ( otaconfigMAX_NUM_OTA_DATA_BUFFERS % 32 ) ) - 1UL ) )
+
+#if ( otaconfigMAX_NUM_OTA_DATA_BUFFERS < 1 ) || ( otaconfigMAX_NUM_OTA_DATA_BUFFERS > 32 )
+    #error "otaconfigMAX_NUM_OTA_DATA_BUFFERS must be between 1 and 32."
+#endif
+
 /* Struct definitions *********************************************************/
 
 /**
@@ -219,14 +242,37 @@ static uint8_t bitmap[ OTA_MAX_BLOCK_BITMAP_SIZE ];
 static OtaEventData_t eventBuffer[ otaconfigMAX_NUM_OTA_DATA_BUFFERS ] = { 0 };
 
 /**
- * @brief Mutex used to manage thread safe access of OTA event buffers.
+ * @brief One bit per OTA event buffer, set while the buffer is free.
+ */
+static uint32_t ulFreeEventBuffers = OTA_EVENT_BUFFERS_ALL_FREE;
+
+/**
+ * @brief OTA event buffers in use, their high-water mark, and the number of
+ * messages dropped because no buffer was free. Updated with atomic operations.
+ */
+static uint32_t ulEventBuffersInUse;
+static uint32_t ulEventBuffersHighWater;
+static uint32_t ulEventBufferExhausted;
+
+/**
+ * @brief Total size of the statically allocated OTA buffers.
+ */
+#define OTA_BUFFERS_SIZE    ( sizeof( eventBuffer ) + sizeof( decodeMem ) + sizeof( bitmap ) )
+
+/**
+ * @brief Tick at which the image file being received was created, the number
+ * of blocks written to flash for it so far, and the time spent writing them.
  */
-static SemaphoreHandle_t xBufferSemaphore;
+static TickType_t xImageStartTick;
+static uint32_t ulImageBlockWrites;
+static uint64_t ullImageWriteUs;
 
 /**
- * @brief Static handle used for MQTT agent context.
+ * @brief Job update response topics filter of this thing, empty until the OTA
+ * demo task starts.
  */
-extern MQTTAgentContext_t xGlobalMqttAgentContext;
+static char cJobUpdateResponseFilter[ OTA_JOB_UPDATE_RESPONSE_TOPIC_FILTER_SIZE ];
+static uint16_t usJobUpdateResponseFilterLength;
 
 /**
  * @brief Structure containing all application allocated buffers used by the OTA agent.
@@ -331,7 +377,8 @@ static OtaMqttStatus_t prvMQTTUnsubscribe( const char * pTopicFilter,
  * Demo uses a simple statically allocated array of fixed size event buffers. The
  * number of event buffers is configured by the param otaconfigMAX_NUM_OTA_DATA_BUFFERS
  * within ota_config.h. This function is used to fetch a free buffer from the pool for processing
- * by the OTA agent task. It uses a mutex for thread safe access to the pool.
+ * by the OTA agent task. The lowest free buffer is claimed from a bitmask of free buffers with
+ * a compare-and-swap, so it never blocks. Failures are counted in ulEventBufferExhausted.
  *
  * @return A pointer to an unused buffer. NULL if there are no buffers available.
  */
@@ -343,13 +390,46 @@ static OtaEventData_t * prvOTAEventBufferGet( void );
  * OTA demo uses a statically allocated array of fixed size event buffers . The
  * number of event buffers is configured by the param otaconfigMAX_NUM_OTA_DATA_BUFFERS
  * within ota_config.h. The function is used by the OTA application callback to free a buffer,
- * after OTA agent has completed processing with the event. The access to the pool is made thread safe
- * using a mutex.
+ * after OTA agent has completed processing with the event. The buffer's bit is set back in the
+ * bitmask of free buffers atomically.
  *
  * @param[in] pxBuffer Pointer to the buffer to be freed.
  */
 static void prvOTAEventBufferFree( OtaEventData_t * const pxBuffer );
 
+/**
+ * @brief Create the file receiving the image and reset the flash write
+ * statistics of the image.
+ *
+ * @param[in] pFileContext OTA file context of the image.
+ * @return OtaPalSuccess if successful. Appropriate error code otherwise.
+ */
+static OtaPalStatus_t prvCreateFileForRx( OtaFileContext_t * const pFileContext );
+
+/**
+ * @brief Write a decoded image block to flash through the PAL, and account
+ * for the time taken.
+ *
+ * @param[in] pFileContext OTA file context of the image.
+ * @param[in] ulOffset Offset of the block in the image.
+ * @param[in] pData Decoded block.
+ * @param[in] ulBlockSize Size of the block.
+ * @return The block size if successful, -1 otherwise.
+ */
+static int16_t prvWriteBlock( OtaFileContext_t * const pFileContext,
+                              uint32_t ulOffset,
+                              uint8_t * const pData,
+                              uint32_t ulBlockSize );
+
+/**
+ * @brief Close the image file and report the throughput and memory use of the
+ * download.
+ *
+ * @param[in] pFileContext OTA file context of the image.
+ * @return OtaPalSuccess if successful. Appropriate error code otherwise.
+ */
+static OtaPalStatus_t prvCloseFile( OtaFileContext_t * const pFileContext );
+
 /**
  * @brief The function which runs the OTA agent task.
  *
@@ -404,19 +484,42 @@ static void prvProcessIncomingJobMessage( void * pxSubscriptionContext,
                                           MQTTPublishInfo_t * pPublishInfo );
 
 /**
- * @brief Matches a client identifier within an OTA topic.
- * This function is used to validate that topic is valid and intended for this device thing name.
+ * @brief Select the callback handling the publishes of a topic filter the OTA
+ * agent subscribes to.
+ *
+ * The OTA agent subscribes with the thing name in the filter, so the filter is
+ * routed by the subscription manager as is, and incoming job messages and data
+ * blocks are matched with a single lookup of their topic.
+ *
+ * @param[in] pTopicFilter Topic filter subscribed to.
+ * @param[in] topicFilterLength Length of the topic filter.
+ * @return The callback for the filter, NULL if it is not an OTA job or data
+ * stream filter.
+ */
+static IncomingPubCallback_t prvGetTopicFilterCallback( const char * pTopicFilter,
+                                                        uint16_t topicFilterLength );
+
+/**
+ * @brief Passed into MQTTAgent_Subscribe() and MQTTAgent_Unsubscribe() as the
+ * callbacks to execute when the broker ACKs the command. They add or remove
+ * the route of the topic filter to its callback in the subscription list,
+ * then notify the task waiting for the command.
  *
- * @param[in] pTopic Pointer to the topic
- * @param[in] topicNameLength length of the topic
- * @param[in] pClientIdentifier Client identifier, should be null terminated.
- * @param[in] clientIdentifierLength Length of the client identifier.
- * @return true if client identifier is found within the topic at the right index.
+ * @param[in] pCommandContext Context of the initial command.
+ * @param[in] pxReturnInfo The result of the command.
+ */
+static void prvSubscribeCommandCallback( MQTTAgentCommandContext_t * pCommandContext,
+                                         MQTTAgentReturnInfo_t * pxReturnInfo );
+static void prvUnsubscribeCommandCallback( MQTTAgentCommandContext_t * pCommandContext,
+                                           MQTTAgentReturnInfo_t * pxReturnInfo );
+
+/**
+ * @brief Register the job topic filters of this thing as startup
+ * subscriptions, so they are subscribed to along with those of the other
+ * demos on the first connection. prvMQTTSubscribe() then finds them in the
+ * subscription list when the OTA agent subscribes, and skips the round trip.
  */
-static bool prvMatchClientIdentifierInTopic( const char * pTopic,
-                                             size_t topicNameLength,
-                                             const char * pClientIdentifier,
-                                             size_t clientIdentifierLength );
+static void prvAddStartupSubscriptions( void );
 
 /**
  * @brief The OTA agent has completed the update job or it is in
@@ -464,46 +567,112 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
 
 static void prvOTAEventBufferFree( OtaEventData_t * const pxBuffer )
 {
-    if( xSemaphoreTake( xBufferSemaphore, portMAX_DELAY ) == pdTRUE )
-    {
-        pxBuffer->bufferUsed = false;
-        ( void ) xSemaphoreGive( xBufferSemaphore );
-    }
-    else
-    {
-        ESP_LOGE( TAG, "Failed to get buffer semaphore." );
-    }
+    uint32_t ulIndex = ( uint32_t ) ( pxBuffer - eventBuffer );
+
+    configASSERT( ulIndex < otaconfigMAX_NUM_OTA_DATA_BUFFERS );
+
+    pxBuffer->bufferUsed = false;
+    ( void ) __atomic_fetch_sub( &ulEventBuffersInUse, 1U, __ATOMIC_RELAXED );
+    ( void ) __atomic_fetch_or( &ulFreeEventBuffers, 1UL << ulIndex, __ATOMIC_RELEASE );
 }
 
 static OtaEventData_t * prvOTAEventBufferGet( void )
 {
     uint32_t ulIndex = 0;
+    uint32_t ulMask = __atomic_load_n( &ulFreeEventBuffers, __ATOMIC_ACQUIRE );
+    uint32_t ulInUse;
+    uint32_t ulHighWater;
+    bool xClaimed = false;
     OtaEventData_t * pFreeBuffer = NULL;
 
-    if( xSemaphoreTake( xBufferSemaphore, portMAX_DELAY ) == pdTRUE )
+    while( ( ulMask != 0U ) && !xClaimed )
+    {
+        ulIndex = ( uint32_t ) __builtin_ctz( ulMask );
+        xClaimed = __atomic_compare_exchange_n( &ulFreeEventBuffers, &ulMask, ulMask & ~( 1UL << ulIndex ),
+                                                true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE );
+    }
+
+    if( xClaimed )
     {
-        for( ulIndex = 0; ulIndex < otaconfigMAX_NUM_OTA_DATA_BUFFERS; ulIndex++ )
+        pFreeBuffer = &eventBuffer[ ulIndex ];
+        pFreeBuffer->bufferUsed = true;
+
+        ulInUse = __atomic_add_fetch( &ulEventBuffersInUse, 1U, __ATOMIC_RELAXED );
+        ulHighWater = __atomic_load_n( &ulEventBuffersHighWater, __ATOMIC_RELAXED );
+
+        while( ( ulInUse > ulHighWater ) &&
+               !__atomic_compare_exchange_n( &ulEventBuffersHighWater, &ulHighWater, ulInUse,
+                                             true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
         {
-            if( eventBuffer[ ulIndex ].bufferUsed == false )
-            {
-                eventBuffer[ ulIndex ].bufferUsed = true;
-                pFreeBuffer = &eventBuffer[ ulIndex ];
-                break;
-            }
         }
-
-        ( void ) xSemaphoreGive( xBufferSemaphore );
     }
     else
     {
-        ESP_LOGE( TAG, "Failed to get buffer semaphore." );
+        ( void ) __atomic_fetch_add( &ulEventBufferExhausted, 1U, __ATOMIC_RELAXED );
     }
 
     return pFreeBuffer;
 }
 
+static OtaPalStatus_t prvCreateFileForRx( OtaFileContext_t * const pFileContext )
+{
+    xImageStartTick = xTaskGetTickCount();
+    ulImageBlockWrites = 0U;
+    ullImageWriteUs = 0U;
+
+    return otaPal_CreateFileForRx( pFileContext );
+}
+
+static int16_t prvWriteBlock( OtaFileContext_t * const pFileContext,
+                              uint32_t ulOffset,
+                              uint8_t * const pData,
+                              uint32_t ulBlockSize )
+{
+    int64_t llStartUs = esp_timer_get_time();
+    int16_t sResult;
+
+    sResult = otaPal_WriteBlock( pFileContext, ulOffset, pData, ulBlockSize );
+
+    ullImageWriteUs += ( uint64_t ) ( esp_timer_get_time() - llStartUs );
+    ulImageBlockWrites++;
+
+    return sResult;
+}
+
+static OtaPalStatus_t prvCloseFile( OtaFileContext_t * const pFileContext )
+{
+    OtaPalStatus_t xResult;
+    uint32_t ulElapsedMs;
+
+    xResult = otaPal_CloseFile( pFileContext );
+
+    if( OTA_PAL_MAIN_ERR( xResult ) == OtaPalSuccess )
+    {
+        ulElapsedMs = ( uint32_t ) ( ( xTaskGetTickCount() - xImageStartTick ) * portTICK_PERIOD_MS );
+        ulElapsedMs = ( ulElapsedMs > 0U ) ? ulElapsedMs : 1U;
+
+        /* This runs on the OTA agent task, whose stack also decodes the blocks. */
+        ESP_LOGI( TAG, "Image of %"PRIu32" bytes received in %"PRIu32" ms (%"PRIu32" B/s), "
+                       "%"PRIu32" blocks written to flash in %"PRIu32" ms. "
+                       "OTA buffers %u bytes, minimum free heap %"PRIu32" bytes, OTA agent stack headroom %u bytes.",
+                  pFileContext->fileSize,
+                  ulElapsedMs,
+                  ( uint32_t ) ( ( ( uint64_t ) pFileContext->fileSize * 1000U ) / ulElapsedMs ),
+                  ulImageBlockWrites,
+                  ( uint32_t ) ( ullImageWriteUs / 1000U ),
+                  ( unsigned ) OTA_BUFFERS_SIZE,
+                  esp_get_minimum_free_heap_size(),
+                  ( unsigned ) uxTaskGetStackHighWaterMark( NULL ) );
+    }
+
+    return xResult;
+}
+
 static void prvOTAAgentTask( void * pvParam )
 {
+    /* Keep OTA within its share of the command pool. */
+    ( void ) xMQTTAgentCommandPoolRegisterTask( NULL, eMQTTAgentCommandPoolCallerOta );
+
     OTA_EventProcessingTask( pvParam );
     vTaskDelete( NULL );
 }
@@ -672,37 +841,137 @@ static void prvProcessIncomingJobMessage( void * pxSubscriptionContext,
     }
 }
 
-static bool prvMatchClientIdentifierInTopic( const char * pTopic,
-                                             size_t topicNameLength,
-                                             const char * pClientIdentifier,
-                                             size_t clientIdentifierLength )
+static IncomingPubCallback_t prvGetTopicFilterCallback( const char * pTopicFilter,
+                                                        uint16_t topicFilterLength )
 {
+    IncomingPubCallback_t pxCallback = NULL;
     bool isMatch = false;
-    size_t idx, matchIdx = 0;
 
-    for( idx = OTA_TOPIC_CLIENT_IDENTIFIER_START_IDX; idx < topicNameLength; idx++ )
+    /* The filters subscribed by the OTA agent have no wildcard, so they are
+     * matched as topics against the OTA filters. */
+    ( void ) MQTT_MatchTopic( pTopicFilter,
+                              topicFilterLength,
+                              OTA_DATA_STREAM_TOPIC_FILTER,
+                              OTA_DATA_STREAM_TOPIC_FILTER_LENGTH,
+                              &isMatch );
+
+    if( isMatch == true )
+    {
+        pxCallback = prvProcessIncomingData;
+    }
+    else
     {
-        if( matchIdx == clientIdentifierLength )
+        ( void ) MQTT_MatchTopic( pTopicFilter,
+                                  topicFilterLength,
+                                  OTA_JOB_NOTIFY_TOPIC_FILTER,
+                                  OTA_JOB_NOTIFY_TOPIC_FILTER_LENGTH,
+                                  &isMatch );
+
+        if( isMatch == false )
         {
-            if( pTopic[ idx ] == '/' )
-            {
-                isMatch = true;
-            }
+            ( void ) MQTT_MatchTopic( pTopicFilter,
+                                      topicFilterLength,
+                                      OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FILTER,
+                                      OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FILTER_LENGTH,
+                                      &isMatch );
+        }
 
-            break;
+        if( isMatch == true )
+        {
+            pxCallback = prvProcessIncomingJobMessage;
         }
-        else
+    }
+
+    return pxCallback;
+}
+
+static void prvSubscribeCommandCallback( MQTTAgentCommandContext_t * pCommandContext,
+                                         MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    MQTTSubscribeInfo_t * pxSubscribeInfo = ( ( MQTTAgentSubscribeArgs_t * ) pCommandContext->pArgs )->pSubscribeInfo;
+    IncomingPubCallback_t pxCallback;
+
+    pCommandContext->xReturnStatus = pxReturnInfo->returnCode;
+
+    if( pxReturnInfo->returnCode == MQTTSuccess )
+    {
+        pxCallback = prvGetTopicFilterCallback( pxSubscribeInfo->pTopicFilter,
+                                                pxSubscribeInfo->topicFilterLength );
+
+        if( pxCallback == NULL )
         {
-            if( pClientIdentifier[ matchIdx ] != pTopic[ idx ] )
-            {
-                break;
-            }
+            ESP_LOGW( TAG, "No OTA callback for topic filter %.*s.",
+                      pxSubscribeInfo->topicFilterLength,
+                      pxSubscribeInfo->pTopicFilter );
         }
+        else if( addSubscription( ( SubscriptionList_t * ) pxCoreMqttAgentManagerGetContextForTopic( pxSubscribeInfo->pTopicFilter,
+                                                                                                     pxSubscribeInfo->topicFilterLength )->pIncomingCallbackContext,
+                                  pxSubscribeInfo->pTopicFilter,
+                                  pxSubscribeInfo->topicFilterLength,
+                                  pxCallback,
+                                  NULL ) == false )
+        {
+            ESP_LOGE( TAG, "Failed to register an incoming publish callback for topic %.*s.",
+                      pxSubscribeInfo->topicFilterLength,
+                      pxSubscribeInfo->pTopicFilter );
 
-        matchIdx++;
+            pCommandContext->xReturnStatus = MQTTNoMemory;
+        }
     }
 
-    return isMatch;
+    xTaskNotify( pCommandContext->xTaskToNotify, ( uint32_t ) ( pCommandContext->xReturnStatus ), eSetValueWithOverwrite );
+}
+
+static void prvUnsubscribeCommandCallback( MQTTAgentCommandContext_t * pCommandContext,
+                                           MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    MQTTSubscribeInfo_t * pxSubscribeInfo = ( ( MQTTAgentSubscribeArgs_t * ) pCommandContext->pArgs )->pSubscribeInfo;
+    IncomingPubCallback_t pxCallback;
+
+    pCommandContext->xReturnStatus = pxReturnInfo->returnCode;
+
+    if( pxReturnInfo->returnCode == MQTTSuccess )
+    {
+        pxCallback = prvGetTopicFilterCallback( pxSubscribeInfo->pTopicFilter,
+                                                pxSubscribeInfo->topicFilterLength );
+
+        if( pxCallback != NULL )
+        {
+            ( void ) removeSubscriptionCallback( ( SubscriptionList_t * ) pxCoreMqttAgentManagerGetContextForTopic( pxSubscribeInfo->pTopicFilter,
+                                                                                                                   pxSubscribeInfo->topicFilterLength )->pIncomingCallbackContext,
+                                                 pxSubscribeInfo->pTopicFilter,
+                                                 pxSubscribeInfo->topicFilterLength,
+                                                 pxCallback,
+                                                 NULL );
+        }
+    }
+
+    xTaskNotify( pCommandContext->xTaskToNotify, ( uint32_t ) ( pCommandContext->xReturnStatus ), eSetValueWithOverwrite );
+}
+
+static void prvAddStartupSubscriptions( void )
+{
+    static const char * const pcFormats[] = { OTA_JOB_NOTIFY_TOPIC_FORMAT, OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FORMAT };
+    char cFilter[ OTA_JOB_TOPIC_FILTER_SIZE ];
+    uint16_t usFilterLength;
+    uint32_t i;
+
+    for( i = 0; i < ( sizeof( pcFormats ) / sizeof( pcFormats[ 0 ] ) ); i++ )
+    {
+        usFilterLength = ( uint16_t ) snprintf( cFilter,
+                                                sizeof( cFilter ),
+                                                pcFormats[ i ],
+                                                xCoreMqttAgentManagerGetClientId() );
+
+        /* Otherwise the OTA agent subscribes when it starts. */
+        if( usFilterLength < sizeof( cFilter ) )
+        {
+            ( void ) xCoreMqttAgentManagerAddStartupSubscription( cFilter,
+                                                                  usFilterLength,
+                                                                  prvGetTopicFilterCallback( cFilter, usFilterLength ),
+                                                                  NULL );
+        }
+    }
 }
 
 static void prvCommandCallback( MQTTAgentCommandContext_t * pCommandContext,
@@ -739,30 +1008,47 @@ static OtaMqttStatus_t prvMQTTSubscribe( const char * pTopicFilter,
     xSubscribeArgs.numSubscriptions = 1;
 
     xApplicationDefinedContext.xTaskToNotify = xTaskGetCurrentTaskHandle();
+    xApplicationDefinedContext.pArgs = ( void * ) &xSubscribeArgs;
 
     xCommandParams.blockTimeMs = otademoconfigMQTT_TIMEOUT_MS;
-    xCommandParams.cmdCompleteCallback = prvCommandCallback;
+    xCommandParams.cmdCompleteCallback = prvSubscribeCommandCallback;
     xCommandParams.pCmdCompleteCallbackContext = ( void * ) &xApplicationDefinedContext;
 
-    xTaskNotifyStateClear( NULL );
-
-    mqttStatus = MQTTAgent_Subscribe( &xGlobalMqttAgentContext,
-                                      &xSubscribeArgs,
-                                      &xCommandParams );
+    /* A filter already in the subscription list was subscribed to, by the
+     * startup subscriptions or a previous SUBACK, and is restored with the
+     * list if the broker loses the session. */
+    if( countSubscriptions( ( SubscriptionList_t * ) pxCoreMqttAgentManagerGetContextForTopic( pTopicFilter, topicFilterLength )->pIncomingCallbackContext,
+                            pTopicFilter,
+                            topicFilterLength ) > 0U )
+    {
+        ESP_LOGI( TAG, "Topic %.*s is already subscribed to.",
+                  topicFilterLength,
+                  pTopicFilter );
 
-    /* Wait for command to complete so MQTTSubscribeInfo_t remains in scope for the
-     * duration of the command. */
-    if( mqttStatus == MQTTSuccess )
+        mqttStatus = MQTTSuccess;
+    }
+    else
     {
-        result = xTaskNotifyWait( 0, MAX_UINT32, &ulNotifiedValue, portMAX_DELAY );
+        xTaskNotifyStateClear( NULL );
 
-        if( result == pdTRUE )
-        {
-            mqttStatus = xApplicationDefinedContext.xReturnStatus;
-        }
-        else
+        mqttStatus = MQTTAgent_Subscribe( pxCoreMqttAgentManagerGetContextForTopic( pTopicFilter, topicFilterLength ),
+                                          &xSubscribeArgs,
+                                          &xCommandParams );
+
+        /* Wait for command to complete so MQTTSubscribeInfo_t remains in scope for the
+         * duration of the command. */
+        if( mqttStatus == MQTTSuccess )
         {
-            mqttStatus = MQTTRecvFailed;
+            result = xTaskNotifyWait( 0, MAX_UINT32, &ulNotifiedValue, portMAX_DELAY );
+
+            if( result == pdTRUE )
+            {
+                mqttStatus = xApplicationDefinedContext.xReturnStatus;
+            }
+            else
+            {
+                mqttStatus = MQTTRecvFailed;
+            }
         }
     }
 
@@ -811,7 +1097,7 @@ static OtaMqttStatus_t prvMQTTPublish( const char * const pacTopic,
     xCommandParams.cmdCompleteCallback = prvCommandCallback;
     xCommandParams.pCmdCompleteCallbackContext = ( void * ) &xCommandContext;
 
-    mqttStatus = MQTTAgent_Publish( &xGlobalMqttAgentContext,
+    mqttStatus = MQTTAgent_Publish( pxCoreMqttAgentManagerGetContextForTopic( pacTopic, topicLen ),
                                     &publishInfo,
                                     &xCommandParams );
 
@@ -874,16 +1160,17 @@ static OtaMqttStatus_t prvMQTTUnsubscribe( const char * pTopicFilter,
 
 
     xApplicationDefinedContext.xTaskToNotify = xTaskGetCurrentTaskHandle();
+    xApplicationDefinedContext.pArgs = ( void * ) &xSubscribeArgs;
 
     xCommandParams.blockTimeMs = otademoconfigMQTT_TIMEOUT_MS;
-    xCommandParams.cmdCompleteCallback = prvCommandCallback;
+    xCommandParams.cmdCompleteCallback = prvUnsubscribeCommandCallback;
     xCommandParams.pCmdCompleteCallbackContext = ( void * ) &xApplicationDefinedContext;
 
     ESP_LOGI( TAG, "Unsubscribing to topic filter: %s", pTopicFilter );
     xTaskNotifyStateClear( NULL );
 
 
-    mqttStatus = MQTTAgent_Unsubscribe( &xGlobalMqttAgentContext,
+    mqttStatus = MQTTAgent_Unsubscribe( pxCoreMqttAgentManagerGetContextForTopic( pTopicFilter, topicFilterLength ),
                                         &xSubscribeArgs,
                                         &xCommandParams );
 
@@ -947,12 +1234,12 @@ static void setOtaInterfaces( OtaInterfaces_t * pOtaInterfaces )
     /* Initialize the OTA library PAL Interface.*/
     pOtaInterfaces->pal.getPlatformImageState = otaPal_GetPlatformImageState;
     pOtaInterfaces->pal.setPlatformImageState = otaPal_SetPlatformImageState;
-    pOtaInterfaces->pal.writeBlock = otaPal_WriteBlock;
+    pOtaInterfaces->pal.writeBlock = prvWriteBlock;
     pOtaInterfaces->pal.activate = otaPal_ActivateNewImage;
-    pOtaInterfaces->pal.closeFile = otaPal_CloseFile;
+    pOtaInterfaces->pal.closeFile = prvCloseFile;
     pOtaInterfaces->pal.reset = otaPal_ResetDevice;
     pOtaInterfaces->pal.abort = otaPal_Abort;
-    pOtaInterfaces->pal.createFile = otaPal_CreateFileForRx;
+    pOtaInterfaces->pal.createFile = prvCreateFileForRx;
 }
 
 static void prvOTADemoTask( void * pvParam )
@@ -976,6 +1263,8 @@ static void prvOTADemoTask( void * pvParam )
     /* OTA Agent state returned from calling OTA_GetAgentState.*/
     OtaState_t state = OtaAgentStateStopped;
 
+    ( void ) xMQTTAgentCommandPoolRegisterTask( NULL, eMQTTAgentCommandPoolCallerOta );
+
     /* Set OTA Library interfaces.*/
     setOtaInterfaces( &otaInterfaces );
 
@@ -986,17 +1275,15 @@ static void prvOTADemoTask( void * pvParam )
 
     /****************************** Init OTA Library. ******************************/
 
-    xBufferSemaphore = xSemaphoreCreateMutex();
-
-    if( xBufferSemaphore == NULL )
-    {
-        xResult = pdFAIL;
-    }
-
     if( xResult == pdPASS )
     {
         memset( eventBuffer, 0x00, sizeof( eventBuffer ) );
 
+        usJobUpdateResponseFilterLength = ( uint16_t ) snprintf( cJobUpdateResponseFilter,
+                                                                 sizeof( cJobUpdateResponseFilter ),
+                                                                 OTA_JOB_UPDATE_RESPONSE_TOPIC_FORMAT,
+                                                                 xCoreMqttAgentManagerGetClientId() );
+
         if( ( otaRet = OTA_Init( &otaBuffer,
                                  &otaInterfaces,
                                  ( const uint8_t * ) ( xCoreMqttAgentManagerGetClientId() ),
@@ -1045,11 +1332,16 @@ static void prvOTADemoTask( void * pvParam )
             OTA_GetStatistics( &otaStatistics );
 
             ESP_LOGI( TAG,
-                      " Received: %"PRIu32"   Queued: %"PRIu32"   Processed: %"PRIu32"   Dropped: %"PRIu32"",
+                      " Received: %"PRIu32"   Queued: %"PRIu32"   Processed: %"PRIu32"   Dropped: %"PRIu32""
+                      "   Buffers in use: %"PRIu32"/%u (peak %"PRIu32")   No buffer: %"PRIu32"",
                       otaStatistics.otaPacketsReceived,
                       otaStatistics.otaPacketsQueued,
                       otaStatistics.otaPacketsProcessed,
-                      otaStatistics.otaPacketsDropped );
+                      otaStatistics.otaPacketsDropped,
+                      __atomic_load_n( &ulEventBuffersInUse, __ATOMIC_RELAXED ),
+                      ( unsigned ) otaconfigMAX_NUM_OTA_DATA_BUFFERS,
+                      __atomic_load_n( &ulEventBuffersHighWater, __ATOMIC_RELAXED ),
+                      __atomic_load_n( &ulEventBufferExhausted, __ATOMIC_RELAXED ) );
 
 
             vTaskDelay( pdMS_TO_TICKS( otademoconfigTASK_DELAY_MS ) );
@@ -1130,6 +1422,8 @@ void vStartOTACodeSigningDemo( void )
 
     xCoreMqttAgentManagerRegisterHandler( prvCoreMqttAgentEventHandler );
 
+    prvAddStartupSubscriptions();
+
     if( ( xResult = xTaskCreate( prvOTADemoTask,
                                  "OTADemoTask",
                                  otademoconfigDEMO_TASK_STACK_SIZE,
@@ -1148,69 +1442,28 @@ bool vOTAProcessMessage( void * pvIncomingPublishCallbackContext,
 {
     bool isMatch = false;
 
-    ( void ) MQTT_MatchTopic( pxPublishInfo->pTopicName,
-                              pxPublishInfo->topicNameLength,
-                              OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FILTER,
-                              OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FILTER_LENGTH,
-                              &isMatch );
-
-    if( isMatch == true )
-    {
-        /* validate thing name */
-
-        isMatch = prvMatchClientIdentifierInTopic( pxPublishInfo->pTopicName,
-                                                   pxPublishInfo->topicNameLength,
-                                                   xCoreMqttAgentManagerGetClientId(),
-                                                   strlen( xCoreMqttAgentManagerGetClientId() ) );
-
-        if( isMatch == true )
-        {
-            prvProcessIncomingJobMessage( pvIncomingPublishCallbackContext, pxPublishInfo );
-        }
-    }
-
-    if( isMatch == false )
-    {
-        ( void ) MQTT_MatchTopic( pxPublishInfo->pTopicName,
-                                  pxPublishInfo->topicNameLength,
-                                  OTA_JOB_NOTIFY_TOPIC_FILTER,
-                                  OTA_JOB_NOTIFY_TOPIC_FILTER_LENGTH,
-                                  &isMatch );
-
-        if( isMatch == true )
-        {
-            prvProcessIncomingJobMessage( pvIncomingPublishCallbackContext, pxPublishInfo );
-        }
-    }
+    ( void ) pvIncomingPublishCallbackContext;
 
-    if( isMatch == false )
+    /* Job messages and data blocks are routed by the subscription manager, so
+     * only the responses to job updates, which are not subscribed to, are
+     * left. */
+    if( ( usJobUpdateResponseFilterLength > 0U ) &&
+        ( usJobUpdateResponseFilterLength < sizeof( cJobUpdateResponseFilter ) ) )
     {
         ( void ) MQTT_MatchTopic( pxPublishInfo->pTopicName,
                                   pxPublishInfo->topicNameLength,
-                                  OTA_DATA_STREAM_TOPIC_FILTER,
-                                  OTA_DATA_STREAM_TOPIC_FILTER_LENGTH,
+                                  cJobUpdateResponseFilter,
+                                  usJobUpdateResponseFilterLength,
                                   &isMatch );
-
-        if( isMatch == true )
-        {
-            prvProcessIncomingData( pvIncomingPublishCallbackContext, pxPublishInfo );
-        }
     }
 
-    if( isMatch == false )
+    /* Return true if receiving update/accepted or update/rejected to get rid of warning
+     * message "WARN:  Received an unsolicited publish from topic $aws/things/<thing name>/jobs/+/update/+". */
+    if( isMatch == true )
     {
-        ( void ) MQTT_MatchTopic( pxPublishInfo->pTopicName,
-                                  pxPublishInfo->topicNameLength,
-                                  OTA_JOB_UPDATE_RESPONSE_TOPIC_FILTER,
-                                  OTA_JOB_UPDATE_RESPONSE_TOPIC_FILTER_LENGTH,
-                                  &isMatch );
-
-        /* Return true if receiving update/accepted or update/rejected to get rid of warning
-         * message "WARN:  Received an unsolicited publish from topic $aws/things/+/jobs/+/update/+". */
-        if( isMatch == true )
-        {
-            ESP_LOGI( TAG, "Received update response: %s.", pxPublishInfo->pTopicName );
-        }
+        ESP_LOGI( TAG, "Received update response: %.*s.",
+                  pxPublishInfo->topicNameLength,
+                  pxPublishInfo->pTopicName );
     }
 
     return isMatch;
@@ -38,10 +38,9 @@ void vStartOTACodeSigningDemo( void );
 /**
  * @brief Default callback used to receive default messages for OTA.
  *
- * The callback is not subscribed with MQTT broker, but only with local subscription manager.
- * A wildcard OTA job topic is used for subscription so that all unsolicited messages related to OTA is
- * forwarded to this callback for filtration. Right now the callback is used to filter responses to job requests
- * from the OTA service.
+ * Called for the publishes which no subscription claimed. The job and data stream topics the OTA agent
+ * subscribes to are routed to it by the subscription manager, so the callback only claims the responses to the
+ * job updates of this thing, which are not subscribed to.
  *
  * @param[in] pvIncomingPublishCallbackContext MQTT context which stores the connection.
  * @param[in] pPublishInfo MQTT packet that stores the information of the file block.
@@ -31,8 +31,12 @@
  *
  * Each created task is a unique instance of the task implemented by
  * prvSubscribePublishUnsubscribeTask().  prvSubscribePublishUnsubscribeTask()
- * subscribes to a topic, publishes a message to the same
- * topic, receives the message, then unsubscribes from the topic in a loop.
+ * subscribes to the topic filter /subpubunsub/+ shared by all tasks, publishes
+ * a message to a topic of its own matched by the filter, receives the message,
+ * then unsubscribes from the filter in a loop.  Only the first task to
+ * subscribe sends the SUBSCRIBE packet, and only the last one to leave sends
+ * the UNSUBSCRIBE packet; joining and leaving are serialized until the packet
+ * is acknowledged.
  * The command context sent to MQTTAgent_Publish(), MQTTAgent_Subscribe(), and
  * MQTTAgent_Unsubscribe contains a unique number that is sent back to the task
  * as a task notification from the callback function that executes when the
@@ -84,6 +88,14 @@
 #define CORE_MQTT_AGENT_CONNECTED_BIT              ( 1 << 0 )
 #define CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT    ( 1 << 1 )
 
+/* Topic filter shared by the tasks, matching the topic each task publishes to.
+ * Specific to this demo, so that it does not overlap the subscriptions of the
+ * other demos. */
+#define SUB_PUB_UNSUB_SHARED_TOPIC_FILTER          "/subpubunsub/+"
+
+/* Time a task waits for the broker to send its publish back. */
+#define SUB_PUB_UNSUB_ECHO_WAIT_MS                 ( 5000U )
+
 /* Struct definitions *********************************************************/
 
 /**
@@ -94,6 +106,7 @@ typedef struct IncomingPublishCallbackContext
 {
     TaskHandle_t xTaskToNotify;
     uint32_t ulNotificationValue;
+    const char * pcTopic;
     char pcIncomingPublish[ subpubunsubconfigSTRING_BUFFER_LENGTH ];
 } IncomingPublishCallbackContext_t;
 
@@ -149,11 +162,24 @@ static EventGroupHandle_t xNetworkEventGroup;
  */
 static SemaphoreHandle_t xMessageIdSemaphore;
 
+/**
+ * @brief The semaphore held from joining or leaving the shared subscription
+ * until the SUBSCRIBE or UNSUBSCRIBE it calls for is acknowledged, so that the
+ * packets reach the broker in the order the tasks joined and left.
+ */
+static SemaphoreHandle_t xSharedSubscriptionSemaphore;
+
 /**
  * @brief The message ID for the next message sent by this demo.
  */
 static uint32_t ulMessageId = 0;
 
+/**
+ * @brief The topic filter all tasks subscribe to. It must persist for the
+ * duration of the subscription.
+ */
+static char cSharedTopicFilter[] = SUB_PUB_UNSUB_SHARED_TOPIC_FILTER;
+
 /* Static function declarations ***********************************************/
 
 /**
@@ -218,11 +244,19 @@ static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandCont
  */
 static BaseType_t prvWaitForNotification( uint32_t * pulNotifiedValue );
 
+/**
+ * @brief Get the time to block when queueing a command, stretched to the
+ * retransmission timeout of the connection when the network is slow.
+ *
+ * @return Block time in milliseconds.
+ */
+static uint32_t prvGetCommandBlockTimeMs( void );
+
 /**
  * @brief Passed into MQTTAgent_Subscribe() as the callback to execute when
  * there is an incoming publish on the topic being subscribed to.  Its
- * implementation just logs information about the incoming publish including
- * the publish messages source topic and payload.
+ * implementation passes the payload of a publish to the topic of the task to
+ * the task, and ignores the publishes of the other tasks.
  *
  * See https://freertos.org/mqtt/mqtt-agent-demo.html#example_mqtt_api_call
  *
@@ -248,15 +282,46 @@ static void prvSubscribeToTopic( IncomingPublishCallbackContext_t * pxIncomingPu
                                  MQTTQoS_t xQoS,
                                  char * pcTopicFilter );
 
+/**
+ * @brief Add the callback of the task to a topic filter the other tasks may
+ * already be subscribed to.
+ *
+ * @param[in] pxIncomingPublishCallbackContext The callback context used when
+ * data is received from pcTopicFilter.
+ * @param[in] pcTopicFilter Topic filter to subscribe to.
+ *
+ * @return pdTRUE if the callback is the first one added to the filter, so
+ * the task has to send the SUBSCRIBE packet, pdFALSE otherwise.
+ */
+static BaseType_t prvJoinSharedSubscription( IncomingPublishCallbackContext_t * pxIncomingPublishCallbackContext,
+                                             char * pcTopicFilter );
+
+/**
+ * @brief Remove the callback of the task from a topic filter the other tasks
+ * may still be subscribed to.
+ *
+ * @param[in] pxIncomingPublishCallbackContext The callback context used when
+ * subscribing to pcTopicFilter.
+ * @param[in] pcTopicFilter Topic filter to unsubscribe from.
+ *
+ * @return pdTRUE if the callback was the last one removed from the filter, so
+ * the task has to send the UNSUBSCRIBE packet, pdFALSE otherwise.
+ */
+static BaseType_t prvLeaveSharedSubscription( IncomingPublishCallbackContext_t * pxIncomingPublishCallbackContext,
+                                              char * pcTopicFilter );
+
 /**
  * @brief Unsubscribe to the topic the demo task will also publish to.
  *
+ * @param[in] pxIncomingPublishCallbackContext The callback context used when
+ * subscribing to pcTopicFilter.
  * @param[in] xQoS The quality of service (QoS) to use.  Can be zero or one
  * for all MQTT brokers.  Can also be QoS2 if supported by the broker.  AWS IoT
  * does not support QoS2.
  * @param[in] pcTopicFilter Topic filter to unsubscribe from.
  */
-static void prvUnsubscribeToTopic( MQTTQoS_t xQoS,
+static void prvUnsubscribeToTopic( IncomingPublishCallbackContext_t * pxIncomingPublishCallbackContext,
+                                   MQTTQoS_t xQoS,
                                    char * pcTopicFilter );
 
 /**
@@ -337,33 +402,11 @@ static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandCont
 static void prvSubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
                                          MQTTAgentReturnInfo_t * pxReturnInfo )
 {
-    bool xSubscriptionAdded = false;
-    MQTTAgentSubscribeArgs_t * pxSubscribeArgs = ( MQTTAgentSubscribeArgs_t * ) pxCommandContext->pArgs;
-
     /* Store the result in the application defined context so the task that
-     * initiated the subscribe can check the operation's status. */
+     * initiated the subscribe can check the operation's status. The callback
+     * of the task was added to the subscription manager before subscribing. */
     pxCommandContext->xReturnStatus = pxReturnInfo->returnCode;
 
-    /* Check if the subscribe operation is a success. */
-    if( pxReturnInfo->returnCode == MQTTSuccess )
-    {
-        /* Add subscription so that incoming publishes are routed to the application
-         * callback. */
-        xSubscriptionAdded = addSubscription( ( SubscriptionElement_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
-                                              pxSubscribeArgs->pSubscribeInfo->pTopicFilter,
-                                              pxSubscribeArgs->pSubscribeInfo->topicFilterLength,
-                                              prvIncomingPublishCallback,
-                                              ( void * ) ( pxCommandContext->pxIncomingPublishCallbackContext ) );
-
-        if( xSubscriptionAdded == false )
-        {
-            ESP_LOGE( TAG,
-                      "Failed to register an incoming publish callback for topic %.*s.",
-                      pxSubscribeArgs->pSubscribeInfo->topicFilterLength,
-                      pxSubscribeArgs->pSubscribeInfo->pTopicFilter );
-        }
-    }
-
     if( pxCommandContext->xTaskToNotify != NULL )
     {
         xTaskNotify( pxCommandContext->xTaskToNotify,
@@ -375,21 +418,12 @@ static void prvSubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandCo
 static void prvUnsubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
                                            MQTTAgentReturnInfo_t * pxReturnInfo )
 {
-    MQTTAgentSubscribeArgs_t * pxUnsubscribeArgs = ( MQTTAgentSubscribeArgs_t * ) pxCommandContext->pArgs;
-
     /* Store the result in the application defined context so the task that
-     * initiated the subscribe can check the operation's status. */
+     * initiated the subscribe can check the operation's status. The callback
+     * of the task was removed from the subscription manager before
+     * unsubscribing. */
     pxCommandContext->xReturnStatus = pxReturnInfo->returnCode;
 
-    /* Check if the unsubscribe operation is a success. */
-    if( pxReturnInfo->returnCode == MQTTSuccess )
-    {
-        /* Remove subscription from subscription manager. */
-        removeSubscription( ( SubscriptionElement_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
-                            pxUnsubscribeArgs->pSubscribeInfo->pTopicFilter,
-                            pxUnsubscribeArgs->pSubscribeInfo->topicFilterLength );
-    }
-
     if( pxCommandContext->xTaskToNotify != NULL )
     {
         xTaskNotify( pxCommandContext->xTaskToNotify,
@@ -411,33 +445,52 @@ static BaseType_t prvWaitForNotification( uint32_t * pulNotifiedValue )
     return xReturn;
 }
 
+static uint32_t prvGetCommandBlockTimeMs( void )
+{
+    uint32_t ulBlockTimeMs = ulCoreMqttAgentManagerGetTimeoutMs( &xGlobalMqttAgentContext );
+
+    if( ulBlockTimeMs < subpubunsubconfigMAX_COMMAND_SEND_BLOCK_TIME_MS )
+    {
+        ulBlockTimeMs = subpubunsubconfigMAX_COMMAND_SEND_BLOCK_TIME_MS;
+    }
+
+    return ulBlockTimeMs;
+}
+
 static void prvIncomingPublishCallback( void * pvIncomingPublishCallbackContext,
                                         MQTTPublishInfo_t * pxPublishInfo )
 {
     IncomingPublishCallbackContext_t * pxIncomingPublishCallbackContext = ( IncomingPublishCallbackContext_t * ) pvIncomingPublishCallbackContext;
 
-    /* Create a message that contains the incoming MQTT payload to the logger,
-     * terminating the string first. */
-    if( pxPublishInfo->payloadLength < subpubunsubconfigSTRING_BUFFER_LENGTH )
+    /* The shared topic filter also matches the topics of the other tasks. */
+    if( ( pxPublishInfo->topicNameLength == strlen( pxIncomingPublishCallbackContext->pcTopic ) ) &&
+        ( strncmp( pxPublishInfo->pTopicName,
+                   pxIncomingPublishCallbackContext->pcTopic,
+                   pxPublishInfo->topicNameLength ) == 0 ) )
     {
-        memcpy( ( void * ) ( pxIncomingPublishCallbackContext->pcIncomingPublish ),
-                pxPublishInfo->pPayload,
-                pxPublishInfo->payloadLength );
+        /* Create a message that contains the incoming MQTT payload to the logger,
+         * terminating the string first. */
+        if( pxPublishInfo->payloadLength < subpubunsubconfigSTRING_BUFFER_LENGTH )
+        {
+            memcpy( ( void * ) ( pxIncomingPublishCallbackContext->pcIncomingPublish ),
+                    pxPublishInfo->pPayload,
+                    pxPublishInfo->payloadLength );
 
-        ( pxIncomingPublishCallbackContext->pcIncomingPublish )[ pxPublishInfo->payloadLength ] = 0x00;
-    }
-    else
-    {
-        memcpy( ( void * ) ( pxIncomingPublishCallbackContext->pcIncomingPublish ),
-                pxPublishInfo->pPayload,
-                subpubunsubconfigSTRING_BUFFER_LENGTH );
+            ( pxIncomingPublishCallbackContext->pcIncomingPublish )[ pxPublishInfo->payloadLength ] = 0x00;
+        }
+        else
+        {
+            memcpy( ( void * ) ( pxIncomingPublishCallbackContext->pcIncomingPublish ),
+                    pxPublishInfo->pPayload,
+                    subpubunsubconfigSTRING_BUFFER_LENGTH );
 
-        ( pxIncomingPublishCallbackContext->pcIncomingPublish )[ subpubunsubconfigSTRING_BUFFER_LENGTH - 1 ] = 0x00;
-    }
+            ( pxIncomingPublishCallbackContext->pcIncomingPublish )[ subpubunsubconfigSTRING_BUFFER_LENGTH - 1 ] = 0x00;
+        }
 
-    xTaskNotify( pxIncomingPublishCallbackContext->xTaskToNotify,
-                 pxIncomingPublishCallbackContext->ulNotificationValue,
-                 eSetValueWithOverwrite );
+        xTaskNotify( pxIncomingPublishCallbackContext->xTaskToNotify,
+                     pxIncomingPublishCallbackContext->ulNotificationValue,
+                     eSetValueWithOverwrite );
+    }
 }
 
 static void prvPublishToTopic( MQTTQoS_t xQoS,
@@ -484,7 +537,7 @@ static void prvPublishToTopic( MQTTQoS_t xQoS,
     xCommandContext.ulNotificationValue = ulPublishMessageId;
     xCommandContext.xTaskToNotify = xTaskGetCurrentTaskHandle();
 
-    xCommandParams.blockTimeMs = subpubunsubconfigMAX_COMMAND_SEND_BLOCK_TIME_MS;
+    xCommandParams.blockTimeMs = prvGetCommandBlockTimeMs();
     xCommandParams.cmdCompleteCallback = prvPublishCommandCallback;
     xCommandParams.pCmdCompleteCallbackContext = &xCommandContext;
 
@@ -603,7 +656,7 @@ static void prvSubscribeToTopic( IncomingPublishCallbackContext_t * pxIncomingPu
     xCommandContext.pxIncomingPublishCallbackContext = pxIncomingPublishCallbackContext;
     xCommandContext.pArgs = ( void * ) &xSubscribeArgs;
 
-    xCommandParams.blockTimeMs = subpubunsubconfigMAX_COMMAND_SEND_BLOCK_TIME_MS;
+    xCommandParams.blockTimeMs = prvGetCommandBlockTimeMs();
     xCommandParams.cmdCompleteCallback = prvSubscribeCommandCallback;
     xCommandParams.pCmdCompleteCallbackContext = ( void * ) &xCommandContext;
 
@@ -665,7 +718,74 @@ static void prvSubscribeToTopic( IncomingPublishCallbackContext_t * pxIncomingPu
              ( ulNotifiedValue != ulSubscribeMessageId ) );
 }
 
-static void prvUnsubscribeToTopic( MQTTQoS_t xQoS,
+static BaseType_t prvJoinSharedSubscription( IncomingPublishCallbackContext_t * pxIncomingPublishCallbackContext,
+                                             char * pcTopicFilter )
+{
+    SubscriptionList_t * pxSubscriptionList = ( SubscriptionList_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext;
+    bool xFirst = false;
+    BaseType_t xSubscribe = pdFALSE;
+
+    /* Added before subscribing, so that the publishes the broker sends right
+     * after the SUBACK are routed to the task. */
+    if( addSharedSubscription( pxSubscriptionList,
+                               pcTopicFilter,
+                               ( uint16_t ) strlen( pcTopicFilter ),
+                               prvIncomingPublishCallback,
+                               ( void * ) pxIncomingPublishCallbackContext,
+                               &xFirst ) == false )
+    {
+        ESP_LOGE( TAG,
+                  "Failed to register an incoming publish callback for topic filter %s.",
+                  pcTopicFilter );
+    }
+    else if( xFirst )
+    {
+        xSubscribe = pdTRUE;
+    }
+    else
+    {
+        ESP_LOGI( TAG,
+                  "Task \"%s\" shares the subscription to topic filter %s.",
+                  pcTaskGetName( NULL ),
+                  pcTopicFilter );
+    }
+
+    return xSubscribe;
+}
+
+static BaseType_t prvLeaveSharedSubscription( IncomingPublishCallbackContext_t * pxIncomingPublishCallbackContext,
+                                              char * pcTopicFilter )
+{
+    SubscriptionList_t * pxSubscriptionList = ( SubscriptionList_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext;
+    bool xLast = false;
+    BaseType_t xUnsubscribe = pdFALSE;
+
+    if( removeSharedSubscription( pxSubscriptionList,
+                                  pcTopicFilter,
+                                  ( uint16_t ) strlen( pcTopicFilter ),
+                                  prvIncomingPublishCallback,
+                                  ( void * ) pxIncomingPublishCallbackContext,
+                                  &xLast ) == false )
+    {
+        /* The callback could not be added. */
+    }
+    else if( xLast )
+    {
+        xUnsubscribe = pdTRUE;
+    }
+    else
+    {
+        ESP_LOGI( TAG,
+                  "Task \"%s\" left the shared subscription to topic filter %s.",
+                  pcTaskGetName( NULL ),
+                  pcTopicFilter );
+    }
+
+    return xUnsubscribe;
+}
+
+static void prvUnsubscribeToTopic( IncomingPublishCallbackContext_t * pxIncomingPublishCallbackContext,
+                                   MQTTQoS_t xQoS,
                                    char * pcTopicFilter )
 {
     uint32_t ulUnsubscribeMessageId, ulNotifiedValue = 0;
@@ -709,9 +829,10 @@ static void prvUnsubscribeToTopic( MQTTQoS_t xQoS,
      * until the callback executes. */
     xCommandContext.ulNotificationValue = ulUnsubscribeMessageId;
     xCommandContext.xTaskToNotify = xTaskGetCurrentTaskHandle();
+    xCommandContext.pxIncomingPublishCallbackContext = pxIncomingPublishCallbackContext;
     xCommandContext.pArgs = ( void * ) &xUnsubscribeArgs;
 
-    xCommandParams.blockTimeMs = subpubunsubconfigMAX_COMMAND_SEND_BLOCK_TIME_MS;
+    xCommandParams.blockTimeMs = prvGetCommandBlockTimeMs();
     xCommandParams.cmdCompleteCallback = prvUnsubscribeCommandCallback;
     xCommandParams.pCmdCompleteCallbackContext = ( void * ) &xCommandContext;
 
@@ -786,23 +907,32 @@ static void prvSubscribePublishUnsubscribeTask( void * pvParameters )
 
     xIncomingPublishCallbackContext.ulNotificationValue = ulTaskNumber;
     xIncomingPublishCallbackContext.xTaskToNotify = xTaskGetCurrentTaskHandle();
+    xIncomingPublishCallbackContext.pcTopic = pcTopicBuffer;
 
     xQoS = ( MQTTQoS_t ) subpubunsubconfigQOS_LEVEL;
 
-    /* Create a topic name for this task to publish to. */
+    /* Create a topic name for this task to publish to, matched by the shared
+     * topic filter. */
     snprintf( pcTopicBuffer,
               subpubunsubconfigSTRING_BUFFER_LENGTH,
-              "/filter/%s",
+              "/subpubunsub/%s",
               pcTaskGetName( xIncomingPublishCallbackContext.xTaskToNotify ) );
 
     while( 1 )
     {
-        /* Subscribe to the same topic to which this task will publish.  That will
-         * result in each published message being published from the server back to
-         * the target. */
-        prvSubscribeToTopic( &xIncomingPublishCallbackContext,
-                             xQoS,
-                             pcTopicBuffer );
+        /* Subscribe to a filter matching the topic to which this task will
+         * publish.  That will result in each published message being published
+         * from the server back to the target. */
+        xSemaphoreTake( xSharedSubscriptionSemaphore, portMAX_DELAY );
+
+        if( prvJoinSharedSubscription( &xIncomingPublishCallbackContext, cSharedTopicFilter ) == pdTRUE )
+        {
+            prvSubscribeToTopic( &xIncomingPublishCallbackContext,
+                                 xQoS,
+                                 cSharedTopicFilter );
+        }
+
+        xSemaphoreGive( xSharedSubscriptionSemaphore );
 
         snprintf( pcPayload,
                   subpubunsubconfigSTRING_BUFFER_LENGTH,
@@ -813,14 +943,35 @@ static void prvSubscribePublishUnsubscribeTask( void * pvParameters )
                            pcTopicBuffer,
                            pcPayload );
 
-        prvWaitForNotification( &ulNotifiedValue );
+        /* The publish is not echoed if it overtook the SUBSCRIBE of the task
+         * that subscribed to the shared filter first, so do not wait forever. */
+        if( xTaskNotifyWait( 0,
+                             0,
+                             &ulNotifiedValue,
+                             pdMS_TO_TICKS( SUB_PUB_UNSUB_ECHO_WAIT_MS ) ) == pdTRUE )
+        {
+            ESP_LOGI( TAG,
+                      "Task \"%s\" received: %s",
+                      pcTaskGetName( xIncomingPublishCallbackContext.xTaskToNotify ),
+                      xIncomingPublishCallbackContext.pcIncomingPublish );
+        }
+        else
+        {
+            ESP_LOGW( TAG,
+                      "Task \"%s\" did not receive its publish.",
+                      pcTaskGetName( xIncomingPublishCallbackContext.xTaskToNotify ) );
+        }
+
+        /* Otherwise a task joining right after the last one left could have
+         * its SUBSCRIBE sent before the UNSUBSCRIBE. */
+        xSemaphoreTake( xSharedSubscriptionSemaphore, portMAX_DELAY );
 
-        ESP_LOGI( TAG,
-                  "Task \"%s\" received: %s",
-                  pcTaskGetName( xIncomingPublishCallbackContext.xTaskToNotify ),
-                  xIncomingPublishCallbackContext.pcIncomingPublish );
+        if( prvLeaveSharedSubscription( &xIncomingPublishCallbackContext, cSharedTopicFilter ) == pdTRUE )
+        {
+            prvUnsubscribeToTopic( &xIncomingPublishCallbackContext, xQoS, cSharedTopicFilter );
+        }
 
-        prvUnsubscribeToTopic( xQoS, pcTopicBuffer );
+        xSemaphoreGive( xSharedSubscriptionSemaphore );
 
         ESP_LOGI( TAG,
                   "Task \"%s\" completed a loop. Delaying before next loop.",
@@ -841,6 +992,7 @@ void vStartSubscribePublishUnsubscribeDemo( void )
     uint32_t ulTaskNumber;
 
     xMessageIdSemaphore = xSemaphoreCreateMutex();
+    xSharedSubscriptionSemaphore = xSemaphoreCreateMutex();
     xNetworkEventGroup = xEventGroupCreate();
     xCoreMqttAgentManagerRegisterHandler( prvCoreMqttAgentEventHandler );
 
@@ -77,6 +77,14 @@
 /* Subscription manager include. */
 #include "subscription_manager.h"
 
+/* coreMQTT-Agent manager configurations include. */
+#include "core_mqtt_agent_manager_config.h"
+
+/* Subscription dispatcher include. */
+#if configMQTT_AGENT_QUEUED_DISPATCH
+    #include "subscription_dispatcher.h"
+#endif /* configMQTT_AGENT_QUEUED_DISPATCH */
+
 /* Hardware drivers include. */
 #include "app_driver.h"
 
@@ -92,6 +100,13 @@
 #define CORE_MQTT_AGENT_CONNECTED_BIT              ( 1 << 0 )
 #define CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT    ( 1 << 1 )
 
+/* Name of the demo task, which is also part of its topic. */
+#define TEMP_SUB_PUB_AND_LED_CONTROL_TASK_NAME     "TempSubPubLED"
+
+/* Name of the worker task running the incoming publish callback, distinct
+ * from the demo task so the two can be told apart in task lists. */
+#define TEMP_SUB_PUB_AND_LED_CONTROL_WORKER_NAME   "TempSubPubRx"
+
 /* Struct definitions *********************************************************/
 
 /**
@@ -132,6 +147,22 @@ static char topicBuf[ temppubsubandledcontrolconfigSTRING_BUFFER_LENGTH ];
  */
 static EventGroupHandle_t xNetworkEventGroup;
 
+/**
+ * @brief Whether the topic is subscribed to by the coreMQTT-Agent manager on
+ * the first connection, so the task does not subscribe itself.
+ */
+static bool xStartupSubscribed;
+
+#if configMQTT_AGENT_QUEUED_DISPATCH
+
+/**
+ * @brief Worker task running prvIncomingPublishCallback(), so JSON parsing and
+ * LED driver calls do not hold up the coreMQTT-Agent task. NULL if it could
+ * not be created, in which case the callback runs on the coreMQTT-Agent task.
+ */
+    static SubscriptionDispatcher_t * pxIncomingPublishDispatcher;
+#endif /* configMQTT_AGENT_QUEUED_DISPATCH */
+
 /* Static function declarations ***********************************************/
 
 /**
@@ -207,6 +238,17 @@ static BaseType_t prvWaitForCommandAcknowledgment( uint32_t * pulNotifiedValue )
 static void prvIncomingPublishCallback( void * pvIncomingPublishCallbackContext,
                                         MQTTPublishInfo_t * pxPublishInfo );
 
+/**
+ * @brief Callback registered with the subscription manager. Passes incoming
+ * publishes to the worker task of the demo once it is created, and runs
+ * prvIncomingPublishCallback() on the coreMQTT-Agent task otherwise.
+ *
+ * @param[in] pvIncomingPublishCallbackContext Unused.
+ * @param[in] pxPublishInfo Deserialized publish.
+ */
+static void prvRouteIncomingPublish( void * pvIncomingPublishCallbackContext,
+                                     MQTTPublishInfo_t * pxPublishInfo );
+
 /**
  * @brief Subscribe to the topic the demo task will also publish to - that
  * results in all outgoing publishes being published back to the task
@@ -262,10 +304,10 @@ static void prvSubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandCo
     {
         /* Add subscription so that incoming publishes are routed to the application
          * callback. */
-        xSubscriptionAdded = addSubscription( ( SubscriptionElement_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
+        xSubscriptionAdded = addSubscription( ( SubscriptionList_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
                                               pxSubscribeArgs->pSubscribeInfo->pTopicFilter,
                                               pxSubscribeArgs->pSubscribeInfo->topicFilterLength,
-                                              prvIncomingPublishCallback,
+                                              prvRouteIncomingPublish,
                                               NULL );
 
         if( xSubscriptionAdded == false )
@@ -368,6 +410,21 @@ static void prvIncomingPublishCallback( void * pvIncomingPublishCallbackContext,
     prvParseIncomingPublish( ( char * ) pxPublishInfo->pPayload, pxPublishInfo->payloadLength );
 }
 
+static void prvRouteIncomingPublish( void * pvIncomingPublishCallbackContext,
+                                     MQTTPublishInfo_t * pxPublishInfo )
+{
+    #if configMQTT_AGENT_QUEUED_DISPATCH
+        if( pxIncomingPublishDispatcher != NULL )
+        {
+            vSubscriptionDispatcherCallback( pxIncomingPublishDispatcher, pxPublishInfo );
+        }
+        else
+    #endif /* configMQTT_AGENT_QUEUED_DISPATCH */
+    {
+        prvIncomingPublishCallback( pvIncomingPublishCallbackContext, pxPublishInfo );
+    }
+}
+
 static bool prvSubscribeToTopic( MQTTQoS_t xQoS,
                                  char * pcTopicFilter )
 {
@@ -462,12 +519,21 @@ static void prvTempSubPubAndLEDControlTask( void * pvParameters )
     const char * pcTaskName;
     uint32_t ulPublishPassCounts = 0;
     uint32_t ulPublishFailCounts = 0;
+    uint32_t ulPublishSkipCounts = 0;
 
     pcTaskName = pcTaskGetName( xTaskGetCurrentTaskHandle() );
 
     /* Hardware initialisation */
     app_driver_init();
 
+    #if configMQTT_AGENT_QUEUED_DISPATCH
+        pxIncomingPublishDispatcher = pxSubscriptionDispatcherCreate( TEMP_SUB_PUB_AND_LED_CONTROL_WORKER_NAME,
+                                                                      configMQTT_AGENT_DISPATCH_QUEUE_LENGTH,
+                                                                      ( SubscriptionDispatcherOverflow_t ) configMQTT_AGENT_DISPATCH_OVERFLOW,
+                                                                      prvIncomingPublishCallback,
+                                                                      NULL );
+    #endif /* configMQTT_AGENT_QUEUED_DISPATCH */
+
     /* Initialize the coreMQTT-Agent event group. */
     xNetworkEventGroup = xEventGroupCreate();
     xEventGroupSetBits( xNetworkEventGroup,
@@ -478,16 +544,14 @@ static void prvTempSubPubAndLEDControlTask( void * pvParameters )
 
     xQoS = ( MQTTQoS_t ) temppubsubandledcontrolconfigQOS_LEVEL;
 
-    /* Create a topic name for this task to publish to. */
-    snprintf( pcTopicBuffer,
-              temppubsubandledcontrolconfigSTRING_BUFFER_LENGTH,
-              "/filter/%s",
-              pcTaskName );
-
     /* Subscribe to the same topic to which this task will publish.  That will
      * result in each published message being published from the server back to
-     * the target. */
-    prvSubscribeToTopic( xQoS, pcTopicBuffer );
+     * the target. The topic was normally registered as a startup subscription,
+     * made along with those of the other demos on the first connection. */
+    if( !xStartupSubscribed )
+    {
+        prvSubscribeToTopic( xQoS, pcTopicBuffer );
+    }
 
     /* Configure the publish operation. */
     memset( ( void * ) &xPublishInfo, 0x00, sizeof( xPublishInfo ) );
@@ -546,51 +610,67 @@ static void prvTempSubPubAndLEDControlTask( void * pvParameters )
                              pdTRUE,
                              portMAX_DELAY );
 
-        ESP_LOGI( TAG,
-                  "Sending publish request to agent with message \"%s\" on topic \"%s\"",
-                  payloadBuf,
-                  pcTopicBuffer );
-
-        /* To ensure ulNotification doesn't accidentally hold the expected value
-         * as it is to be checked against the value sent from the callback.. */
-        ulNotification = ~ulValueToNotify;
-
-        xCommandAdded = MQTTAgent_Publish( &xGlobalMqttAgentContext,
-                                           &xPublishInfo,
-                                           &xCommandParams );
-        configASSERT( xCommandAdded == MQTTSuccess );
-
-        /* For QoS 1 and 2, wait for the publish acknowledgment.  For QoS0,
-         * wait for the publish to be sent. */
-        ESP_LOGI( TAG,
-                  "Task %s waiting for publish %"PRIu32" to complete.",
-                  pcTaskName,
-                  ulValueToNotify );
-
-        prvWaitForCommandAcknowledgment( &ulNotification );
-
-        /* The value received by the callback that executed when the publish was
-         * acked came from the context passed into MQTTAgent_Publish() above, so
-         * should match the value set in the context above. */
-        if( ulNotification == ulValueToNotify )
+        /* Rather than block on a congested agent, skip this sample; the next
+         * one is read after the usual delay. */
+        if( xCoreMqttAgentManagerCanPublish( pcTopicBuffer,
+                                             xPublishInfo.topicNameLength,
+                                             xPublishInfo.payloadLength ) == pdFALSE )
         {
-            ulPublishPassCounts++;
-            ESP_LOGI( TAG,
-                      "Rx'ed %s from Tx to %s (P%"PRIu32":F%"PRIu32").",
-                      ( xQoS == 0 ) ? "completion notification for QoS0 publish" : "ack for QoS1 publish",
+            ulPublishSkipCounts++;
+            ESP_LOGW( TAG,
+                      "coreMQTT-Agent congested, skipping publish %"PRIu32" to %s (S%"PRIu32").",
+                      ulValueToNotify,
                       pcTopicBuffer,
-                      ulPublishPassCounts,
-                      ulPublishFailCounts );
+                      ulPublishSkipCounts );
         }
         else
         {
-            ulPublishFailCounts++;
-            ESP_LOGE( TAG,
-                      "Timed out Rx'ing %s from Tx to %s (P%"PRIu32":F%"PRIu32")",
-                      ( xQoS == 0 ) ? "completion notification for QoS0 publish" : "ack for QoS1 publish",
-                      pcTopicBuffer,
-                      ulPublishPassCounts,
-                      ulPublishFailCounts );
+            ESP_LOGI( TAG,
+                      "Sending publish request to agent with message \"%s\" on topic \"%s\"",
+                      payloadBuf,
+                      pcTopicBuffer );
+
+            /* To ensure ulNotification doesn't accidentally hold the expected value
+             * as it is to be checked against the value sent from the callback.. */
+            ulNotification = ~ulValueToNotify;
+
+            xCommandAdded = MQTTAgent_Publish( &xGlobalMqttAgentContext,
+                                               &xPublishInfo,
+                                               &xCommandParams );
+            configASSERT( xCommandAdded == MQTTSuccess );
+
+            /* For QoS 1 and 2, wait for the publish acknowledgment.  For QoS0,
+             * wait for the publish to be sent. */
+            ESP_LOGI( TAG,
+                      "Task %s waiting for publish %"PRIu32" to complete.",
+                      pcTaskName,
+                      ulValueToNotify );
+
+            prvWaitForCommandAcknowledgment( &ulNotification );
+
+            /* The value received by the callback that executed when the publish was
+             * acked came from the context passed into MQTTAgent_Publish() above, so
+             * should match the value set in the context above. */
+            if( ulNotification == ulValueToNotify )
+            {
+                ulPublishPassCounts++;
+                ESP_LOGI( TAG,
+                          "Rx'ed %s from Tx to %s (P%"PRIu32":F%"PRIu32").",
+                          ( xQoS == 0 ) ? "completion notification for QoS0 publish" : "ack for QoS1 publish",
+                          pcTopicBuffer,
+                          ulPublishPassCounts,
+                          ulPublishFailCounts );
+            }
+            else
+            {
+                ulPublishFailCounts++;
+                ESP_LOGE( TAG,
+                          "Timed out Rx'ing %s from Tx to %s (P%"PRIu32":F%"PRIu32")",
+                          ( xQoS == 0 ) ? "completion notification for QoS0 publish" : "ack for QoS1 publish",
+                          pcTopicBuffer,
+                          ulPublishPassCounts,
+                          ulPublishFailCounts );
+            }
         }
 
         ulValueToNotify++;
@@ -660,8 +740,19 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
 
 void vStartTempSubPubAndLEDControlDemo( void )
 {
+    /* Create a topic name for the task to publish to. */
+    snprintf( topicBuf,
+              temppubsubandledcontrolconfigSTRING_BUFFER_LENGTH,
+              "/filter/%s",
+              TEMP_SUB_PUB_AND_LED_CONTROL_TASK_NAME );
+
+    xStartupSubscribed = ( xCoreMqttAgentManagerAddStartupSubscription( topicBuf,
+                                                                        ( uint16_t ) strlen( topicBuf ),
+                                                                        prvRouteIncomingPublish,
+                                                                        NULL ) == pdPASS );
+
     xTaskCreate( prvTempSubPubAndLEDControlTask,
-                 "TempSubPubLED",
+                 TEMP_SUB_PUB_AND_LED_CONTROL_TASK_NAME,
                  temppubsubandledcontrolconfigTASK_STACK_SIZE,
                  NULL,
                  temppubsubandledcontrolconfigTASK_PRIORITY,
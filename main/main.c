@@ -52,6 +52,9 @@
 /* coreMQTT-Agent network manager include. */
 #include "core_mqtt_agent_manager.h"
 
+/* coreMQTT-Agent metrics include. */
+#include "core_mqtt_agent_metrics.h"
+
 /* WiFi provisioning/connection handler include. */
 #include "app_wifi.h"
 
@@ -73,6 +76,10 @@
     #include "device_tracking_demo.h"
 #endif /* CONFIG_GRI_ENABLE_DEVICE_TRACKING_DEMO */
 
+#if CONFIG_GRI_ENABLE_MQTT_AGENT_BENCHMARK
+    #include "mqtt_agent_benchmark.h"
+#endif /* CONFIG_GRI_ENABLE_MQTT_AGENT_BENCHMARK */
+
 #if CONFIG_GRI_RUN_QUALIFICATION_TEST
     #include "qualification_wrapper_config.h"
 #endif /* CONFIG_GRI_RUN_QUALIFICATION_TEST */
@@ -324,6 +331,10 @@ static void prvStartEnabledDemos( void )
             vStartDeviceTrackingDemo();
         #endif /* CONFIG_GRI_ENABLE_DEVICE_TRACKING_DEMO */
 
+        #if CONFIG_GRI_ENABLE_MQTT_AGENT_BENCHMARK
+            vStartMqttAgentBenchmark();
+        #endif /* CONFIG_GRI_ENABLE_MQTT_AGENT_BENCHMARK */
+
     /* Initialize and start the coreMQTT-Agent network manager. This handles
      * establishing a TLS connection and MQTT connection to the MQTT broker.
      * This needs to be started before starting WiFi so it can handle WiFi
@@ -337,6 +348,11 @@ static void prvStartEnabledDemos( void )
 
             configASSERT( xResult == pdPASS );
         }
+
+        if( xCoreMqttAgentMetricsStart() != pdPASS )
+        {
+            ESP_LOGE( TAG, "Failed to start coreMQTT-Agent metrics." );
+        }
     #endif /* CONFIG_GRI_RUN_QUALIFICATION_TEST == 0 */
 
     #if CONFIG_GRI_RUN_QUALIFICATION_TEST
@@ -0,0 +1,452 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2023 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file dns_cache.c
+ * @brief Resolver cache for the MQTT broker endpoint.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+/* ESP-IDF includes. */
+#include <esp_log.h>
+#include <nvs.h>
+#include <sdkconfig.h>
+
+/* lwIP includes. */
+#include "lwip/api.h"
+#include "lwip/ip_addr.h"
+
+/* Public functions include. */
+#include "dns_cache.h"
+
+/* Configurations include. */
+#if CONFIG_LWIP_HOOK_NETCONN_EXT_RESOLVE_CUSTOM
+    #include "dns_cache_config.h"
+#endif /* CONFIG_LWIP_HOOK_NETCONN_EXT_RESOLVE_CUSTOM */
+
+/* Preprocessor definitions ***************************************************/
+
+/* NVS namespace and keys used to persist the last known good address. */
+#define DNS_CACHE_NVS_NAMESPACE    "dns_cache"
+#define DNS_CACHE_NVS_HOST_KEY     "host"
+#define DNS_CACHE_NVS_ADDR_KEY     "addr"
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief The single cache entry, for the MQTT broker host name.
+ */
+typedef struct DnsCacheEntry
+{
+    const char * pcHostname; /**< Cached host name, NULL until initialized. */
+    ip_addr_t xAddr;         /**< Last known good address of the host. */
+    bool xAddrKnown;         /**< Whether xAddr holds a usable address. */
+    bool xFresh;             /**< Whether xAddr may be served without querying DNS. */
+    TickType_t xResolvedAt;  /**< Tick count at which xAddr was last resolved. */
+} DnsCacheEntry_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "dns_cache";
+
+/**
+ * @brief The cache entry for the broker host name.
+ */
+static DnsCacheEntry_t xCacheEntry = { 0 };
+
+/**
+ * @brief Counters reported by vDnsCacheGetStats().
+ */
+static DnsCacheStats_t xCacheStats = { 0 };
+
+/**
+ * @brief Lock serializing access to the cache entry and counters.
+ */
+static SemaphoreHandle_t xCacheMutex = NULL;
+
+/**
+ * @brief Lock held across a DNS query, so that the host name is queried by
+ * one task at a time. It is taken before xCacheMutex.
+ */
+static SemaphoreHandle_t xResolveMutex = NULL;
+
+/**
+ * @brief Task currently resolving the host name through lwIP. The resolve hook
+ * is re-entered by that task and must then let lwIP handle the query. Written
+ * with xResolveMutex held.
+ */
+static TaskHandle_t xResolvingTask = NULL;
+
+/* Static function definitions ************************************************/
+
+#if CONFIG_LWIP_HOOK_NETCONN_EXT_RESOLVE_CUSTOM
+
+    #if dnscacheconfigPERSIST_TO_NVS
+
+        static void prvLoadFromNvs( void )
+        {
+            nvs_handle_t xNvsHandle;
+            char cStoredHost[ 256 ] = { 0 };
+            size_t xLength = sizeof( cStoredHost );
+            ip_addr_t xStoredAddr;
+
+            if( nvs_open( DNS_CACHE_NVS_NAMESPACE, NVS_READONLY, &xNvsHandle ) != ESP_OK )
+            {
+                return;
+            }
+
+            if( ( nvs_get_str( xNvsHandle, DNS_CACHE_NVS_HOST_KEY, cStoredHost, &xLength ) == ESP_OK ) &&
+                ( strcmp( cStoredHost, xCacheEntry.pcHostname ) == 0 ) )
+            {
+                xLength = sizeof( xStoredAddr );
+
+                if( ( nvs_get_blob( xNvsHandle, DNS_CACHE_NVS_ADDR_KEY, &xStoredAddr, &xLength ) == ESP_OK ) &&
+                    ( xLength == sizeof( xStoredAddr ) ) )
+                {
+                    /* Only usable as a fallback until DNS has been queried once. */
+                    xCacheEntry.xAddr = xStoredAddr;
+                    xCacheEntry.xAddrKnown = true;
+                    xCacheEntry.xFresh = false;
+
+                    ESP_LOGI( TAG, "Loaded last known address of %s: %s",
+                              cStoredHost, ipaddr_ntoa( &xStoredAddr ) );
+                }
+            }
+
+            nvs_close( xNvsHandle );
+        }
+
+        static void prvStoreToNvs( const ip_addr_t * pxAddr )
+        {
+            nvs_handle_t xNvsHandle;
+            esp_err_t xEspErrRet;
+
+            xEspErrRet = nvs_open( DNS_CACHE_NVS_NAMESPACE, NVS_READWRITE, &xNvsHandle );
+
+            if( xEspErrRet == ESP_OK )
+            {
+                xEspErrRet = nvs_set_str( xNvsHandle, DNS_CACHE_NVS_HOST_KEY, xCacheEntry.pcHostname );
+
+                if( xEspErrRet == ESP_OK )
+                {
+                    xEspErrRet = nvs_set_blob( xNvsHandle, DNS_CACHE_NVS_ADDR_KEY,
+                                               pxAddr, sizeof( *pxAddr ) );
+                }
+
+                if( xEspErrRet == ESP_OK )
+                {
+                    xEspErrRet = nvs_commit( xNvsHandle );
+                }
+
+                nvs_close( xNvsHandle );
+            }
+
+            if( xEspErrRet != ESP_OK )
+            {
+                ESP_LOGW( TAG, "Failed to persist resolved address. Error: %s",
+                          esp_err_to_name( xEspErrRet ) );
+            }
+        }
+
+    #endif /* dnscacheconfigPERSIST_TO_NVS */
+
+    static bool prvAddrTypeMatches( const ip_addr_t * pxAddr,
+                                    u8_t ucAddrType )
+    {
+        bool xMatches = true;
+
+        #if LWIP_IPV4 && LWIP_IPV6
+            if( ucAddrType == NETCONN_DNS_IPV4 )
+            {
+                xMatches = IP_IS_V4( pxAddr );
+            }
+            else if( ucAddrType == NETCONN_DNS_IPV6 )
+            {
+                xMatches = IP_IS_V6( pxAddr );
+            }
+        #else
+            ( void ) pxAddr;
+            ( void ) ucAddrType;
+        #endif /* LWIP_IPV4 && LWIP_IPV6 */
+
+        return xMatches;
+    }
+
+    /* Serve the cached address if it is fresh. Called with xCacheMutex held. */
+    static bool prvGetFresh( ip_addr_t * pxAddr,
+                             u8_t ucAddrType )
+    {
+        /* In ticks straight from seconds, as milliseconds times the tick rate
+         * would overflow for long TTLs. */
+        bool xFresh = xCacheEntry.xFresh &&
+                      prvAddrTypeMatches( &xCacheEntry.xAddr, ucAddrType ) &&
+                      ( ( xTaskGetTickCount() - xCacheEntry.xResolvedAt ) <
+                        ( ( TickType_t ) dnscacheconfigTTL_SECONDS * configTICK_RATE_HZ ) );
+
+        if( xFresh )
+        {
+            xCacheStats.ulHits++;
+            *pxAddr = xCacheEntry.xAddr;
+        }
+
+        return xFresh;
+    }
+
+    static err_t prvResolveUpstream( const char * pcName,
+                                     ip_addr_t * pxAddr,
+                                     u8_t ucAddrType )
+    {
+        err_t xErr;
+
+        xResolvingTask = xTaskGetCurrentTaskHandle();
+
+        #if LWIP_IPV4 && LWIP_IPV6
+            xErr = netconn_gethostbyname_addrtype( pcName, pxAddr, ucAddrType );
+        #else
+            ( void ) ucAddrType;
+            xErr = netconn_gethostbyname( pcName, pxAddr );
+        #endif /* LWIP_IPV4 && LWIP_IPV6 */
+
+        xResolvingTask = NULL;
+
+        return xErr;
+    }
+
+/*-----------------------------------------------------------*/
+
+    /**
+     * @brief lwIP external resolve hook, called by netconn_gethostbyname() and
+     * so by every getaddrinfo().
+     *
+     * @return 1 if the name was resolved (or failed) here, 0 to let lwIP
+     * resolve it.
+     */
+    int lwip_hook_netconn_external_resolve( const char * name,
+                                            ip_addr_t * addr,
+                                            u8_t addrtype,
+                                            err_t * err )
+    {
+        int lHandled = 0;
+        ip_addr_t xResolved;
+        err_t xErr;
+
+        #if dnscacheconfigPERSIST_TO_NVS
+            bool xChanged = false;
+        #endif /* dnscacheconfigPERSIST_TO_NVS */
+
+        if( ( xCacheMutex == NULL ) ||
+            ( xCacheEntry.pcHostname == NULL ) ||
+            ( xResolvingTask == xTaskGetCurrentTaskHandle() ) ||
+            ( strcmp( name, xCacheEntry.pcHostname ) != 0 ) )
+        {
+            return 0;
+        }
+
+        xSemaphoreTake( xCacheMutex, portMAX_DELAY );
+        lHandled = prvGetFresh( addr, addrtype ) ? 1 : 0;
+        xSemaphoreGive( xCacheMutex );
+
+        if( lHandled == 0 )
+        {
+            /* A task that waited for another task's query is served its
+             * answer from the cache. */
+            xSemaphoreTake( xResolveMutex, portMAX_DELAY );
+            xSemaphoreTake( xCacheMutex, portMAX_DELAY );
+
+            if( prvGetFresh( addr, addrtype ) )
+            {
+                lHandled = 1;
+            }
+            else
+            {
+                xCacheStats.ulMisses++;
+                xCacheEntry.xFresh = false;
+            }
+
+            xSemaphoreGive( xCacheMutex );
+
+            if( lHandled == 0 )
+            {
+                /* The query can take as long as all DNS retries, so it is made
+                 * without the cache lock; hits, invalidation and the counters
+                 * are not held up by it. */
+                xErr = prvResolveUpstream( name, &xResolved, addrtype );
+
+                xSemaphoreTake( xCacheMutex, portMAX_DELAY );
+
+                if( xErr == ERR_OK )
+                {
+                    #if dnscacheconfigPERSIST_TO_NVS
+                        xChanged = !xCacheEntry.xAddrKnown ||
+                                   !ip_addr_cmp( &xCacheEntry.xAddr, &xResolved );
+                    #endif /* dnscacheconfigPERSIST_TO_NVS */
+
+                    xCacheEntry.xAddr = xResolved;
+                    xCacheEntry.xAddrKnown = true;
+                    xCacheEntry.xFresh = true;
+                    xCacheEntry.xResolvedAt = xTaskGetTickCount();
+
+                    *addr = xResolved;
+                }
+                else if( xCacheEntry.xAddrKnown &&
+                         prvAddrTypeMatches( &xCacheEntry.xAddr, addrtype ) )
+                {
+                    xCacheStats.ulFallbacks++;
+                    ESP_LOGW( TAG, "Failed to resolve %s (err=%d). Using last known address %s.",
+                              name, xErr, ipaddr_ntoa( &xCacheEntry.xAddr ) );
+                    *addr = xCacheEntry.xAddr;
+                    xErr = ERR_OK;
+                }
+                else
+                {
+                    xCacheStats.ulFailures++;
+                    ESP_LOGE( TAG, "Failed to resolve %s (err=%d).", name, xErr );
+                }
+
+                xSemaphoreGive( xCacheMutex );
+
+                #if dnscacheconfigPERSIST_TO_NVS
+                    /* Still serialized with other queries by xResolveMutex. */
+                    if( xChanged )
+                    {
+                        prvStoreToNvs( &xResolved );
+                    }
+                #endif /* dnscacheconfigPERSIST_TO_NVS */
+
+                *err = xErr;
+                lHandled = 1;
+            }
+            else
+            {
+                *err = ERR_OK;
+            }
+
+            xSemaphoreGive( xResolveMutex );
+        }
+        else
+        {
+            *err = ERR_OK;
+        }
+
+        return lHandled;
+    }
+
+#endif /* CONFIG_LWIP_HOOK_NETCONN_EXT_RESOLVE_CUSTOM */
+
+/* Public function definitions ************************************************/
+
+BaseType_t xDnsCacheInit( const char * pcHostname )
+{
+    BaseType_t xRet = pdPASS;
+
+    if( pcHostname == NULL )
+    {
+        ESP_LOGE( TAG, "Passed in host name is null." );
+        xRet = pdFAIL;
+    }
+
+    #if CONFIG_LWIP_HOOK_NETCONN_EXT_RESOLVE_CUSTOM
+        if( ( xRet == pdPASS ) && ( xResolveMutex == NULL ) )
+        {
+            xResolveMutex = xSemaphoreCreateMutex();
+
+            if( xResolveMutex == NULL )
+            {
+                ESP_LOGE( TAG, "No memory to allocate DNS resolve mutex." );
+                xRet = pdFAIL;
+            }
+        }
+
+        /* Created last, as the resolve hook is enabled by xCacheMutex. */
+        if( ( xRet == pdPASS ) && ( xCacheMutex == NULL ) )
+        {
+            xCacheMutex = xSemaphoreCreateMutex();
+
+            if( xCacheMutex == NULL )
+            {
+                ESP_LOGE( TAG, "No memory to allocate DNS cache mutex." );
+                xRet = pdFAIL;
+            }
+        }
+
+        if( xRet == pdPASS )
+        {
+            xSemaphoreTake( xCacheMutex, portMAX_DELAY );
+
+            memset( &xCacheEntry, 0x00, sizeof( xCacheEntry ) );
+            xCacheEntry.pcHostname = pcHostname;
+
+            #if dnscacheconfigPERSIST_TO_NVS
+                prvLoadFromNvs();
+            #endif /* dnscacheconfigPERSIST_TO_NVS */
+
+            xSemaphoreGive( xCacheMutex );
+        }
+    #else
+        ESP_LOGW( TAG, "DNS cache disabled. Enable CONFIG_LWIP_HOOK_NETCONN_EXT_RESOLVE_CUSTOM to use it." );
+    #endif /* CONFIG_LWIP_HOOK_NETCONN_EXT_RESOLVE_CUSTOM */
+
+    return xRet;
+}
+
+void vDnsCacheInvalidate( void )
+{
+    if( xCacheMutex != NULL )
+    {
+        xSemaphoreTake( xCacheMutex, portMAX_DELAY );
+        xCacheEntry.xFresh = false;
+        xSemaphoreGive( xCacheMutex );
+    }
+}
+
+void vDnsCacheGetStats( DnsCacheStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    if( xCacheMutex != NULL )
+    {
+        xSemaphoreTake( xCacheMutex, portMAX_DELAY );
+        *pxStats = xCacheStats;
+        xSemaphoreGive( xCacheMutex );
+    }
+    else
+    {
+        memset( pxStats, 0x00, sizeof( *pxStats ) );
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2023 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file dns_cache.h
+ * @brief Resolver cache for the MQTT broker endpoint.
+ *
+ * The cache is plugged into lwIP through the external resolve hook
+ * (CONFIG_LWIP_HOOK_NETCONN_EXT_RESOLVE_CUSTOM), so every getaddrinfo() made
+ * by esp-tls while connecting to the broker is served from the cache when the
+ * entry is fresh, and falls back to the last known good address when the
+ * upstream DNS server fails.
+ */
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include <freertos/FreeRTOS.h>
+
+/**
+ * @brief Counters describing how resolutions of the cached host were served.
+ */
+typedef struct DnsCacheStats
+{
+    uint32_t ulHits;      /**< Served from a fresh cache entry. */
+    uint32_t ulMisses;    /**< Entry absent or expired; upstream DNS was queried. */
+    uint32_t ulFallbacks; /**< Upstream DNS failed; last known good address was used. */
+    uint32_t ulFailures;  /**< Upstream DNS failed and no address was known. */
+} DnsCacheStats_t;
+
+/**
+ * @brief Initialize the resolver cache for a single host name.
+ *
+ * Only resolutions of @p pcHostname are cached; all other names are passed
+ * through to lwIP unchanged. If NVS persistence is enabled, the last known
+ * good address of the host is loaded so it can be used as a fallback on the
+ * first connection after boot. NVS must have been initialized beforehand.
+ *
+ * @param[in] pcHostname Host name to cache. Must stay in scope forever.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xDnsCacheInit( const char * pcHostname );
+
+/**
+ * @brief Mark the cached entry as expired so the next resolution queries the
+ * upstream DNS server. The last known good address is kept as a fallback.
+ */
+void vDnsCacheInvalidate( void );
+
+/**
+ * @brief Copy the resolver cache counters.
+ *
+ * @param[out] pxStats Where to copy the counters.
+ */
+void vDnsCacheGetStats( DnsCacheStats_t * pxStats );
+
+#endif /* DNS_CACHE_H */
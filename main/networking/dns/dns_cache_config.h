@@ -0,0 +1,49 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2023 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef DNS_CACHE_CONFIG_H
+#define DNS_CACHE_CONFIG_H
+
+/* ESP-IDF sdkconfig include. */
+#include <sdkconfig.h>
+
+/**
+ * @brief Time in seconds for which a resolved address is served from the
+ * cache without querying the upstream DNS server.
+ *
+ * @note lwIP does not expose the TTL of the DNS record through its resolver
+ * API, so this acts as an upper bound. lwIP's own DNS table still honors the
+ * record TTL underneath.
+ */
+#define dnscacheconfigTTL_SECONDS        ( CONFIG_GRI_DNS_CACHE_TTL_SECONDS )
+
+/**
+ * @brief Whether the last known good address is persisted to NVS so it can be
+ * used as a fallback after a reboot.
+ */
+#define dnscacheconfigPERSIST_TO_NVS     ( CONFIG_GRI_DNS_CACHE_PERSIST_TO_NVS )
+
+#endif /* DNS_CACHE_CONFIG_H */
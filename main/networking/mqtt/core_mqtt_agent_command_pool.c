@@ -0,0 +1,373 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file core_mqtt_agent_command_pool.c
+ * @brief Lock-free pool of coreMQTT-Agent commands with per-caller quotas.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include <freertos/semphr.h>
+
+/* Public functions include. */
+#include "core_mqtt_agent_command_pool.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/* Tasks that can be registered as a caller class. */
+#define COMMAND_POOL_MAX_REGISTERED_TASKS    ( 8 )
+
+#define COMMAND_POOL_ALL_FREE                                                   \
+    ( ( configMQTT_AGENT_COMMAND_POOL_SIZE == 32 ) ? UINT32_MAX :               \
+      ( ( 1UL << ( configMQTT_AGENT_COMMAND_POOL_SIZE % 32 ) ) - 1UL ) )
+
+#if ( configMQTT_AGENT_COMMAND_POOL_SIZE < 1 ) || ( configMQTT_AGENT_COMMAND_POOL_SIZE > 32 )
+    #error "configMQTT_AGENT_COMMAND_POOL_SIZE must be between 1 and 32."
+#endif
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Commands of the pool.
+ */
+static MQTTAgentCommand_t xCommands[ configMQTT_AGENT_COMMAND_POOL_SIZE ];
+
+/**
+ * @brief Caller class each command was taken by.
+ */
+static uint8_t ucCommandCallers[ configMQTT_AGENT_COMMAND_POOL_SIZE ];
+
+/**
+ * @brief One bit per command, set while the command is free.
+ */
+static uint32_t ulFreeMask;
+
+/**
+ * @brief Most commands each caller class may hold at once.
+ */
+static const uint32_t ulQuotas[ eMQTTAgentCommandPoolCallerCount ] =
+{
+    [ eMQTTAgentCommandPoolCallerDefault ]   = configMQTT_AGENT_COMMAND_POOL_SIZE,
+    [ eMQTTAgentCommandPoolCallerOta ]       = configMQTT_AGENT_COMMAND_POOL_OTA_QUOTA,
+    [ eMQTTAgentCommandPoolCallerTelemetry ] = configMQTT_AGENT_COMMAND_POOL_TELEMETRY_QUOTA
+};
+
+/**
+ * @brief Tasks registered as a caller class. A slot is in use once its task
+ * handle is set, which is done last.
+ */
+static TaskHandle_t xRegisteredTasks[ COMMAND_POOL_MAX_REGISTERED_TASKS ];
+static uint8_t ucRegisteredCallers[ COMMAND_POOL_MAX_REGISTERED_TASKS ];
+static uint32_t ulRegisteredCount;
+
+/**
+ * @brief Given on release while callers of the class wait for a command.
+ * Each class has its own, so a waiter that is woken but still over its quota
+ * cannot swallow the wakeup meant for a waiter of another class.
+ */
+static SemaphoreHandle_t xCommandReleased[ eMQTTAgentCommandPoolCallerCount ];
+static StaticSemaphore_t xCommandReleasedStructures[ eMQTTAgentCommandPoolCallerCount ];
+static uint32_t ulWaiters[ eMQTTAgentCommandPoolCallerCount ];
+
+/**
+ * @brief Counters, updated with atomic operations.
+ */
+static MQTTAgentCommandPoolStats_t xStats;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Caller class of the calling task.
+ *
+ * @return Registered class of the task, or eMQTTAgentCommandPoolCallerDefault.
+ */
+static MQTTAgentCommandPoolCaller_t prvGetCaller( void );
+
+/**
+ * @brief Take a free command without waiting.
+ *
+ * @param[in] eCaller Class of the caller, whose quota applies.
+ *
+ * @return A command, or NULL if the quota is used up or no command is free.
+ */
+static MQTTAgentCommand_t * prvTryTake( MQTTAgentCommandPoolCaller_t eCaller );
+
+/**
+ * @brief Atomically raise a high-water mark.
+ *
+ * @param[in, out] pulHighWater High-water mark to raise.
+ * @param[in] ulValue New value.
+ */
+static void prvRaise( uint32_t * pulHighWater,
+                      uint32_t ulValue );
+
+/* Static function definitions ************************************************/
+
+static MQTTAgentCommandPoolCaller_t prvGetCaller( void )
+{
+    MQTTAgentCommandPoolCaller_t eCaller = eMQTTAgentCommandPoolCallerDefault;
+    TaskHandle_t xTask = xTaskGetCurrentTaskHandle();
+    int i;
+
+    for( i = 0; i < COMMAND_POOL_MAX_REGISTERED_TASKS; i++ )
+    {
+        if( __atomic_load_n( &( xRegisteredTasks[ i ] ), __ATOMIC_ACQUIRE ) == xTask )
+        {
+            eCaller = ( MQTTAgentCommandPoolCaller_t ) ucRegisteredCallers[ i ];
+            break;
+        }
+    }
+
+    return eCaller;
+}
+
+static void prvRaise( uint32_t * pulHighWater,
+                      uint32_t ulValue )
+{
+    uint32_t ulCurrent = __atomic_load_n( pulHighWater, __ATOMIC_RELAXED );
+
+    while( ( ulValue > ulCurrent ) &&
+           !__atomic_compare_exchange_n( pulHighWater, &ulCurrent, ulValue, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+    {
+    }
+}
+
+static MQTTAgentCommand_t * prvTryTake( MQTTAgentCommandPoolCaller_t eCaller )
+{
+    MQTTAgentCommand_t * pxCommand = NULL;
+    uint32_t ulInUse = __atomic_load_n( &( xStats.ulInUse[ eCaller ] ), __ATOMIC_RELAXED );
+    uint32_t ulMask;
+    uint32_t ulIndex = 0;
+    bool xQuotaClaimed = false;
+    bool xClaimed = false;
+
+    /* Claim a unit of the caller's quota first, so concurrent callers of the
+     * same class cannot overshoot it. */
+    while( ( ulInUse < ulQuotas[ eCaller ] ) && !xQuotaClaimed )
+    {
+        xQuotaClaimed = __atomic_compare_exchange_n( &( xStats.ulInUse[ eCaller ] ), &ulInUse, ulInUse + 1U,
+                                                     true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED );
+    }
+
+    if( xQuotaClaimed )
+    {
+        ulMask = __atomic_load_n( &ulFreeMask, __ATOMIC_ACQUIRE );
+
+        while( ( ulMask != 0U ) && !xClaimed )
+        {
+            ulIndex = ( uint32_t ) __builtin_ctz( ulMask );
+            xClaimed = __atomic_compare_exchange_n( &ulFreeMask, &ulMask, ulMask & ~( 1UL << ulIndex ),
+                                                    true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE );
+        }
+
+        if( xClaimed )
+        {
+            ucCommandCallers[ ulIndex ] = ( uint8_t ) eCaller;
+            pxCommand = &( xCommands[ ulIndex ] );
+            memset( pxCommand, 0x00, sizeof( *pxCommand ) );
+            prvRaise( &( xStats.ulHighWater[ eCaller ] ), ulInUse + 1U );
+        }
+        else
+        {
+            ( void ) __atomic_fetch_sub( &( xStats.ulInUse[ eCaller ] ), 1U, __ATOMIC_RELEASE );
+        }
+    }
+
+    return pxCommand;
+}
+
+/* Public function definitions ************************************************/
+
+BaseType_t xMQTTAgentCommandPoolInit( void )
+{
+    BaseType_t xRet = pdPASS;
+    int i;
+
+    memset( &xStats, 0x00, sizeof( xStats ) );
+    __atomic_store_n( &ulFreeMask, COMMAND_POOL_ALL_FREE, __ATOMIC_RELEASE );
+
+    for( i = 0; i < eMQTTAgentCommandPoolCallerCount; i++ )
+    {
+        xCommandReleased[ i ] = xSemaphoreCreateCountingStatic( configMQTT_AGENT_COMMAND_POOL_SIZE,
+                                                                0,
+                                                                &( xCommandReleasedStructures[ i ] ) );
+
+        if( xCommandReleased[ i ] == NULL )
+        {
+            xRet = pdFAIL;
+        }
+    }
+
+    return xRet;
+}
+
+BaseType_t xMQTTAgentCommandPoolRegisterTask( TaskHandle_t xTask,
+                                              MQTTAgentCommandPoolCaller_t eCaller )
+{
+    BaseType_t xRet = pdPASS;
+    uint32_t ulSlot;
+
+    configASSERT( eCaller < eMQTTAgentCommandPoolCallerCount );
+
+    ulSlot = __atomic_fetch_add( &ulRegisteredCount, 1U, __ATOMIC_RELAXED );
+
+    if( ulSlot >= COMMAND_POOL_MAX_REGISTERED_TASKS )
+    {
+        xRet = pdFAIL;
+    }
+    else
+    {
+        ucRegisteredCallers[ ulSlot ] = ( uint8_t ) eCaller;
+        __atomic_store_n( &( xRegisteredTasks[ ulSlot ] ),
+                          ( xTask != NULL ) ? xTask : xTaskGetCurrentTaskHandle(),
+                          __ATOMIC_RELEASE );
+    }
+
+    return xRet;
+}
+
+MQTTAgentCommand_t * Agent_PoolGetCommand( uint32_t blockTimeMs )
+{
+    MQTTAgentCommandPoolCaller_t eCaller = prvGetCaller();
+    MQTTAgentCommand_t * pxCommand = prvTryTake( eCaller );
+    TickType_t xWaitTicks = pdMS_TO_TICKS( blockTimeMs );
+    TickType_t xStartTick;
+    TickType_t xElapsed;
+    uint32_t ulWaitMs;
+
+    if( ( pxCommand == NULL ) && ( xWaitTicks > 0U ) )
+    {
+        xStartTick = xTaskGetTickCount();
+
+        while( ( pxCommand == NULL ) && ( ( xElapsed = xTaskGetTickCount() - xStartTick ) < xWaitTicks ) )
+        {
+            /* Announce the wait before trying again, so a command released
+             * after the attempt always gives the semaphore. */
+            ( void ) __atomic_fetch_add( &( ulWaiters[ eCaller ] ), 1U, __ATOMIC_ACQ_REL );
+            pxCommand = prvTryTake( eCaller );
+
+            if( pxCommand == NULL )
+            {
+                ( void ) xSemaphoreTake( xCommandReleased[ eCaller ], xWaitTicks - xElapsed );
+                pxCommand = prvTryTake( eCaller );
+            }
+
+            ( void ) __atomic_fetch_sub( &( ulWaiters[ eCaller ] ), 1U, __ATOMIC_ACQ_REL );
+        }
+
+        ulWaitMs = ( uint32_t ) ( ( xTaskGetTickCount() - xStartTick ) * portTICK_PERIOD_MS );
+        ( void ) __atomic_fetch_add( &( xStats.ulWaits[ eCaller ] ), 1U, __ATOMIC_RELAXED );
+        ( void ) __atomic_fetch_add( &( xStats.ulTotalWaitMs[ eCaller ] ), ulWaitMs, __ATOMIC_RELAXED );
+        prvRaise( &( xStats.ulMaxWaitMs[ eCaller ] ), ulWaitMs );
+    }
+
+    if( pxCommand == NULL )
+    {
+        ( void ) __atomic_fetch_add( &( xStats.ulExhausted[ eCaller ] ), 1U, __ATOMIC_RELAXED );
+    }
+    else
+    {
+        ( void ) __atomic_fetch_add( &( xStats.ulTaken[ eCaller ] ), 1U, __ATOMIC_RELAXED );
+    }
+
+    return pxCommand;
+}
+
+bool Agent_PoolReleaseCommand( MQTTAgentCommand_t * pCommandToRelease )
+{
+    uint32_t ulIndex = ulMQTTAgentCommandPoolGetIndex( pCommandToRelease );
+    uint8_t ucCaller;
+    bool xReleased = false;
+    int i;
+
+    if( ulIndex < configMQTT_AGENT_COMMAND_POOL_SIZE )
+    {
+        ucCaller = ucCommandCallers[ ulIndex ];
+
+        ( void ) __atomic_fetch_or( &ulFreeMask, 1UL << ulIndex, __ATOMIC_RELEASE );
+        ( void ) __atomic_fetch_sub( &( xStats.ulInUse[ ucCaller ] ), 1U, __ATOMIC_RELEASE );
+
+        /* The command may be taken by any class, and the release may also
+         * bring its own class back under quota, so wake every class that
+         * waits. Those that lose the race wait again. */
+        for( i = 0; i < eMQTTAgentCommandPoolCallerCount; i++ )
+        {
+            if( __atomic_load_n( &( ulWaiters[ i ] ), __ATOMIC_ACQUIRE ) > 0U )
+            {
+                ( void ) xSemaphoreGive( xCommandReleased[ i ] );
+            }
+        }
+
+        xReleased = true;
+    }
+
+    return xReleased;
+}
+
+bool xMQTTAgentCommandPoolHasCapacity( void )
+{
+    MQTTAgentCommandPoolCaller_t eCaller = prvGetCaller();
+
+    return ( __atomic_load_n( &ulFreeMask, __ATOMIC_RELAXED ) != 0U ) &&
+           ( __atomic_load_n( &( xStats.ulInUse[ eCaller ] ), __ATOMIC_RELAXED ) < ulQuotas[ eCaller ] );
+}
+
+uint32_t ulMQTTAgentCommandPoolGetIndex( const MQTTAgentCommand_t * pxCommand )
+{
+    uint32_t ulIndex = configMQTT_AGENT_COMMAND_POOL_SIZE;
+
+    if( ( pxCommand >= &( xCommands[ 0 ] ) ) &&
+        ( pxCommand < &( xCommands[ configMQTT_AGENT_COMMAND_POOL_SIZE ] ) ) )
+    {
+        ulIndex = ( uint32_t ) ( pxCommand - xCommands );
+    }
+
+    return ulIndex;
+}
+
+void vMQTTAgentCommandPoolGetStats( MQTTAgentCommandPoolStats_t * pxStats )
+{
+    int i;
+
+    configASSERT( pxStats != NULL );
+
+    for( i = 0; i < eMQTTAgentCommandPoolCallerCount; i++ )
+    {
+        pxStats->ulInUse[ i ] = __atomic_load_n( &( xStats.ulInUse[ i ] ), __ATOMIC_RELAXED );
+        pxStats->ulHighWater[ i ] = __atomic_load_n( &( xStats.ulHighWater[ i ] ), __ATOMIC_RELAXED );
+        pxStats->ulTaken[ i ] = __atomic_load_n( &( xStats.ulTaken[ i ] ), __ATOMIC_RELAXED );
+        pxStats->ulExhausted[ i ] = __atomic_load_n( &( xStats.ulExhausted[ i ] ), __ATOMIC_RELAXED );
+        pxStats->ulWaits[ i ] = __atomic_load_n( &( xStats.ulWaits[ i ] ), __ATOMIC_RELAXED );
+        pxStats->ulTotalWaitMs[ i ] = __atomic_load_n( &( xStats.ulTotalWaitMs[ i ] ), __ATOMIC_RELAXED );
+        pxStats->ulMaxWaitMs[ i ] = __atomic_load_n( &( xStats.ulMaxWaitMs[ i ] ), __ATOMIC_RELAXED );
+    }
+}
@@ -0,0 +1,154 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file core_mqtt_agent_command_pool.h
+ * @brief Lock-free pool of coreMQTT-Agent commands with per-caller quotas.
+ *
+ * Replaces the command pool of the coreMQTT-Agent port
+ * (freertos_command_pool.c). Free commands are tracked in a bitmap claimed
+ * with compare-and-swap, so taking and returning a command never blocks on a
+ * lock; a semaphore per caller class is only used to wake callers waiting for a
+ * command while the pool is exhausted or their quota is used up.
+ *
+ * Tasks can be registered as a caller class, each class being limited to a
+ * quota of the pool, so a burst from one class, such as OTA, cannot take every
+ * command and starve another, such as telemetry.
+ */
+#ifndef CORE_MQTT_AGENT_COMMAND_POOL_H
+#define CORE_MQTT_AGENT_COMMAND_POOL_H
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/* coreMQTT-Agent library include. */
+#include "core_mqtt_agent.h"
+
+/* Configurations include. */
+#include "core_mqtt_agent_manager_config.h"
+
+/**
+ * @brief Classes of tasks taking commands from the pool.
+ */
+typedef enum MQTTAgentCommandPoolCaller
+{
+    eMQTTAgentCommandPoolCallerDefault = 0, /**< Unregistered tasks; limited by the pool size only. */
+    eMQTTAgentCommandPoolCallerOta,         /**< Limited to configMQTT_AGENT_COMMAND_POOL_OTA_QUOTA. */
+    eMQTTAgentCommandPoolCallerTelemetry,   /**< Limited to configMQTT_AGENT_COMMAND_POOL_TELEMETRY_QUOTA. */
+
+    eMQTTAgentCommandPoolCallerCount
+} MQTTAgentCommandPoolCaller_t;
+
+/**
+ * @brief Counters of a caller class.
+ */
+typedef struct MQTTAgentCommandPoolStats
+{
+    uint32_t ulInUse[ eMQTTAgentCommandPoolCallerCount ];       /**< Commands currently taken. */
+    uint32_t ulHighWater[ eMQTTAgentCommandPoolCallerCount ];   /**< Largest value ulInUse reached. */
+    uint32_t ulTaken[ eMQTTAgentCommandPoolCallerCount ];       /**< Commands taken. */
+    uint32_t ulExhausted[ eMQTTAgentCommandPoolCallerCount ];   /**< Requests failed for lack of a command or quota. */
+    uint32_t ulWaits[ eMQTTAgentCommandPoolCallerCount ];       /**< Requests that had to wait for a command. */
+    uint32_t ulTotalWaitMs[ eMQTTAgentCommandPoolCallerCount ]; /**< Sum of the waits, for averaging. */
+    uint32_t ulMaxWaitMs[ eMQTTAgentCommandPoolCallerCount ];   /**< Longest wait. */
+} MQTTAgentCommandPoolStats_t;
+
+/**
+ * @brief Initialize the command pool. Must be called once, before any other
+ * function of the pool.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xMQTTAgentCommandPoolInit( void );
+
+/**
+ * @brief Register a task as belonging to a caller class. Registrations are
+ * expected at task start-up, and are kept for the life of the application.
+ *
+ * @param[in] xTask Task to register, or NULL for the calling task.
+ * @param[in] eCaller Class of the task.
+ *
+ * @return pdPASS if successful, pdFAIL if the registry is full.
+ */
+BaseType_t xMQTTAgentCommandPoolRegisterTask( TaskHandle_t xTask,
+                                              MQTTAgentCommandPoolCaller_t eCaller );
+
+/**
+ * @brief Take a command from the pool, within the quota of the calling task.
+ *
+ * Matches the MQTTAgentCommandGet_t prototype.
+ *
+ * @param[in] blockTimeMs Time to wait for a command if none is available.
+ *
+ * @return A command, or NULL if none became available in time.
+ */
+MQTTAgentCommand_t * Agent_PoolGetCommand( uint32_t blockTimeMs );
+
+/**
+ * @brief Return a command to the pool.
+ *
+ * Matches the MQTTAgentCommandRelease_t prototype.
+ *
+ * @param[in] pCommandToRelease Command taken with Agent_PoolGetCommand().
+ *
+ * @return true if the command was returned, false if it is not from the pool.
+ */
+bool Agent_PoolReleaseCommand( MQTTAgentCommand_t * pCommandToRelease );
+
+/**
+ * @brief Check, without blocking, whether the calling task could take a
+ * command now, given its quota.
+ *
+ * @return true if a command is free within the quota of the calling task.
+ */
+bool xMQTTAgentCommandPoolHasCapacity( void );
+
+/**
+ * @brief Index of a command in the pool, for callers keeping data alongside
+ * each command.
+ *
+ * @param[in] pxCommand Command of the pool.
+ *
+ * @return Index below configMQTT_AGENT_COMMAND_POOL_SIZE, or
+ * configMQTT_AGENT_COMMAND_POOL_SIZE if the command is not from the pool.
+ */
+uint32_t ulMQTTAgentCommandPoolGetIndex( const MQTTAgentCommand_t * pxCommand );
+
+/**
+ * @brief Copy the counters of the pool. Lock free; each counter is read
+ * atomically, but counters are not a consistent snapshot of one another.
+ *
+ * @param[out] pxStats Where to copy the counters.
+ */
+void vMQTTAgentCommandPoolGetStats( MQTTAgentCommandPoolStats_t * pxStats );
+
+#endif /* CORE_MQTT_AGENT_COMMAND_POOL_H */
@@ -0,0 +1,345 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file core_mqtt_agent_command_queue.c
+ * @brief Priority-aware implementation of the coreMQTT-Agent message interface.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <string.h>
+
+/* coreMQTT library include. */
+#include "core_mqtt.h"
+
+/* Public functions include. */
+#include "core_mqtt_agent_command_queue.h"
+
+/* Preprocessor definitions ***************************************************/
+
+#define AGING_TICKS    pdMS_TO_TICKS( configMQTT_AGENT_COMMAND_AGING_MS )
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Protects the counters of all message contexts, which are updated
+ * from every task that sends a command.
+ */
+static portMUX_TYPE xStatsLock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Check whether a publish topic matches one of
+ * configMQTT_AGENT_CONTROL_TOPIC_FILTERS.
+ *
+ * @param[in] pxPublishInfo Publish to check.
+ *
+ * @return true if the topic matches a control topic filter.
+ */
+static bool prvIsControlTopic( const MQTTPublishInfo_t * pxPublishInfo );
+
+/**
+ * @brief Select the priority class to receive the next command from.
+ *
+ * The highest non-empty class is selected, unless a command has waited for
+ * longer than configMQTT_AGENT_COMMAND_AGING_MS, in which case the class of
+ * the oldest such command is selected.
+ *
+ * @param[in] pxMsgCtx Message context holding at least one command.
+ * @param[out] pxAged Set to true if the class was selected due to aging.
+ *
+ * @return Index of the selected class, or eMQTTAgentCommandPriorityCount if
+ * every class is empty.
+ */
+static MQTTAgentCommandPriority_t prvSelectPriority( MQTTAgentMessageContext_t * pxMsgCtx,
+                                                     bool * pxAged );
+
+/* Static function definitions ************************************************/
+
+static bool prvIsControlTopic( const MQTTPublishInfo_t * pxPublishInfo )
+{
+    const char * pcFilter = configMQTT_AGENT_CONTROL_TOPIC_FILTERS;
+    const char * pcEnd;
+    bool xMatch = false;
+
+    while( ( xMatch == false ) && ( *pcFilter != '\0' ) )
+    {
+        pcEnd = strchr( pcFilter, ';' );
+
+        if( pcEnd == NULL )
+        {
+            pcEnd = pcFilter + strlen( pcFilter );
+        }
+
+        if( pcEnd > pcFilter )
+        {
+            ( void ) MQTT_MatchTopic( pxPublishInfo->pTopicName,
+                                      pxPublishInfo->topicNameLength,
+                                      pcFilter,
+                                      ( uint16_t ) ( pcEnd - pcFilter ),
+                                      &xMatch );
+        }
+
+        pcFilter = ( *pcEnd == ';' ) ? ( pcEnd + 1 ) : pcEnd;
+    }
+
+    return xMatch;
+}
+
+static MQTTAgentCommandPriority_t prvSelectPriority( MQTTAgentMessageContext_t * pxMsgCtx,
+                                                     bool * pxAged )
+{
+    MQTTAgentCommandPriority_t eHighest = eMQTTAgentCommandPriorityCount;
+    MQTTAgentCommandPriority_t eOldestAged = eMQTTAgentCommandPriorityCount;
+    TickType_t xOldestAge = 0;
+    TickType_t xNow = xTaskGetTickCount();
+    MQTTAgentQueuedCommand_t xHead;
+    int i;
+
+    for( i = 0; i < eMQTTAgentCommandPriorityCount; i++ )
+    {
+        if( xQueuePeek( pxMsgCtx->xQueues[ i ], &xHead, 0 ) == pdTRUE )
+        {
+            TickType_t xAge = xNow - xHead.xEnqueueTick;
+
+            if( eHighest == eMQTTAgentCommandPriorityCount )
+            {
+                eHighest = ( MQTTAgentCommandPriority_t ) i;
+            }
+
+            if( ( xAge >= AGING_TICKS ) && ( xAge > xOldestAge ) )
+            {
+                eOldestAged = ( MQTTAgentCommandPriority_t ) i;
+                xOldestAge = xAge;
+            }
+        }
+    }
+
+    *pxAged = ( eOldestAged != eMQTTAgentCommandPriorityCount ) && ( eOldestAged != eHighest );
+
+    return *pxAged ? eOldestAged : eHighest;
+}
+
+/* Public function definitions ************************************************/
+
+BaseType_t xMQTTAgentCommandQueueInit( MQTTAgentMessageContext_t * pxMsgCtx )
+{
+    BaseType_t xRet = pdPASS;
+    int i;
+
+    configASSERT( pxMsgCtx != NULL );
+
+    memset( &( pxMsgCtx->xStats ), 0x00, sizeof( pxMsgCtx->xStats ) );
+    pxMsgCtx->xPollHook = NULL;
+    pxMsgCtx->pvPollHookContext = NULL;
+
+    for( i = 0; ( i < eMQTTAgentCommandPriorityCount ) && ( xRet != pdFAIL ); i++ )
+    {
+        pxMsgCtx->xQueues[ i ] = xQueueCreateStatic( configMQTT_AGENT_COMMAND_QUEUE_LENGTH,
+                                                     sizeof( MQTTAgentQueuedCommand_t ),
+                                                     pxMsgCtx->ucQueueStorage[ i ],
+                                                     &( pxMsgCtx->xQueueStructures[ i ] ) );
+
+        if( pxMsgCtx->xQueues[ i ] == NULL )
+        {
+            xRet = pdFAIL;
+        }
+    }
+
+    if( xRet != pdFAIL )
+    {
+        pxMsgCtx->xCommandsAvailable = xSemaphoreCreateCountingStatic( eMQTTAgentCommandPriorityCount * configMQTT_AGENT_COMMAND_QUEUE_LENGTH,
+                                                                       0,
+                                                                       &( pxMsgCtx->xCommandsAvailableStructure ) );
+
+        if( pxMsgCtx->xCommandsAvailable == NULL )
+        {
+            xRet = pdFAIL;
+        }
+    }
+
+    return xRet;
+}
+
+MQTTAgentCommandPriority_t eMQTTAgentCommandQueueGetPriority( const MQTTAgentCommand_t * pxCommand )
+{
+    MQTTAgentCommandPriority_t ePriority;
+
+    switch( pxCommand->commandType )
+    {
+        case PUBLISH:
+            ePriority = prvIsControlTopic( ( const MQTTPublishInfo_t * ) pxCommand->pArgs ) ?
+                        eMQTTAgentCommandPriorityNormal : eMQTTAgentCommandPriorityBulk;
+            break;
+
+        case DISCONNECT:
+        case TERMINATE:
+            ePriority = eMQTTAgentCommandPriorityBulk;
+            break;
+
+        default:
+            ePriority = eMQTTAgentCommandPriorityControl;
+            break;
+    }
+
+    return ePriority;
+}
+
+bool Agent_PriorityMessageSend( MQTTAgentMessageContext_t * pxMsgCtx,
+                                MQTTAgentCommand_t * const * pxCommandToSend,
+                                uint32_t blockTimeMs )
+{
+    BaseType_t xQueueStatus = pdFAIL;
+    MQTTAgentQueuedCommand_t xQueued;
+    MQTTAgentCommandPriority_t ePriority;
+
+    if( ( pxMsgCtx != NULL ) && ( pxCommandToSend != NULL ) && ( *pxCommandToSend != NULL ) )
+    {
+        ePriority = eMQTTAgentCommandQueueGetPriority( *pxCommandToSend );
+
+        xQueued.pxCommand = *pxCommandToSend;
+        xQueued.xEnqueueTick = xTaskGetTickCount();
+
+        xQueueStatus = xQueueSendToBack( pxMsgCtx->xQueues[ ePriority ],
+                                         &xQueued,
+                                         pdMS_TO_TICKS( blockTimeMs ) );
+
+        taskENTER_CRITICAL( &xStatsLock );
+
+        if( xQueueStatus == pdPASS )
+        {
+            pxMsgCtx->xStats.ulSent[ ePriority ]++;
+            pxMsgCtx->xStats.ulDepth++;
+
+            if( pxMsgCtx->xStats.ulDepth > pxMsgCtx->xStats.ulDepthHighWater )
+            {
+                pxMsgCtx->xStats.ulDepthHighWater = pxMsgCtx->xStats.ulDepth;
+            }
+        }
+        else
+        {
+            pxMsgCtx->xStats.ulDropped[ ePriority ]++;
+        }
+
+        taskEXIT_CRITICAL( &xStatsLock );
+
+        /* Counted before the agent task can receive the command, so the
+         * depth never goes below zero. */
+        if( xQueueStatus == pdPASS )
+        {
+            ( void ) xSemaphoreGive( pxMsgCtx->xCommandsAvailable );
+        }
+    }
+
+    return ( xQueueStatus == pdPASS ) ? true : false;
+}
+
+bool xMQTTAgentCommandQueueHasSpace( MQTTAgentMessageContext_t * pxMsgCtx,
+                                     MQTTAgentCommandPriority_t ePriority )
+{
+    configASSERT( pxMsgCtx != NULL );
+    configASSERT( ePriority < eMQTTAgentCommandPriorityCount );
+
+    return uxQueueSpacesAvailable( pxMsgCtx->xQueues[ ePriority ] ) > 0U;
+}
+
+bool Agent_PriorityMessageReceive( MQTTAgentMessageContext_t * pxMsgCtx,
+                                   MQTTAgentCommand_t ** pReceivedCommand,
+                                   uint32_t blockTimeMs )
+{
+    BaseType_t xQueueStatus = pdFAIL;
+    MQTTAgentQueuedCommand_t xQueued;
+    MQTTAgentCommandPriority_t ePriority;
+    bool xAged = false;
+    uint32_t ulWaitMs;
+
+    if( ( pxMsgCtx != NULL ) && ( pxMsgCtx->xPollHook != NULL ) )
+    {
+        pxMsgCtx->xPollHook( pxMsgCtx->pvPollHookContext,
+                             ( uxSemaphoreGetCount( pxMsgCtx->xCommandsAvailable ) == 0 ) );
+    }
+
+    if( ( pxMsgCtx != NULL ) && ( pReceivedCommand != NULL ) &&
+        ( xSemaphoreTake( pxMsgCtx->xCommandsAvailable, pdMS_TO_TICKS( blockTimeMs ) ) == pdTRUE ) )
+    {
+        /* Every given count matches a queued command, and only the agent task
+         * receives, so the selected class cannot be empty. */
+        ePriority = prvSelectPriority( pxMsgCtx, &xAged );
+        configASSERT( ePriority != eMQTTAgentCommandPriorityCount );
+
+        xQueueStatus = xQueueReceive( pxMsgCtx->xQueues[ ePriority ], &xQueued, 0 );
+
+        if( xQueueStatus == pdPASS )
+        {
+            *pReceivedCommand = xQueued.pxCommand;
+            ulWaitMs = ( uint32_t ) ( ( xTaskGetTickCount() - xQueued.xEnqueueTick ) * portTICK_PERIOD_MS );
+
+            taskENTER_CRITICAL( &xStatsLock );
+
+            pxMsgCtx->xStats.ulTotalWaitMs[ ePriority ] += ulWaitMs;
+            pxMsgCtx->xStats.ulDepth--;
+
+            if( ulWaitMs > pxMsgCtx->xStats.ulMaxWaitMs[ ePriority ] )
+            {
+                pxMsgCtx->xStats.ulMaxWaitMs[ ePriority ] = ulWaitMs;
+            }
+
+            if( xAged )
+            {
+                pxMsgCtx->xStats.ulAged[ ePriority ]++;
+            }
+
+            taskEXIT_CRITICAL( &xStatsLock );
+        }
+    }
+
+    return ( xQueueStatus == pdPASS ) ? true : false;
+}
+
+void vMQTTAgentCommandQueueSetPollHook( MQTTAgentMessageContext_t * pxMsgCtx,
+                                        MQTTAgentCommandQueuePollHook_t xPollHook,
+                                        void * pvContext )
+{
+    configASSERT( pxMsgCtx != NULL );
+
+    pxMsgCtx->pvPollHookContext = pvContext;
+    pxMsgCtx->xPollHook = xPollHook;
+}
+
+void vMQTTAgentCommandQueueGetStats( MQTTAgentMessageContext_t * pxMsgCtx,
+                                     MQTTAgentCommandQueueStats_t * pxStats )
+{
+    configASSERT( pxMsgCtx != NULL );
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL( &xStatsLock );
+    *pxStats = pxMsgCtx->xStats;
+    taskEXIT_CRITICAL( &xStatsLock );
+}
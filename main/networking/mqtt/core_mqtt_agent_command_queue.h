@@ -0,0 +1,216 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file core_mqtt_agent_command_queue.h
+ * @brief Priority-aware implementation of the coreMQTT-Agent message interface.
+ *
+ * Commands are sorted into priority classes, each served FIFO from its own
+ * queue. The agent task always receives from the highest non-empty class,
+ * unless the oldest command of a lower class has waited longer than the aging
+ * threshold, in which case that command is served first so a steady stream of
+ * higher priority commands cannot starve it.
+ *
+ * This replaces the FreeRTOS queue based message interface of the
+ * coreMQTT-Agent port (freertos_agent_message.c), and so defines
+ * struct MQTTAgentMessageContext itself. The two must not be included in the
+ * same translation unit.
+ */
+#ifndef CORE_MQTT_AGENT_COMMAND_QUEUE_H
+#define CORE_MQTT_AGENT_COMMAND_QUEUE_H
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+/* coreMQTT-Agent library include. */
+#include "core_mqtt_agent.h"
+
+/* Configurations include. */
+#include "core_mqtt_agent_manager_config.h"
+
+/**
+ * @brief Priority classes of coreMQTT-Agent commands, highest first.
+ */
+typedef enum MQTTAgentCommandPriority
+{
+    /**
+     * @brief Keep-alive, receive processing, subscribes and unsubscribes.
+     */
+    eMQTTAgentCommandPriorityControl = 0,
+
+    /**
+     * @brief Publishes to topics matching configMQTT_AGENT_CONTROL_TOPIC_FILTERS,
+     * such as OTA job updates.
+     */
+    eMQTTAgentCommandPriorityNormal,
+
+    /**
+     * @brief Every other publish, and disconnects so they are sent after the
+     * publishes queued before them.
+     */
+    eMQTTAgentCommandPriorityBulk,
+
+    eMQTTAgentCommandPriorityCount
+} MQTTAgentCommandPriority_t;
+
+/**
+ * @brief A command waiting in a priority class queue.
+ */
+typedef struct MQTTAgentQueuedCommand
+{
+    MQTTAgentCommand_t * pxCommand; /**< Command to hand to the agent. */
+    TickType_t xEnqueueTick;        /**< When the command was queued, for aging and latency. */
+} MQTTAgentQueuedCommand_t;
+
+/**
+ * @brief Counters describing the traffic of a priority class.
+ */
+typedef struct MQTTAgentCommandQueueStats
+{
+    uint32_t ulSent[ eMQTTAgentCommandPriorityCount ];        /**< Commands queued. */
+    uint32_t ulDropped[ eMQTTAgentCommandPriorityCount ];     /**< Commands rejected as the class queue was full. */
+    uint32_t ulAged[ eMQTTAgentCommandPriorityCount ];        /**< Commands served ahead of a higher class due to aging. */
+    uint32_t ulMaxWaitMs[ eMQTTAgentCommandPriorityCount ];   /**< Longest time a command waited in the queue. */
+    uint32_t ulTotalWaitMs[ eMQTTAgentCommandPriorityCount ]; /**< Sum of the time commands waited, for averaging. */
+    uint32_t ulDepth;                                         /**< Commands currently queued in all classes. */
+    uint32_t ulDepthHighWater;                                /**< Largest value ulDepth reached. */
+} MQTTAgentCommandQueueStats_t;
+
+/**
+ * @brief Function called by the agent task each time it receives a command.
+ *
+ * @param[in] pvContext Context given to vMQTTAgentCommandQueueSetPollHook().
+ * @param[in] xIdle true if no command is queued, so the agent task is about
+ * to block.
+ */
+typedef void ( * MQTTAgentCommandQueuePollHook_t )( void * pvContext,
+                                                    bool xIdle );
+
+/**
+ * @brief Message context used by the coreMQTT-Agent to pass commands to the
+ * agent task. Must be initialized with xMQTTAgentCommandQueueInit().
+ */
+struct MQTTAgentMessageContext
+{
+    QueueHandle_t xQueues[ eMQTTAgentCommandPriorityCount ];
+    StaticQueue_t xQueueStructures[ eMQTTAgentCommandPriorityCount ];
+    uint8_t ucQueueStorage[ eMQTTAgentCommandPriorityCount ][ configMQTT_AGENT_COMMAND_QUEUE_LENGTH * sizeof( MQTTAgentQueuedCommand_t ) ];
+    SemaphoreHandle_t xCommandsAvailable;
+    StaticSemaphore_t xCommandsAvailableStructure;
+    MQTTAgentCommandQueueStats_t xStats;
+    MQTTAgentCommandQueuePollHook_t xPollHook;
+    void * pvPollHookContext;
+};
+
+/**
+ * @brief Create the priority class queues of a message context.
+ *
+ * @param[in] pxMsgCtx Message context to initialize.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xMQTTAgentCommandQueueInit( MQTTAgentMessageContext_t * pxMsgCtx );
+
+/**
+ * @brief Priority class a command is queued with.
+ *
+ * @param[in] pxCommand Command to classify.
+ *
+ * @return Priority class of the command.
+ */
+MQTTAgentCommandPriority_t eMQTTAgentCommandQueueGetPriority( const MQTTAgentCommand_t * pxCommand );
+
+/**
+ * @brief Queue a command in the queue of its priority class.
+ *
+ * Matches the MQTTAgentMessageSend_t prototype.
+ *
+ * @param[in] pxMsgCtx Message context to queue the command in.
+ * @param[in] pxCommandToSend Pointer to the command to queue.
+ * @param[in] blockTimeMs Time to wait for space in the class queue.
+ *
+ * @return true if the command was queued, false otherwise.
+ */
+bool Agent_PriorityMessageSend( MQTTAgentMessageContext_t * pxMsgCtx,
+                                MQTTAgentCommand_t * const * pxCommandToSend,
+                                uint32_t blockTimeMs );
+
+/**
+ * @brief Check, without blocking, whether the queue of a priority class has
+ * space for a command.
+ *
+ * @param[in] pxMsgCtx Message context to check.
+ * @param[in] ePriority Priority class to check.
+ *
+ * @return true if a command of the class can be queued now.
+ */
+bool xMQTTAgentCommandQueueHasSpace( MQTTAgentMessageContext_t * pxMsgCtx,
+                                     MQTTAgentCommandPriority_t ePriority );
+
+/**
+ * @brief Receive the next command to process.
+ *
+ * Matches the MQTTAgentMessageRecv_t prototype. Must only be called from the
+ * agent task.
+ *
+ * @param[in] pxMsgCtx Message context to receive from.
+ * @param[out] pReceivedCommand Where to write the received command pointer.
+ * @param[in] blockTimeMs Time to wait for a command.
+ *
+ * @return true if a command was received, false otherwise.
+ */
+bool Agent_PriorityMessageReceive( MQTTAgentMessageContext_t * pxMsgCtx,
+                                   MQTTAgentCommand_t ** pReceivedCommand,
+                                   uint32_t blockTimeMs );
+
+/**
+ * @brief Set the function called by the agent task each time it receives a
+ * command, for example to flush output gathered while commands were queued.
+ *
+ * @param[in] pxMsgCtx Message context.
+ * @param[in] xPollHook Function to call, or NULL.
+ * @param[in] pvContext Context passed to xPollHook.
+ */
+void vMQTTAgentCommandQueueSetPollHook( MQTTAgentMessageContext_t * pxMsgCtx,
+                                        MQTTAgentCommandQueuePollHook_t xPollHook,
+                                        void * pvContext );
+
+/**
+ * @brief Copy the counters of a message context.
+ *
+ * @param[in] pxMsgCtx Message context to read.
+ * @param[out] pxStats Where to copy the counters.
+ */
+void vMQTTAgentCommandQueueGetStats( MQTTAgentMessageContext_t * pxMsgCtx,
+                                     MQTTAgentCommandQueueStats_t * pxStats );
+
+#endif /* CORE_MQTT_AGENT_COMMAND_QUEUE_H */
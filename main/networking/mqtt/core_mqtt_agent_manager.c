@@ -27,6 +27,7 @@
 /* Includes *******************************************************************/
 
 /* Standard includes. */
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -46,17 +47,32 @@
 #include <esp_wifi.h>
 #include <esp_wifi_types.h>
 #include <esp_netif_types.h>
-
-/* Backoff algorithm library include. */
-#include "backoff_algorithm.h"
+#include <esp_random.h>
 
 /* coreMQTT-Agent library include. */
 #include "core_mqtt_agent.h"
 
 /* coreMQTT-Agent port include. */
 #include "esp_tls.h"
-#include "freertos_agent_message.h"
-#include "freertos_command_pool.h"
+#include "core_mqtt_agent_command_pool.h"
+#include "core_mqtt_agent_command_queue.h"
+
+/* Publish pool include. */
+#include "core_mqtt_agent_publish_pool.h"
+
+/* Corked transport include. */
+#if configMQTT_AGENT_CORKED_TRANSPORT
+    #include "corked_transport.h"
+#endif /* configMQTT_AGENT_CORKED_TRANSPORT */
+
+/* Reconnect policy include. */
+#include "reconnect_policy.h"
+
+/* Keep-alive manager include. */
+#include "keep_alive_manager.h"
+
+/* Resubscribe engine include. */
+#include "resubscribe_engine.h"
 
 /* coreMQTT-Agent manager events include. */
 #include "core_mqtt_agent_manager_events.h"
@@ -64,9 +80,17 @@
 /* Subscription manager include. */
 #include "subscription_manager.h"
 
+/* Subscription dispatcher include. */
+#if configMQTT_AGENT_QUEUED_DISPATCH
+    #include "subscription_dispatcher.h"
+#endif /* configMQTT_AGENT_QUEUED_DISPATCH */
+
 /* Network transport include. */
 #include "network_transport.h"
 
+/* MQTT endpoint resolver cache include. */
+#include "dns_cache.h"
+
 /* Public functions include. */
 #include "core_mqtt_agent_manager.h"
 
@@ -85,6 +109,8 @@
 #define WIFI_DISCONNECTED_BIT               ( 1 << 1 )
 #define CORE_MQTT_AGENT_CONNECTED_BIT       ( 1 << 2 )
 #define CORE_MQTT_AGENT_DISCONNECTED_BIT    ( 1 << 3 )
+#define RECONNECT_NOW_BIT                   ( 1 << 4 )
+#define PUBLISH_CREDIT_BIT                  ( 1 << 5 )
 
 /* Timing definitions */
 #define MILLISECONDS_PER_SECOND             ( 1000U )
@@ -94,6 +120,60 @@
 
 #define MUTEX_IS_OWNED( xHandle )    ( xTaskGetCurrentTaskHandle() == xSemaphoreGetMutexHolder( xHandle ) )
 
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief State of one TLS + MQTT connection to the broker, served by its own
+ * coreMQTT-Agent task and connection handling task.
+ */
+typedef struct CoreMqttAgentConnection
+{
+    const char * pcName;                                   /**< Name used in logs and task names. */
+    const char * pcClientIdSuffix;                         /**< Appended to the client identifier. */
+    MQTTAgentContext_t * pxAgentContext;                   /**< coreMQTT-Agent context of the connection. */
+    SubscriptionList_t * pxSubscriptionList;               /**< Subscriptions made over the connection. */
+    uint8_t * pucNetworkBuffer;                            /**< Buffer used to serialize MQTT packets. */
+    size_t xNetworkBufferSize;                             /**< Size of pucNetworkBuffer. */
+    bool xPostEvents;                                      /**< Post CORE_MQTT_AGENT_* events on state change. */
+    bool xCleanSession;                                    /**< Whether the next connect starts a clean session. */
+    NetworkContext_t * pxNetworkContext;                   /**< TLS connection and credentials. */
+    EventGroupHandle_t xNetworkEventGroup;                 /**< Network state bits of the connection. */
+    MQTTAgentMessageContext_t xCommandQueue;               /**< Priority queues delivering commands to the agent task. */
+    char cClientId[ 80 ];                                  /**< Client identifier including the suffix. */
+    ResubscribeEngine_t xResubscribe;                      /**< Restores the subscriptions when the broker lost the session. */
+    bool xResubscribing;                                   /**< The resubscribe engine has filters left to restore. */
+    uint32_t ulRetainedFilters;                            /**< Filters of the resubscribe engine retained in the subscription list. */
+    bool xReady;                                           /**< The link was signalled ready after the critical subscriptions were restored. */
+    MQTTAgentSubscribeArgs_t xResubscribeArgs;             /**< Must stay in scope until the resubscribe packet completes. */
+    MQTTAgentCommandInfo_t xResubscribeCommandParams;
+    uint32_t ulRxHighWater;                                /**< Largest incoming packet, in bytes. */
+    KeepAliveManager_t xKeepAlive;                         /**< Adapts the ping interval, estimates the RTT. */
+    CoreMqttAgentStats_t xStats;                           /**< Counters; averages and gauges are filled in when read. */
+    uint32_t ulCommandTotalMs;                             /**< Sum of command latencies, for averaging. */
+    uint32_t ulPubackTotalMs;                              /**< Sum of PUBACK latencies, for averaging. */
+    TickType_t xConnectedTick;                             /**< When the current connection was established. */
+    uint32_t ulPublishBytesInFlight;                       /**< Topic and payload bytes of publishes queued and not completed. */
+    bool xCreditWanted;                                    /**< A producer was refused credit and waits for PUBLISH_CREDIT_BIT. */
+    #if configMQTT_AGENT_CORKED_TRANSPORT
+        CorkedTransport_t xCorkedTransport;                /**< Gathers outgoing packets into fewer TLS records. */
+    #endif /* configMQTT_AGENT_CORKED_TRANSPORT */
+    #if configMQTT_AGENT_OTA_NETWORK_BUFFER
+        volatile bool xLargeBufferWanted;                  /**< Whether an OTA job is active on the connection. */
+        uint8_t * pucLargeNetworkBuffer;                   /**< Heap buffer in use while an OTA job is active. */
+    #endif /* configMQTT_AGENT_OTA_NETWORK_BUFFER */
+} CoreMqttAgentConnection_t;
+
+/**
+ * @brief A command queued to an agent task, timed until it is released.
+ */
+typedef struct CommandStamp
+{
+    CoreMqttAgentConnection_t * pxConnection; /**< Connection the command was queued to, NULL if not queued. */
+    TickType_t xSendTick;                     /**< When the command was queued. */
+    bool xAwaitsPuback;                       /**< QoS 1 publish, completed by its PUBACK. */
+    uint32_t ulPublishBytes;                  /**< Topic and payload bytes of a publish, 0 for other commands. */
+} CommandStamp_t;
+
 /* Global variables ***********************************************************/
 
 /**
@@ -110,14 +190,42 @@ static const char * TAG = "core_mqtt_agent_manager";
 static uint32_t ulGlobalEntryTimeMs;
 
 /**
- * @brief Network buffer for coreMQTT.
+ * @brief Protects the counters of all connections, which are updated from
+ * every task queuing commands. Readers do not take it.
  */
-static uint8_t ucNetworkBuffer[ configMQTT_AGENT_NETWORK_BUFFER_SIZE ];
+static portMUX_TYPE xStatsLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Commands in flight, indexed like the commands of the pool.
+ */
+static CommandStamp_t xCommandStamps[ configMQTT_AGENT_COMMAND_POOL_SIZE ];
+
+/**
+ * @brief Reconnect backoff curves, indexed by ReconnectFailure_t.
+ */
+static const ReconnectCurve_t xReconnectCurves[ eReconnectFailureCount ] =
+{
+    [ eReconnectFailureDns ]     = { configRETRY_BACKOFF_BASE_MS,         configRETRY_MAX_BACKOFF_DELAY_MS         },
+    [ eReconnectFailureTcp ]     = { configRETRY_BACKOFF_BASE_MS,         configRETRY_MAX_BACKOFF_DELAY_MS         },
+    [ eReconnectFailureTls ]     = { configRETRY_TLS_BACKOFF_BASE_MS,     configRETRY_TLS_MAX_BACKOFF_DELAY_MS     },
+    [ eReconnectFailureConnack ] = { configRETRY_CONNACK_BACKOFF_BASE_MS, configRETRY_CONNACK_MAX_BACKOFF_DELAY_MS }
+};
+
+/**
+ * @brief Limits of the resubscribe engines.
+ */
+static const ResubscribeConfig_t xResubscribeConfig =
+{
+    .ulMaxPacketSize = configMQTT_AGENT_RESUBSCRIBE_MAX_PACKET_SIZE,
+    .ulMaxAttempts   = configMQTT_AGENT_RESUBSCRIBE_MAX_ATTEMPTS,
+    .ulBackoffBaseMs = configMQTT_AGENT_RESUBSCRIBE_BACKOFF_BASE_MS,
+    .ulBackoffMaxMs  = configMQTT_AGENT_RESUBSCRIBE_MAX_BACKOFF_DELAY_MS
+};
 
 /**
- * @brief Message queue used to deliver commands to the agent task.
+ * @brief Network buffer for the control connection.
  */
-static MQTTAgentMessageContext_t xCommandQueue;
+static uint8_t ucNetworkBuffer[ configMQTT_AGENT_NETWORK_BUFFER_SIZE ];
 
 /**
  * @brief Global MQTT Agent context used by every task.
@@ -125,30 +233,79 @@ static MQTTAgentMessageContext_t xCommandQueue;
 MQTTAgentContext_t xGlobalMqttAgentContext;
 
 /**
- * @brief The global array of subscription elements.
+ * @brief The global list of subscriptions.
  *
- * @note No thread safety is required to this array, since updates to the array
- * elements are done only from the MQTT agent task. The subscription manager
- * implementation expects that the array of the subscription elements used for
- * storing subscriptions to be initialized to 0. As this is a global array, it
- * will be initialized to 0 by default.
+ * @note Incoming publishes are dispatched from the list without a lock, while
+ * any task may add or remove subscriptions. The subscription manager
+ * implementation expects the list used for storing subscriptions to be
+ * initialized to 0. As this is a global variable, it will be initialized to 0
+ * by default.
  */
-SubscriptionElement_t xGlobalSubscriptionList[ SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ];
+SubscriptionList_t xGlobalSubscriptionList;
 
 /**
- * @brief Lock to handle multi-tasks accessing xSubInfo in prvHandleResubscribe.
+ * @brief Lock of the state restoring the subscriptions, which is started by
+ * the connection task and advanced by the coreMQTT-Agent task. Dispatching
+ * incoming publishes does not take it.
  */
 SemaphoreHandle_t xSubListMutex;
 
 /**
- * @brief Pointer to the network context passed in.
+ * @brief State of the control connection, which carries every topic not
+ * routed to the bulk connection.
+ */
+static CoreMqttAgentConnection_t xControlConnection =
+{
+    .pcName             = "control",
+    .pcClientIdSuffix   = "",
+    .pxAgentContext     = &xGlobalMqttAgentContext,
+    .pxSubscriptionList = &xGlobalSubscriptionList,
+    .pucNetworkBuffer   = ucNetworkBuffer,
+    .xNetworkBufferSize = configMQTT_AGENT_NETWORK_BUFFER_SIZE,
+    .xPostEvents        = true,
+    .xCleanSession      = !configMQTT_AGENT_PERSISTENT_SESSION
+};
+
+#if configMQTT_AGENT_DUAL_CONNECTION
+
+/**
+ * @brief Network buffer for the bulk connection.
+ */
+    static uint8_t ucBulkNetworkBuffer[ configMQTT_AGENT_BULK_NETWORK_BUFFER_SIZE ];
+
+/**
+ * @brief MQTT Agent context of the bulk connection.
+ */
+    static MQTTAgentContext_t xBulkMqttAgentContext;
+
+/**
+ * @brief Subscriptions made over the bulk connection.
  */
-static NetworkContext_t * pxNetworkContext;
+    static SubscriptionList_t xBulkSubscriptionList;
 
 /**
- * @brief The event group used to manage network events.
+ * @brief Network context of the bulk connection. Credentials are copied from
+ * the network context passed to xCoreMqttAgentManagerStart().
  */
-static EventGroupHandle_t xNetworkEventGroup;
+    static NetworkContext_t xBulkNetworkContext;
+
+/**
+ * @brief State of the bulk connection, which carries the topics matching
+ * configMQTT_AGENT_BULK_TOPIC_FILTERS.
+ */
+    static CoreMqttAgentConnection_t xBulkConnection =
+    {
+        .pcName             = "bulk",
+        .pcClientIdSuffix   = configMQTT_AGENT_BULK_CLIENT_ID_SUFFIX,
+        .pxAgentContext     = &xBulkMqttAgentContext,
+        .pxSubscriptionList = &xBulkSubscriptionList,
+        .pucNetworkBuffer   = ucBulkNetworkBuffer,
+        .xNetworkBufferSize = configMQTT_AGENT_BULK_NETWORK_BUFFER_SIZE,
+        .xPostEvents        = false,
+        .xCleanSession      = !configMQTT_AGENT_PERSISTENT_SESSION
+    };
+
+#endif /* configMQTT_AGENT_DUAL_CONNECTION */
 
 /* Static function declarations ***********************************************/
 
@@ -174,9 +331,9 @@ static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
 
 /**
  * @brief Passed into MQTTAgent_Subscribe() as the callback to execute when the
- * broker ACKs the SUBSCRIBE message. This callback implementation is used for
- * handling the completion of resubscribes. Any topic filter failed to resubscribe
- * will be removed from the subscription list.
+ * broker ACKs a SUBSCRIBE packet of the resubscribe engine. Refused filters
+ * are scheduled for a retry; filters given up are removed from the
+ * subscription list.
  *
  * See https://freertos.org/mqtt/mqtt-agent-demo.html#example_mqtt_api_call
  *
@@ -187,18 +344,40 @@ static void prvSubscriptionCommandCallback( MQTTAgentCommandContext_t * pxComman
                                             MQTTAgentReturnInfo_t * pxReturnInfo );
 
 /**
- * @brief Function to attempt to resubscribe to the topics already present in the
- * subscription list.
+ * @brief Start restoring the topic filters present in the subscription list.
  *
  * This function will be invoked when this demo requests the broker to
- * reestablish the session and the broker cannot do so. This function will
- * enqueue commands to the MQTT Agent queue and will be processed once the
- * command loop starts.
+ * reestablish the session and the broker cannot do so. The SUBSCRIBE packets
+ * are queued by the agent task once the command loop runs, see
+ * prvSendResubscribeBatch().
  *
- * @return `MQTTSuccess` if adding subscribes to the command queue succeeds, else
- * appropriate error code from MQTTAgent_Subscribe.
+ * @param[in] pxConnection Connection whose subscriptions are restored.
  */
-static MQTTStatus_t prvHandleResubscribe( void );
+static void prvHandleResubscribe( CoreMqttAgentConnection_t * pxConnection );
+
+/**
+ * @brief Release the topic filters the resubscribe engine retained in the
+ * subscription list.
+ *
+ * @param[in] pxConnection Connection whose subscriptions were restored.
+ */
+static void prvReleaseResubscribeFilters( CoreMqttAgentConnection_t * pxConnection );
+
+/**
+ * @brief Queue the next SUBSCRIBE packet of the resubscribe engine, if a
+ * filter is due and no packet is in flight. Called from the agent task.
+ *
+ * @param[in] pxConnection Connection whose subscriptions are restored.
+ */
+static void prvSendResubscribeBatch( CoreMqttAgentConnection_t * pxConnection );
+
+/**
+ * @brief Signal the link as ready to the application once per connection,
+ * by posting CORE_MQTT_AGENT_CONNECTED_EVENT if the connection posts events.
+ *
+ * @param[in] pxConnection Connection whose critical subscriptions are in place.
+ */
+static void prvSetLinkReady( CoreMqttAgentConnection_t * pxConnection );
 
 /**
  * @brief Task used to run the MQTT agent.
@@ -207,57 +386,96 @@ static MQTTStatus_t prvHandleResubscribe( void );
  * is called. If an error occurs in the command loop, then it will reconnect the
  * TCP and MQTT connections.
  *
- * @param[in] pvParameters Parameters as passed at the time of task creation. Not
- * used in this example.
+ * @param[in] pvParameters The CoreMqttAgentConnection_t served by the task.
  */
 static void prvMQTTAgentTask( void * pvParameters );
 
 /**
- * @brief This function starts the coreMQTT-Agent task.
+ * @brief This function starts the coreMQTT-Agent task and the connection
+ * handling task of a connection.
+ *
+ * @param[in] pxConnection Connection to start.
  *
- * @return pdPASS if task created successfully, pdFAIL otherwise.
+ * @return pdPASS if tasks created successfully, pdFAIL otherwise.
  */
-static BaseType_t prvStartCoreMqttAgent( void );
+static BaseType_t prvStartCoreMqttAgent( CoreMqttAgentConnection_t * pxConnection );
 
 /**
  * @brief Initializes an MQTT Agent context, including transport interface,
  * network buffer, and publish callback.
  *
+ * @param[in] pxConnection Connection whose agent context is initialized.
+ *
  * @return `MQTTSuccess` if the initialization succeeds, else `MQTTBadParameter`.
  */
-static MQTTStatus_t prvCoreMqttAgentInit( NetworkContext_t * pxNetworkContext );
+static MQTTStatus_t prvCoreMqttAgentInit( CoreMqttAgentConnection_t * pxConnection );
 
 /**
  * @brief Sends an MQTT Connect packet over the already connected TCP socket.
  *
- * @param[in] xCleanSession If a clean session should be established.
+ * @param[in] pxConnection Connection to send the CONNECT packet over.
  *
  * @return `MQTTSuccess` if connection succeeds, else appropriate error code
  * from MQTT_Connect.
  */
-static MQTTStatus_t prvCoreMqttAgentConnect( bool xCleanSession );
+static MQTTStatus_t prvCoreMqttAgentConnect( CoreMqttAgentConnection_t * pxConnection );
+
+/**
+ * @brief Update the network event group bits of a connection after it was
+ * established or lost, and post the matching coreMQTT-Agent event if the
+ * connection posts events. While critical subscriptions are being restored,
+ * the connected event is held back until they are, see prvSetLinkReady().
+ *
+ * @param[in] pxConnection Connection whose state changed.
+ * @param[in] xConnected Whether the connection is now established.
+ */
+static void prvSetConnectionState( CoreMqttAgentConnection_t * pxConnection,
+                                   bool xConnected );
+
+/**
+ * @brief Called by the agent task each time it is about to receive a command.
+ *
+ * @param[in] pvContext Connection of the agent task.
+ * @param[in] xIdle true if no command is queued.
+ */
+static void prvAgentPollHook( void * pvContext,
+                              bool xIdle );
+
+#if configMQTT_AGENT_CORKED_TRANSPORT
 
 /**
- * @brief Calculate and perform an exponential backoff with jitter delay for
- * the next retry attempt of a failed network operation with the server.
+ * @brief Wake hook of the corked transport. Queues an empty process loop
+ * command without blocking, so the agent task runs prvAgentPollHook() and
+ * writes the data that reached its flush deadline.
  *
- * The function generates a random number, calculates the next backoff period
- * with the generated random number, and performs the backoff delay operation if the
- * number of retries have not exhausted.
+ * @param[in] pvContext Connection of the agent task.
+ */
+    static void prvCorkDeadlineWake( void * pvContext );
+#endif /* configMQTT_AGENT_CORKED_TRANSPORT */
+
+/**
+ * @brief Wait before the next attempt to connect to the broker.
  *
- * @note The backoff period is calculated using the backoffAlgorithm library.
+ * The delay is computed by the reconnect policy from the class of the failure.
+ * The wait ends early when WiFi gets an IP address again, in which case the
+ * policy is reset, as the failures were most likely due to the link.
  *
- * @param[in, out] pxRetryAttempts The context to use for backoff period calculation
- * with the backoffAlgorithm library.
+ * @param[in] pxConnection Connection that failed to connect.
+ * @param[in, out] pxPolicy Reconnect policy of the connection.
+ * @param[in] eFailure Class of the failure.
  *
- * @return pdPASS if calculating the backoff period was successful; otherwise pdFAIL
- * if there was failure in random number generation OR all retry attempts had exhausted.
+ * @return pdPASS if the next attempt should be made now, pdFAIL if WiFi is
+ * disconnected and the attempt should wait for it.
  */
-static BaseType_t prvBackoffForRetry( BackoffAlgorithmContext_t * pxRetryParams );
+static BaseType_t prvBackoffForRetry( CoreMqttAgentConnection_t * pxConnection,
+                                      ReconnectPolicy_t * pxPolicy,
+                                      ReconnectFailure_t eFailure );
 
 /**
  * @brief The function that implements the task which handles
  * connecting/reconnecting a TLS and MQTT connection.
+ *
+ * @param[in] pvParameters The CoreMqttAgentConnection_t handled by the task.
  */
 static void prvCoreMqttAgentConnectionTask( void * pvParameters );
 
@@ -279,6 +497,123 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
                                           int32_t lEventId,
                                           void * pvEventData );
 
+/**
+ * @brief Prepare the event group, client identifier and coreMQTT-Agent context
+ * of a connection, and register it for WiFi and IP events.
+ *
+ * @param[in] pxConnection Connection to prepare.
+ * @param[in] pxNetworkContextIn Network context used by the connection.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+static BaseType_t prvInitializeConnection( CoreMqttAgentConnection_t * pxConnection,
+                                           NetworkContext_t * pxNetworkContextIn );
+
+/**
+ * @brief Get the connection served by an agent context.
+ *
+ * @param[in] pxAgentContext Agent context of the connection.
+ *
+ * @return The connection, or NULL if no connection uses pxAgentContext.
+ */
+static CoreMqttAgentConnection_t * prvGetConnection( MQTTAgentContext_t * pxAgentContext );
+
+/**
+ * @brief Get a connection by index.
+ *
+ * @param[in] ulConnection 0 for the control connection, 1 for the bulk
+ * connection.
+ *
+ * @return The connection, or NULL if there is no such connection.
+ */
+static CoreMqttAgentConnection_t * prvGetConnectionByIndex( uint32_t ulConnection );
+
+/**
+ * @brief Get the connection using a network context.
+ *
+ * @param[in] pxNetworkContext Network context of the connection.
+ *
+ * @return The connection, or NULL if no connection uses pxNetworkContext.
+ */
+static CoreMqttAgentConnection_t * prvGetConnectionByNetworkContext( const NetworkContext_t * pxNetworkContext );
+
+/**
+ * @brief Command release function given to the coreMQTT-Agent. Times the
+ * command from queuing to release, which follows its completion, then returns
+ * it to the command pool.
+ */
+static bool prvReleaseCommand( MQTTAgentCommand_t * pxCommandToRelease );
+
+/**
+ * @brief Message send function given to the coreMQTT-Agent. Stamps the
+ * command with its queuing time, then queues it in the priority queues.
+ */
+static bool prvMessageSend( MQTTAgentMessageContext_t * pxMsgCtx,
+                            MQTTAgentCommand_t * const * pxCommandToSend,
+                            uint32_t blockTimeMs );
+
+/**
+ * @brief Transport functions given to coreMQTT. They count the bytes and
+ * packets of the connection and forward to the TLS transport, through the
+ * corked transport if it is enabled.
+ */
+static int32_t prvTransportSend( NetworkContext_t * pxNetworkContext,
+                                 const void * pvBuffer,
+                                 size_t xBytesToSend );
+static int32_t prvTransportWritev( NetworkContext_t * pxNetworkContext,
+                                   TransportOutVector_t * pxIoVec,
+                                   size_t xIoVecCount );
+static int32_t prvTransportRecv( NetworkContext_t * pxNetworkContext,
+                                 void * pvBuffer,
+                                 size_t xBytesToRecv );
+
+/**
+ * @brief Record the size of an incoming publish packet in the receive
+ * high-water mark of its connection.
+ *
+ * coreMQTT serializes outgoing packets straight from the caller's buffers, so
+ * the network buffer only has to fit the largest incoming packet.
+ *
+ * @param[in] pxConnection Connection the publish was received on.
+ * @param[in] pxPublishInfo Info of incoming publish.
+ */
+static void prvUpdateRxHighWater( CoreMqttAgentConnection_t * pxConnection,
+                                  const MQTTPublishInfo_t * pxPublishInfo );
+
+#if configMQTT_AGENT_OTA_NETWORK_BUFFER
+
+/**
+ * @brief Request the connection carrying OTA file blocks to switch to, or back
+ * from, a large network buffer borrowed from the heap.
+ *
+ * @param[in] xOtaActive Whether an OTA job is active.
+ */
+    static void prvRequestOtaNetworkBuffer( bool xOtaActive );
+
+/**
+ * @brief Passed into MQTTAgent_ProcessLoop() to switch the network buffer of
+ * a connection from the agent task, which is the only task using it.
+ *
+ * @param[in] pxCommandContext Connection whose buffer is switched.
+ * @param[in] pxReturnInfo The result of the command.
+ */
+    static void prvSwitchNetworkBufferCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                                MQTTAgentReturnInfo_t * pxReturnInfo );
+#endif /* configMQTT_AGENT_OTA_NETWORK_BUFFER */
+
+/**
+ * @brief Check whether a topic matches a list of topic filters.
+ *
+ * @param[in] pcFilters ';'-separated list of topic filters.
+ * @param[in] pcTopic Topic name or filter.
+ * @param[in] usTopicLength Length of pcTopic.
+ *
+ * @return true if pcTopic is one of pcFilters, or matches one of them.
+ */
+static bool prvMatchesTopicFilters( const char * pcFilters,
+                                    const char * pcTopic,
+                                    uint16_t usTopicLength );
+
 /* Static function definitions ************************************************/
 
 static inline BaseType_t xLockSubList( void )
@@ -289,16 +624,9 @@ static inline BaseType_t xLockSubList( void )
 
     configASSERT( !MUTEX_IS_OWNED( xSubListMutex ) );
 
-    ESP_LOGD( TAG,
-              "Waiting for Mutex." );
     xResult = xSemaphoreTake( xSubListMutex, portMAX_DELAY );
 
-    if( xResult )
-    {
-        ESP_LOGD( TAG,
-                  ">>>> Mutex wait complete." );
-    }
-    else
+    if( xResult != pdTRUE )
     {
         ESP_LOGE( TAG,
                   "**** Mutex request failed, xResult=%d.", xResult );
@@ -319,12 +647,7 @@ static inline BaseType_t xUnlockSubList( void )
 
     xResult = xSemaphoreGive( xSubListMutex );
 
-    if( xResult )
-    {
-        ESP_LOGD( TAG,
-                  "<<<< Mutex Give." );
-    }
-    else
+    if( xResult != pdTRUE )
     {
         ESP_LOGE( TAG,
                   "**** Mutex Give request failed, xResult=%d.", xResult );
@@ -408,14 +731,24 @@ static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
                                         uint16_t packetId,
                                         MQTTPublishInfo_t * pxPublishInfo )
 {
+    CoreMqttAgentConnection_t * pxConnection = prvGetConnection( pMqttAgentContext );
     bool xPublishHandled = false;
     char cOriginalChar, * pcLocation;
 
     ( void ) packetId;
 
+    if( pxConnection != NULL )
+    {
+        prvUpdateRxHighWater( pxConnection, pxPublishInfo );
+
+        taskENTER_CRITICAL( &xStatsLock );
+        pxConnection->xStats.ulRxPublishes++;
+        taskEXIT_CRITICAL( &xStatsLock );
+    }
+
     /* Fan out the incoming publishes to the callbacks registered using
      * subscription manager. */
-    xPublishHandled = handleIncomingPublishes( ( SubscriptionElement_t * ) pMqttAgentContext->pIncomingCallbackContext,
+    xPublishHandled = handleIncomingPublishes( ( SubscriptionList_t * ) pMqttAgentContext->pIncomingCallbackContext,
                                                pxPublishInfo );
 
     #if CONFIG_GRI_ENABLE_OTA_DEMO
@@ -447,119 +780,243 @@ static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
 static void prvSubscriptionCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
                                             MQTTAgentReturnInfo_t * pxReturnInfo )
 {
-    size_t lIndex = 0;
-    MQTTAgentSubscribeArgs_t * pxSubscribeArgs = ( MQTTAgentSubscribeArgs_t * ) pxCommandContext;
+    CoreMqttAgentConnection_t * pxConnection = ( CoreMqttAgentConnection_t * ) pxCommandContext;
+    ResubscribeEngine_t * pxEngine = &( pxConnection->xResubscribe );
+    uint16_t usBatchCount = pxEngine->usBatchCount;
+    ResubscribeFilter_t * pxFilter;
+    uint32_t ulNowMs = prvGetTimeMs();
+    bool xStartup;
+    uint16_t i;
+
+    /* The SUBACK codes are missing if the packet could not be sent, or was
+     * lost with the connection, in which case every filter is retried. */
+    vResubscribeEngineOnBatchResult( pxEngine,
+                                     pxReturnInfo->pSubackCodes,
+                                     ulNowMs,
+                                     esp_random() );
 
     xLockSubList();
 
-    /* If the return code is success, no further action is required as all the topic filters
-     * are already part of the subscription list. */
-    if( pxReturnInfo->returnCode != MQTTSuccess )
+    /* The result only clears the batch count; its indexes are still there. */
+    for( i = 0U; i < usBatchCount; i++ )
     {
-        /* Check through each of the suback codes and determine if there are any failures. */
-        for( lIndex = 0; lIndex < pxSubscribeArgs->numSubscriptions; lIndex++ )
+        pxFilter = &( pxEngine->xFilters[ pxEngine->usBatchFilter[ i ] ] );
+
+        if( pxFilter->eState == eResubscribeFilterPending )
         {
-            /* This demo doesn't attempt to resubscribe in the event that a SUBACK failed. */
-            if( pxReturnInfo->pSubackCodes != NULL && pxReturnInfo->pSubackCodes[ lIndex ] == MQTTSubAckFailure )
-            {
-                ESP_LOGE( TAG,
-                          "Failed to resubscribe to topic %.*s.",
-                          pxSubscribeArgs->pSubscribeInfo[ lIndex ].topicFilterLength,
-                          pxSubscribeArgs->pSubscribeInfo[ lIndex ].pTopicFilter );
-                /* Remove subscription callback for unsubscribe. */
-                removeSubscription( xGlobalSubscriptionList,
-                                    pxSubscribeArgs->pSubscribeInfo[ lIndex ].pTopicFilter,
-                                    pxSubscribeArgs->pSubscribeInfo[ lIndex ].topicFilterLength );
-            }
+            ESP_LOGW( TAG,
+                      "Failed to resubscribe to topic %.*s (%s connection, attempt %"PRIu32"), retrying in %"PRIu32" ms.",
+                      pxFilter->usFilterLength,
+                      pxFilter->pcFilter,
+                      pxConnection->pcName,
+                      pxFilter->ulAttempts,
+                      pxFilter->ulRetryMs - ulNowMs );
+        }
+        else if( pxFilter->eState == eResubscribeFilterDropped )
+        {
+            ESP_LOGE( TAG,
+                      "Failed to resubscribe to topic %.*s after %"PRIu32" attempts, giving up.",
+                      pxFilter->usFilterLength,
+                      pxFilter->pcFilter,
+                      pxFilter->ulAttempts );
+            /* Remove subscription callback for unsubscribe. */
+            removeSubscription( pxConnection->pxSubscriptionList,
+                                pxFilter->pcFilter,
+                                pxFilter->usFilterLength );
         }
-
-        /* Hit an assert as some of the tasks won't be able to proceed correctly without
-         * the subscriptions. This logic will be updated with exponential backoff and retry.  */
-        configASSERT( pdTRUE );
     }
 
     xUnlockSubList();
+
+    if( pxConnection->xResubscribing && xResubscribeEngineCriticalDone( pxEngine ) )
+    {
+        prvSetLinkReady( pxConnection );
+    }
+
+    if( pxConnection->xResubscribing && xResubscribeEngineDone( pxEngine ) )
+    {
+        pxConnection->xResubscribing = false;
+        prvReleaseResubscribeFilters( pxConnection );
+
+        /* The engine is started right after the CONNACK. */
+        xStartup = ( pxConnection->xStats.ulConnects == 1U ) && ( pxConnection->xStats.ulStartupSubscribeMs == 0U );
+
+        taskENTER_CRITICAL( &xStatsLock );
+        pxConnection->xStats.ulResubscribeMs = ulNowMs - pxEngine->ulStartMs;
+        pxConnection->xStats.ulResubscribePackets += pxEngine->ulPackets;
+        pxConnection->xStats.ulResubscribeRetries += pxEngine->ulRetries;
+        pxConnection->xStats.ulResubscribeDropped += pxEngine->ulDropped;
+
+        if( xStartup )
+        {
+            /* 0 means not done yet. */
+            pxConnection->xStats.ulStartupSubscribeMs = ( ulNowMs > pxEngine->ulStartMs ) ? ( ulNowMs - pxEngine->ulStartMs ) : 1U;
+        }
+
+        taskEXIT_CRITICAL( &xStatsLock );
+
+        ESP_LOGI( TAG,
+                  "%s in %"PRIu32" ms after the CONNACK (%s connection): filters=%"PRIu32" packets=%"PRIu32" retries=%"PRIu32" dropped=%"PRIu32".",
+                  xStartup ? "Startup subscriptions made" : "Subscriptions restored",
+                  ulNowMs - pxEngine->ulStartMs,
+                  pxConnection->pcName,
+                  pxEngine->ulFilterCount,
+                  pxEngine->ulPackets,
+                  pxEngine->ulRetries,
+                  pxEngine->ulDropped );
+    }
 }
 
-static MQTTStatus_t prvHandleResubscribe( void )
+static void prvHandleResubscribe( CoreMqttAgentConnection_t * pxConnection )
 {
-    MQTTStatus_t xResult = MQTTBadParameter;
-    uint32_t ulIndex = 0U;
-    uint16_t usNumSubscriptions = 0U;
-
-    /* These variables need to stay in scope until command completes. */
-    static MQTTAgentSubscribeArgs_t xSubArgs = { 0 };
-    static MQTTSubscribeInfo_t xSubInfo[ SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ];
-    static MQTTAgentCommandInfo_t xCommandParams = { 0 };
+    uint32_t ulIndex = 0U, ulCount = 0U;
+    bool xCritical;
+    const SubscriptionElement_t * pxSubscriptionList;
+    ResubscribeEngine_t * pxEngine = &( pxConnection->xResubscribe );
 
     xLockSubList();
 
-    memset( &( xSubInfo[ 0 ] ), 0, SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS * sizeof( MQTTSubscribeInfo_t ) );
+    /* A previous run may have been cut short by the connection loss. */
+    prvReleaseResubscribeFilters( pxConnection );
+
+    pxSubscriptionList = acquireSubscriptions( pxConnection->pxSubscriptionList, &ulCount );
 
-    /* Loop through each subscription in the subscription list and add a subscribe
-     * command to the command queue. */
-    for( ulIndex = 0U; ulIndex < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS; ulIndex++ )
+    vResubscribeEngineStart( pxEngine, prvGetTimeMs() );
+
+    /* Loop through each subscription in the subscription list and add its
+     * filter to the engine, which subscribes each filter once. */
+    for( ulIndex = 0U; ulIndex < ulCount; ulIndex++ )
     {
-        /* Check if there is a subscription in the subscription list. This demo
-         * doesn't check for duplicate subscriptions. */
-        if( xGlobalSubscriptionList[ ulIndex ].usFilterStringLength != 0 )
+        /* Check if there is a subscription in the subscription list. */
+        if( pxSubscriptionList[ ulIndex ].usFilterStringLength != 0 )
         {
-            xSubInfo[ usNumSubscriptions ].pTopicFilter = xGlobalSubscriptionList[ ulIndex ].pcSubscriptionFilterString;
-            xSubInfo[ usNumSubscriptions ].topicFilterLength = xGlobalSubscriptionList[ ulIndex ].usFilterStringLength;
-
-            /* QoS1 is used for all the subscriptions in this demo. */
-            xSubInfo[ usNumSubscriptions ].qos = MQTTQoS1;
+            /* Every filter is critical unless critical filters are listed. */
+            xCritical = ( configMQTT_AGENT_CRITICAL_TOPIC_FILTERS[ 0 ] == '\0' ) ||
+                        prvMatchesTopicFilters( configMQTT_AGENT_CRITICAL_TOPIC_FILTERS,
+                                                pxSubscriptionList[ ulIndex ].pcSubscriptionFilterString,
+                                                pxSubscriptionList[ ulIndex ].usFilterStringLength );
 
             ESP_LOGI( TAG,
-                      "Resubscribe to the topic %.*s will be attempted.",
-                      xSubInfo[ usNumSubscriptions ].topicFilterLength,
-                      xSubInfo[ usNumSubscriptions ].pTopicFilter );
-
-            usNumSubscriptions++;
+                      "Resubscribe to the topic %.*s will be attempted%s.",
+                      pxSubscriptionList[ ulIndex ].usFilterStringLength,
+                      pxSubscriptionList[ ulIndex ].pcSubscriptionFilterString,
+                      xCritical ? " (critical)" : "" );
+
+            ( void ) xResubscribeEngineAddFilter( pxEngine,
+                                                  pxSubscriptionList[ ulIndex ].pcSubscriptionFilterString,
+                                                  pxSubscriptionList[ ulIndex ].usFilterStringLength,
+                                                  xCritical );
         }
     }
 
-    if( usNumSubscriptions > 0U )
+    /* The engine keeps pointers to the filters, which are retained until it
+     * is done, as they may be unsubscribed meanwhile. Callbacks sharing a
+     * filter share its copy, so each is retained once. */
+    for( ulIndex = 0U; ulIndex < pxEngine->ulFilterCount; ulIndex++ )
     {
-        xSubArgs.pSubscribeInfo = xSubInfo;
-        xSubArgs.numSubscriptions = usNumSubscriptions;
+        retainSubscriptionFilter( pxConnection->pxSubscriptionList, pxEngine->xFilters[ ulIndex ].pcFilter );
+    }
+
+    pxConnection->ulRetainedFilters = pxEngine->ulFilterCount;
+
+    releaseSubscriptions( pxConnection->pxSubscriptionList, pxSubscriptionList );
 
-        /* The block time can be 0 as the command loop is not running at this point. */
-        xCommandParams.blockTimeMs = 0U;
-        xCommandParams.cmdCompleteCallback = prvSubscriptionCommandCallback;
-        xCommandParams.pCmdCompleteCallbackContext = ( void * ) &xSubArgs;
+    /* The command loop is not running at this point, so the first packet is
+     * queued by the agent task once it is. */
+    pxConnection->xResubscribing = !xResubscribeEngineDone( pxEngine );
 
-        /* Enqueue subscribe to the command queue. These commands will be processed only
-         * when command loop starts. */
-        xResult = MQTTAgent_Subscribe( &xGlobalMqttAgentContext, &xSubArgs, &xCommandParams );
+    xUnlockSubList();
+}
+
+static void prvReleaseResubscribeFilters( CoreMqttAgentConnection_t * pxConnection )
+{
+    uint32_t ulIndex;
+
+    for( ulIndex = 0U; ulIndex < pxConnection->ulRetainedFilters; ulIndex++ )
+    {
+        releaseSubscriptionFilter( pxConnection->pxSubscriptionList,
+                                   pxConnection->xResubscribe.xFilters[ ulIndex ].pcFilter );
     }
-    else
+
+    pxConnection->ulRetainedFilters = 0U;
+}
+
+static void prvSendResubscribeBatch( CoreMqttAgentConnection_t * pxConnection )
+{
+    ResubscribeEngine_t * pxEngine = &( pxConnection->xResubscribe );
+    MQTTAgentSubscribeArgs_t * pxSubArgs = &( pxConnection->xResubscribeArgs );
+    MQTTAgentCommandInfo_t * pxCommandParams = &( pxConnection->xResubscribeCommandParams );
+    MQTTStatus_t xResult;
+    uint16_t usCount;
+
+    usCount = usResubscribeEngineNextBatch( pxEngine, prvGetTimeMs() );
+
+    if( usCount > 0U )
     {
-        /* Mark the resubscribe as success if there is nothing to be subscribed. */
-        xResult = MQTTSuccess;
+        pxSubArgs->pSubscribeInfo = pxEngine->xBatch;
+        pxSubArgs->numSubscriptions = usCount;
+
+        /* The agent task must not block on its own queue. */
+        pxCommandParams->blockTimeMs = 0U;
+        pxCommandParams->cmdCompleteCallback = prvSubscriptionCommandCallback;
+        pxCommandParams->pCmdCompleteCallbackContext = ( void * ) pxConnection;
+
+        xResult = MQTTAgent_Subscribe( pxConnection->pxAgentContext, pxSubArgs, pxCommandParams );
+
+        if( xResult != MQTTSuccess )
+        {
+            /* Out of commands or queue space; tried again on the next poll. */
+            ESP_LOGW( TAG,
+                      "Failed to enqueue the MQTT subscribe command. xResult=%s.",
+                      MQTT_Status_strerror( xResult ) );
+            vResubscribeEngineRequeueBatch( pxEngine );
+        }
+        else
+        {
+            ESP_LOGD( TAG,
+                      "Resubscribing to %u topic filters (%s connection).",
+                      ( unsigned int ) usCount,
+                      pxConnection->pcName );
+        }
     }
+}
 
-    if( xResult != MQTTSuccess )
+static void prvSetLinkReady( CoreMqttAgentConnection_t * pxConnection )
+{
+    bool xSignal = false;
+
+    taskENTER_CRITICAL( &xStatsLock );
+
+    if( pxConnection->xStats.xConnected && !pxConnection->xReady )
     {
-        ESP_LOGE( TAG,
-                  "Failed to enqueue the MQTT subscribe command. xResult=%s.",
-                  MQTT_Status_strerror( xResult ) );
+        pxConnection->xReady = true;
+        xSignal = true;
     }
 
-    xUnlockSubList();
+    taskEXIT_CRITICAL( &xStatsLock );
 
-    return xResult;
+    if( xSignal )
+    {
+        if( pxConnection->xPostEvents )
+        {
+            xCoreMqttAgentManagerPost( CORE_MQTT_AGENT_CONNECTED_EVENT );
+        }
+        else
+        {
+            ESP_LOGI( TAG, "coreMQTT-Agent %s connection connected.",
+                      pxConnection->pcName );
+        }
+    }
 }
 
 static void prvMQTTAgentTask( void * pvParameters )
 {
+    CoreMqttAgentConnection_t * pxConnection = ( CoreMqttAgentConnection_t * ) pvParameters;
     MQTTStatus_t xMQTTStatus = MQTTSuccess;
 
-    ( void ) pvParameters;
-
     do
     {
-        xEventGroupWaitBits( xNetworkEventGroup,
+        xEventGroupWaitBits( pxConnection->xNetworkEventGroup,
                              CORE_MQTT_AGENT_CONNECTED_BIT, pdFALSE, pdTRUE,
                              portMAX_DELAY );
 
@@ -568,34 +1025,39 @@ static void prvMQTTAgentTask( void * pvParameters )
          * which could be a disconnect.  If an error occurs the MQTT context on
          * which the error happened is returned so there can be an attempt to
          * clean up and reconnect however the application writer prefers. */
-        xMQTTStatus = MQTTAgent_CommandLoop( &xGlobalMqttAgentContext );
+        xMQTTStatus = MQTTAgent_CommandLoop( pxConnection->pxAgentContext );
 
         /* Success is returned for disconnect or termination. The socket should
          * be disconnected. */
         if( xMQTTStatus == MQTTSuccess )
         {
-            ESP_LOGI( TAG, "MQTT Disconnect from broker." );
+            ESP_LOGI( TAG, "MQTT Disconnect from broker (%s connection).", pxConnection->pcName );
         }
         /* Error. */
         else
         {
-            xEventGroupClearBits( xNetworkEventGroup,
-                                  CORE_MQTT_AGENT_CONNECTED_BIT );
-            xEventGroupSetBits( xNetworkEventGroup,
-                                CORE_MQTT_AGENT_DISCONNECTED_BIT );
-            xCoreMqttAgentManagerPost( CORE_MQTT_AGENT_DISCONNECTED_EVENT );
+            if( xMQTTStatus == MQTTKeepAliveTimeout )
+            {
+                /* Most likely a NAT mapping that expired while idle. */
+                vKeepAliveManagerOnTimeout( &( pxConnection->xKeepAlive ) );
+            }
+
+            prvSetConnectionState( pxConnection, false );
         }
     } while( xMQTTStatus != MQTTSuccess );
 }
 
-static BaseType_t prvStartCoreMqttAgent( void )
+static BaseType_t prvStartCoreMqttAgent( CoreMqttAgentConnection_t * pxConnection )
 {
     BaseType_t xRet = pdPASS;
+    char cTaskName[ configMAX_TASK_NAME_LEN ];
+
+    snprintf( cTaskName, sizeof( cTaskName ), "MQTTAgent-%s", pxConnection->pcName );
 
     if( xTaskCreate( prvMQTTAgentTask,
-                     "coreMQTT-Agent",
+                     cTaskName,
                      configMQTT_AGENT_TASK_STACK_SIZE,
-                     NULL,
+                     pxConnection,
                      configMQTT_AGENT_TASK_PRIORITY,
                      NULL ) != pdPASS )
     {
@@ -603,59 +1065,102 @@ static BaseType_t prvStartCoreMqttAgent( void )
         xRet = pdFAIL;
     }
 
+    if( xRet != pdFAIL )
+    {
+        snprintf( cTaskName, sizeof( cTaskName ), "MQTTConn-%s", pxConnection->pcName );
+
+        /* Start network establishing task. */
+        if( xTaskCreate( prvCoreMqttAgentConnectionTask,
+                         cTaskName,
+                         configCONNECTION_TASK_STACK_SIZE,
+                         pxConnection,
+                         configCONNECTION_TASK_PRIORITY,
+                         NULL ) != pdPASS )
+        {
+            ESP_LOGE( TAG, "Failed to create network management task." );
+            xRet = pdFAIL;
+        }
+    }
+
     return xRet;
 }
 
-static MQTTStatus_t prvCoreMqttAgentInit( NetworkContext_t * pxNetworkContext )
+static MQTTStatus_t prvCoreMqttAgentInit( CoreMqttAgentConnection_t * pxConnection )
 {
     TransportInterface_t xTransport = { 0 };
     MQTTStatus_t xReturn;
-    MQTTFixedBuffer_t xFixedBuffer = { .pBuffer = ucNetworkBuffer, .size = configMQTT_AGENT_NETWORK_BUFFER_SIZE };
-    static uint8_t staticQueueStorageArea[ configMQTT_AGENT_COMMAND_QUEUE_LENGTH * sizeof( MQTTAgentCommand_t * ) ];
-    static StaticQueue_t staticQueueStructure;
+    MQTTFixedBuffer_t xFixedBuffer = { .pBuffer = pxConnection->pucNetworkBuffer, .size = pxConnection->xNetworkBufferSize };
     MQTTAgentMessageInterface_t xMessageInterface =
     {
         .pMsgCtx        = NULL,
-        .send           = Agent_MessageSend,
-        .recv           = Agent_MessageReceive,
-        .getCommand     = Agent_GetCommand,
-        .releaseCommand = Agent_ReleaseCommand
+        .send           = prvMessageSend,
+        .recv           = Agent_PriorityMessageReceive,
+        .getCommand     = Agent_PoolGetCommand,
+        .releaseCommand = prvReleaseCommand
     };
 
-    ulGlobalEntryTimeMs = prvGetTimeMs();
-
-    xCommandQueue.queue = xQueueCreateStatic( configMQTT_AGENT_COMMAND_QUEUE_LENGTH,
-                                              sizeof( MQTTAgentCommand_t * ),
-                                              staticQueueStorageArea,
-                                              &staticQueueStructure );
-    configASSERT( xCommandQueue.queue );
-    xMessageInterface.pMsgCtx = &xCommandQueue;
-
-    /* Initialize the task pool. */
-    Agent_InitializePool();
-
-    /* Fill in Transport Interface send and receive function pointers. */
-    xTransport.pNetworkContext = pxNetworkContext;
-    xTransport.send = espTlsTransportSend;
-    xTransport.recv = espTlsTransportRecv;
+    if( xMQTTAgentCommandQueueInit( &( pxConnection->xCommandQueue ) ) != pdPASS )
+    {
+        ESP_LOGE( TAG, "Failed to create coreMQTT-Agent command queues." );
+        xReturn = MQTTNoMemory;
+    }
 
-    /* Initialize MQTT library. */
-    xReturn = MQTTAgent_Init( &xGlobalMqttAgentContext,
-                              &xMessageInterface,
-                              &xFixedBuffer,
-                              &xTransport,
-                              prvGetTimeMs,
-                              prvIncomingPublishCallback,
-                              xGlobalSubscriptionList );
+    #if configMQTT_AGENT_CORKED_TRANSPORT
+        else if( xCorkedTransportInit( &( pxConnection->xCorkedTransport ),
+                                       pxConnection->pxNetworkContext,
+                                       prvCorkDeadlineWake,
+                                       pxConnection ) != pdPASS )
+        {
+            ESP_LOGE( TAG, "Failed to initialize corked transport." );
+            xReturn = MQTTNoMemory;
+        }
+    #endif /* configMQTT_AGENT_CORKED_TRANSPORT */
+    else
+    {
+        xMessageInterface.pMsgCtx = &( pxConnection->xCommandQueue );
+
+        /* Fill in Transport Interface send and receive function pointers. */
+        xTransport.pNetworkContext = pxConnection->pxNetworkContext;
+        xTransport.recv = prvTransportRecv;
+        xTransport.send = prvTransportSend;
+        xTransport.writev = prvTransportWritev;
+
+        vKeepAliveManagerInit( &( pxConnection->xKeepAlive ),
+                               configMQTT_AGENT_KEEP_ALIVE_MIN_INTERVAL_SECONDS,
+                               configMQTT_AGENT_KEEP_ALIVE_INTERVAL_SECONDS );
+
+        vResubscribeEngineInit( &( pxConnection->xResubscribe ), &xResubscribeConfig );
+
+        vMQTTAgentCommandQueueSetPollHook( &( pxConnection->xCommandQueue ),
+                                           prvAgentPollHook,
+                                           pxConnection );
+
+        /* Initialize MQTT library. */
+        xReturn = MQTTAgent_Init( pxConnection->pxAgentContext,
+                                  &xMessageInterface,
+                                  &xFixedBuffer,
+                                  &xTransport,
+                                  prvGetTimeMs,
+                                  prvIncomingPublishCallback,
+                                  pxConnection->pxSubscriptionList );
+    }
 
     return xReturn;
 }
 
-static MQTTStatus_t prvCoreMqttAgentConnect( bool xCleanSession )
+static MQTTStatus_t prvCoreMqttAgentConnect( CoreMqttAgentConnection_t * pxConnection )
 {
     MQTTStatus_t xResult;
     MQTTConnectInfo_t xConnectInfo;
     bool xSessionPresent = false;
+    bool xCleanSession = pxConnection->xCleanSession;
+    uint32_t ulConnackTimeoutMs = configMQTT_AGENT_CONNACK_RECV_TIMEOUT_MS;
+
+    /* Give slow paths at least one retransmission timeout to answer. */
+    if( ulKeepAliveManagerGetTimeoutMs( &( pxConnection->xKeepAlive ) ) > ulConnackTimeoutMs )
+    {
+        ulConnackTimeoutMs = ulKeepAliveManagerGetTimeoutMs( &( pxConnection->xKeepAlive ) );
+    }
 
     /* Many fields are not used in this demo so start with everything at 0. */
     memset( &xConnectInfo, 0x00, sizeof( xConnectInfo ) );
@@ -668,9 +1173,11 @@ static MQTTStatus_t prvCoreMqttAgentConnect( bool xCleanSession )
 
     /* The client identifier is used to uniquely identify this MQTT client to
      * the MQTT broker. In a production device the identifier can be something
-     * unique, such as a device serial number. */
-    xConnectInfo.pClientIdentifier = prvGetClientId();
-    xConnectInfo.clientIdentifierLength = ( uint16_t ) strlen( prvGetClientId() );
+     * unique, such as a device serial number. Each connection appends its own
+     * suffix, as the broker drops a connection when another one uses the same
+     * client identifier. */
+    xConnectInfo.pClientIdentifier = pxConnection->cClientId;
+    xConnectInfo.clientIdentifierLength = ( uint16_t ) strlen( pxConnection->cClientId );
 
     /* Set MQTT keep-alive period. It is the responsibility of the application
      * to ensure that the interval between Control Packets being sent does not
@@ -681,88 +1188,286 @@ static MQTTStatus_t prvCoreMqttAgentConnect( bool xCleanSession )
 
     /* Send MQTT CONNECT packet to broker. MQTT's Last Will and Testament feature
      * is not used in this demo, so it is passed as NULL. */
-    xResult = MQTT_Connect( &( xGlobalMqttAgentContext.mqttContext ),
+    xResult = MQTT_Connect( &( pxConnection->pxAgentContext->mqttContext ),
                             &xConnectInfo,
                             NULL,
-                            configMQTT_AGENT_CONNACK_RECV_TIMEOUT_MS,
+                            ulConnackTimeoutMs,
                             &xSessionPresent );
 
+    if( xResult == MQTTSuccess )
+    {
+        /* The negotiated keep-alive is the upper bound of the ping interval. */
+        vKeepAliveManagerOnConnect( &( pxConnection->xKeepAlive ),
+                                    &( pxConnection->pxAgentContext->mqttContext ) );
+    }
+
 
     ESP_LOGI( TAG,
-              "Session present: %d\n",
+              "Session present (%s connection): %d\n",
+              pxConnection->pcName,
               xSessionPresent );
 
     /* Resume a session if desired. */
     if( ( xResult == MQTTSuccess ) && ( xCleanSession == false ) )
     {
-        xResult = MQTTAgent_ResumeSession( &xGlobalMqttAgentContext, xSessionPresent );
+        xResult = MQTTAgent_ResumeSession( pxConnection->pxAgentContext, xSessionPresent );
+    }
 
-        /* Resubscribe to all the subscribed topics. */
-        if( ( xResult == MQTTSuccess ) && ( xSessionPresent == false ) )
+    if( xResult == MQTTSuccess )
+    {
+        /* Subscribe to all the topics of the subscription list when the broker
+         * has no session, and on the first connection, which carries the
+         * startup subscriptions even if a session from before the reboot is
+         * present. */
+        if( ( xSessionPresent == false ) || ( pxConnection->xStats.ulConnects == 0U ) )
+        {
+            prvHandleResubscribe( pxConnection );
+        }
+        else
         {
-            xResult = prvHandleResubscribe();
+            /* The broker kept the session, so carry on with the filters left
+             * from the previous connection. A packet still in flight was lost
+             * with it. */
+            vResubscribeEngineRequeueBatch( &( pxConnection->xResubscribe ) );
         }
     }
 
     return xResult;
 }
 
-static BaseType_t prvBackoffForRetry( BackoffAlgorithmContext_t * pxRetryParams )
+static void prvSetConnectionState( CoreMqttAgentConnection_t * pxConnection,
+                                   bool xConnected )
 {
-    BaseType_t xReturnStatus = pdFAIL;
-    uint16_t usNextRetryBackOff = 0U;
-    BackoffAlgorithmStatus_t xBackoffAlgStatus = BackoffAlgorithmSuccess;
-
-    uint32_t ulRandomNum = rand();
+    #if configMQTT_AGENT_CORKED_TRANSPORT
+        /* MQTT_Connect() waits for the CONNACK without the agent going idle,
+         * so only gather packets while connected. */
+        vCorkedTransportSetCorked( &( pxConnection->xCorkedTransport ), xConnected );
+    #endif /* configMQTT_AGENT_CORKED_TRANSPORT */
 
-    /* Get back-off value (in milliseconds) for the next retry attempt. */
-    xBackoffAlgStatus = BackoffAlgorithm_GetNextBackoff( pxRetryParams,
-                                                         ulRandomNum,
-                                                         &usNextRetryBackOff );
+    taskENTER_CRITICAL( &xStatsLock );
 
-    if( xBackoffAlgStatus == BackoffAlgorithmRetriesExhausted )
+    if( xConnected && !pxConnection->xStats.xConnected )
     {
-        ESP_LOGI( TAG,
-                  "All retry attempts have exhausted. Operation will not be retried." );
+        pxConnection->xConnectedTick = xTaskGetTickCount();
+        pxConnection->xStats.ulConnects++;
     }
-    else if( xBackoffAlgStatus == BackoffAlgorithmSuccess )
+    else if( !xConnected && pxConnection->xStats.xConnected )
     {
-        /* Perform the backoff delay. */
-        vTaskDelay( pdMS_TO_TICKS( usNextRetryBackOff ) );
+        pxConnection->xStats.ulConnectedMs += ( uint32_t ) ( ( xTaskGetTickCount() - pxConnection->xConnectedTick ) * MILLISECONDS_PER_TICK );
+        pxConnection->xStats.ulDisconnects++;
+    }
 
-        xReturnStatus = pdPASS;
+    pxConnection->xStats.xConnected = xConnected;
 
-        ESP_LOGI( TAG,
-                  "Retry attempt %"PRIu32".",
-                  pxRetryParams->attemptsDone );
+    if( !xConnected )
+    {
+        pxConnection->xReady = false;
     }
 
-    return xReturnStatus;
-}
-
-static void processLoopCompleteCallback( MQTTAgentCommandContext_t * pCmdCallbackContext,
-                                         MQTTAgentReturnInfo_t * pReturnInfo )
-{
-    xTaskNotifyGive( ( void * ) pCmdCallbackContext );
-}
+    taskEXIT_CRITICAL( &xStatsLock );
 
-static void prvCoreMqttAgentConnectionTask( void * pvParameters )
-{
-    ( void ) pvParameters;
+    if( xConnected )
+    {
+        /* Producers refused while disconnected can try again. */
+        pxConnection->xCreditWanted = false;
+        xEventGroupClearBits( pxConnection->xNetworkEventGroup,
+                              CORE_MQTT_AGENT_DISCONNECTED_BIT );
+        xEventGroupSetBits( pxConnection->xNetworkEventGroup,
+                            CORE_MQTT_AGENT_CONNECTED_BIT | PUBLISH_CREDIT_BIT );
+    }
+    else
+    {
+        xEventGroupClearBits( pxConnection->xNetworkEventGroup,
+                              CORE_MQTT_AGENT_CONNECTED_BIT );
+        xEventGroupSetBits( pxConnection->xNetworkEventGroup,
+                            CORE_MQTT_AGENT_DISCONNECTED_BIT );
+    }
 
-    static bool xCleanSession = true;
-    BackoffAlgorithmContext_t xReconnectParams;
+    if( xConnected )
+    {
+        /* The application is told once its critical subscriptions are back,
+         * so it does not publish requests whose responses would be lost. */
+        if( !pxConnection->xResubscribing ||
+            xResubscribeEngineCriticalDone( &( pxConnection->xResubscribe ) ) )
+        {
+            prvSetLinkReady( pxConnection );
+        }
+        else
+        {
+            ESP_LOGI( TAG, "coreMQTT-Agent %s connection established, restoring subscriptions.",
+                      pxConnection->pcName );
+        }
+    }
+    else if( pxConnection->xPostEvents )
+    {
+        xCoreMqttAgentManagerPost( CORE_MQTT_AGENT_DISCONNECTED_EVENT );
+    }
+    else
+    {
+        ESP_LOGI( TAG, "coreMQTT-Agent %s connection disconnected.",
+                  pxConnection->pcName );
+    }
+
+    if( xConnected == false )
+    {
+        MQTTAgentCommandQueueStats_t xQueueStats;
+        int i;
+
+        vMQTTAgentCommandQueueGetStats( &( pxConnection->xCommandQueue ), &xQueueStats );
+
+        for( i = 0; i < eMQTTAgentCommandPriorityCount; i++ )
+        {
+            ESP_LOGI( TAG,
+                      "%s command queue class %d: sent=%"PRIu32" dropped=%"PRIu32" aged=%"PRIu32" max wait=%"PRIu32"ms avg wait=%"PRIu32"ms.",
+                      pxConnection->pcName,
+                      i,
+                      xQueueStats.ulSent[ i ],
+                      xQueueStats.ulDropped[ i ],
+                      xQueueStats.ulAged[ i ],
+                      xQueueStats.ulMaxWaitMs[ i ],
+                      ( xQueueStats.ulSent[ i ] > 0 ) ? ( xQueueStats.ulTotalWaitMs[ i ] / xQueueStats.ulSent[ i ] ) : 0 );
+        }
+
+        ESP_LOGI( TAG,
+                  "%s network buffer: receive high-water %"PRIu32" of %u bytes.",
+                  pxConnection->pcName,
+                  pxConnection->ulRxHighWater,
+                  ( unsigned int ) pxConnection->xNetworkBufferSize );
+
+        {
+            KeepAliveStats_t xKeepAliveStats;
+
+            vKeepAliveManagerGetStats( &( pxConnection->xKeepAlive ), &xKeepAliveStats );
+            ESP_LOGI( TAG,
+                      "%s keep-alive: interval=%us pings=%"PRIu32" timeouts=%"PRIu32" srtt=%"PRIu32"ms rttvar=%"PRIu32"ms min=%"PRIu32"ms max=%"PRIu32"ms.",
+                      pxConnection->pcName,
+                      ( unsigned int ) xKeepAliveStats.usIntervalSec,
+                      xKeepAliveStats.ulPings,
+                      xKeepAliveStats.ulTimeouts,
+                      xKeepAliveStats.ulSrttMs,
+                      xKeepAliveStats.ulRttVarMs,
+                      xKeepAliveStats.ulMinRttMs,
+                      xKeepAliveStats.ulMaxRttMs );
+        }
+
+        #if configMQTT_AGENT_CORKED_TRANSPORT
+        {
+            CorkedTransportStats_t xCorkStats;
+
+            vCorkedTransportGetStats( &( pxConnection->xCorkedTransport ), &xCorkStats );
+            ESP_LOGI( TAG,
+                      "%s transport: packets=%"PRIu32" records=%"PRIu32" bytes=%"PRIu32" flushes full=%"PRIu32" idle=%"PRIu32" deadline=%"PRIu32".",
+                      pxConnection->pcName,
+                      xCorkStats.ulPackets,
+                      xCorkStats.ulRecords,
+                      xCorkStats.ulBytes,
+                      xCorkStats.ulFlushFull,
+                      xCorkStats.ulFlushIdle,
+                      xCorkStats.ulFlushDeadline );
+        }
+        #endif /* configMQTT_AGENT_CORKED_TRANSPORT */
+    }
+}
+
+static void prvAgentPollHook( void * pvContext,
+                              bool xIdle )
+{
+    CoreMqttAgentConnection_t * pxConnection = ( CoreMqttAgentConnection_t * ) pvContext;
+
+    vKeepAliveManagerPoll( &( pxConnection->xKeepAlive ),
+                           &( pxConnection->pxAgentContext->mqttContext ) );
+
+    if( pxConnection->xResubscribing )
+    {
+        prvSendResubscribeBatch( pxConnection );
+    }
+
+    #if configMQTT_AGENT_CORKED_TRANSPORT
+        /* Write out gathered packets when the agent runs out of commands. */
+        vCorkedTransportPoll( &( pxConnection->xCorkedTransport ), xIdle );
+    #else
+        ( void ) xIdle;
+    #endif /* configMQTT_AGENT_CORKED_TRANSPORT */
+}
+
+#if configMQTT_AGENT_CORKED_TRANSPORT
+    static void prvCorkDeadlineWake( void * pvContext )
+    {
+        CoreMqttAgentConnection_t * pxConnection = ( CoreMqttAgentConnection_t * ) pvContext;
+        MQTTAgentCommandInfo_t xCommandInfo = { 0 };
+
+        /* If no command is free or the queue is full, the agent is busy and
+         * polls the corked transport before its next command anyway. */
+        xCommandInfo.blockTimeMs = 0;
+        ( void ) MQTTAgent_ProcessLoop( pxConnection->pxAgentContext, &xCommandInfo );
+    }
+#endif /* configMQTT_AGENT_CORKED_TRANSPORT */
+
+static BaseType_t prvBackoffForRetry( CoreMqttAgentConnection_t * pxConnection,
+                                      ReconnectPolicy_t * pxPolicy,
+                                      ReconnectFailure_t eFailure )
+{
+    BaseType_t xReturnStatus = pdPASS;
+    uint32_t ulDelayMs;
+    EventBits_t xBits;
+
+    ulDelayMs = ulReconnectPolicyNextDelayMs( pxPolicy, eFailure, esp_random() );
+
+    ESP_LOGI( TAG,
+              "%s failure on attempt %"PRIu32" (%s connection), retrying in %"PRIu32" ms.",
+              pcReconnectPolicyFailureName( eFailure ),
+              pxPolicy->ulAttempts,
+              pxConnection->pcName,
+              ulDelayMs );
+
+    xBits = xEventGroupWaitBits( pxConnection->xNetworkEventGroup,
+                                 RECONNECT_NOW_BIT,
+                                 pdTRUE,
+                                 pdFALSE,
+                                 pdMS_TO_TICKS( ulDelayMs ) );
+
+    if( ( xBits & RECONNECT_NOW_BIT ) != 0 )
+    {
+        ESP_LOGI( TAG, "Link is back up, retrying now (%s connection).", pxConnection->pcName );
+        vReconnectPolicyReset( pxPolicy );
+    }
+
+    if( ( xEventGroupGetBits( pxConnection->xNetworkEventGroup ) & WIFI_CONNECTED_BIT ) == 0 )
+    {
+        xReturnStatus = pdFAIL;
+    }
+
+    return xReturnStatus;
+}
+
+static void processLoopCompleteCallback( MQTTAgentCommandContext_t * pCmdCallbackContext,
+                                         MQTTAgentReturnInfo_t * pReturnInfo )
+{
+    xTaskNotifyGive( ( void * ) pCmdCallbackContext );
+}
+
+static void prvCoreMqttAgentConnectionTask( void * pvParameters )
+{
+    CoreMqttAgentConnection_t * pxConnection = ( CoreMqttAgentConnection_t * ) pvParameters;
+    NetworkContext_t * pxNetworkContext = pxConnection->pxNetworkContext;
+    ReconnectPolicy_t xReconnectPolicy;
+    ReconnectFailure_t eFailure;
+    DnsCacheStats_t xDnsStats;
+    uint32_t ulDnsFailures;
+    TickType_t xReconnectStartTick;
     BaseType_t xBackoffRet;
     TlsTransportStatus_t xTlsRet;
     MQTTStatus_t eMqttRet;
 
+    vReconnectPolicyInit( &xReconnectPolicy, xReconnectCurves );
+
     while( 1 )
     {
         int lSockFd = -1;
 
         /* Wait for the device to be connected to WiFi and be disconnected from
          * MQTT broker. */
-        xEventGroupWaitBits( xNetworkEventGroup,
+        xEventGroupWaitBits( pxConnection->xNetworkEventGroup,
                              WIFI_CONNECTED_BIT | CORE_MQTT_AGENT_DISCONNECTED_BIT,
                              pdFALSE,
                              pdTRUE,
@@ -776,23 +1481,49 @@ static void prvCoreMqttAgentConnectionTask( void * pvParameters )
         if( ( pxNetworkContext != NULL ) && ( pxNetworkContext->pxTls != NULL ) )
         {
             xTlsDisconnect( pxNetworkContext );
-            ESP_LOGI( TAG, "TLS connection was disconnected." );
+            ESP_LOGI( TAG, "TLS connection was disconnected (%s connection).", pxConnection->pcName );
         }
 
-        BackoffAlgorithm_InitializeParams( &xReconnectParams,
-                                           configRETRY_BACKOFF_BASE_MS,
-                                           configRETRY_MAX_BACKOFF_DELAY_MS,
-                                           BACKOFF_ALGORITHM_RETRY_FOREVER );
+        /* The first attempt after the link comes up is made immediately. */
+        vReconnectPolicyReset( &xReconnectPolicy );
+        xEventGroupClearBits( pxConnection->xNetworkEventGroup, RECONNECT_NOW_BIT );
+        xReconnectStartTick = xTaskGetTickCount();
 
         do
         {
+            vDnsCacheGetStats( &xDnsStats );
+            ulDnsFailures = xDnsStats.ulFailures;
+
             xTlsRet = xTlsConnect( pxNetworkContext );
 
-            if( xTlsRet == TLS_TRANSPORT_SUCCESS )
+            if( xTlsRet != TLS_TRANSPORT_SUCCESS )
+            {
+                /* The cached broker address may be stale, so resolve it again
+                 * on the next attempt. */
+                vDnsCacheInvalidate();
+
+                /* esp-tls reports TCP and TLS handshake failures alike as a
+                 * connect failure; other statuses come from the TLS setup. */
+                vDnsCacheGetStats( &xDnsStats );
+
+                if( xDnsStats.ulFailures != ulDnsFailures )
+                {
+                    eFailure = eReconnectFailureDns;
+                }
+                else if( xTlsRet == TLS_TRANSPORT_CONNECT_FAILURE )
+                {
+                    eFailure = eReconnectFailureTcp;
+                }
+                else
+                {
+                    eFailure = eReconnectFailureTls;
+                }
+            }
+            else
             {
                 if( esp_tls_get_conn_sockfd( pxNetworkContext->pxTls, &lSockFd ) == ESP_OK )
                 {
-                    eMqttRet = prvCoreMqttAgentConnect( xCleanSession );
+                    eMqttRet = prvCoreMqttAgentConnect( pxConnection );
                 }
                 else
                 {
@@ -805,31 +1536,41 @@ static void prvCoreMqttAgentConnectionTask( void * pvParameters )
                               "MQTT_Status: %s",
                               MQTT_Status_strerror( eMqttRet ) );
                 }
+
+                eFailure = eReconnectFailureConnack;
             }
 
             if( eMqttRet != MQTTSuccess )
             {
                 xTlsDisconnect( pxNetworkContext );
-                xBackoffRet = prvBackoffForRetry( &xReconnectParams );
+                xBackoffRet = prvBackoffForRetry( pxConnection, &xReconnectPolicy, eFailure );
             }
-
-
         } while( ( eMqttRet != MQTTSuccess ) && ( xBackoffRet == pdPASS ) );
 
         if( eMqttRet == MQTTSuccess )
         {
-            xCleanSession = false;
+            ESP_LOGI( TAG,
+                      "Connected to the broker in %"PRIu32" ms after %"PRIu32" failed attempts (%s connection).",
+                      ( uint32_t ) ( ( xTaskGetTickCount() - xReconnectStartTick ) * MILLISECONDS_PER_TICK ),
+                      xReconnectPolicy.ulAttempts,
+                      pxConnection->pcName );
+
+            vDnsCacheGetStats( &xDnsStats );
+            ESP_LOGI( TAG,
+                      "MQTT endpoint DNS cache: hits=%"PRIu32" misses=%"PRIu32" fallbacks=%"PRIu32" failures=%"PRIu32".",
+                      xDnsStats.ulHits,
+                      xDnsStats.ulMisses,
+                      xDnsStats.ulFallbacks,
+                      xDnsStats.ulFailures );
+
+            pxConnection->xCleanSession = false;
             /* Flag that an MQTT connection has been established. */
-            xEventGroupClearBits( xNetworkEventGroup,
-                                  CORE_MQTT_AGENT_DISCONNECTED_BIT );
-            xEventGroupSetBits( xNetworkEventGroup,
-                                CORE_MQTT_AGENT_CONNECTED_BIT );
-            xCoreMqttAgentManagerPost( CORE_MQTT_AGENT_CONNECTED_EVENT );
+            prvSetConnectionState( pxConnection, true );
         }
 
         if( eMqttRet == MQTTSuccess )
         {
-            while( xEventGroupWaitBits( xNetworkEventGroup, CORE_MQTT_AGENT_DISCONNECTED_BIT, pdFALSE, pdFALSE, 0 ) != CORE_MQTT_AGENT_DISCONNECTED_BIT )
+            while( xEventGroupWaitBits( pxConnection->xNetworkEventGroup, CORE_MQTT_AGENT_DISCONNECTED_BIT, pdFALSE, pdFALSE, 0 ) != CORE_MQTT_AGENT_DISCONNECTED_BIT )
             {
                 fd_set readSet;
                 fd_set errorSet;
@@ -854,18 +1595,14 @@ static void prvCoreMqttAgentConnectionTask( void * pvParameters )
                         };
                         ESP_LOGI( TAG, "Sending ProcessLoop request." );
 
-                        ( void ) MQTTAgent_ProcessLoop( &xGlobalMqttAgentContext, &xCommandInfo );
+                        ( void ) MQTTAgent_ProcessLoop( pxConnection->pxAgentContext, &xCommandInfo );
                         ( void ) ulTaskNotifyTake( pdTRUE, pdMS_TO_TICKS( 10000 ) );
                         ESP_LOGI( TAG, "ProcessLoop complete." );
 
                     }
                     else if ( FD_ISSET( lSockFd, &errorSet ) )
                     {
-                        xEventGroupClearBits( xNetworkEventGroup,
-                                  CORE_MQTT_AGENT_CONNECTED_BIT );
-                        xEventGroupSetBits( xNetworkEventGroup,
-                                            CORE_MQTT_AGENT_DISCONNECTED_BIT );
-                        xCoreMqttAgentManagerPost( CORE_MQTT_AGENT_DISCONNECTED_EVENT );
+                        prvSetConnectionState( pxConnection, false );
                     }
                 }
                 vTaskDelay( 1 );
@@ -882,7 +1619,8 @@ static void prvWifiEventHandler( void * pvHandlerArg,
                                  int32_t lEventId,
                                  void * pvEventData )
 {
-    ( void ) pvHandlerArg;
+    CoreMqttAgentConnection_t * pxConnection = ( CoreMqttAgentConnection_t * ) pvHandlerArg;
+
     ( void ) pvEventData;
 
     if( xEventBase == WIFI_EVENT )
@@ -893,7 +1631,7 @@ static void prvWifiEventHandler( void * pvHandlerArg,
                 ESP_LOGI( TAG, "WiFi disconnected." );
 
                 /* Notify networking tasks that WiFi is disconnected. */
-                xEventGroupClearBits( xNetworkEventGroup,
+                xEventGroupClearBits( pxConnection->xNetworkEventGroup,
                                       WIFI_CONNECTED_BIT );
                 break;
 
@@ -907,9 +1645,10 @@ static void prvWifiEventHandler( void * pvHandlerArg,
         {
             case IP_EVENT_STA_GOT_IP:
                 ESP_LOGI( TAG, "WiFi connected." );
-                /* Notify networking tasks that WiFi is connected. */
-                xEventGroupSetBits( xNetworkEventGroup,
-                                    WIFI_CONNECTED_BIT );
+                /* Notify networking tasks that WiFi is connected, and cut a
+                 * pending reconnect backoff short. */
+                xEventGroupSetBits( pxConnection->xNetworkEventGroup,
+                                    WIFI_CONNECTED_BIT | RECONNECT_NOW_BIT );
                 break;
 
             default:
@@ -942,18 +1681,24 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
             ESP_LOGI( TAG,
                       "coreMQTT-Agent disconnected." );
             /* Notify networking tasks of TLS and MQTT disconnection. */
-            xEventGroupClearBits( xNetworkEventGroup,
+            xEventGroupClearBits( xControlConnection.xNetworkEventGroup,
                                   CORE_MQTT_AGENT_CONNECTED_BIT );
-            xEventGroupSetBits( xNetworkEventGroup,
+            xEventGroupSetBits( xControlConnection.xNetworkEventGroup,
                                 CORE_MQTT_AGENT_DISCONNECTED_BIT );
             break;
 
         case CORE_MQTT_AGENT_OTA_STARTED_EVENT:
             ESP_LOGI( TAG, "OTA started." );
+            #if configMQTT_AGENT_OTA_NETWORK_BUFFER
+                prvRequestOtaNetworkBuffer( true );
+            #endif /* configMQTT_AGENT_OTA_NETWORK_BUFFER */
             break;
 
         case CORE_MQTT_AGENT_OTA_STOPPED_EVENT:
             ESP_LOGI( TAG, "OTA stopped." );
+            #if configMQTT_AGENT_OTA_NETWORK_BUFFER
+                prvRequestOtaNetworkBuffer( false );
+            #endif /* configMQTT_AGENT_OTA_NETWORK_BUFFER */
             break;
 
         default:
@@ -963,6 +1708,480 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
     }
 }
 
+static BaseType_t prvInitializeConnection( CoreMqttAgentConnection_t * pxConnection,
+                                           NetworkContext_t * pxNetworkContextIn )
+{
+    esp_err_t xEspErrRet;
+    MQTTStatus_t eMqttRet;
+    BaseType_t xRet = pdPASS;
+
+    pxConnection->pxNetworkContext = pxNetworkContextIn;
+
+    snprintf( pxConnection->cClientId, sizeof( pxConnection->cClientId ), "%s%s",
+              prvGetClientId(), pxConnection->pcClientIdSuffix );
+
+    pxConnection->xNetworkEventGroup = xEventGroupCreate();
+
+    if( pxConnection->xNetworkEventGroup == NULL )
+    {
+        ESP_LOGE( TAG,
+                  "Failed to create coreMQTT-Agent network manager event group." );
+
+        xRet = pdFAIL;
+    }
+
+    if( xRet != pdFAIL )
+    {
+        xEspErrRet = esp_event_handler_instance_register( IP_EVENT,
+                                                          ESP_EVENT_ANY_ID,
+                                                          prvWifiEventHandler,
+                                                          pxConnection,
+                                                          NULL );
+
+        if( xEspErrRet != ESP_OK )
+        {
+            ESP_LOGE( TAG,
+                      "Failed to register WiFi event handler with IP events." );
+
+            xRet = pdFAIL;
+        }
+    }
+
+    if( xRet != pdFAIL )
+    {
+        xEspErrRet = esp_event_handler_instance_register( WIFI_EVENT,
+                                                          ESP_EVENT_ANY_ID,
+                                                          prvWifiEventHandler,
+                                                          pxConnection,
+                                                          NULL );
+
+        if( xEspErrRet != ESP_OK )
+        {
+            ESP_LOGE( TAG,
+                      "Failed to register WiFi event handler with WiFi events." );
+
+            xRet = pdFAIL;
+        }
+    }
+
+    if( xRet != pdFAIL )
+    {
+        /* Initialize coreMQTT-Agent. */
+        eMqttRet = prvCoreMqttAgentInit( pxConnection );
+
+        if( eMqttRet != MQTTSuccess )
+        {
+            ESP_LOGE( TAG,
+                      "Failed to initialize coreMQTT-Agent." );
+
+            xRet = pdFAIL;
+        }
+    }
+
+    return xRet;
+}
+
+static CoreMqttAgentConnection_t * prvGetConnection( MQTTAgentContext_t * pxAgentContext )
+{
+    CoreMqttAgentConnection_t * pxConnection = NULL;
+
+    if( pxAgentContext == xControlConnection.pxAgentContext )
+    {
+        pxConnection = &xControlConnection;
+    }
+
+    #if configMQTT_AGENT_DUAL_CONNECTION
+        else if( pxAgentContext == xBulkConnection.pxAgentContext )
+        {
+            pxConnection = &xBulkConnection;
+        }
+    #endif /* configMQTT_AGENT_DUAL_CONNECTION */
+
+    return pxConnection;
+}
+
+static CoreMqttAgentConnection_t * prvGetConnectionByIndex( uint32_t ulConnection )
+{
+    CoreMqttAgentConnection_t * pxConnection = NULL;
+
+    if( ulConnection == 0U )
+    {
+        pxConnection = &xControlConnection;
+    }
+
+    #if configMQTT_AGENT_DUAL_CONNECTION
+        else if( ulConnection == 1U )
+        {
+            pxConnection = &xBulkConnection;
+        }
+    #endif /* configMQTT_AGENT_DUAL_CONNECTION */
+
+    return pxConnection;
+}
+
+static CoreMqttAgentConnection_t * prvGetConnectionByNetworkContext( const NetworkContext_t * pxNetworkContext )
+{
+    CoreMqttAgentConnection_t * pxConnection = NULL;
+    uint32_t i;
+
+    for( i = 0U; ( pxConnection == NULL ) && ( prvGetConnectionByIndex( i ) != NULL ); i++ )
+    {
+        if( prvGetConnectionByIndex( i )->pxNetworkContext == pxNetworkContext )
+        {
+            pxConnection = prvGetConnectionByIndex( i );
+        }
+    }
+
+    return pxConnection;
+}
+
+static bool prvReleaseCommand( MQTTAgentCommand_t * pxCommandToRelease )
+{
+    CoreMqttAgentConnection_t * pxConnection = NULL;
+    uint32_t ulIndex = ulMQTTAgentCommandPoolGetIndex( pxCommandToRelease );
+    uint32_t ulLatencyMs;
+    bool xCreditFreed = false;
+    bool xReleased;
+
+    if( ulIndex < configMQTT_AGENT_COMMAND_POOL_SIZE )
+    {
+        taskENTER_CRITICAL( &xStatsLock );
+
+        pxConnection = xCommandStamps[ ulIndex ].pxConnection;
+
+        if( pxConnection != NULL )
+        {
+            ulLatencyMs = ( uint32_t ) ( ( xTaskGetTickCount() - xCommandStamps[ ulIndex ].xSendTick ) * MILLISECONDS_PER_TICK );
+
+            pxConnection->xStats.ulCommands++;
+            pxConnection->ulCommandTotalMs += ulLatencyMs;
+
+            if( ulLatencyMs > pxConnection->xStats.ulCommandMaxMs )
+            {
+                pxConnection->xStats.ulCommandMaxMs = ulLatencyMs;
+            }
+
+            if( xCommandStamps[ ulIndex ].xAwaitsPuback )
+            {
+                pxConnection->xStats.ulPubacks++;
+                pxConnection->ulPubackTotalMs += ulLatencyMs;
+
+                if( ulLatencyMs > pxConnection->xStats.ulPubackMaxMs )
+                {
+                    pxConnection->xStats.ulPubackMaxMs = ulLatencyMs;
+                }
+            }
+
+            pxConnection->ulPublishBytesInFlight -= xCommandStamps[ ulIndex ].ulPublishBytes;
+
+            /* Producers refused credit are told once the backlog drained to
+             * half the budget, so they do not wake for every completion. */
+            if( pxConnection->xCreditWanted &&
+                ( pxConnection->ulPublishBytesInFlight <= ( configMQTT_AGENT_PUBLISH_CREDIT_BYTES / 2U ) ) )
+            {
+                pxConnection->xCreditWanted = false;
+                xCreditFreed = true;
+            }
+
+            xCommandStamps[ ulIndex ].pxConnection = NULL;
+        }
+
+        taskEXIT_CRITICAL( &xStatsLock );
+    }
+
+    xReleased = Agent_PoolReleaseCommand( pxCommandToRelease );
+
+    if( xCreditFreed )
+    {
+        xEventGroupSetBits( pxConnection->xNetworkEventGroup,
+                            PUBLISH_CREDIT_BIT );
+    }
+
+    return xReleased;
+}
+
+static bool prvMessageSend( MQTTAgentMessageContext_t * pxMsgCtx,
+                            MQTTAgentCommand_t * const * pxCommandToSend,
+                            uint32_t blockTimeMs )
+{
+    CoreMqttAgentConnection_t * pxConnection;
+    CommandStamp_t * pxStamp = NULL;
+    const MQTTPublishInfo_t * pxPublishInfo;
+    uint32_t ulIndex;
+    bool xSent;
+
+    pxConnection = ( CoreMqttAgentConnection_t * ) ( ( uint8_t * ) pxMsgCtx - offsetof( CoreMqttAgentConnection_t, xCommandQueue ) );
+
+    /* Stamped before queuing, as the agent task may complete and release the
+     * command before Agent_PriorityMessageSend() returns. */
+    ulIndex = ( pxCommandToSend != NULL ) ? ulMQTTAgentCommandPoolGetIndex( *pxCommandToSend ) : configMQTT_AGENT_COMMAND_POOL_SIZE;
+
+    if( ulIndex < configMQTT_AGENT_COMMAND_POOL_SIZE )
+    {
+        pxStamp = &( xCommandStamps[ ulIndex ] );
+        pxPublishInfo = ( ( *pxCommandToSend )->commandType == PUBLISH ) ?
+                        ( const MQTTPublishInfo_t * ) ( *pxCommandToSend )->pArgs : NULL;
+
+        taskENTER_CRITICAL( &xStatsLock );
+
+        pxStamp->pxConnection = pxConnection;
+        pxStamp->xSendTick = xTaskGetTickCount();
+        pxStamp->xAwaitsPuback = ( pxPublishInfo != NULL ) && ( pxPublishInfo->qos > MQTTQoS0 );
+        pxStamp->ulPublishBytes = ( pxPublishInfo != NULL ) ?
+                                  ( uint32_t ) ( pxPublishInfo->topicNameLength + pxPublishInfo->payloadLength ) : 0U;
+        pxConnection->ulPublishBytesInFlight += pxStamp->ulPublishBytes;
+
+        taskEXIT_CRITICAL( &xStatsLock );
+    }
+
+    xSent = Agent_PriorityMessageSend( pxMsgCtx, pxCommandToSend, blockTimeMs );
+
+    if( ( xSent == false ) && ( pxStamp != NULL ) )
+    {
+        /* Released without completing, so not timed. */
+        taskENTER_CRITICAL( &xStatsLock );
+        pxConnection->ulPublishBytesInFlight -= pxStamp->ulPublishBytes;
+        pxStamp->pxConnection = NULL;
+        taskEXIT_CRITICAL( &xStatsLock );
+    }
+
+    return xSent;
+}
+
+static int32_t prvTransportSend( NetworkContext_t * pxNetworkContext,
+                                 const void * pvBuffer,
+                                 size_t xBytesToSend )
+{
+    CoreMqttAgentConnection_t * pxConnection = prvGetConnectionByNetworkContext( pxNetworkContext );
+    int32_t lSent;
+
+    #if configMQTT_AGENT_CORKED_TRANSPORT
+        lSent = lCorkedTransportSend( pxNetworkContext, pvBuffer, xBytesToSend );
+    #else
+        lSent = espTlsTransportSend( pxNetworkContext, pvBuffer, xBytesToSend );
+    #endif /* configMQTT_AGENT_CORKED_TRANSPORT */
+
+    if( ( pxConnection != NULL ) && ( lSent > 0 ) )
+    {
+        pxConnection->xStats.ulTxBytes += ( uint32_t ) lSent;
+        pxConnection->xStats.ulTxPackets++;
+    }
+
+    return lSent;
+}
+
+static int32_t prvTransportWritev( NetworkContext_t * pxNetworkContext,
+                                   TransportOutVector_t * pxIoVec,
+                                   size_t xIoVecCount )
+{
+    CoreMqttAgentConnection_t * pxConnection = prvGetConnectionByNetworkContext( pxNetworkContext );
+    int32_t lSent;
+
+    #if configMQTT_AGENT_CORKED_TRANSPORT
+        lSent = lCorkedTransportWritev( pxNetworkContext, pxIoVec, xIoVecCount );
+    #else
+        int32_t lVectorSent;
+        size_t i;
+
+        /* Same as coreMQTT does without a writev function, but counted as a
+         * single packet. */
+        lSent = 0;
+
+        for( i = 0; i < xIoVecCount; i++ )
+        {
+            lVectorSent = espTlsTransportSend( pxNetworkContext, pxIoVec[ i ].iov_base, pxIoVec[ i ].iov_len );
+
+            if( lVectorSent < 0 )
+            {
+                lSent = ( lSent > 0 ) ? lSent : lVectorSent;
+                break;
+            }
+
+            lSent += lVectorSent;
+
+            if( ( size_t ) lVectorSent < pxIoVec[ i ].iov_len )
+            {
+                break;
+            }
+        }
+    #endif /* configMQTT_AGENT_CORKED_TRANSPORT */
+
+    if( ( pxConnection != NULL ) && ( lSent > 0 ) )
+    {
+        pxConnection->xStats.ulTxBytes += ( uint32_t ) lSent;
+        pxConnection->xStats.ulTxPackets++;
+    }
+
+    return lSent;
+}
+
+static int32_t prvTransportRecv( NetworkContext_t * pxNetworkContext,
+                                 void * pvBuffer,
+                                 size_t xBytesToRecv )
+{
+    CoreMqttAgentConnection_t * pxConnection = prvGetConnectionByNetworkContext( pxNetworkContext );
+    int32_t lReceived = espTlsTransportRecv( pxNetworkContext, pvBuffer, xBytesToRecv );
+
+    if( ( pxConnection != NULL ) && ( lReceived > 0 ) )
+    {
+        pxConnection->xStats.ulRxBytes += ( uint32_t ) lReceived;
+    }
+
+    return lReceived;
+}
+
+static void prvUpdateRxHighWater( CoreMqttAgentConnection_t * pxConnection,
+                                  const MQTTPublishInfo_t * pxPublishInfo )
+{
+    uint32_t ulRemainingLength;
+    uint32_t ulPacketSize;
+
+    /* Topic length field, topic, packet identifier and payload. */
+    ulRemainingLength = 2U + pxPublishInfo->topicNameLength +
+                        ( ( pxPublishInfo->qos > MQTTQoS0 ) ? 2U : 0U ) +
+                        ( uint32_t ) pxPublishInfo->payloadLength;
+
+    /* Packet type byte and the variable length encoding of the remaining
+     * length. */
+    ulPacketSize = 1U + ulRemainingLength +
+                   ( ( ulRemainingLength < 128U ) ? 1U :
+                     ( ulRemainingLength < 16384U ) ? 2U :
+                     ( ulRemainingLength < 2097152U ) ? 3U : 4U );
+
+    if( ulPacketSize > pxConnection->ulRxHighWater )
+    {
+        pxConnection->ulRxHighWater = ulPacketSize;
+        ESP_LOGD( TAG,
+                  "%s network buffer receive high-water: %"PRIu32" bytes.",
+                  pxConnection->pcName,
+                  ulPacketSize );
+    }
+}
+
+#if configMQTT_AGENT_OTA_NETWORK_BUFFER
+
+    static void prvRequestOtaNetworkBuffer( bool xOtaActive )
+    {
+        char cStreamTopic[ 128 ];
+        int lLength;
+        CoreMqttAgentConnection_t * pxConnection;
+        MQTTAgentCommandInfo_t xCommandInfo = { 0 };
+
+        /* OTA file blocks are published on the stream topics of the thing. */
+        lLength = snprintf( cStreamTopic, sizeof( cStreamTopic ),
+                            "$aws/things/%s/streams/ota/data/cbor", prvGetClientId() );
+
+        pxConnection = prvGetConnection( pxCoreMqttAgentManagerGetContextForTopic( cStreamTopic,
+                                                                                    ( uint16_t ) lLength ) );
+        configASSERT( pxConnection != NULL );
+
+        pxConnection->xLargeBufferWanted = xOtaActive;
+
+        /* Only the agent task may touch the network buffer, so switch it
+         * from the completion callback of an otherwise empty process loop. */
+        xCommandInfo.blockTimeMs = 0;
+        xCommandInfo.cmdCompleteCallback = prvSwitchNetworkBufferCallback;
+        xCommandInfo.pCmdCompleteCallbackContext = ( void * ) pxConnection;
+
+        if( MQTTAgent_ProcessLoop( pxConnection->pxAgentContext, &xCommandInfo ) != MQTTSuccess )
+        {
+            ESP_LOGW( TAG, "Failed to queue %s network buffer switch.", pxConnection->pcName );
+        }
+    }
+
+    static void prvSwitchNetworkBufferCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                                MQTTAgentReturnInfo_t * pxReturnInfo )
+    {
+        CoreMqttAgentConnection_t * pxConnection = ( CoreMqttAgentConnection_t * ) pxCommandContext;
+        MQTTContext_t * pxMqttContext = &( pxConnection->pxAgentContext->mqttContext );
+        MQTTAgentCommandInfo_t xCommandInfo = { 0 };
+
+        ( void ) pxReturnInfo;
+
+        if( pxMqttContext->index != 0U )
+        {
+            /* Part of a packet is in the buffer; try again after the next
+             * process loop has consumed it. */
+            xCommandInfo.blockTimeMs = 0;
+            xCommandInfo.cmdCompleteCallback = prvSwitchNetworkBufferCallback;
+            xCommandInfo.pCmdCompleteCallbackContext = pxCommandContext;
+
+            ( void ) MQTTAgent_ProcessLoop( pxConnection->pxAgentContext, &xCommandInfo );
+        }
+        else if( pxConnection->xLargeBufferWanted && ( pxConnection->pucLargeNetworkBuffer == NULL ) )
+        {
+            pxConnection->pucLargeNetworkBuffer = malloc( configMQTT_AGENT_OTA_NETWORK_BUFFER_SIZE );
+
+            if( pxConnection->pucLargeNetworkBuffer == NULL )
+            {
+                ESP_LOGE( TAG, "No memory for %d byte OTA network buffer.",
+                          configMQTT_AGENT_OTA_NETWORK_BUFFER_SIZE );
+            }
+            else
+            {
+                pxMqttContext->networkBuffer.pBuffer = pxConnection->pucLargeNetworkBuffer;
+                pxMqttContext->networkBuffer.size = configMQTT_AGENT_OTA_NETWORK_BUFFER_SIZE;
+                ESP_LOGI( TAG, "%s network buffer switched to %d bytes for OTA.",
+                          pxConnection->pcName,
+                          configMQTT_AGENT_OTA_NETWORK_BUFFER_SIZE );
+            }
+        }
+        else if( ( pxConnection->xLargeBufferWanted == false ) && ( pxConnection->pucLargeNetworkBuffer != NULL ) )
+        {
+            pxMqttContext->networkBuffer.pBuffer = pxConnection->pucNetworkBuffer;
+            pxMqttContext->networkBuffer.size = pxConnection->xNetworkBufferSize;
+            free( pxConnection->pucLargeNetworkBuffer );
+            pxConnection->pucLargeNetworkBuffer = NULL;
+            ESP_LOGI( TAG, "%s network buffer switched back to %u bytes.",
+                      pxConnection->pcName,
+                      ( unsigned int ) pxConnection->xNetworkBufferSize );
+        }
+    }
+
+#endif /* configMQTT_AGENT_OTA_NETWORK_BUFFER */
+
+static bool prvMatchesTopicFilters( const char * pcFilters,
+                                    const char * pcTopic,
+                                    uint16_t usTopicLength )
+{
+    const char * pcFilter = pcFilters;
+    const char * pcEnd;
+    bool xMatch = false;
+
+    while( ( xMatch == false ) && ( *pcFilter != '\0' ) )
+    {
+        pcEnd = strchr( pcFilter, ';' );
+
+        if( pcEnd == NULL )
+        {
+            pcEnd = pcFilter + strlen( pcFilter );
+        }
+
+        if( pcEnd > pcFilter )
+        {
+            /* A subscription is routed by its filter, so compare the
+             * strings verbatim before matching the filter as a pattern. */
+            if( ( ( size_t ) ( pcEnd - pcFilter ) == usTopicLength ) &&
+                ( strncmp( pcFilter, pcTopic, usTopicLength ) == 0 ) )
+            {
+                xMatch = true;
+            }
+            else
+            {
+                ( void ) MQTT_MatchTopic( pcTopic,
+                                          usTopicLength,
+                                          pcFilter,
+                                          ( uint16_t ) ( pcEnd - pcFilter ),
+                                          &xMatch );
+            }
+        }
+
+        pcFilter = ( *pcEnd == ';' ) ? ( pcEnd + 1 ) : pcEnd;
+    }
+
+    return xMatch;
+}
+
 /* Public function definitions ************************************************/
 
 const char* xCoreMqttAgentManagerGetClientId( void )
@@ -1008,32 +2227,210 @@ BaseType_t xCoreMqttAgentManagerRegisterHandler( esp_event_handler_t xEventHandl
     return xRet;
 }
 
-BaseType_t xCoreMqttAgentManagerStart( NetworkContext_t * pxNetworkContextIn )
+uint32_t ulCoreMqttAgentManagerGetTimeoutMs( MQTTAgentContext_t * pxAgentContext )
 {
-    esp_err_t xEspErrRet;
-    MQTTStatus_t eMqttRet;
+    CoreMqttAgentConnection_t * pxConnection = prvGetConnection( pxAgentContext );
+    uint32_t ulTimeoutMs = 0U;
+
+    if( pxConnection != NULL )
+    {
+        ulTimeoutMs = ulKeepAliveManagerGetTimeoutMs( &( pxConnection->xKeepAlive ) );
+    }
+
+    return ulTimeoutMs;
+}
+
+BaseType_t xCoreMqttAgentManagerAddStartupSubscription( const char * pcTopicFilter,
+                                                        uint16_t usTopicFilterLength,
+                                                        IncomingPubCallback_t pxCallback,
+                                                        void * pvCallbackContext )
+{
+    CoreMqttAgentConnection_t * pxConnection;
     BaseType_t xRet = pdPASS;
 
-    if( pxNetworkContextIn == NULL )
+    /* The mutex is created by xCoreMqttAgentManagerStart(), after which the
+     * first connection may already have subscribed. */
+    if( xSubListMutex != NULL )
     {
         ESP_LOGE( TAG,
-                  "Passed in network context pointer is null." );
+                  "Startup subscription to %.*s registered after the manager started.",
+                  usTopicFilterLength,
+                  pcTopicFilter );
+        xRet = pdFAIL;
+    }
+    else
+    {
+        pxConnection = prvGetConnection( pxCoreMqttAgentManagerGetContextForTopic( pcTopicFilter, usTopicFilterLength ) );
+
+        if( addSubscription( pxConnection->pxSubscriptionList,
+                             pcTopicFilter,
+                             usTopicFilterLength,
+                             pxCallback,
+                             pvCallbackContext ) == false )
+        {
+            ESP_LOGE( TAG,
+                      "Failed to register the startup subscription to %.*s.",
+                      usTopicFilterLength,
+                      pcTopicFilter );
+            xRet = pdFAIL;
+        }
+    }
 
+    return xRet;
+}
+
+BaseType_t xCoreMqttAgentManagerCanPublish( const char * pcTopic,
+                                            uint16_t usTopicLength,
+                                            size_t xPayloadLength )
+{
+    CoreMqttAgentConnection_t * pxConnection;
+    MQTTPublishInfo_t xPublishInfo = { 0 };
+    MQTTAgentCommand_t xCommand = { 0 };
+    uint32_t ulBytes = ( uint32_t ) ( usTopicLength + xPayloadLength );
+    BaseType_t xRet;
+
+    pxConnection = prvGetConnection( pxCoreMqttAgentManagerGetContextForTopic( pcTopic, usTopicLength ) );
+
+    /* Classify the publish as Agent_PriorityMessageSend() would. */
+    xPublishInfo.pTopicName = pcTopic;
+    xPublishInfo.topicNameLength = usTopicLength;
+    xCommand.commandType = PUBLISH;
+    xCommand.pArgs = &xPublishInfo;
+
+    /* A publish is always allowed on an idle connection, whatever its size. */
+    xRet = ( pxConnection->xStats.xConnected &&
+             ( ( pxConnection->ulPublishBytesInFlight == 0U ) ||
+               ( ( pxConnection->ulPublishBytesInFlight + ulBytes ) <= configMQTT_AGENT_PUBLISH_CREDIT_BYTES ) ) &&
+             xMQTTAgentCommandPoolHasCapacity() &&
+             xMQTTAgentCommandQueueHasSpace( &( pxConnection->xCommandQueue ),
+                                             eMQTTAgentCommandQueueGetPriority( &xCommand ) ) ) ? pdTRUE : pdFALSE;
+
+    if( xRet == pdFALSE )
+    {
+        /* Cleared before the flag is raised, so a completion in between sets
+         * the bit again rather than being missed. */
+        xEventGroupClearBits( pxConnection->xNetworkEventGroup,
+                              PUBLISH_CREDIT_BIT );
+
+        taskENTER_CRITICAL( &xStatsLock );
+        pxConnection->xCreditWanted = true;
+        pxConnection->xStats.ulCreditRefusals++;
+        taskEXIT_CRITICAL( &xStatsLock );
+    }
+
+    return xRet;
+}
+
+BaseType_t xCoreMqttAgentManagerWaitForCredit( const char * pcTopic,
+                                               uint16_t usTopicLength,
+                                               TickType_t xTicksToWait )
+{
+    CoreMqttAgentConnection_t * pxConnection;
+    EventBits_t xBits;
+
+    pxConnection = prvGetConnection( pxCoreMqttAgentManagerGetContextForTopic( pcTopic, usTopicLength ) );
+
+    xBits = xEventGroupWaitBits( pxConnection->xNetworkEventGroup,
+                                 PUBLISH_CREDIT_BIT,
+                                 pdFALSE,
+                                 pdTRUE,
+                                 xTicksToWait );
+
+    return ( ( xBits & PUBLISH_CREDIT_BIT ) != 0U ) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xCoreMqttAgentManagerGetStats( uint32_t ulConnection,
+                                          CoreMqttAgentStats_t * pxStats )
+{
+    CoreMqttAgentConnection_t * pxConnection = prvGetConnectionByIndex( ulConnection );
+    MQTTAgentCommandPoolStats_t xPoolStats;
+    SubscriptionMemory_t xMemory;
+    BaseType_t xRet = pdPASS;
+    uint32_t i;
+
+    if( ( pxConnection == NULL ) || ( pxStats == NULL ) )
+    {
         xRet = pdFAIL;
     }
     else
     {
-        pxNetworkContext = pxNetworkContextIn;
+        /* Field by field without the lock; each is written as a whole. */
+        *pxStats = pxConnection->xStats;
+        pxStats->pcName = pxConnection->pcName;
+
+        if( pxStats->xConnected )
+        {
+            pxStats->ulConnectedMs += ( uint32_t ) ( ( xTaskGetTickCount() - pxConnection->xConnectedTick ) * MILLISECONDS_PER_TICK );
+        }
+
+        pxStats->ulPublishBytesInFlight = pxConnection->ulPublishBytesInFlight;
+        pxStats->ulQueueDepth = pxConnection->xCommandQueue.xStats.ulDepth;
+        pxStats->ulQueueHighWater = pxConnection->xCommandQueue.xStats.ulDepthHighWater;
+        pxStats->ulCommandAvgMs = ( pxStats->ulCommands > 0U ) ? ( pxConnection->ulCommandTotalMs / pxStats->ulCommands ) : 0U;
+        pxStats->ulPubackAvgMs = ( pxStats->ulPubacks > 0U ) ? ( pxConnection->ulPubackTotalMs / pxStats->ulPubacks ) : 0U;
+
+        /* The pool is shared by all connections; report the sum of the caller
+         * classes, which makes the high-water an upper bound. */
+        vMQTTAgentCommandPoolGetStats( &xPoolStats );
+        pxStats->ulPoolInUse = 0U;
+        pxStats->ulPoolHighWater = 0U;
+        pxStats->ulPoolExhausted = 0U;
+
+        for( i = 0U; i < ( uint32_t ) eMQTTAgentCommandPoolCallerCount; i++ )
+        {
+            pxStats->ulPoolInUse += xPoolStats.ulInUse[ i ];
+            pxStats->ulPoolHighWater += xPoolStats.ulHighWater[ i ];
+            pxStats->ulPoolExhausted += xPoolStats.ulExhausted[ i ];
+        }
+
+        getSubscriptionMemory( pxConnection->pxSubscriptionList, &xMemory );
+        pxStats->ulSubscriptions = xMemory.ulSubscriptions;
+        pxStats->ulSubscriptionFilters = xMemory.ulFilters;
+        pxStats->ulSubscriptionBytes = xMemory.ulTableBytes + xMemory.ulArenaBytes;
+    }
+
+    return xRet;
+}
+
+MQTTAgentContext_t * pxCoreMqttAgentManagerGetContextForTopic( const char * pcTopic,
+                                                               uint16_t usTopicLength )
+{
+    MQTTAgentContext_t * pxAgentContext = &xGlobalMqttAgentContext;
+
+    #if configMQTT_AGENT_DUAL_CONNECTION
+        if( ( pcTopic != NULL ) &&
+            prvMatchesTopicFilters( configMQTT_AGENT_BULK_TOPIC_FILTERS, pcTopic, usTopicLength ) )
+        {
+            pxAgentContext = &xBulkMqttAgentContext;
+        }
+    #else
+        ( void ) pcTopic;
+        ( void ) usTopicLength;
+    #endif /* configMQTT_AGENT_DUAL_CONNECTION */
+
+    return pxAgentContext;
+}
+
+BaseType_t xCoreMqttAgentManagerStart( NetworkContext_t * pxNetworkContextIn )
+{
+    BaseType_t xRet = pdPASS;
+
+    if( pxNetworkContextIn == NULL )
+    {
+        ESP_LOGE( TAG,
+                  "Passed in network context pointer is null." );
+
+        xRet = pdFAIL;
     }
 
     if( xRet != pdFAIL )
     {
-        xNetworkEventGroup = xEventGroupCreate();
+        xRet = xDnsCacheInit( pxNetworkContextIn->pcHostname );
 
-        if( xNetworkEventGroup == NULL )
+        if( xRet != pdPASS )
         {
             ESP_LOGE( TAG,
-                      "Failed to create coreMQTT-Agent network manager event group." );
+                      "Failed to initialize MQTT endpoint DNS cache." );
 
             xRet = pdFAIL;
         }
@@ -1054,51 +2451,58 @@ BaseType_t xCoreMqttAgentManagerStart( NetworkContext_t * pxNetworkContextIn )
 
     if( xRet != pdFAIL )
     {
-        xEspErrRet = esp_event_handler_instance_register( IP_EVENT,
-                                                          ESP_EVENT_ANY_ID,
-                                                          prvWifiEventHandler,
-                                                          NULL,
-                                                          NULL );
+        ulGlobalEntryTimeMs = prvGetTimeMs();
 
-        if( xEspErrRet != ESP_OK )
+        /* Initialize the command pool shared by all connections. */
+        xRet = xMQTTAgentCommandPoolInit();
+
+        if( xRet != pdPASS )
         {
             ESP_LOGE( TAG,
-                      "Failed to register WiFi event handler with IP events." );
-
-            xRet = pdFAIL;
+                      "Failed to initialize the coreMQTT-Agent command pool." );
         }
     }
 
     if( xRet != pdFAIL )
     {
-        xEspErrRet = esp_event_handler_instance_register( WIFI_EVENT,
-                                                          ESP_EVENT_ANY_ID,
-                                                          prvWifiEventHandler,
-                                                          NULL,
-                                                          NULL );
+        xRet = xMQTTAgentPublishPoolInit();
+    }
 
-        if( xEspErrRet != ESP_OK )
+    #if configMQTT_AGENT_QUEUED_DISPATCH
+        if( xRet != pdFAIL )
         {
-            ESP_LOGE( TAG,
-                      "Failed to register WiFi event handler with WiFi events." );
-
-            xRet = pdFAIL;
+            xRet = xSubscriptionDispatcherInit();
         }
-    }
+    #endif /* configMQTT_AGENT_QUEUED_DISPATCH */
 
     if( xRet != pdFAIL )
     {
-        /* Initialize coreMQTT-Agent. */
-        eMqttRet = prvCoreMqttAgentInit( pxNetworkContext );
+        xRet = prvInitializeConnection( &xControlConnection, pxNetworkContextIn );
+    }
 
-        if( eMqttRet != MQTTSuccess )
+    #if configMQTT_AGENT_DUAL_CONNECTION
+        if( xRet != pdFAIL )
         {
-            ESP_LOGE( TAG,
-                      "Failed to initialize coreMQTT-Agent." );
+            /* The bulk connection uses the same endpoint and credentials over
+             * its own TLS session. */
+            xBulkNetworkContext = *pxNetworkContextIn;
+            xBulkNetworkContext.pxTls = NULL;
+            xBulkNetworkContext.xTlsContextSemaphore = xSemaphoreCreateMutex();
 
-            xRet = pdFAIL;
+            if( xBulkNetworkContext.xTlsContextSemaphore == NULL )
+            {
+                ESP_LOGE( TAG,
+                          "Failed to create bulk connection TLS context semaphore." );
+
+                xRet = pdFAIL;
+            }
         }
-    }
+
+        if( xRet != pdFAIL )
+        {
+            xRet = prvInitializeConnection( &xBulkConnection, &xBulkNetworkContext );
+        }
+    #endif /* configMQTT_AGENT_DUAL_CONNECTION */
 
     if( xRet != pdFAIL )
     {
@@ -1119,8 +2523,12 @@ BaseType_t xCoreMqttAgentManagerStart( NetworkContext_t * pxNetworkContextIn )
 
     if( xRet != pdFAIL )
     {
-        /* Start coreMQTT-Agent. */
-        xRet = prvStartCoreMqttAgent();
+        /* Set initial state of network connection */
+        xEventGroupSetBits( xControlConnection.xNetworkEventGroup,
+                            CORE_MQTT_AGENT_DISCONNECTED_BIT );
+
+        /* Start coreMQTT-Agent and network establishing tasks. */
+        xRet = prvStartCoreMqttAgent( &xControlConnection );
 
         if( xRet != pdPASS )
         {
@@ -1131,30 +2539,29 @@ BaseType_t xCoreMqttAgentManagerStart( NetworkContext_t * pxNetworkContextIn )
         }
     }
 
-    if( xRet != pdFAIL )
-    {
-        /* Start network establishing tasks */
-        xRet = xTaskCreate( prvCoreMqttAgentConnectionTask,
-                            "CoreMqttAgentConnectionTask",
-                            configCONNECTION_TASK_STACK_SIZE,
-                            NULL,
-                            configCONNECTION_TASK_PRIORITY,
-                            NULL );
-
-        if( xRet != pdPASS )
+    #if configMQTT_AGENT_DUAL_CONNECTION
+        if( xRet != pdFAIL )
         {
-            ESP_LOGE( TAG,
-                      "Failed to create network management task." );
+            xEventGroupSetBits( xBulkConnection.xNetworkEventGroup,
+                                CORE_MQTT_AGENT_DISCONNECTED_BIT );
 
-            xRet = pdFAIL;
+            xRet = prvStartCoreMqttAgent( &xBulkConnection );
+
+            if( xRet != pdPASS )
+            {
+                ESP_LOGE( TAG,
+                          "Failed to start bulk coreMQTT-Agent." );
+
+                xRet = pdFAIL;
+            }
         }
-    }
+    #endif /* configMQTT_AGENT_DUAL_CONNECTION */
 
     if( xRet != pdFAIL )
     {
-        /* Set initial state of network connection */
-        xEventGroupSetBits( xNetworkEventGroup,
-                            CORE_MQTT_AGENT_DISCONNECTED_BIT );
+        /* Queue the publishes left unacknowledged by the previous boot now
+         * that the agent contexts exist. They are sent once connected. */
+        vMQTTAgentPublishPoolReplay();
     }
 
     return xRet;
@@ -28,9 +28,51 @@
 #define CORE_MQTT_AGENT_NETWORK_MANAGER_H
 
 #include "network_transport.h"
+#include "core_mqtt_agent.h"
+#include "subscription_manager.h"
 #include "freertos/FreeRTOS.h"
 #include "esp_event.h"
 
+/**
+ * @brief Counters and gauges of a coreMQTT-Agent connection.
+ *
+ * Each field is read atomically, but fields are not a consistent snapshot of
+ * one another. Counters wrap around.
+ */
+typedef struct CoreMqttAgentStats
+{
+    const char * pcName;             /**< Name of the connection. */
+    bool xConnected;                 /**< Whether the connection is established. */
+    uint32_t ulConnects;             /**< Connections established. */
+    uint32_t ulDisconnects;          /**< Connections lost or closed. */
+    uint32_t ulConnectedMs;          /**< Time spent connected, including the current connection. */
+    uint32_t ulQueueDepth;           /**< Commands waiting for the agent task. */
+    uint32_t ulQueueHighWater;       /**< Largest value ulQueueDepth reached. */
+    uint32_t ulCommands;             /**< Commands completed. */
+    uint32_t ulCommandAvgMs;         /**< Average time from queuing a command to its completion. */
+    uint32_t ulCommandMaxMs;         /**< Longest time from queuing a command to its completion. */
+    uint32_t ulPubacks;              /**< QoS 1 publishes acknowledged. */
+    uint32_t ulPubackAvgMs;          /**< Average time from queuing a QoS 1 publish to its PUBACK. */
+    uint32_t ulPubackMaxMs;          /**< Longest time from queuing a QoS 1 publish to its PUBACK. */
+    uint32_t ulTxBytes;              /**< Bytes handed to the transport. */
+    uint32_t ulTxPackets;            /**< Transport writes, one per packet unless it was sent partially. */
+    uint32_t ulRxBytes;              /**< Bytes read from the transport. */
+    uint32_t ulRxPublishes;          /**< Incoming publishes. */
+    uint32_t ulPublishBytesInFlight; /**< Topic and payload bytes of publishes queued and not completed. */
+    uint32_t ulCreditRefusals;       /**< Times xCoreMqttAgentManagerCanPublish() refused a publish. */
+    uint32_t ulPoolInUse;            /**< Commands taken from the command pool, shared by all connections. */
+    uint32_t ulPoolHighWater;        /**< Largest value ulPoolInUse reached. */
+    uint32_t ulPoolExhausted;        /**< Times the command pool had no command to give. */
+    uint32_t ulResubscribeMs;        /**< Time the last restore of the subscriptions took, from connection to the last SUBACK. */
+    uint32_t ulResubscribePackets;   /**< SUBSCRIBE packets sent to restore subscriptions. */
+    uint32_t ulResubscribeRetries;   /**< Topic filters sent again after they failed to be restored. */
+    uint32_t ulResubscribeDropped;   /**< Topic filters given up and removed from the subscription list. */
+    uint32_t ulStartupSubscribeMs;   /**< Time from the first CONNACK to the last SUBACK of the startup subscriptions, 0 until done. */
+    uint32_t ulSubscriptions;        /**< Callbacks in the subscription list. */
+    uint32_t ulSubscriptionFilters;  /**< Distinct topic filters held by the subscription list. */
+    uint32_t ulSubscriptionBytes;    /**< Heap used by the subscription list, tables and filters. */
+} CoreMqttAgentStats_t;
+
 /**
  * @brief Register an event handler with coreMQTT-Agent events.
  *
@@ -72,4 +114,118 @@ BaseType_t xCoreMqttAgentManagerPost( int32_t lEventId );
  */
 const char* xCoreMqttAgentManagerGetClientId( void );
 
+/**
+ * @brief Get the retransmission timeout of a connection, estimated from the
+ * round trip time of its keep-alive pings.
+ *
+ * Producers can use it to size the time they wait for a command to complete,
+ * or to pace how many publishes they keep in flight.
+ *
+ * @param[in] pxAgentContext Agent context of the connection.
+ *
+ * @return Timeout in milliseconds, 0 until a ping was answered or if
+ * pxAgentContext is not the context of a connection.
+ */
+uint32_t ulCoreMqttAgentManagerGetTimeoutMs( MQTTAgentContext_t * pxAgentContext );
+
+/**
+ * @brief Get the coreMQTT-Agent context that carries a topic.
+ *
+ * When the dual connection mode is enabled, topics matching
+ * CONFIG_GRI_MQTT_AGENT_BULK_TOPIC_FILTERS are carried by the bulk connection
+ * and every other topic by the control connection. Publishes, subscribes and
+ * unsubscribes of a topic must all use the returned context. Subscription
+ * manager entries for the topic must be added to the returned context's
+ * pIncomingCallbackContext.
+ *
+ * @param[in] pcTopic Topic name or topic filter.
+ * @param[in] usTopicLength Length of pcTopic.
+ *
+ * @return Agent context of the connection carrying the topic.
+ */
+MQTTAgentContext_t * pxCoreMqttAgentManagerGetContextForTopic( const char * pcTopic,
+                                                               uint16_t usTopicLength );
+
+/**
+ * @brief Register a subscription to be made once the connection carrying its
+ * topic filter is first established.
+ *
+ * The subscription is added to the subscription list of the connection right
+ * away. On the first connection, the filters of the list are subscribed to at
+ * QoS 1 in as few SUBSCRIBE packets as
+ * CONFIG_GRI_MQTT_AGENT_RESUBSCRIBE_MAX_PACKET_SIZE allows, the way they are
+ * restored after the broker lost the session, instead of one SUBSCRIBE packet
+ * and SUBACK round trip per feature. The connected event is posted once the
+ * critical ones are acknowledged.
+ *
+ * Must be called before xCoreMqttAgentManagerStart(), for instance by the
+ * function starting a demo. Later subscriptions are made with
+ * MQTTAgent_Subscribe().
+ *
+ * @param[in] pcTopicFilter Topic filter. It is copied.
+ * @param[in] usTopicFilterLength Length of pcTopicFilter.
+ * @param[in] pxCallback Callback of the incoming publishes matching the filter.
+ * @param[in] pvCallbackContext Context passed to pxCallback.
+ *
+ * @return pdPASS if registered, pdFAIL if the manager was already started or
+ * the subscription list is full.
+ */
+BaseType_t xCoreMqttAgentManagerAddStartupSubscription( const char * pcTopicFilter,
+                                                        uint16_t usTopicFilterLength,
+                                                        IncomingPubCallback_t pxCallback,
+                                                        void * pvCallbackContext );
+
+/**
+ * @brief Check, without blocking, whether a publish can be queued now.
+ *
+ * A publish is refused while the connection carrying the topic is down, when
+ * the topic and payload bytes of the publishes in flight on it would exceed
+ * CONFIG_GRI_MQTT_AGENT_PUBLISH_CREDIT_BYTES, or when MQTTAgent_Publish() would
+ * have to wait for a command or for space in the command queue. Producers can
+ * then batch, downsample or keep the data, and call
+ * xCoreMqttAgentManagerWaitForCredit() to learn when to try again.
+ *
+ * @param[in] pcTopic Topic of the publish.
+ * @param[in] usTopicLength Length of pcTopic.
+ * @param[in] xPayloadLength Length of the payload.
+ *
+ * @return pdTRUE if the publish can be queued without blocking, pdFALSE
+ * otherwise.
+ */
+BaseType_t xCoreMqttAgentManagerCanPublish( const char * pcTopic,
+                                            uint16_t usTopicLength,
+                                            size_t xPayloadLength );
+
+/**
+ * @brief Wait until publishes on the connection carrying a topic are likely to
+ * be accepted again, after xCoreMqttAgentManagerCanPublish() refused one.
+ *
+ * Credit is signalled once the bytes in flight drained to half the budget,
+ * and when the connection is established.
+ *
+ * @param[in] pcTopic Topic of the refused publish.
+ * @param[in] usTopicLength Length of pcTopic.
+ * @param[in] xTicksToWait Time to wait.
+ *
+ * @return pdTRUE if credit was signalled, pdFALSE on timeout.
+ */
+BaseType_t xCoreMqttAgentManagerWaitForCredit( const char * pcTopic,
+                                               uint16_t usTopicLength,
+                                               TickType_t xTicksToWait );
+
+/**
+ * @brief Read the counters of a connection.
+ *
+ * Lock free, so it can be called from any task, and often.
+ *
+ * @param[in] ulConnection Index of the connection: 0 for the control
+ * connection, 1 for the bulk connection if the dual connection mode is
+ * enabled.
+ * @param[out] pxStats Where to copy the counters.
+ *
+ * @return pdPASS if successful, pdFAIL if there is no such connection.
+ */
+BaseType_t xCoreMqttAgentManagerGetStats( uint32_t ulConnection,
+                                          CoreMqttAgentStats_t * pxStats );
+
 #endif /* CORE_MQTT_AGENT_NETWORK_MANAGER_H */
@@ -56,6 +56,20 @@
  */
 #define configRETRY_BACKOFF_BASE_MS                     ( CONFIG_GRI_RETRY_BACKOFF_BASE_MS )
 
+/**
+ * @brief The base and maximum back-off delays (in milliseconds) after a failed
+ * TLS session setup, such as invalid credentials or lack of memory.
+ */
+#define configRETRY_TLS_BACKOFF_BASE_MS                 ( CONFIG_GRI_RETRY_TLS_BACKOFF_BASE_MS )
+#define configRETRY_TLS_MAX_BACKOFF_DELAY_MS            ( CONFIG_GRI_RETRY_TLS_MAX_BACKOFF_DELAY_MS )
+
+/**
+ * @brief The base and maximum back-off delays (in milliseconds) after the
+ * broker did not accept the MQTT CONNECT, for example when it throttles.
+ */
+#define configRETRY_CONNACK_BACKOFF_BASE_MS             ( CONFIG_GRI_RETRY_CONNACK_BACKOFF_BASE_MS )
+#define configRETRY_CONNACK_MAX_BACKOFF_DELAY_MS        ( CONFIG_GRI_RETRY_CONNACK_MAX_BACKOFF_DELAY_MS )
+
 /**
  * @brief Dimensions the buffer used to serialize and deserialize MQTT packets.
  * @note Specified in bytes.  Must be large enough to hold the maximum
@@ -63,11 +77,46 @@
  */
 #define configMQTT_AGENT_NETWORK_BUFFER_SIZE            ( CONFIG_GRI_MQTT_AGENT_NETWORK_BUFFER_SIZE )
 
+/**
+ * @brief Whether outgoing packets are gathered into fewer TLS records by the
+ * corked transport.
+ */
+#if CONFIG_GRI_TRANSPORT_CORK
+    #define configMQTT_AGENT_CORKED_TRANSPORT           ( 1 )
+#else
+    #define configMQTT_AGENT_CORKED_TRANSPORT           ( 0 )
+#endif /* CONFIG_GRI_TRANSPORT_CORK */
+
+/**
+ * @brief Whether the connection carrying OTA file blocks borrows a network
+ * buffer of configMQTT_AGENT_OTA_NETWORK_BUFFER_SIZE bytes from the heap while
+ * an OTA job is active, so configMQTT_AGENT_NETWORK_BUFFER_SIZE only has to fit
+ * steady-state traffic.
+ */
+#if CONFIG_GRI_MQTT_AGENT_OTA_NETWORK_BUFFER
+    #define configMQTT_AGENT_OTA_NETWORK_BUFFER         ( 1 )
+    #define configMQTT_AGENT_OTA_NETWORK_BUFFER_SIZE    ( CONFIG_GRI_MQTT_AGENT_OTA_NETWORK_BUFFER_SIZE )
+#else
+    #define configMQTT_AGENT_OTA_NETWORK_BUFFER         ( 0 )
+#endif /* CONFIG_GRI_MQTT_AGENT_OTA_NETWORK_BUFFER */
+
 /**
  * @brief The length of the queue used to hold commands for the agent.
  */
 #define configMQTT_AGENT_COMMAND_QUEUE_LENGTH           ( CONFIG_GRI_MQTT_AGENT_COMMAND_QUEUE_LENGTH )
 
+/**
+ * @brief Time in milliseconds after which a queued command is served ahead of
+ * commands of a higher priority class, so they cannot starve it.
+ */
+#define configMQTT_AGENT_COMMAND_AGING_MS               ( CONFIG_GRI_MQTT_AGENT_COMMAND_AGING_MS )
+
+/**
+ * @brief ';'-separated list of topic filters whose publishes are queued ahead
+ * of other publishes.
+ */
+#define configMQTT_AGENT_CONTROL_TOPIC_FILTERS          CONFIG_GRI_MQTT_AGENT_CONTROL_TOPIC_FILTERS
+
 /**
  * @brief The maximum time interval in seconds which is allowed to elapse
  *  between two Control Packets.
@@ -79,6 +128,15 @@
  */
 #define configMQTT_AGENT_KEEP_ALIVE_INTERVAL_SECONDS    ( CONFIG_GRI_MQTT_AGENT_KEEP_ALIVE_INTERVAL_SECONDS )
 
+/**
+ * @brief The shortest interval in seconds between two PINGREQ packets.
+ *
+ * The ping interval starts at configMQTT_AGENT_KEEP_ALIVE_INTERVAL_SECONDS, is
+ * halved down to this value after a PINGRESP timeout, and grows back while
+ * pings are answered.
+ */
+#define configMQTT_AGENT_KEEP_ALIVE_MIN_INTERVAL_SECONDS    ( CONFIG_GRI_MQTT_AGENT_KEEP_ALIVE_MIN_INTERVAL_SECONDS )
+
 /**
  * @brief Timeout for receiving CONNACK after sending an MQTT CONNECT packet.
  * Defined in milliseconds.
@@ -95,4 +153,187 @@
  */
 #define configMQTT_AGENT_TASK_PRIORITY                  ( CONFIG_GRI_MQTT_AGENT_TASK_PRIORITY )
 
+/**
+ * @brief Number of buffers in the publish pool, which bounds the number of
+ * pool publishes in flight.
+ */
+#define configMQTT_AGENT_PUBLISH_POOL_BUFFERS           ( CONFIG_GRI_MQTT_AGENT_PUBLISH_POOL_BUFFERS )
+
+/**
+ * @brief Size in bytes of the topic area of a publish pool buffer.
+ */
+#define configMQTT_AGENT_PUBLISH_POOL_TOPIC_SIZE        ( CONFIG_GRI_MQTT_AGENT_PUBLISH_POOL_TOPIC_SIZE )
+
+/**
+ * @brief Size in bytes of the payload area of a publish pool buffer.
+ */
+#define configMQTT_AGENT_PUBLISH_POOL_PAYLOAD_SIZE      ( CONFIG_GRI_MQTT_AGENT_PUBLISH_POOL_PAYLOAD_SIZE )
+
+/**
+ * @brief Whether subscribers may have their incoming publishes copied to
+ * worker tasks by the subscription dispatcher, instead of being called on the
+ * coreMQTT-Agent task.
+ */
+#if CONFIG_GRI_MQTT_AGENT_QUEUED_DISPATCH
+    #define configMQTT_AGENT_QUEUED_DISPATCH            ( 1 )
+#else
+    #define configMQTT_AGENT_QUEUED_DISPATCH            ( 0 )
+#endif /* CONFIG_GRI_MQTT_AGENT_QUEUED_DISPATCH */
+
+#if configMQTT_AGENT_QUEUED_DISPATCH
+
+/**
+ * @brief Number of buffers shared by the subscribers to hold the publishes
+ * queued to their worker tasks.
+ */
+    #define configMQTT_AGENT_DISPATCH_BUFFERS           ( CONFIG_GRI_MQTT_AGENT_DISPATCH_BUFFERS )
+
+/**
+ * @brief Size in bytes of the topic and payload areas of a dispatch buffer.
+ * Larger publishes are dropped.
+ */
+    #define configMQTT_AGENT_DISPATCH_TOPIC_SIZE        ( CONFIG_GRI_MQTT_AGENT_DISPATCH_TOPIC_SIZE )
+    #define configMQTT_AGENT_DISPATCH_PAYLOAD_SIZE      ( CONFIG_GRI_MQTT_AGENT_DISPATCH_PAYLOAD_SIZE )
+
+/**
+ * @brief Publishes queued to a subscriber at most, and the overflow policy of
+ * the subscribers of the demos, as a SubscriptionDispatcherOverflow_t value.
+ */
+    #define configMQTT_AGENT_DISPATCH_QUEUE_LENGTH      ( CONFIG_GRI_MQTT_AGENT_DISPATCH_QUEUE_LENGTH )
+    #if CONFIG_GRI_MQTT_AGENT_DISPATCH_OVERFLOW_DROP_OLDEST
+        #define configMQTT_AGENT_DISPATCH_OVERFLOW      ( 1 )
+    #elif CONFIG_GRI_MQTT_AGENT_DISPATCH_OVERFLOW_BLOCK
+        #define configMQTT_AGENT_DISPATCH_OVERFLOW      ( 2 )
+    #else
+        #define configMQTT_AGENT_DISPATCH_OVERFLOW      ( 0 )
+    #endif
+
+/**
+ * @brief Longest time in milliseconds the coreMQTT-Agent task waits for room
+ * in the queue of a subscriber with the blocking overflow policy.
+ */
+    #ifdef CONFIG_GRI_MQTT_AGENT_DISPATCH_BLOCK_TIME_MS
+        #define configMQTT_AGENT_DISPATCH_BLOCK_TIME_MS    ( CONFIG_GRI_MQTT_AGENT_DISPATCH_BLOCK_TIME_MS )
+    #else
+        #define configMQTT_AGENT_DISPATCH_BLOCK_TIME_MS    ( 0 )
+    #endif
+
+/**
+ * @brief The task stack size and priority of the subscriber worker tasks.
+ */
+    #define configMQTT_AGENT_DISPATCH_TASK_STACK_SIZE   ( CONFIG_GRI_MQTT_AGENT_DISPATCH_TASK_STACK_SIZE )
+    #define configMQTT_AGENT_DISPATCH_TASK_PRIORITY     ( CONFIG_GRI_MQTT_AGENT_DISPATCH_TASK_PRIORITY )
+
+#endif /* configMQTT_AGENT_QUEUED_DISPATCH */
+
+/**
+ * @brief Whether the MQTT session outlives a reboot. The first connection
+ * after boot resumes the broker session instead of starting a clean one, and
+ * QoS 1 publishes from the publish pool are kept in NVS until acknowledged.
+ */
+#if CONFIG_GRI_MQTT_AGENT_PERSISTENT_SESSION
+    #define configMQTT_AGENT_PERSISTENT_SESSION         ( 1 )
+#else
+    #define configMQTT_AGENT_PERSISTENT_SESSION         ( 0 )
+#endif /* CONFIG_GRI_MQTT_AGENT_PERSISTENT_SESSION */
+
+/**
+ * @brief Whether a second "bulk" MQTT connection is opened next to the
+ * control connection, so large transfers do not delay control traffic.
+ */
+#if CONFIG_GRI_MQTT_AGENT_DUAL_CONNECTION
+    #define configMQTT_AGENT_DUAL_CONNECTION            ( 1 )
+#else
+    #define configMQTT_AGENT_DUAL_CONNECTION            ( 0 )
+#endif /* CONFIG_GRI_MQTT_AGENT_DUAL_CONNECTION */
+
+#if configMQTT_AGENT_DUAL_CONNECTION
+
+/**
+ * @brief Dimensions the network buffer of the bulk connection.
+ * @note Specified in bytes.
+ */
+    #define configMQTT_AGENT_BULK_NETWORK_BUFFER_SIZE   ( CONFIG_GRI_MQTT_AGENT_BULK_NETWORK_BUFFER_SIZE )
+
+/**
+ * @brief Suffix appended to the MQTT client identifier of the bulk connection.
+ */
+    #define configMQTT_AGENT_BULK_CLIENT_ID_SUFFIX      CONFIG_GRI_MQTT_AGENT_BULK_CLIENT_ID_SUFFIX
+
+/**
+ * @brief ';'-separated list of topic filters carried by the bulk connection.
+ */
+    #define configMQTT_AGENT_BULK_TOPIC_FILTERS         CONFIG_GRI_MQTT_AGENT_BULK_TOPIC_FILTERS
+
+#endif /* configMQTT_AGENT_DUAL_CONNECTION */
+
+/**
+ * @brief Number of commands in the coreMQTT-Agent command pool.
+ */
+#define configMQTT_AGENT_COMMAND_POOL_SIZE              ( CONFIG_GRI_MQTT_AGENT_COMMAND_POOL_SIZE )
+
+/**
+ * @brief Maximum number of commands held at once by the tasks registered as
+ * OTA callers of the command pool.
+ */
+#define configMQTT_AGENT_COMMAND_POOL_OTA_QUOTA         ( CONFIG_GRI_MQTT_AGENT_COMMAND_POOL_OTA_QUOTA )
+
+/**
+ * @brief Maximum number of commands held at once by the tasks registered as
+ * telemetry callers of the command pool.
+ */
+#define configMQTT_AGENT_COMMAND_POOL_TELEMETRY_QUOTA   ( CONFIG_GRI_MQTT_AGENT_COMMAND_POOL_TELEMETRY_QUOTA )
+
+/**
+ * @brief Topic and payload bytes of publishes a connection may have in flight
+ * before xCoreMqttAgentManagerCanPublish() refuses further publishes.
+ */
+#define configMQTT_AGENT_PUBLISH_CREDIT_BYTES           ( CONFIG_GRI_MQTT_AGENT_PUBLISH_CREDIT_BYTES )
+
+/**
+ * @brief Largest SUBSCRIBE packet sent when restoring the subscriptions of a
+ * session lost by the broker.
+ * @note Specified in bytes.
+ */
+#define configMQTT_AGENT_RESUBSCRIBE_MAX_PACKET_SIZE    ( CONFIG_GRI_MQTT_AGENT_RESUBSCRIBE_MAX_PACKET_SIZE )
+
+/**
+ * @brief Attempts to restore a topic filter which is not critical before it is
+ * removed from the subscription list.
+ */
+#define configMQTT_AGENT_RESUBSCRIBE_MAX_ATTEMPTS       ( CONFIG_GRI_MQTT_AGENT_RESUBSCRIBE_MAX_ATTEMPTS )
+
+/**
+ * @brief Delay before the first retry of a topic filter which failed to be
+ * restored.
+ */
+#define configMQTT_AGENT_RESUBSCRIBE_BACKOFF_BASE_MS    ( CONFIG_GRI_MQTT_AGENT_RESUBSCRIBE_BACKOFF_BASE_MS )
+
+/**
+ * @brief Longest delay between two retries of a topic filter.
+ */
+#define configMQTT_AGENT_RESUBSCRIBE_MAX_BACKOFF_DELAY_MS    ( CONFIG_GRI_MQTT_AGENT_RESUBSCRIBE_MAX_BACKOFF_DELAY_MS )
+
+/**
+ * @brief ';'-separated list of topic filters whose subscriptions must be
+ * restored before the connection is signalled to the application. Every
+ * subscription is critical if the list is empty.
+ */
+#define configMQTT_AGENT_CRITICAL_TOPIC_FILTERS         CONFIG_GRI_MQTT_AGENT_CRITICAL_TOPIC_FILTERS
+
+/**
+ * @brief Whether a console with the "mqtt_stats" command is started.
+ */
+#if CONFIG_GRI_MQTT_AGENT_METRICS_CONSOLE
+    #define configMQTT_AGENT_METRICS_CONSOLE            ( 1 )
+#else
+    #define configMQTT_AGENT_METRICS_CONSOLE            ( 0 )
+#endif /* CONFIG_GRI_MQTT_AGENT_METRICS_CONSOLE */
+
+/**
+ * @brief Interval in seconds between two publishes of the connection counters,
+ * or 0 to not publish them.
+ */
+#define configMQTT_AGENT_METRICS_PUBLISH_INTERVAL_S     ( CONFIG_GRI_MQTT_AGENT_METRICS_PUBLISH_INTERVAL_S )
+
 #endif /* CORE_MQTT_AGENT_MANAGER_CONFIG_H */
@@ -0,0 +1,309 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file core_mqtt_agent_metrics.c
+ * @brief Reports the coreMQTT-Agent manager counters on a console command and
+ * in periodic MQTT publishes.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <inttypes.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/* ESP-IDF includes. */
+#include <esp_log.h>
+#include <sdkconfig.h>
+
+#if CONFIG_GRI_MQTT_AGENT_METRICS_CONSOLE
+    #include <esp_console.h>
+#endif /* CONFIG_GRI_MQTT_AGENT_METRICS_CONSOLE */
+
+/* coreMQTT-Agent manager include. */
+#include "core_mqtt_agent_manager.h"
+
+/* Publish pool include. */
+#include "core_mqtt_agent_publish_pool.h"
+
+/* Command pool include. */
+#include "core_mqtt_agent_command_pool.h"
+
+/* Public functions include. */
+#include "core_mqtt_agent_metrics.h"
+
+/* Configurations include. */
+#include "core_mqtt_agent_manager_config.h"
+
+/* Preprocessor definitions ***************************************************/
+
+#define METRICS_TASK_STACK_SIZE    ( 3072 )
+#define METRICS_TASK_PRIORITY      ( tskIDLE_PRIORITY + 1 )
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "core_mqtt_agent_metrics";
+
+#if configMQTT_AGENT_METRICS_CONSOLE
+
+/**
+ * @brief Names of the command pool caller classes, for the console.
+ */
+    static const char * const pcCallerNames[ eMQTTAgentCommandPoolCallerCount ] =
+    {
+        [ eMQTTAgentCommandPoolCallerDefault ]   = "default",
+        [ eMQTTAgentCommandPoolCallerOta ]       = "ota",
+        [ eMQTTAgentCommandPoolCallerTelemetry ] = "telemetry",
+    };
+#endif /* configMQTT_AGENT_METRICS_CONSOLE */
+
+/* Static function declarations ***********************************************/
+
+#if configMQTT_AGENT_METRICS_CONSOLE
+
+/**
+ * @brief Handler of the "mqtt_stats" console command, printing the counters
+ * of every connection.
+ *
+ * @param[in] argc Unused.
+ * @param[in] argv Unused.
+ *
+ * @return 0.
+ */
+    static int prvStatsCommand( int argc,
+                                char ** argv );
+#endif /* configMQTT_AGENT_METRICS_CONSOLE */
+
+#if ( configMQTT_AGENT_METRICS_PUBLISH_INTERVAL_S > 0 )
+
+/**
+ * @brief Task publishing the counters of every connected connection each
+ * configMQTT_AGENT_METRICS_PUBLISH_INTERVAL_S seconds.
+ *
+ * @param[in] pvParameters Unused.
+ */
+    static void prvMetricsPublishTask( void * pvParameters );
+#endif /* configMQTT_AGENT_METRICS_PUBLISH_INTERVAL_S > 0 */
+
+/* Static function definitions ************************************************/
+
+#if configMQTT_AGENT_METRICS_CONSOLE
+
+    static int prvStatsCommand( int argc,
+                                char ** argv )
+    {
+        CoreMqttAgentStats_t xStats;
+        MQTTAgentCommandPoolStats_t xPoolStats;
+        uint32_t i;
+
+        ( void ) argc;
+        ( void ) argv;
+
+        for( i = 0; xCoreMqttAgentManagerGetStats( i, &xStats ) == pdPASS; i++ )
+        {
+            printf( "%s connection: %s\n", xStats.pcName, xStats.xConnected ? "connected" : "disconnected" );
+            printf( "  connects %"PRIu32", disconnects %"PRIu32", connected for %"PRIu32" ms\n",
+                    xStats.ulConnects, xStats.ulDisconnects, xStats.ulConnectedMs );
+            printf( "  command queue depth %"PRIu32", high-water %"PRIu32"\n",
+                    xStats.ulQueueDepth, xStats.ulQueueHighWater );
+            printf( "  commands %"PRIu32", avg %"PRIu32" ms, max %"PRIu32" ms\n",
+                    xStats.ulCommands, xStats.ulCommandAvgMs, xStats.ulCommandMaxMs );
+            printf( "  pubacks %"PRIu32", avg %"PRIu32" ms, max %"PRIu32" ms\n",
+                    xStats.ulPubacks, xStats.ulPubackAvgMs, xStats.ulPubackMaxMs );
+            printf( "  tx %"PRIu32" bytes in %"PRIu32" packets, rx %"PRIu32" bytes, %"PRIu32" publishes\n",
+                    xStats.ulTxBytes, xStats.ulTxPackets, xStats.ulRxBytes, xStats.ulRxPublishes );
+            printf( "  publish bytes in flight %"PRIu32", credit refusals %"PRIu32"\n",
+                    xStats.ulPublishBytesInFlight, xStats.ulCreditRefusals );
+            printf( "  command pool in use %"PRIu32", high-water %"PRIu32", exhausted %"PRIu32"\n",
+                    xStats.ulPoolInUse, xStats.ulPoolHighWater, xStats.ulPoolExhausted );
+            printf( "  resubscribe last %"PRIu32" ms, packets %"PRIu32", retries %"PRIu32", dropped %"PRIu32"\n",
+                    xStats.ulResubscribeMs, xStats.ulResubscribePackets,
+                    xStats.ulResubscribeRetries, xStats.ulResubscribeDropped );
+            printf( "  startup subscriptions %"PRIu32" ms after the CONNACK\n",
+                    xStats.ulStartupSubscribeMs );
+            printf( "  subscriptions %"PRIu32" on %"PRIu32" filters, %"PRIu32" bytes\n",
+                    xStats.ulSubscriptions, xStats.ulSubscriptionFilters, xStats.ulSubscriptionBytes );
+        }
+
+        vMQTTAgentCommandPoolGetStats( &xPoolStats );
+
+        for( i = 0; i < ( uint32_t ) eMQTTAgentCommandPoolCallerCount; i++ )
+        {
+            printf( "%s commands: in use %"PRIu32", high-water %"PRIu32", taken %"PRIu32", exhausted %"PRIu32"\n",
+                    pcCallerNames[ i ], xPoolStats.ulInUse[ i ], xPoolStats.ulHighWater[ i ],
+                    xPoolStats.ulTaken[ i ], xPoolStats.ulExhausted[ i ] );
+            printf( "  waits %"PRIu32", avg %"PRIu32" ms, max %"PRIu32" ms\n",
+                    xPoolStats.ulWaits[ i ],
+                    ( xPoolStats.ulWaits[ i ] > 0U ) ? ( xPoolStats.ulTotalWaitMs[ i ] / xPoolStats.ulWaits[ i ] ) : 0U,
+                    xPoolStats.ulMaxWaitMs[ i ] );
+        }
+
+        return 0;
+    }
+
+#endif /* configMQTT_AGENT_METRICS_CONSOLE */
+
+#if ( configMQTT_AGENT_METRICS_PUBLISH_INTERVAL_S > 0 )
+
+    static void prvMetricsPublishTask( void * pvParameters )
+    {
+        CoreMqttAgentStats_t xStats;
+        MQTTAgentPublishBuffer_t * pxBuffer;
+        int lTopicLength;
+        int lPayloadLength;
+        uint32_t i;
+
+        ( void ) pvParameters;
+
+        ( void ) xMQTTAgentCommandPoolRegisterTask( NULL, eMQTTAgentCommandPoolCallerTelemetry );
+
+        for( ; ; )
+        {
+            vTaskDelay( pdMS_TO_TICKS( configMQTT_AGENT_METRICS_PUBLISH_INTERVAL_S * 1000U ) );
+
+            for( i = 0; xCoreMqttAgentManagerGetStats( i, &xStats ) == pdPASS; i++ )
+            {
+                if( xStats.xConnected == false )
+                {
+                    continue;
+                }
+
+                /* Metrics are not worth waiting for a buffer. */
+                pxBuffer = pxMQTTAgentPublishPoolReserve( 0 );
+
+                if( pxBuffer == NULL )
+                {
+                    ESP_LOGW( TAG, "No publish buffer for %s connection metrics.", xStats.pcName );
+                    continue;
+                }
+
+                lTopicLength = snprintf( pxBuffer->cTopic, sizeof( pxBuffer->cTopic ), "%s/metrics/%s",
+                                         xCoreMqttAgentManagerGetClientId(), xStats.pcName );
+
+                lPayloadLength = snprintf( ( char * ) pxBuffer->ucPayload, sizeof( pxBuffer->ucPayload ),
+                                           "{\"con\":%"PRIu32",\"dis\":%"PRIu32",\"upMs\":%"PRIu32","
+                                           "\"qd\":%"PRIu32",\"qhw\":%"PRIu32","
+                                           "\"cmd\":%"PRIu32",\"cmdAvg\":%"PRIu32",\"cmdMax\":%"PRIu32","
+                                           "\"ack\":%"PRIu32",\"ackAvg\":%"PRIu32",\"ackMax\":%"PRIu32","
+                                           "\"txB\":%"PRIu32",\"txP\":%"PRIu32",\"rxB\":%"PRIu32",\"rxP\":%"PRIu32","
+                                           "\"pool\":%"PRIu32",\"poolHw\":%"PRIu32",\"poolEx\":%"PRIu32"}",
+                                           xStats.ulConnects, xStats.ulDisconnects, xStats.ulConnectedMs,
+                                           xStats.ulQueueDepth, xStats.ulQueueHighWater,
+                                           xStats.ulCommands, xStats.ulCommandAvgMs, xStats.ulCommandMaxMs,
+                                           xStats.ulPubacks, xStats.ulPubackAvgMs, xStats.ulPubackMaxMs,
+                                           xStats.ulTxBytes, xStats.ulTxPackets, xStats.ulRxBytes, xStats.ulRxPublishes,
+                                           xStats.ulPoolInUse, xStats.ulPoolHighWater, xStats.ulPoolExhausted );
+
+                if( ( lTopicLength <= 0 ) || ( ( size_t ) lTopicLength >= sizeof( pxBuffer->cTopic ) ) ||
+                    ( lPayloadLength <= 0 ) || ( ( size_t ) lPayloadLength >= sizeof( pxBuffer->ucPayload ) ) )
+                {
+                    ESP_LOGW( TAG, "%s connection metrics do not fit a publish buffer.", xStats.pcName );
+                    vMQTTAgentPublishPoolRelease( pxBuffer );
+                }
+                else
+                {
+                    /* The pool releases the buffer, whatever the outcome. */
+                    ( void ) xMQTTAgentPublishPoolSend( pxBuffer,
+                                                        ( uint16_t ) lTopicLength,
+                                                        ( size_t ) lPayloadLength,
+                                                        MQTTQoS0 );
+                }
+            }
+        }
+    }
+
+#endif /* configMQTT_AGENT_METRICS_PUBLISH_INTERVAL_S > 0 */
+
+/* Public function definitions ************************************************/
+
+BaseType_t xCoreMqttAgentMetricsStart( void )
+{
+    BaseType_t xRet = pdPASS;
+
+    #if configMQTT_AGENT_METRICS_CONSOLE
+        esp_console_repl_t * pxRepl = NULL;
+        esp_console_repl_config_t xReplConfig = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+        const esp_console_cmd_t xStatsCommand =
+        {
+            .command = "mqtt_stats",
+            .help    = "Print the coreMQTT-Agent connection counters",
+            .hint    = NULL,
+            .func    = prvStatsCommand,
+        };
+        esp_err_t xEspErrRet;
+
+        #if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
+            esp_console_dev_usb_serial_jtag_config_t xDeviceConfig = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+
+            xEspErrRet = esp_console_new_repl_usb_serial_jtag( &xDeviceConfig, &xReplConfig, &pxRepl );
+        #else
+            esp_console_dev_uart_config_t xDeviceConfig = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+
+            xEspErrRet = esp_console_new_repl_uart( &xDeviceConfig, &xReplConfig, &pxRepl );
+        #endif /* CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG */
+
+        if( xEspErrRet == ESP_OK )
+        {
+            xEspErrRet = esp_console_cmd_register( &xStatsCommand );
+        }
+
+        if( xEspErrRet == ESP_OK )
+        {
+            xEspErrRet = esp_console_start_repl( pxRepl );
+        }
+
+        if( xEspErrRet != ESP_OK )
+        {
+            ESP_LOGE( TAG, "Failed to start the metrics console: %s.", esp_err_to_name( xEspErrRet ) );
+            xRet = pdFAIL;
+        }
+    #endif /* configMQTT_AGENT_METRICS_CONSOLE */
+
+    #if ( configMQTT_AGENT_METRICS_PUBLISH_INTERVAL_S > 0 )
+        if( ( xRet == pdPASS ) &&
+            ( xTaskCreate( prvMetricsPublishTask,
+                           "MQTTMetrics",
+                           METRICS_TASK_STACK_SIZE,
+                           NULL,
+                           METRICS_TASK_PRIORITY,
+                           NULL ) != pdPASS ) )
+        {
+            ESP_LOGE( TAG, "Failed to create the metrics publish task." );
+            xRet = pdFAIL;
+        }
+    #endif /* configMQTT_AGENT_METRICS_PUBLISH_INTERVAL_S > 0 */
+
+    return xRet;
+}
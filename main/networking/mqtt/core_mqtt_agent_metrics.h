@@ -0,0 +1,50 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file core_mqtt_agent_metrics.h
+ * @brief Reports the coreMQTT-Agent manager counters on a console command and
+ * in periodic MQTT publishes.
+ */
+#ifndef CORE_MQTT_AGENT_METRICS_H
+#define CORE_MQTT_AGENT_METRICS_H
+
+/* FreeRTOS includes. */
+#include <freertos/FreeRTOS.h>
+
+/**
+ * @brief Start the metrics reporters enabled in the configuration: the
+ * "mqtt_stats" console command, and the task publishing the counters of each
+ * connection to "<client id>/metrics/<connection name>".
+ *
+ * Must be called after xCoreMqttAgentManagerStart().
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xCoreMqttAgentMetricsStart( void );
+
+#endif /* CORE_MQTT_AGENT_METRICS_H */
@@ -0,0 +1,698 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file core_mqtt_agent_publish_pool.c
+ * @brief Pool of publish buffers owned by the coreMQTT-Agent while in flight.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+/* ESP-IDF includes. */
+#include <esp_log.h>
+#include <nvs.h>
+
+/* coreMQTT-Agent library include. */
+#include "core_mqtt_agent.h"
+
+/* coreMQTT-Agent manager include. */
+#include "core_mqtt_agent_manager.h"
+
+/* Public functions include. */
+#include "core_mqtt_agent_publish_pool.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/* NVS namespace and key format used to persist in-flight QoS 1 publishes. */
+#define PUBLISH_POOL_NVS_NAMESPACE     "mqtt_session"
+#define PUBLISH_POOL_NVS_KEY_FORMAT    "pub%02d"
+
+#if configMQTT_AGENT_PERSISTENT_SESSION
+
+/* Time the NVS task waits once woken, so the publishes queued and
+ * acknowledged meanwhile are stored and erased in the same pass. */
+    #define PUBLISH_POOL_NVS_BATCH_MS           ( 100 )
+
+    #define PUBLISH_POOL_NVS_TASK_STACK_SIZE    ( 3072 )
+    #define PUBLISH_POOL_NVS_TASK_PRIORITY      ( tskIDLE_PRIORITY + 1 )
+
+    #if ( configMQTT_AGENT_PUBLISH_POOL_BUFFERS > 32 )
+        #error "configMQTT_AGENT_PUBLISH_POOL_BUFFERS must be 32 at most with persistent sessions."
+    #endif
+#endif /* configMQTT_AGENT_PERSISTENT_SESSION */
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief Lengths and QoS of the publish held by a pool entry.
+ */
+typedef struct PublishPoolRecord
+{
+    uint16_t usTopicLength;
+    uint16_t usPayloadLength;
+    uint8_t ucQoS;
+} PublishPoolRecord_t;
+
+/**
+ * @brief A pool entry. The coreMQTT-Agent hands it back to the completion
+ * callback as the command context, and resends its publish info when a
+ * session is resumed, so both must stay valid until the publish completes.
+ *
+ * While a QoS 1 publish is in flight, if persistent sessions are enabled, its
+ * xRecord followed by the used bytes of the topic and payload is persisted as
+ * one NVS blob.
+ */
+struct MQTTAgentCommandContext
+{
+    MQTTAgentPublishBuffer_t xBuffer; /**< Must be first, handed out to callers. */
+    PublishPoolRecord_t xRecord;      /**< Describes the contents of xBuffer. */
+    MQTTPublishInfo_t xPublishInfo;   /**< Publish info referencing xBuffer. */
+};
+
+/**
+ * @brief Largest NVS blob of an entry.
+ */
+#define PUBLISH_POOL_MAX_RECORD_SIZE                 \
+    ( sizeof( PublishPoolRecord_t ) +                \
+      configMQTT_AGENT_PUBLISH_POOL_TOPIC_SIZE +     \
+      configMQTT_AGENT_PUBLISH_POOL_PAYLOAD_SIZE )
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "core_mqtt_agent_publish_pool";
+
+/**
+ * @brief Storage of the pool entries.
+ */
+static MQTTAgentCommandContext_t xEntries[ configMQTT_AGENT_PUBLISH_POOL_BUFFERS ];
+
+/**
+ * @brief Queue holding the free pool entries.
+ */
+static QueueHandle_t xFreeEntries;
+static StaticQueue_t xFreeEntriesStructure;
+static uint8_t ucFreeEntriesStorage[ configMQTT_AGENT_PUBLISH_POOL_BUFFERS * sizeof( MQTTAgentCommandContext_t * ) ];
+
+/**
+ * @brief Pool counters, protected by xStatsLock.
+ */
+static MQTTAgentPublishPoolStats_t xStats;
+static portMUX_TYPE xStatsLock = portMUX_INITIALIZER_UNLOCKED;
+
+#if configMQTT_AGENT_PERSISTENT_SESSION
+
+/**
+ * @brief Entries restored from NVS at boot, waiting for
+ * vMQTTAgentPublishPoolReplay().
+ */
+    static bool xRestored[ configMQTT_AGENT_PUBLISH_POOL_BUFFERS ];
+
+/**
+ * @brief One bit per entry whose QoS 1 publish was queued, set atomically by
+ * the producer and taken by the NVS task.
+ */
+    static uint32_t ulEntriesToStore;
+
+/**
+ * @brief One bit per entry whose QoS 1 publish completed, set atomically by
+ * the agent task and taken by the NVS task. Such an entry is only returned to
+ * the free queue by the NVS task, so it is never refilled while being stored.
+ */
+    static uint32_t ulEntriesCompleted;
+
+/**
+ * @brief One bit per entry with a record in NVS, and per entry whose record
+ * failed to be erased. Only used by the NVS task once initialized.
+ */
+    static uint32_t ulStoredEntries;
+    static uint32_t ulEntriesToRetry;
+
+/**
+ * @brief Blob of the entry being stored or restored.
+ */
+    static uint8_t ucRecordBuffer[ PUBLISH_POOL_MAX_RECORD_SIZE ];
+
+/**
+ * @brief Task storing and erasing the records of QoS 1 publishes.
+ */
+    static TaskHandle_t xNvsTask;
+#endif /* configMQTT_AGENT_PERSISTENT_SESSION */
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Count the result of a publish and return its entry, through the NVS
+ * task if the publish may have been stored.
+ *
+ * @param[in] pxEntry Entry to return.
+ * @param[in] xResult Result of the publish using the entry.
+ */
+static void prvReturnEntry( MQTTAgentCommandContext_t * pxEntry,
+                            MQTTStatus_t xResult );
+
+/**
+ * @brief Return an entry to the free queue.
+ *
+ * @param[in] pxEntry Entry to return.
+ */
+static void prvFreeEntry( MQTTAgentCommandContext_t * pxEntry );
+
+/**
+ * @brief Passed into MQTTAgent_Publish() as the callback to execute when the
+ * publish completes. Returns the entry to the pool.
+ *
+ * @param[in] pxCommandContext Pool entry used by the publish.
+ * @param[in] pxReturnInfo The result of the command.
+ */
+static void prvPublishCompleteCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                        MQTTAgentReturnInfo_t * pxReturnInfo );
+
+/**
+ * @brief Queue the publish described by an entry to the agent.
+ *
+ * @param[in] pxEntry Entry to publish.
+ *
+ * @return The result of MQTTAgent_Publish().
+ */
+static MQTTStatus_t prvQueuePublish( MQTTAgentCommandContext_t * pxEntry );
+
+#if configMQTT_AGENT_PERSISTENT_SESSION
+
+/**
+ * @brief Store an entry in NVS, replacing the record of its previous publish
+ * if that one was not erased yet.
+ *
+ * @param[in] xNvsHandle Open NVS handle.
+ * @param[in] i Index of the entry.
+ *
+ * @return The result of nvs_set_blob().
+ */
+    static esp_err_t prvStoreEntry( nvs_handle_t xNvsHandle,
+                                    int i );
+
+/**
+ * @brief Task storing the publishes queued since its last pass and erasing
+ * the records of those completed, in batches with one commit each. NVS writes
+ * block for the duration of a flash write, so they are kept off both the
+ * producers and the agent task, which completes the publishes.
+ *
+ * @param[in] pvParameters Unused.
+ */
+    static void prvNvsTask( void * pvParameters );
+
+/**
+ * @brief Load the entries persisted before the last reboot.
+ */
+    static void prvRestoreEntries( void );
+#endif /* configMQTT_AGENT_PERSISTENT_SESSION */
+
+/* Static function definitions ************************************************/
+
+static void prvReturnEntry( MQTTAgentCommandContext_t * pxEntry,
+                            MQTTStatus_t xResult )
+{
+    taskENTER_CRITICAL( &xStatsLock );
+
+    if( xResult == MQTTSuccess )
+    {
+        xStats.ulPublished++;
+    }
+    else
+    {
+        xStats.ulFailed++;
+    }
+
+    taskEXIT_CRITICAL( &xStatsLock );
+
+    #if configMQTT_AGENT_PERSISTENT_SESSION
+        /* The NVS task erases the record, if it was stored at all, and then
+         * frees the entry. */
+        if( pxEntry->xRecord.ucQoS > ( uint8_t ) MQTTQoS0 )
+        {
+            ( void ) __atomic_fetch_or( &ulEntriesCompleted, 1UL << ( pxEntry - xEntries ), __ATOMIC_RELEASE );
+            xTaskNotifyGive( xNvsTask );
+        }
+        else
+    #endif /* configMQTT_AGENT_PERSISTENT_SESSION */
+    {
+        prvFreeEntry( pxEntry );
+    }
+}
+
+static void prvFreeEntry( MQTTAgentCommandContext_t * pxEntry )
+{
+    taskENTER_CRITICAL( &xStatsLock );
+    xStats.ulInUse--;
+    taskEXIT_CRITICAL( &xStatsLock );
+
+    ( void ) xQueueSendToBack( xFreeEntries, &pxEntry, 0 );
+}
+
+static void prvPublishCompleteCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                        MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    if( pxReturnInfo->returnCode != MQTTSuccess )
+    {
+        ESP_LOGW( TAG, "Publish to %.*s failed with error = %u.",
+                  pxCommandContext->xPublishInfo.topicNameLength,
+                  pxCommandContext->xPublishInfo.pTopicName,
+                  pxReturnInfo->returnCode );
+    }
+
+    prvReturnEntry( pxCommandContext, pxReturnInfo->returnCode );
+}
+
+static MQTTStatus_t prvQueuePublish( MQTTAgentCommandContext_t * pxEntry )
+{
+    MQTTAgentCommandInfo_t xCommandParams = { 0 };
+
+    memset( &( pxEntry->xPublishInfo ), 0x00, sizeof( pxEntry->xPublishInfo ) );
+    pxEntry->xPublishInfo.qos = ( MQTTQoS_t ) pxEntry->xRecord.ucQoS;
+    pxEntry->xPublishInfo.pTopicName = pxEntry->xBuffer.cTopic;
+    pxEntry->xPublishInfo.topicNameLength = pxEntry->xRecord.usTopicLength;
+    pxEntry->xPublishInfo.pPayload = pxEntry->xBuffer.ucPayload;
+    pxEntry->xPublishInfo.payloadLength = pxEntry->xRecord.usPayloadLength;
+
+    /* Do not block the producer; a full command queue is reported as a
+     * failure so the producer can decide whether to retry. */
+    xCommandParams.blockTimeMs = 0;
+    xCommandParams.cmdCompleteCallback = prvPublishCompleteCallback;
+    xCommandParams.pCmdCompleteCallbackContext = pxEntry;
+
+    return MQTTAgent_Publish( pxCoreMqttAgentManagerGetContextForTopic( pxEntry->xBuffer.cTopic,
+                                                                        pxEntry->xRecord.usTopicLength ),
+                              &( pxEntry->xPublishInfo ),
+                              &xCommandParams );
+}
+
+#if configMQTT_AGENT_PERSISTENT_SESSION
+
+    static esp_err_t prvStoreEntry( nvs_handle_t xNvsHandle,
+                                    int i )
+    {
+        MQTTAgentCommandContext_t * pxEntry = &( xEntries[ i ] );
+        size_t xLength = sizeof( PublishPoolRecord_t );
+        char cKey[ 8 ];
+
+        /* Only the used bytes, so small publishes cost small writes. */
+        memcpy( ucRecordBuffer, &( pxEntry->xRecord ), sizeof( PublishPoolRecord_t ) );
+        memcpy( &( ucRecordBuffer[ xLength ] ), pxEntry->xBuffer.cTopic, pxEntry->xRecord.usTopicLength );
+        xLength += pxEntry->xRecord.usTopicLength;
+        memcpy( &( ucRecordBuffer[ xLength ] ), pxEntry->xBuffer.ucPayload, pxEntry->xRecord.usPayloadLength );
+        xLength += pxEntry->xRecord.usPayloadLength;
+
+        snprintf( cKey, sizeof( cKey ), PUBLISH_POOL_NVS_KEY_FORMAT, i );
+
+        return nvs_set_blob( xNvsHandle, cKey, ucRecordBuffer, xLength );
+    }
+
+    static void prvNvsTask( void * pvParameters )
+    {
+        nvs_handle_t xNvsHandle;
+        esp_err_t xEspErrRet;
+        esp_err_t xLastError;
+        uint32_t ulStore;
+        uint32_t ulCompleted;
+        uint32_t ulErase;
+        uint32_t ulFailed;
+        char cKey[ 8 ];
+        int i;
+
+        ( void ) pvParameters;
+
+        for( ; ; )
+        {
+            ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+            vTaskDelay( pdMS_TO_TICKS( PUBLISH_POOL_NVS_BATCH_MS ) );
+
+            /* Taken in this order, an entry that completes in between is in
+             * both sets, and is not stored. Completed entries are not refilled
+             * until freed below, so their contents are stable. */
+            ulStore = __atomic_exchange_n( &ulEntriesToStore, 0U, __ATOMIC_ACQUIRE );
+            ulCompleted = __atomic_exchange_n( &ulEntriesCompleted, 0U, __ATOMIC_ACQUIRE );
+            ulStore &= ~ulCompleted;
+            ulFailed = 0U;
+            xLastError = ESP_OK;
+
+            if( ( ulStore | ulEntriesToRetry | ( ulCompleted & ulStoredEntries ) ) != 0U )
+            {
+                xEspErrRet = nvs_open( PUBLISH_POOL_NVS_NAMESPACE, NVS_READWRITE, &xNvsHandle );
+
+                if( xEspErrRet == ESP_OK )
+                {
+                    for( i = 0; i < configMQTT_AGENT_PUBLISH_POOL_BUFFERS; i++ )
+                    {
+                        if( ( ulStore & ( 1UL << i ) ) != 0U )
+                        {
+                            xEspErrRet = prvStoreEntry( xNvsHandle, i );
+
+                            if( xEspErrRet == ESP_OK )
+                            {
+                                /* Replaces the record of the previous publish. */
+                                ulStoredEntries |= 1UL << i;
+                                ulEntriesToRetry &= ~( 1UL << i );
+                            }
+                            else
+                            {
+                                ulFailed |= 1UL << i;
+                                xLastError = xEspErrRet;
+                            }
+                        }
+                    }
+
+                    ulErase = ( ulCompleted | ulEntriesToRetry ) & ulStoredEntries;
+
+                    for( i = 0; i < configMQTT_AGENT_PUBLISH_POOL_BUFFERS; i++ )
+                    {
+                        if( ( ulErase & ( 1UL << i ) ) != 0U )
+                        {
+                            snprintf( cKey, sizeof( cKey ), PUBLISH_POOL_NVS_KEY_FORMAT, i );
+                            xEspErrRet = nvs_erase_key( xNvsHandle, cKey );
+
+                            if( ( xEspErrRet == ESP_OK ) || ( xEspErrRet == ESP_ERR_NVS_NOT_FOUND ) )
+                            {
+                                ulStoredEntries &= ~( 1UL << i );
+                                ulEntriesToRetry &= ~( 1UL << i );
+                            }
+                            else
+                            {
+                                /* A record left in NVS is sent again after a
+                                 * reboot, which QoS 1 allows. It is retried
+                                 * with the next batch. */
+                                ulEntriesToRetry |= 1UL << i;
+                                xLastError = xEspErrRet;
+                            }
+                        }
+                    }
+
+                    /* One commit for the whole batch. */
+                    xEspErrRet = nvs_commit( xNvsHandle );
+                    nvs_close( xNvsHandle );
+                }
+                else
+                {
+                    ulFailed = ulStore;
+                    ulEntriesToRetry |= ulCompleted & ulStoredEntries;
+                }
+
+                if( xEspErrRet != ESP_OK )
+                {
+                    xLastError = xEspErrRet;
+                }
+
+                if( xLastError != ESP_OK )
+                {
+                    ESP_LOGW( TAG, "Failed to persist publishes 0x%08"PRIx32" or erase 0x%08"PRIx32": %s.",
+                              ulFailed,
+                              ulEntriesToRetry,
+                              esp_err_to_name( xLastError ) );
+                }
+            }
+
+            for( i = 0; i < configMQTT_AGENT_PUBLISH_POOL_BUFFERS; i++ )
+            {
+                if( ( ulCompleted & ( 1UL << i ) ) != 0U )
+                {
+                    prvFreeEntry( &( xEntries[ i ] ) );
+                }
+            }
+        }
+    }
+
+    static void prvRestoreEntries( void )
+    {
+        nvs_handle_t xNvsHandle;
+        PublishPoolRecord_t xRecord;
+        char cKey[ 8 ];
+        size_t xLength;
+        int i;
+
+        if( nvs_open( PUBLISH_POOL_NVS_NAMESPACE, NVS_READONLY, &xNvsHandle ) == ESP_OK )
+        {
+            for( i = 0; i < configMQTT_AGENT_PUBLISH_POOL_BUFFERS; i++ )
+            {
+                snprintf( cKey, sizeof( cKey ), PUBLISH_POOL_NVS_KEY_FORMAT, i );
+                xLength = sizeof( ucRecordBuffer );
+
+                if( ( nvs_get_blob( xNvsHandle, cKey, ucRecordBuffer, &xLength ) == ESP_OK ) &&
+                    ( xLength >= sizeof( xRecord ) ) )
+                {
+                    memcpy( &xRecord, ucRecordBuffer, sizeof( xRecord ) );
+
+                    /* A record whose lengths do not add up was stored by a
+                     * firmware with a different pool layout and cannot be
+                     * trusted. It is still marked as stored, so that it is
+                     * erased with the next batch. */
+                    ulStoredEntries |= 1UL << i;
+
+                    if( ( xRecord.usTopicLength <= sizeof( xEntries[ i ].xBuffer.cTopic ) ) &&
+                        ( xRecord.usPayloadLength <= sizeof( xEntries[ i ].xBuffer.ucPayload ) ) &&
+                        ( xLength == sizeof( xRecord ) + xRecord.usTopicLength + xRecord.usPayloadLength ) )
+                    {
+                        xEntries[ i ].xRecord = xRecord;
+                        memcpy( xEntries[ i ].xBuffer.cTopic,
+                                &( ucRecordBuffer[ sizeof( xRecord ) ] ),
+                                xRecord.usTopicLength );
+                        memcpy( xEntries[ i ].xBuffer.ucPayload,
+                                &( ucRecordBuffer[ sizeof( xRecord ) + xRecord.usTopicLength ] ),
+                                xRecord.usPayloadLength );
+                        xRestored[ i ] = true;
+                    }
+                    else
+                    {
+                        ulEntriesToRetry |= 1UL << i;
+                    }
+                }
+            }
+
+            nvs_close( xNvsHandle );
+        }
+    }
+
+#endif /* configMQTT_AGENT_PERSISTENT_SESSION */
+
+/* Public function definitions ************************************************/
+
+BaseType_t xMQTTAgentPublishPoolInit( void )
+{
+    BaseType_t xRet = pdPASS;
+    MQTTAgentCommandContext_t * pxEntry;
+    int i;
+
+    xFreeEntries = xQueueCreateStatic( configMQTT_AGENT_PUBLISH_POOL_BUFFERS,
+                                       sizeof( MQTTAgentCommandContext_t * ),
+                                       ucFreeEntriesStorage,
+                                       &xFreeEntriesStructure );
+
+    #if configMQTT_AGENT_PERSISTENT_SESSION
+        /* Restored before the NVS task starts, which owns the records then. */
+        prvRestoreEntries();
+
+        if( xTaskCreate( prvNvsTask,
+                         "MQTTPubNvs",
+                         PUBLISH_POOL_NVS_TASK_STACK_SIZE,
+                         NULL,
+                         PUBLISH_POOL_NVS_TASK_PRIORITY,
+                         &xNvsTask ) != pdPASS )
+        {
+            ESP_LOGE( TAG, "Failed to create the publish pool NVS task." );
+            xRet = pdFAIL;
+        }
+        else if( ulEntriesToRetry != 0U )
+        {
+            xTaskNotifyGive( xNvsTask );
+        }
+    #endif /* configMQTT_AGENT_PERSISTENT_SESSION */
+
+    if( xFreeEntries == NULL )
+    {
+        ESP_LOGE( TAG, "Failed to create publish pool free queue." );
+        xRet = pdFAIL;
+    }
+    else if( xRet == pdFAIL )
+    {
+        /* Reported above. */
+    }
+    else
+    {
+        for( i = 0; i < configMQTT_AGENT_PUBLISH_POOL_BUFFERS; i++ )
+        {
+            pxEntry = &( xEntries[ i ] );
+
+            #if configMQTT_AGENT_PERSISTENT_SESSION
+                if( xRestored[ i ] )
+                {
+                    /* Held until vMQTTAgentPublishPoolReplay() queues it. */
+                    xStats.ulInUse++;
+                    xStats.ulInUseHighWater = xStats.ulInUse;
+                    continue;
+                }
+            #endif /* configMQTT_AGENT_PERSISTENT_SESSION */
+
+            ( void ) xQueueSendToBack( xFreeEntries, &pxEntry, 0 );
+        }
+    }
+
+    return xRet;
+}
+
+void vMQTTAgentPublishPoolReplay( void )
+{
+    #if configMQTT_AGENT_PERSISTENT_SESSION
+        MQTTStatus_t xResult;
+        int i;
+
+        for( i = 0; i < configMQTT_AGENT_PUBLISH_POOL_BUFFERS; i++ )
+        {
+            if( xRestored[ i ] )
+            {
+                xRestored[ i ] = false;
+
+                ESP_LOGI( TAG, "Replaying publish to %.*s interrupted by reboot.",
+                          xEntries[ i ].xRecord.usTopicLength,
+                          xEntries[ i ].xBuffer.cTopic );
+
+                xResult = prvQueuePublish( &( xEntries[ i ] ) );
+
+                if( xResult != MQTTSuccess )
+                {
+                    prvReturnEntry( &( xEntries[ i ] ), xResult );
+                }
+            }
+        }
+    #endif /* configMQTT_AGENT_PERSISTENT_SESSION */
+}
+
+MQTTAgentPublishBuffer_t * pxMQTTAgentPublishPoolReserve( uint32_t ulBlockTimeMs )
+{
+    MQTTAgentCommandContext_t * pxEntry = NULL;
+
+    if( xQueueReceive( xFreeEntries, &pxEntry, pdMS_TO_TICKS( ulBlockTimeMs ) ) == pdTRUE )
+    {
+        taskENTER_CRITICAL( &xStatsLock );
+
+        xStats.ulInUse++;
+
+        if( xStats.ulInUse > xStats.ulInUseHighWater )
+        {
+            xStats.ulInUseHighWater = xStats.ulInUse;
+        }
+
+        taskEXIT_CRITICAL( &xStatsLock );
+    }
+    else
+    {
+        taskENTER_CRITICAL( &xStatsLock );
+        xStats.ulReserveFailures++;
+        taskEXIT_CRITICAL( &xStatsLock );
+
+        pxEntry = NULL;
+    }
+
+    return ( pxEntry != NULL ) ? &( pxEntry->xBuffer ) : NULL;
+}
+
+void vMQTTAgentPublishPoolRelease( MQTTAgentPublishBuffer_t * pxBuffer )
+{
+    MQTTAgentCommandContext_t * pxEntry = ( MQTTAgentCommandContext_t * ) pxBuffer;
+
+    configASSERT( pxBuffer != NULL );
+
+    taskENTER_CRITICAL( &xStatsLock );
+    xStats.ulInUse--;
+    taskEXIT_CRITICAL( &xStatsLock );
+
+    ( void ) xQueueSendToBack( xFreeEntries, &pxEntry, 0 );
+}
+
+MQTTStatus_t xMQTTAgentPublishPoolSend( MQTTAgentPublishBuffer_t * pxBuffer,
+                                        uint16_t usTopicLength,
+                                        size_t xPayloadLength,
+                                        MQTTQoS_t xQoS )
+{
+    MQTTAgentCommandContext_t * pxEntry = ( MQTTAgentCommandContext_t * ) pxBuffer;
+    MQTTStatus_t xResult = MQTTBadParameter;
+
+    configASSERT( pxBuffer != NULL );
+
+    if( ( usTopicLength == 0U ) ||
+        ( usTopicLength > sizeof( pxBuffer->cTopic ) ) ||
+        ( xPayloadLength > sizeof( pxBuffer->ucPayload ) ) )
+    {
+        ESP_LOGE( TAG, "Invalid publish lengths: topic=%u payload=%u.",
+                  ( unsigned int ) usTopicLength,
+                  ( unsigned int ) xPayloadLength );
+    }
+    else
+    {
+        pxEntry->xRecord.usTopicLength = usTopicLength;
+        pxEntry->xRecord.usPayloadLength = ( uint16_t ) xPayloadLength;
+        pxEntry->xRecord.ucQoS = ( uint8_t ) xQoS;
+
+        #if configMQTT_AGENT_PERSISTENT_SESSION
+            /* Keep QoS 1 publishes across a reboot until acknowledged. The
+             * NVS task stores them, so the producer never waits for flash. */
+            if( xQoS > MQTTQoS0 )
+            {
+                ( void ) __atomic_fetch_or( &ulEntriesToStore, 1UL << ( pxEntry - xEntries ), __ATOMIC_RELEASE );
+                xTaskNotifyGive( xNvsTask );
+            }
+        #endif /* configMQTT_AGENT_PERSISTENT_SESSION */
+
+        xResult = prvQueuePublish( pxEntry );
+    }
+
+    /* The completion callback only runs for queued publishes. */
+    if( xResult != MQTTSuccess )
+    {
+        prvReturnEntry( pxEntry, xResult );
+    }
+
+    return xResult;
+}
+
+void vMQTTAgentPublishPoolGetStats( MQTTAgentPublishPoolStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL( &xStatsLock );
+    *pxStats = xStats;
+    taskEXIT_CRITICAL( &xStatsLock );
+}
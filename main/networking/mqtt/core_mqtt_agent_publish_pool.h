@@ -0,0 +1,141 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file core_mqtt_agent_publish_pool.h
+ * @brief Pool of publish buffers owned by the coreMQTT-Agent while in flight.
+ *
+ * A producer reserves a buffer, writes the topic and payload into it in place
+ * and hands it to the agent with xMQTTAgentPublishPoolSend(). The buffer is
+ * returned to the pool when the publish completes: after it is sent for QoS 0,
+ * when the PUBACK is received for QoS 1, or when the publish fails. Producers
+ * therefore do not need to keep their payload alive or wait for the PUBACK,
+ * and the memory used by in-flight publishes stays bounded by the pool size.
+ */
+#ifndef CORE_MQTT_AGENT_PUBLISH_POOL_H
+#define CORE_MQTT_AGENT_PUBLISH_POOL_H
+
+/* Standard includes. */
+#include <stddef.h>
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include <freertos/FreeRTOS.h>
+
+/* coreMQTT library include. */
+#include "core_mqtt.h"
+
+/* Configurations include. */
+#include "core_mqtt_agent_manager_config.h"
+
+/**
+ * @brief A publish buffer. Callers write the topic and payload in place.
+ */
+typedef struct MQTTAgentPublishBuffer
+{
+    char cTopic[ configMQTT_AGENT_PUBLISH_POOL_TOPIC_SIZE ];         /**< Topic name, need not be terminated. */
+    uint8_t ucPayload[ configMQTT_AGENT_PUBLISH_POOL_PAYLOAD_SIZE ]; /**< Payload. */
+} MQTTAgentPublishBuffer_t;
+
+/**
+ * @brief Counters describing the use of the publish pool.
+ */
+typedef struct MQTTAgentPublishPoolStats
+{
+    uint32_t ulReserveFailures;  /**< Reservations that timed out as every buffer was in use. */
+    uint32_t ulPublished;        /**< Publishes completed successfully. */
+    uint32_t ulFailed;           /**< Publishes that could not be queued or completed with an error. */
+    uint32_t ulInUse;            /**< Buffers currently reserved or in flight. */
+    uint32_t ulInUseHighWater;   /**< Maximum of ulInUse since boot. */
+} MQTTAgentPublishPoolStats_t;
+
+/**
+ * @brief Initialize the publish pool. Must be called once before any other
+ * publish pool function.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xMQTTAgentPublishPoolInit( void );
+
+/**
+ * @brief Queue the QoS 1 publishes that were in flight at the last reboot.
+ *
+ * Only has an effect with persistent sessions enabled, in which case the pool
+ * stores each QoS 1 publish in NVS, from a low priority task, until it is
+ * acknowledged. A publish acknowledged before it was stored is not stored at
+ * all, and one queued just before a reboot may not have been stored yet. The
+ * publishes are sent again with new packet identifiers once connected. Must be
+ * called once the coreMQTT-Agent contexts are initialized.
+ */
+void vMQTTAgentPublishPoolReplay( void );
+
+/**
+ * @brief Reserve a publish buffer.
+ *
+ * @param[in] ulBlockTimeMs Time to wait for a buffer when all are in use.
+ *
+ * @return The reserved buffer, or NULL if none became available in time.
+ */
+MQTTAgentPublishBuffer_t * pxMQTTAgentPublishPoolReserve( uint32_t ulBlockTimeMs );
+
+/**
+ * @brief Return a reserved buffer that will not be sent to the pool.
+ *
+ * @param[in] pxBuffer Buffer returned by pxMQTTAgentPublishPoolReserve().
+ */
+void vMQTTAgentPublishPoolRelease( MQTTAgentPublishBuffer_t * pxBuffer );
+
+/**
+ * @brief Publish the contents of a reserved buffer without waiting for the
+ * publish to complete.
+ *
+ * Ownership of the buffer passes to the pool whatever the result, so the
+ * caller must not access it afterwards. The publish is queued on the agent
+ * context that carries the topic, see
+ * pxCoreMqttAgentManagerGetContextForTopic().
+ *
+ * @param[in] pxBuffer Buffer returned by pxMQTTAgentPublishPoolReserve().
+ * @param[in] usTopicLength Length of the topic written to pxBuffer->cTopic.
+ * @param[in] xPayloadLength Length of the payload written to pxBuffer->ucPayload.
+ * @param[in] xQoS QoS of the publish.
+ *
+ * @return `MQTTSuccess` if the publish was queued, else the error returned by
+ * MQTTAgent_Publish() or `MQTTBadParameter` if a length exceeds the buffer.
+ */
+MQTTStatus_t xMQTTAgentPublishPoolSend( MQTTAgentPublishBuffer_t * pxBuffer,
+                                        uint16_t usTopicLength,
+                                        size_t xPayloadLength,
+                                        MQTTQoS_t xQoS );
+
+/**
+ * @brief Copy the publish pool counters.
+ *
+ * @param[out] pxStats Where to copy the counters.
+ */
+void vMQTTAgentPublishPoolGetStats( MQTTAgentPublishPoolStats_t * pxStats );
+
+#endif /* CORE_MQTT_AGENT_PUBLISH_POOL_H */
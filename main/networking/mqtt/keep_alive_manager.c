@@ -0,0 +1,171 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file keep_alive_manager.c
+ * @brief Adapts the MQTT keep-alive interval to the network path.
+ */
+
+/* Includes *******************************************************************/
+
+/* Public functions include. */
+#include "keep_alive_manager.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/* Pings answered in a row before the ping interval is lengthened. */
+#define KEEP_ALIVE_GROW_AFTER_PINGS    ( 4U )
+
+/* The ping interval grows by 1 / KEEP_ALIVE_GROW_DIVISOR of itself. */
+#define KEEP_ALIVE_GROW_DIVISOR        ( 4U )
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Fold a round trip time sample into the estimate, as in RFC 6298.
+ *
+ * @param[in] pxManager Manager to update.
+ * @param[in] ulRttMs Round trip time of the last ping.
+ */
+static void prvUpdateRtt( KeepAliveManager_t * pxManager,
+                          uint32_t ulRttMs );
+
+/* Static function definitions ************************************************/
+
+static void prvUpdateRtt( KeepAliveManager_t * pxManager,
+                          uint32_t ulRttMs )
+{
+    KeepAliveStats_t * pxStats = &( pxManager->xStats );
+    uint32_t ulDeltaMs;
+
+    if( pxStats->ulPings == 0U )
+    {
+        pxStats->ulSrttMs = ulRttMs;
+        pxStats->ulRttVarMs = ulRttMs / 2U;
+        pxStats->ulMinRttMs = ulRttMs;
+        pxStats->ulMaxRttMs = ulRttMs;
+    }
+    else
+    {
+        ulDeltaMs = ( pxStats->ulSrttMs > ulRttMs ) ? ( pxStats->ulSrttMs - ulRttMs ) :
+                    ( ulRttMs - pxStats->ulSrttMs );
+        pxStats->ulRttVarMs = ( ( 3U * pxStats->ulRttVarMs ) + ulDeltaMs ) / 4U;
+        pxStats->ulSrttMs = ( ( 7U * pxStats->ulSrttMs ) + ulRttMs ) / 8U;
+
+        if( ulRttMs < pxStats->ulMinRttMs )
+        {
+            pxStats->ulMinRttMs = ulRttMs;
+        }
+
+        if( ulRttMs > pxStats->ulMaxRttMs )
+        {
+            pxStats->ulMaxRttMs = ulRttMs;
+        }
+    }
+
+    pxStats->ulPings++;
+}
+
+/* Public function definitions ************************************************/
+
+void vKeepAliveManagerInit( KeepAliveManager_t * pxManager,
+                            uint16_t usMinIntervalSec,
+                            uint16_t usMaxIntervalSec )
+{
+    pxManager->usMinIntervalSec = ( usMinIntervalSec < usMaxIntervalSec ) ? usMinIntervalSec : usMaxIntervalSec;
+    pxManager->usMaxIntervalSec = usMaxIntervalSec;
+    pxManager->ulLastPingReqSendTimeMs = 0U;
+    pxManager->ulAnsweredAtInterval = 0U;
+    pxManager->xStats = ( KeepAliveStats_t ) { 0 };
+    pxManager->xStats.usIntervalSec = usMaxIntervalSec;
+}
+
+void vKeepAliveManagerOnConnect( KeepAliveManager_t * pxManager,
+                                 MQTTContext_t * pxContext )
+{
+    pxContext->keepAliveIntervalSec = pxManager->xStats.usIntervalSec;
+    pxManager->ulLastPingReqSendTimeMs = pxContext->pingReqSendTimeMs;
+}
+
+void vKeepAliveManagerPoll( KeepAliveManager_t * pxManager,
+                            MQTTContext_t * pxContext )
+{
+    uint32_t ulGrowSec;
+
+    /* coreMQTT clears waitingForPingResp when the PINGRESP arrives, and only
+     * updates pingReqSendTimeMs when it sends the next PINGREQ. */
+    if( ( pxContext->connectStatus == MQTTConnected ) &&
+        ( pxContext->waitingForPingResp == false ) &&
+        ( pxContext->pingReqSendTimeMs != pxManager->ulLastPingReqSendTimeMs ) )
+    {
+        pxManager->ulLastPingReqSendTimeMs = pxContext->pingReqSendTimeMs;
+        prvUpdateRtt( pxManager, pxContext->getTime() - pxContext->pingReqSendTimeMs );
+
+        pxManager->ulAnsweredAtInterval++;
+
+        if( ( pxManager->ulAnsweredAtInterval >= KEEP_ALIVE_GROW_AFTER_PINGS ) &&
+            ( pxManager->xStats.usIntervalSec < pxManager->usMaxIntervalSec ) )
+        {
+            ulGrowSec = pxManager->xStats.usIntervalSec / KEEP_ALIVE_GROW_DIVISOR;
+            ulGrowSec = ( ulGrowSec == 0U ) ? 1U : ulGrowSec;
+            ulGrowSec += pxManager->xStats.usIntervalSec;
+
+            pxManager->xStats.usIntervalSec = ( ulGrowSec < pxManager->usMaxIntervalSec ) ?
+                                              ( uint16_t ) ulGrowSec : pxManager->usMaxIntervalSec;
+            pxManager->ulAnsweredAtInterval = 0U;
+            pxContext->keepAliveIntervalSec = pxManager->xStats.usIntervalSec;
+        }
+    }
+}
+
+void vKeepAliveManagerOnTimeout( KeepAliveManager_t * pxManager )
+{
+    uint16_t usHalfSec = pxManager->xStats.usIntervalSec / 2U;
+
+    pxManager->xStats.usIntervalSec = ( usHalfSec > pxManager->usMinIntervalSec ) ?
+                                      usHalfSec : pxManager->usMinIntervalSec;
+    pxManager->ulAnsweredAtInterval = 0U;
+    pxManager->xStats.ulTimeouts++;
+}
+
+uint32_t ulKeepAliveManagerGetTimeoutMs( const KeepAliveManager_t * pxManager )
+{
+    uint32_t ulTimeoutMs = 0U;
+
+    if( pxManager->xStats.ulPings > 0U )
+    {
+        ulTimeoutMs = pxManager->xStats.ulSrttMs + ( 4U * pxManager->xStats.ulRttVarMs );
+    }
+
+    return ulTimeoutMs;
+}
+
+void vKeepAliveManagerGetStats( const KeepAliveManager_t * pxManager,
+                                KeepAliveStats_t * pxStats )
+{
+    *pxStats = pxManager->xStats;
+}
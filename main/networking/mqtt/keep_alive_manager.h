@@ -0,0 +1,140 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file keep_alive_manager.h
+ * @brief Adapts the MQTT keep-alive interval to the network path.
+ *
+ * The keep-alive interval negotiated in the CONNECT packet is the upper bound;
+ * coreMQTT may ping more often than negotiated without the broker noticing.
+ * The manager times each PINGREQ/PINGRESP exchange to keep a smoothed round
+ * trip time estimate, lengthens the ping interval while pings are answered,
+ * and halves it after a PINGRESP timeout, which is how a NAT mapping silently
+ * dropped for being idle too long shows up.
+ *
+ * All functions taking an MQTT context must be called from the task that runs
+ * the coreMQTT-Agent command loop of that context, or while it is stopped.
+ */
+#ifndef KEEP_ALIVE_MANAGER_H
+#define KEEP_ALIVE_MANAGER_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* coreMQTT library include. */
+#include "core_mqtt.h"
+
+/**
+ * @brief Counters and estimates of a keep-alive manager.
+ */
+typedef struct KeepAliveStats
+{
+    uint32_t ulPings;       /**< PINGREQs answered by a PINGRESP. */
+    uint32_t ulTimeouts;    /**< PINGRESP timeouts, each ending a connection. */
+    uint32_t ulSrttMs;      /**< Smoothed round trip time, 0 until the first ping. */
+    uint32_t ulRttVarMs;    /**< Round trip time variation. */
+    uint32_t ulMinRttMs;    /**< Shortest round trip time seen. */
+    uint32_t ulMaxRttMs;    /**< Longest round trip time seen. */
+    uint16_t usIntervalSec; /**< Current ping interval. */
+} KeepAliveStats_t;
+
+/**
+ * @brief State of the keep-alive manager of a connection.
+ */
+typedef struct KeepAliveManager
+{
+    uint16_t usMinIntervalSec;        /**< Shortest ping interval. */
+    uint16_t usMaxIntervalSec;        /**< Longest ping interval, as negotiated in CONNECT. */
+    uint32_t ulLastPingReqSendTimeMs; /**< Send time of the last PINGREQ accounted for. */
+    uint32_t ulAnsweredAtInterval;    /**< Pings answered since the interval last changed. */
+    KeepAliveStats_t xStats;
+} KeepAliveManager_t;
+
+/**
+ * @brief Initialize a keep-alive manager. The ping interval starts at the
+ * maximum.
+ *
+ * @param[out] pxManager Manager to initialize.
+ * @param[in] usMinIntervalSec Shortest ping interval in seconds.
+ * @param[in] usMaxIntervalSec Longest ping interval in seconds. Must be the
+ * keep-alive interval sent in the CONNECT packet.
+ */
+void vKeepAliveManagerInit( KeepAliveManager_t * pxManager,
+                            uint16_t usMinIntervalSec,
+                            uint16_t usMaxIntervalSec );
+
+/**
+ * @brief Apply the current ping interval to a freshly connected MQTT context.
+ * Must be called after MQTT_Connect() succeeded.
+ *
+ * @param[in] pxManager Manager of the connection.
+ * @param[in] pxContext MQTT context of the connection.
+ */
+void vKeepAliveManagerOnConnect( KeepAliveManager_t * pxManager,
+                                 MQTTContext_t * pxContext );
+
+/**
+ * @brief Account for a PINGREQ answered since the last call, if any, and
+ * lengthen the ping interval once enough pings in a row were answered.
+ *
+ * Meant to be called each time the agent task is about to receive a command,
+ * so the round trip time includes at most the processing of one command.
+ *
+ * @param[in] pxManager Manager of the connection.
+ * @param[in] pxContext MQTT context of the connection.
+ */
+void vKeepAliveManagerPoll( KeepAliveManager_t * pxManager,
+                            MQTTContext_t * pxContext );
+
+/**
+ * @brief Halve the ping interval after the connection was lost to a PINGRESP
+ * timeout. Takes effect on the next connection.
+ *
+ * @param[in] pxManager Manager of the connection.
+ */
+void vKeepAliveManagerOnTimeout( KeepAliveManager_t * pxManager );
+
+/**
+ * @brief Retransmission timeout derived from the round trip time estimate, as
+ * in RFC 6298: smoothed round trip time plus four times its variation.
+ *
+ * @param[in] pxManager Manager of the connection.
+ *
+ * @return Timeout in milliseconds, 0 until the first ping was answered.
+ */
+uint32_t ulKeepAliveManagerGetTimeoutMs( const KeepAliveManager_t * pxManager );
+
+/**
+ * @brief Copy the counters and estimates of a keep-alive manager.
+ *
+ * @param[in] pxManager Manager to read.
+ * @param[out] pxStats Where to copy the counters.
+ */
+void vKeepAliveManagerGetStats( const KeepAliveManager_t * pxManager,
+                                KeepAliveStats_t * pxStats );
+
+#endif /* KEEP_ALIVE_MANAGER_H */
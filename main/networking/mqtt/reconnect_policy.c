@@ -0,0 +1,112 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file reconnect_policy.c
+ * @brief Backoff policy for re-establishing the broker connection.
+ */
+
+/* Includes *******************************************************************/
+
+/* Public functions include. */
+#include "reconnect_policy.h"
+
+/* Public function definitions ************************************************/
+
+void vReconnectPolicyInit( ReconnectPolicy_t * pxPolicy,
+                           const ReconnectCurve_t * pxCurves )
+{
+    pxPolicy->pxCurves = pxCurves;
+    vReconnectPolicyReset( pxPolicy );
+}
+
+void vReconnectPolicyReset( ReconnectPolicy_t * pxPolicy )
+{
+    pxPolicy->eLastFailure = eReconnectFailureCount;
+    pxPolicy->ulLastDelayMs = 0U;
+    pxPolicy->ulAttempts = 0U;
+}
+
+uint32_t ulReconnectPolicyNextDelayMs( ReconnectPolicy_t * pxPolicy,
+                                       ReconnectFailure_t eFailure,
+                                       uint32_t ulRandom )
+{
+    const ReconnectCurve_t * pxCurve = &( pxPolicy->pxCurves[ eFailure ] );
+    uint64_t ullUpperMs;
+    uint32_t ulDelayMs;
+
+    if( ( eFailure != pxPolicy->eLastFailure ) || ( pxPolicy->ulLastDelayMs < pxCurve->ulBaseMs ) )
+    {
+        /* First failure of this class in a row. */
+        ulDelayMs = pxCurve->ulBaseMs;
+    }
+    else
+    {
+        /* Decorrelated jitter: uniform in [base, 3 * previous delay]. */
+        ullUpperMs = ( uint64_t ) pxPolicy->ulLastDelayMs * 3U;
+
+        if( ullUpperMs > pxCurve->ulMaxMs )
+        {
+            ullUpperMs = pxCurve->ulMaxMs;
+        }
+
+        if( ullUpperMs > pxCurve->ulBaseMs )
+        {
+            ulDelayMs = pxCurve->ulBaseMs +
+                        ( uint32_t ) ( ulRandom % ( ( uint32_t ) ullUpperMs - pxCurve->ulBaseMs + 1U ) );
+        }
+        else
+        {
+            ulDelayMs = pxCurve->ulBaseMs;
+        }
+    }
+
+    pxPolicy->eLastFailure = eFailure;
+    pxPolicy->ulLastDelayMs = ulDelayMs;
+    pxPolicy->ulAttempts++;
+
+    return ulDelayMs;
+}
+
+const char * pcReconnectPolicyFailureName( ReconnectFailure_t eFailure )
+{
+    static const char * const pcNames[ eReconnectFailureCount ] =
+    {
+        "DNS",
+        "TCP",
+        "TLS",
+        "CONNACK"
+    };
+    const char * pcName = "unknown";
+
+    if( eFailure < eReconnectFailureCount )
+    {
+        pcName = pcNames[ eFailure ];
+    }
+
+    return pcName;
+}
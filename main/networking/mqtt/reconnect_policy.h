@@ -0,0 +1,125 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file reconnect_policy.h
+ * @brief Backoff policy for re-establishing the broker connection.
+ *
+ * Each failed attempt is classified by the stage it failed at, and each class
+ * follows its own backoff curve: a broker refusing the CONNECT warrants longer
+ * waits than a DNS server that did not answer. Delays use decorrelated
+ * jitter, so the delay grows from the previous one rather than from the
+ * attempt count, which spreads a fleet of devices reconnecting at the same
+ * time more evenly than plain exponential backoff.
+ *
+ * The policy only computes delays. Waiting, and cutting a wait short when the
+ * link comes back up, is left to the caller.
+ */
+#ifndef RECONNECT_POLICY_H
+#define RECONNECT_POLICY_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/**
+ * @brief Stage at which a connection attempt failed.
+ */
+typedef enum ReconnectFailure
+{
+    eReconnectFailureDns = 0, /**< The broker host name could not be resolved. */
+    eReconnectFailureTcp,     /**< The TCP connection could not be established. */
+    eReconnectFailureTls,     /**< The TLS session could not be established. */
+    eReconnectFailureConnack, /**< The broker did not accept the MQTT CONNECT. */
+
+    eReconnectFailureCount
+} ReconnectFailure_t;
+
+/**
+ * @brief Backoff curve of a failure class.
+ */
+typedef struct ReconnectCurve
+{
+    uint32_t ulBaseMs; /**< Shortest delay, and the delay of the first retry. */
+    uint32_t ulMaxMs;  /**< Longest delay. */
+} ReconnectCurve_t;
+
+/**
+ * @brief State of the reconnect policy of a connection.
+ */
+typedef struct ReconnectPolicy
+{
+    const ReconnectCurve_t * pxCurves; /**< One curve per failure class. */
+    ReconnectFailure_t eLastFailure;   /**< Class of the previous failure. */
+    uint32_t ulLastDelayMs;            /**< Previous delay, 0 after a reset. */
+    uint32_t ulAttempts;               /**< Failed attempts since the last reset. */
+} ReconnectPolicy_t;
+
+/**
+ * @brief Initialize a reconnect policy.
+ *
+ * @param[out] pxPolicy Policy to initialize.
+ * @param[in] pxCurves Array of eReconnectFailureCount curves, indexed by
+ * failure class. Must stay in scope as long as the policy is used.
+ */
+void vReconnectPolicyInit( ReconnectPolicy_t * pxPolicy,
+                           const ReconnectCurve_t * pxCurves );
+
+/**
+ * @brief Forget the previous failures, so the next delay is the base delay of
+ * its class. Called once connected, or when the link has just come back up.
+ *
+ * @param[in] pxPolicy Policy to reset.
+ */
+void vReconnectPolicyReset( ReconnectPolicy_t * pxPolicy );
+
+/**
+ * @brief Record a failed attempt and compute the delay before the next one.
+ *
+ * The delay is drawn between the base delay of the class and three times the
+ * previous delay, capped to the maximum of the class. A failure of another
+ * class than the previous one restarts from the base of the new class.
+ *
+ * @param[in] pxPolicy Policy to update.
+ * @param[in] eFailure Class of the failure.
+ * @param[in] ulRandom Random number used for jitter.
+ *
+ * @return Delay in milliseconds before the next attempt.
+ */
+uint32_t ulReconnectPolicyNextDelayMs( ReconnectPolicy_t * pxPolicy,
+                                       ReconnectFailure_t eFailure,
+                                       uint32_t ulRandom );
+
+/**
+ * @brief Name of a failure class, for logging.
+ *
+ * @param[in] eFailure Failure class.
+ *
+ * @return Name of the failure class.
+ */
+const char * pcReconnectPolicyFailureName( ReconnectFailure_t eFailure );
+
+#endif /* RECONNECT_POLICY_H */
@@ -0,0 +1,311 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file resubscribe_engine.c
+ * @brief Restores the subscriptions of a connection after the broker lost
+ * its session.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <string.h>
+
+/* Public functions include. */
+#include "resubscribe_engine.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/**
+ * @brief Bytes of a SUBSCRIBE packet besides its filters: the packet type,
+ * up to two bytes of remaining length for the sizes used here, and the packet
+ * identifier.
+ */
+#define SUBSCRIBE_PACKET_OVERHEAD    ( 1U + 2U + 2U )
+
+/**
+ * @brief Bytes of a filter in a SUBSCRIBE packet besides the filter itself:
+ * its length and its requested QoS.
+ */
+#define SUBSCRIBE_FILTER_OVERHEAD    ( 2U + 1U )
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Close a filter which was restored or given up.
+ *
+ * @param[in] pxEngine Engine of the filter.
+ * @param[in] pxFilter Filter to close.
+ * @param[in] eState eResubscribeFilterRestored or eResubscribeFilterDropped.
+ */
+static void prvCloseFilter( ResubscribeEngine_t * pxEngine,
+                            ResubscribeFilter_t * pxFilter,
+                            ResubscribeFilterState_t eState );
+
+/**
+ * @brief Schedule the retry of a filter whose attempt failed, or give it up.
+ *
+ * @param[in] pxEngine Engine of the filter.
+ * @param[in] pxFilter Filter which failed.
+ * @param[in] ulNowMs Current time.
+ * @param[in] ulRandom Random number used for jitter.
+ */
+static void prvRetryFilter( ResubscribeEngine_t * pxEngine,
+                            ResubscribeFilter_t * pxFilter,
+                            uint32_t ulNowMs,
+                            uint32_t ulRandom );
+
+/* Static function definitions ************************************************/
+
+static void prvCloseFilter( ResubscribeEngine_t * pxEngine,
+                            ResubscribeFilter_t * pxFilter,
+                            ResubscribeFilterState_t eState )
+{
+    pxFilter->eState = eState;
+    pxEngine->ulOpenFilters--;
+
+    if( pxFilter->xCritical )
+    {
+        pxEngine->ulOpenCritical--;
+    }
+
+    if( eState == eResubscribeFilterDropped )
+    {
+        pxEngine->ulDropped++;
+    }
+}
+
+static void prvRetryFilter( ResubscribeEngine_t * pxEngine,
+                            ResubscribeFilter_t * pxFilter,
+                            uint32_t ulNowMs,
+                            uint32_t ulRandom )
+{
+    const ResubscribeConfig_t * pxConfig = pxEngine->pxConfig;
+    uint32_t ulDelayMs;
+
+    if( !pxFilter->xCritical && ( pxFilter->ulAttempts >= pxConfig->ulMaxAttempts ) )
+    {
+        prvCloseFilter( pxEngine, pxFilter, eResubscribeFilterDropped );
+    }
+    else
+    {
+        /* Exponential backoff, with the upper half of the delay drawn at
+         * random so filters refused together are not retried together. */
+        if( pxFilter->ulDelayMs == 0U )
+        {
+            ulDelayMs = pxConfig->ulBackoffBaseMs;
+        }
+        else if( pxFilter->ulDelayMs > ( pxConfig->ulBackoffMaxMs / 2U ) )
+        {
+            ulDelayMs = pxConfig->ulBackoffMaxMs;
+        }
+        else
+        {
+            ulDelayMs = pxFilter->ulDelayMs * 2U;
+        }
+
+        pxFilter->ulDelayMs = ulDelayMs;
+        pxFilter->ulRetryMs = ulNowMs + ( ulDelayMs / 2U ) + ( ulRandom % ( ( ulDelayMs / 2U ) + 1U ) );
+        pxFilter->eState = eResubscribeFilterPending;
+    }
+}
+
+/* Public function definitions ************************************************/
+
+void vResubscribeEngineInit( ResubscribeEngine_t * pxEngine,
+                             const ResubscribeConfig_t * pxConfig )
+{
+    memset( pxEngine, 0, sizeof( *pxEngine ) );
+    pxEngine->pxConfig = pxConfig;
+}
+
+void vResubscribeEngineStart( ResubscribeEngine_t * pxEngine,
+                              uint32_t ulNowMs )
+{
+    vResubscribeEngineInit( pxEngine, pxEngine->pxConfig );
+    pxEngine->ulStartMs = ulNowMs;
+}
+
+bool xResubscribeEngineAddFilter( ResubscribeEngine_t * pxEngine,
+                                  const char * pcFilter,
+                                  uint16_t usFilterLength,
+                                  bool xCritical )
+{
+    ResubscribeFilter_t * pxFilter = NULL;
+    bool xAdded = false;
+    uint32_t i;
+
+    /* Several callbacks may share a filter, which is subscribed once. */
+    for( i = 0U; ( pxFilter == NULL ) && ( i < pxEngine->ulFilterCount ); i++ )
+    {
+        if( ( pxEngine->xFilters[ i ].usFilterLength == usFilterLength ) &&
+            ( strncmp( pxEngine->xFilters[ i ].pcFilter, pcFilter, usFilterLength ) == 0 ) )
+        {
+            pxFilter = &( pxEngine->xFilters[ i ] );
+        }
+    }
+
+    if( pxFilter != NULL )
+    {
+        if( xCritical && !pxFilter->xCritical &&
+            ( pxFilter->eState != eResubscribeFilterRestored ) &&
+            ( pxFilter->eState != eResubscribeFilterDropped ) )
+        {
+            pxFilter->xCritical = true;
+            pxEngine->ulOpenCritical++;
+        }
+
+        xAdded = true;
+    }
+    else if( pxEngine->ulFilterCount < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS )
+    {
+        pxFilter = &( pxEngine->xFilters[ pxEngine->ulFilterCount++ ] );
+        memset( pxFilter, 0, sizeof( *pxFilter ) );
+        pxFilter->pcFilter = pcFilter;
+        pxFilter->usFilterLength = usFilterLength;
+        pxFilter->xCritical = xCritical;
+        pxFilter->eState = eResubscribeFilterPending;
+        pxFilter->ulRetryMs = pxEngine->ulStartMs;
+
+        pxEngine->ulOpenFilters++;
+
+        if( xCritical )
+        {
+            pxEngine->ulOpenCritical++;
+        }
+
+        xAdded = true;
+    }
+
+    return xAdded;
+}
+
+uint16_t usResubscribeEngineNextBatch( ResubscribeEngine_t * pxEngine,
+                                       uint32_t ulNowMs )
+{
+    ResubscribeFilter_t * pxFilter;
+    uint32_t ulPacketSize = SUBSCRIBE_PACKET_OVERHEAD;
+    uint32_t ulFilterSize;
+    uint16_t usCount = 0U;
+    uint32_t i;
+
+    if( pxEngine->usBatchCount == 0U )
+    {
+        for( i = 0U; i < pxEngine->ulFilterCount; i++ )
+        {
+            pxFilter = &( pxEngine->xFilters[ i ] );
+            ulFilterSize = SUBSCRIBE_FILTER_OVERHEAD + pxFilter->usFilterLength;
+
+            /* Compared as a difference so the time may wrap. */
+            if( ( pxFilter->eState == eResubscribeFilterPending ) &&
+                ( ( int32_t ) ( ulNowMs - pxFilter->ulRetryMs ) >= 0 ) &&
+                ( ( usCount == 0U ) || ( ( ulPacketSize + ulFilterSize ) <= pxEngine->pxConfig->ulMaxPacketSize ) ) )
+            {
+                pxEngine->xBatch[ usCount ].pTopicFilter = pxFilter->pcFilter;
+                pxEngine->xBatch[ usCount ].topicFilterLength = pxFilter->usFilterLength;
+                pxEngine->xBatch[ usCount ].qos = MQTTQoS1;
+                pxEngine->usBatchFilter[ usCount ] = ( uint16_t ) i;
+
+                if( pxFilter->ulAttempts > 0U )
+                {
+                    pxEngine->ulRetries++;
+                }
+
+                pxFilter->ulAttempts++;
+                pxFilter->eState = eResubscribeFilterInFlight;
+                ulPacketSize += ulFilterSize;
+                usCount++;
+            }
+        }
+
+        if( usCount > 0U )
+        {
+            pxEngine->usBatchCount = usCount;
+            pxEngine->ulPackets++;
+        }
+    }
+
+    return usCount;
+}
+
+void vResubscribeEngineOnBatchResult( ResubscribeEngine_t * pxEngine,
+                                      const uint8_t * pucSubackCodes,
+                                      uint32_t ulNowMs,
+                                      uint32_t ulRandom )
+{
+    ResubscribeFilter_t * pxFilter;
+    uint16_t i;
+
+    for( i = 0U; i < pxEngine->usBatchCount; i++ )
+    {
+        pxFilter = &( pxEngine->xFilters[ pxEngine->usBatchFilter[ i ] ] );
+
+        if( ( pucSubackCodes != NULL ) && ( pucSubackCodes[ i ] != ( uint8_t ) MQTTSubAckFailure ) )
+        {
+            prvCloseFilter( pxEngine, pxFilter, eResubscribeFilterRestored );
+        }
+        else
+        {
+            /* Each filter draws its own jitter. */
+            prvRetryFilter( pxEngine, pxFilter, ulNowMs, ulRandom + ( ( uint32_t ) i * 2654435761U ) );
+        }
+    }
+
+    pxEngine->usBatchCount = 0U;
+}
+
+void vResubscribeEngineRequeueBatch( ResubscribeEngine_t * pxEngine )
+{
+    ResubscribeFilter_t * pxFilter;
+    uint16_t i;
+
+    for( i = 0U; i < pxEngine->usBatchCount; i++ )
+    {
+        pxFilter = &( pxEngine->xFilters[ pxEngine->usBatchFilter[ i ] ] );
+        pxFilter->ulAttempts--;
+        pxFilter->eState = eResubscribeFilterPending;
+
+        /* Counted as a retry when the batch was built. */
+        if( pxFilter->ulAttempts > 0U )
+        {
+            pxEngine->ulRetries--;
+        }
+    }
+
+    pxEngine->usBatchCount = 0U;
+}
+
+bool xResubscribeEngineCriticalDone( const ResubscribeEngine_t * pxEngine )
+{
+    return pxEngine->ulOpenCritical == 0U;
+}
+
+bool xResubscribeEngineDone( const ResubscribeEngine_t * pxEngine )
+{
+    return pxEngine->ulOpenFilters == 0U;
+}
@@ -0,0 +1,207 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file resubscribe_engine.h
+ * @brief Restores the subscriptions of a connection after the broker lost
+ * its session.
+ *
+ * The topic filters are sent in SUBSCRIBE packets bounded in size, one packet
+ * in flight at a time. Filters refused by the broker, or whose packet could
+ * not be sent, are retried with their own exponential backoff. Critical
+ * filters are retried until restored; other filters are given up after a
+ * number of attempts.
+ *
+ * The engine only keeps the state. Sending the packets, and removing the
+ * filters given up from the subscription list, is left to the caller.
+ */
+#ifndef RESUBSCRIBE_ENGINE_H
+#define RESUBSCRIBE_ENGINE_H
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* core MQTT include. */
+#include "core_mqtt.h"
+
+/* Subscription manager include. */
+#include "subscription_manager.h"
+
+/**
+ * @brief Progress of a topic filter being restored.
+ */
+typedef enum ResubscribeFilterState
+{
+    eResubscribeFilterPending = 0, /**< Waiting to be sent, possibly after a backoff. */
+    eResubscribeFilterInFlight,    /**< Sent, waiting for the SUBACK. */
+    eResubscribeFilterRestored,    /**< Accepted by the broker. */
+    eResubscribeFilterDropped      /**< Given up after too many attempts. */
+} ResubscribeFilterState_t;
+
+/**
+ * @brief A topic filter being restored.
+ */
+typedef struct ResubscribeFilter
+{
+    const char * pcFilter;           /**< Topic filter, owned by the subscription list. */
+    uint16_t usFilterLength;         /**< Length of pcFilter. */
+    bool xCritical;                  /**< Retried until restored, and holds back the ready signal. */
+    ResubscribeFilterState_t eState; /**< Progress of the filter. */
+    uint32_t ulAttempts;             /**< SUBSCRIBE packets the filter was sent in. */
+    uint32_t ulDelayMs;              /**< Last backoff delay, 0 before the first failure. */
+    uint32_t ulRetryMs;              /**< Time from which a pending filter may be sent again. */
+} ResubscribeFilter_t;
+
+/**
+ * @brief Limits of the resubscribe engine.
+ */
+typedef struct ResubscribeConfig
+{
+    uint32_t ulMaxPacketSize; /**< Largest SUBSCRIBE packet, in bytes. A single filter may exceed it. */
+    uint32_t ulMaxAttempts;   /**< Attempts before a filter which is not critical is given up. */
+    uint32_t ulBackoffBaseMs; /**< Delay before the first retry of a filter. */
+    uint32_t ulBackoffMaxMs;  /**< Longest delay between two retries of a filter. */
+} ResubscribeConfig_t;
+
+/**
+ * @brief State of the resubscribe engine of a connection.
+ */
+typedef struct ResubscribeEngine
+{
+    const ResubscribeConfig_t * pxConfig;                                   /**< Limits of the engine. */
+    ResubscribeFilter_t xFilters[ SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ]; /**< Filters being restored. */
+    uint32_t ulFilterCount;                                                 /**< Valid entries of xFilters. */
+    MQTTSubscribeInfo_t xBatch[ SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ];   /**< Filters of the packet in flight. */
+    uint16_t usBatchFilter[ SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ];       /**< Index in xFilters of each xBatch entry. */
+    uint16_t usBatchCount;                                                  /**< Valid entries of xBatch, 0 if no packet is in flight. */
+    uint32_t ulOpenFilters;                                                 /**< Filters pending or in flight. */
+    uint32_t ulOpenCritical;                                                /**< Critical filters pending or in flight. */
+    uint32_t ulStartMs;                                                     /**< When the engine was started. */
+    uint32_t ulPackets;                                                     /**< SUBSCRIBE packets sent since the start. */
+    uint32_t ulRetries;                                                     /**< Filters sent again since the start. */
+    uint32_t ulDropped;                                                     /**< Filters given up since the start. */
+} ResubscribeEngine_t;
+
+/**
+ * @brief Initialize a resubscribe engine with no filter to restore.
+ *
+ * @param[out] pxEngine Engine to initialize.
+ * @param[in] pxConfig Limits of the engine. Must stay in scope as long as the
+ * engine is used.
+ */
+void vResubscribeEngineInit( ResubscribeEngine_t * pxEngine,
+                             const ResubscribeConfig_t * pxConfig );
+
+/**
+ * @brief Forget the filters of a previous run and start a new one.
+ *
+ * @param[in] pxEngine Engine to start.
+ * @param[in] ulNowMs Current time.
+ */
+void vResubscribeEngineStart( ResubscribeEngine_t * pxEngine,
+                              uint32_t ulNowMs );
+
+/**
+ * @brief Add a topic filter to restore. A filter already added is ignored,
+ * and is made critical if @p xCritical is set.
+ *
+ * @param[in] pxEngine Engine to add the filter to.
+ * @param[in] pcFilter Topic filter. Must stay in scope until restored.
+ * @param[in] usFilterLength Length of pcFilter.
+ * @param[in] xCritical Whether the filter is critical.
+ *
+ * @return true if the filter is to be restored, false if the engine is full.
+ */
+bool xResubscribeEngineAddFilter( ResubscribeEngine_t * pxEngine,
+                                  const char * pcFilter,
+                                  uint16_t usFilterLength,
+                                  bool xCritical );
+
+/**
+ * @brief Build the next SUBSCRIBE packet from the filters due to be sent.
+ *
+ * Filters are taken in order while the packet stays within the maximum size.
+ * The filters are in pxEngine->xBatch until the result of the packet is
+ * reported.
+ *
+ * @param[in] pxEngine Engine to build the packet from.
+ * @param[in] ulNowMs Current time.
+ *
+ * @return Number of filters in the packet, 0 if a packet is already in flight
+ * or no filter is due.
+ */
+uint16_t usResubscribeEngineNextBatch( ResubscribeEngine_t * pxEngine,
+                                       uint32_t ulNowMs );
+
+/**
+ * @brief Report the result of the packet in flight.
+ *
+ * Filters refused, or all filters of the packet if @p pucSubackCodes is NULL,
+ * are scheduled for a retry, or given up. Only usBatchCount is cleared; the
+ * indexes in usBatchFilter stay valid until the next packet is built, so the
+ * caller can report on each filter of the packet.
+ *
+ * @param[in] pxEngine Engine the packet was built from.
+ * @param[in] pucSubackCodes Return codes of the SUBACK, one per filter of the
+ * packet, or NULL if the packet failed as a whole.
+ * @param[in] ulNowMs Current time.
+ * @param[in] ulRandom Random number used for jitter.
+ */
+void vResubscribeEngineOnBatchResult( ResubscribeEngine_t * pxEngine,
+                                      const uint8_t * pucSubackCodes,
+                                      uint32_t ulNowMs,
+                                      uint32_t ulRandom );
+
+/**
+ * @brief Put the filters of the packet in flight back to pending, without
+ * counting an attempt or a retry, when the packet was lost with the
+ * connection.
+ *
+ * @param[in] pxEngine Engine the packet was built from.
+ */
+void vResubscribeEngineRequeueBatch( ResubscribeEngine_t * pxEngine );
+
+/**
+ * @brief Check whether every critical filter was restored.
+ *
+ * @param[in] pxEngine Engine to check.
+ *
+ * @return true if no critical filter is pending or in flight.
+ */
+bool xResubscribeEngineCriticalDone( const ResubscribeEngine_t * pxEngine );
+
+/**
+ * @brief Check whether every filter was restored or given up.
+ *
+ * @param[in] pxEngine Engine to check.
+ *
+ * @return true if no filter is pending or in flight.
+ */
+bool xResubscribeEngineDone( const ResubscribeEngine_t * pxEngine );
+
+#endif /* RESUBSCRIBE_ENGINE_H */
@@ -0,0 +1,390 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file subscription_dispatcher.c
+ * @brief Hands incoming publishes over to worker tasks.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+/* ESP-IDF includes. */
+#include <esp_log.h>
+#include <esp_timer.h>
+
+/* Configurations include. */
+#include "core_mqtt_agent_manager_config.h"
+
+/* Public functions include. */
+#include "subscription_dispatcher.h"
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief A pool buffer holding the copy of a publish.
+ */
+typedef struct SubscriptionDispatcherBuffer
+{
+    char cTopic[ configMQTT_AGENT_DISPATCH_TOPIC_SIZE ];
+    uint8_t ucPayload[ configMQTT_AGENT_DISPATCH_PAYLOAD_SIZE ];
+    uint16_t usTopicLength;
+    uint16_t usPayloadLength;
+    MQTTQoS_t xQoS;
+    bool xRetain;
+    bool xDup;
+    int64_t llQueuedUs; /**< When the buffer was queued to the subscriber. */
+} SubscriptionDispatcherBuffer_t;
+
+/**
+ * @brief A subscriber. The counters are protected by xStatsLock as the
+ * publishes of both connections may be dispatched to the same subscriber.
+ */
+struct SubscriptionDispatcher
+{
+    IncomingPubCallback_t pxCallback;
+    void * pvContext;
+    SubscriptionDispatcherOverflow_t eOverflow;
+    QueueHandle_t xQueue; /**< Buffers waiting for the worker task. */
+    SubscriptionDispatcherStats_t xStats;
+    portMUX_TYPE xStatsLock;
+};
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "subscription_dispatcher";
+
+/**
+ * @brief Storage of the pool buffers.
+ */
+static SubscriptionDispatcherBuffer_t xBuffers[ configMQTT_AGENT_DISPATCH_BUFFERS ];
+
+/**
+ * @brief Queue holding the free pool buffers.
+ */
+static QueueHandle_t xFreeBuffers;
+static StaticQueue_t xFreeBuffersStructure;
+static uint8_t ucFreeBuffersStorage[ configMQTT_AGENT_DISPATCH_BUFFERS * sizeof( SubscriptionDispatcherBuffer_t * ) ];
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Take a buffer for a publish to a subscriber, applying its overflow
+ * policy when the pool is empty.
+ *
+ * @param[in] pxDispatcher Subscriber of the publish.
+ *
+ * @return A buffer, or NULL if the publish is to be dropped.
+ */
+static SubscriptionDispatcherBuffer_t * prvTakeBuffer( SubscriptionDispatcher_t * pxDispatcher );
+
+/**
+ * @brief Queue a filled buffer to a subscriber, applying its overflow policy
+ * when the queue is full. The buffer is returned to the pool if dropped.
+ *
+ * @param[in] pxDispatcher Subscriber of the publish.
+ * @param[in] pxBuffer Buffer to queue.
+ *
+ * @return true if queued, false if dropped.
+ */
+static bool prvQueueBuffer( SubscriptionDispatcher_t * pxDispatcher,
+                            SubscriptionDispatcherBuffer_t * pxBuffer );
+
+/**
+ * @brief Count a publish dropped by the overflow policy of a subscriber.
+ *
+ * @param[in] pxDispatcher Subscriber of the publish.
+ */
+static void prvCountDropped( SubscriptionDispatcher_t * pxDispatcher );
+
+/**
+ * @brief Worker task of a subscriber. Runs the callback of the subscriber for
+ * each queued publish and returns its buffer to the pool.
+ *
+ * @param[in] pvParameters The subscriber.
+ */
+static void prvWorkerTask( void * pvParameters );
+
+/* Static function definitions ************************************************/
+
+static void prvCountDropped( SubscriptionDispatcher_t * pxDispatcher )
+{
+    taskENTER_CRITICAL( &( pxDispatcher->xStatsLock ) );
+    pxDispatcher->xStats.ulDropped++;
+    taskEXIT_CRITICAL( &( pxDispatcher->xStatsLock ) );
+}
+
+static SubscriptionDispatcherBuffer_t * prvTakeBuffer( SubscriptionDispatcher_t * pxDispatcher )
+{
+    SubscriptionDispatcherBuffer_t * pxBuffer = NULL;
+    TickType_t xBlockTime = 0;
+
+    if( pxDispatcher->eOverflow == eSubscriptionDispatcherBlock )
+    {
+        xBlockTime = pdMS_TO_TICKS( configMQTT_AGENT_DISPATCH_BLOCK_TIME_MS );
+    }
+
+    if( xQueueReceive( xFreeBuffers, &pxBuffer, xBlockTime ) != pdTRUE )
+    {
+        /* The pool is shared, so only the publishes of this subscriber can be
+         * given up for the new one. */
+        if( ( pxDispatcher->eOverflow == eSubscriptionDispatcherDropOldest ) &&
+            ( xQueueReceive( pxDispatcher->xQueue, &pxBuffer, 0 ) == pdTRUE ) )
+        {
+            prvCountDropped( pxDispatcher );
+        }
+        else
+        {
+            pxBuffer = NULL;
+            prvCountDropped( pxDispatcher );
+        }
+    }
+
+    return pxBuffer;
+}
+
+static bool prvQueueBuffer( SubscriptionDispatcher_t * pxDispatcher,
+                            SubscriptionDispatcherBuffer_t * pxBuffer )
+{
+    SubscriptionDispatcherBuffer_t * pxOldest = NULL;
+    TickType_t xBlockTime = 0;
+    bool xQueued;
+    uint32_t ulWaiting;
+
+    if( pxDispatcher->eOverflow == eSubscriptionDispatcherBlock )
+    {
+        xBlockTime = pdMS_TO_TICKS( configMQTT_AGENT_DISPATCH_BLOCK_TIME_MS );
+    }
+
+    pxBuffer->llQueuedUs = esp_timer_get_time();
+    xQueued = ( xQueueSendToBack( pxDispatcher->xQueue, &pxBuffer, xBlockTime ) == pdTRUE );
+
+    if( !xQueued && ( pxDispatcher->eOverflow == eSubscriptionDispatcherDropOldest ) )
+    {
+        if( xQueueReceive( pxDispatcher->xQueue, &pxOldest, 0 ) == pdTRUE )
+        {
+            ( void ) xQueueSendToBack( xFreeBuffers, &pxOldest, 0 );
+            prvCountDropped( pxDispatcher );
+        }
+
+        /* Fails only if the publishes of the other connection filled the
+         * freed slot first. */
+        xQueued = ( xQueueSendToBack( pxDispatcher->xQueue, &pxBuffer, 0 ) == pdTRUE );
+    }
+
+    if( xQueued )
+    {
+        ulWaiting = ( uint32_t ) uxQueueMessagesWaiting( pxDispatcher->xQueue );
+
+        taskENTER_CRITICAL( &( pxDispatcher->xStatsLock ) );
+
+        pxDispatcher->xStats.ulQueued++;
+
+        if( ulWaiting > pxDispatcher->xStats.ulQueueHighWater )
+        {
+            pxDispatcher->xStats.ulQueueHighWater = ulWaiting;
+        }
+
+        taskEXIT_CRITICAL( &( pxDispatcher->xStatsLock ) );
+    }
+    else
+    {
+        ( void ) xQueueSendToBack( xFreeBuffers, &pxBuffer, 0 );
+        prvCountDropped( pxDispatcher );
+    }
+
+    return xQueued;
+}
+
+static void prvWorkerTask( void * pvParameters )
+{
+    SubscriptionDispatcher_t * pxDispatcher = ( SubscriptionDispatcher_t * ) pvParameters;
+    SubscriptionDispatcherBuffer_t * pxBuffer = NULL;
+    MQTTPublishInfo_t xPublishInfo;
+    uint32_t ulWaitUs;
+
+    for( ; ; )
+    {
+        if( xQueueReceive( pxDispatcher->xQueue, &pxBuffer, portMAX_DELAY ) == pdTRUE )
+        {
+            ulWaitUs = ( uint32_t ) ( esp_timer_get_time() - pxBuffer->llQueuedUs );
+
+            memset( &xPublishInfo, 0x00, sizeof( xPublishInfo ) );
+            xPublishInfo.qos = pxBuffer->xQoS;
+            xPublishInfo.retain = pxBuffer->xRetain;
+            xPublishInfo.dup = pxBuffer->xDup;
+            xPublishInfo.pTopicName = pxBuffer->cTopic;
+            xPublishInfo.topicNameLength = pxBuffer->usTopicLength;
+            xPublishInfo.pPayload = pxBuffer->ucPayload;
+            xPublishInfo.payloadLength = pxBuffer->usPayloadLength;
+
+            pxDispatcher->pxCallback( pxDispatcher->pvContext, &xPublishInfo );
+
+            ( void ) xQueueSendToBack( xFreeBuffers, &pxBuffer, 0 );
+
+            taskENTER_CRITICAL( &( pxDispatcher->xStatsLock ) );
+
+            pxDispatcher->xStats.ulDelivered++;
+
+            if( ulWaitUs > pxDispatcher->xStats.ulMaxWaitUs )
+            {
+                pxDispatcher->xStats.ulMaxWaitUs = ulWaitUs;
+            }
+
+            taskEXIT_CRITICAL( &( pxDispatcher->xStatsLock ) );
+        }
+    }
+}
+
+/* Public function definitions ************************************************/
+
+BaseType_t xSubscriptionDispatcherInit( void )
+{
+    BaseType_t xRet = pdPASS;
+    SubscriptionDispatcherBuffer_t * pxBuffer;
+    int i;
+
+    xFreeBuffers = xQueueCreateStatic( configMQTT_AGENT_DISPATCH_BUFFERS,
+                                       sizeof( SubscriptionDispatcherBuffer_t * ),
+                                       ucFreeBuffersStorage,
+                                       &xFreeBuffersStructure );
+
+    if( xFreeBuffers == NULL )
+    {
+        ESP_LOGE( TAG, "Failed to create dispatch buffer free queue." );
+        xRet = pdFAIL;
+    }
+    else
+    {
+        for( i = 0; i < configMQTT_AGENT_DISPATCH_BUFFERS; i++ )
+        {
+            pxBuffer = &( xBuffers[ i ] );
+            ( void ) xQueueSendToBack( xFreeBuffers, &pxBuffer, 0 );
+        }
+    }
+
+    return xRet;
+}
+
+SubscriptionDispatcher_t * pxSubscriptionDispatcherCreate( const char * pcName,
+                                                           UBaseType_t uxQueueLength,
+                                                           SubscriptionDispatcherOverflow_t eOverflow,
+                                                           IncomingPubCallback_t pxCallback,
+                                                           void * pvContext )
+{
+    SubscriptionDispatcher_t * pxDispatcher = calloc( 1, sizeof( SubscriptionDispatcher_t ) );
+
+    if( pxDispatcher != NULL )
+    {
+        pxDispatcher->pxCallback = pxCallback;
+        pxDispatcher->pvContext = pvContext;
+        pxDispatcher->eOverflow = eOverflow;
+        portMUX_INITIALIZE( &( pxDispatcher->xStatsLock ) );
+        pxDispatcher->xQueue = xQueueCreate( uxQueueLength, sizeof( SubscriptionDispatcherBuffer_t * ) );
+
+        if( ( pxDispatcher->xQueue == NULL ) ||
+            ( xTaskCreate( prvWorkerTask,
+                           pcName,
+                           configMQTT_AGENT_DISPATCH_TASK_STACK_SIZE,
+                           pxDispatcher,
+                           configMQTT_AGENT_DISPATCH_TASK_PRIORITY,
+                           NULL ) != pdPASS ) )
+        {
+            ESP_LOGE( TAG, "Failed to create the worker task of subscriber %s.", pcName );
+
+            if( pxDispatcher->xQueue != NULL )
+            {
+                vQueueDelete( pxDispatcher->xQueue );
+            }
+
+            free( pxDispatcher );
+            pxDispatcher = NULL;
+        }
+    }
+
+    return pxDispatcher;
+}
+
+void vSubscriptionDispatcherCallback( void * pvIncomingPublishCallbackContext,
+                                      MQTTPublishInfo_t * pxPublishInfo )
+{
+    SubscriptionDispatcher_t * pxDispatcher = ( SubscriptionDispatcher_t * ) pvIncomingPublishCallbackContext;
+    SubscriptionDispatcherBuffer_t * pxBuffer;
+
+    if( ( pxPublishInfo->topicNameLength > configMQTT_AGENT_DISPATCH_TOPIC_SIZE ) ||
+        ( pxPublishInfo->payloadLength > configMQTT_AGENT_DISPATCH_PAYLOAD_SIZE ) )
+    {
+        ESP_LOGW( TAG, "Dropping publish to %.*s larger than a dispatch buffer.",
+                  pxPublishInfo->topicNameLength,
+                  pxPublishInfo->pTopicName );
+
+        taskENTER_CRITICAL( &( pxDispatcher->xStatsLock ) );
+        pxDispatcher->xStats.ulTooLarge++;
+        taskEXIT_CRITICAL( &( pxDispatcher->xStatsLock ) );
+    }
+    else
+    {
+        pxBuffer = prvTakeBuffer( pxDispatcher );
+
+        if( pxBuffer != NULL )
+        {
+            memcpy( pxBuffer->cTopic, pxPublishInfo->pTopicName, pxPublishInfo->topicNameLength );
+
+            if( pxPublishInfo->payloadLength > 0U )
+            {
+                memcpy( pxBuffer->ucPayload, pxPublishInfo->pPayload, pxPublishInfo->payloadLength );
+            }
+
+            pxBuffer->usTopicLength = pxPublishInfo->topicNameLength;
+            pxBuffer->usPayloadLength = ( uint16_t ) pxPublishInfo->payloadLength;
+            pxBuffer->xQoS = pxPublishInfo->qos;
+            pxBuffer->xRetain = pxPublishInfo->retain;
+            pxBuffer->xDup = pxPublishInfo->dup;
+
+            ( void ) prvQueueBuffer( pxDispatcher, pxBuffer );
+        }
+    }
+}
+
+void vSubscriptionDispatcherGetStats( SubscriptionDispatcher_t * pxDispatcher,
+                                      SubscriptionDispatcherStats_t * pxStats )
+{
+    taskENTER_CRITICAL( &( pxDispatcher->xStatsLock ) );
+    *pxStats = pxDispatcher->xStats;
+    taskEXIT_CRITICAL( &( pxDispatcher->xStatsLock ) );
+}
@@ -0,0 +1,131 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file subscription_dispatcher.h
+ * @brief Hands incoming publishes over to worker tasks.
+ *
+ * Incoming publish callbacks run on the coreMQTT-Agent task, so a slow
+ * callback delays every other operation of the connection, PINGs included.
+ * A subscriber registered with the subscription manager through
+ * vSubscriptionDispatcherCallback() instead gets a copy of each matched
+ * publish in a buffer of a shared pool, queued to a worker task of its own
+ * which runs the application callback. The queue of each subscriber is
+ * bounded, and what happens to a publish arriving while it is full is set by
+ * the overflow policy of the subscriber.
+ */
+#ifndef SUBSCRIPTION_DISPATCHER_H
+#define SUBSCRIPTION_DISPATCHER_H
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include <freertos/FreeRTOS.h>
+
+/* coreMQTT library include. */
+#include "core_mqtt.h"
+
+/* Subscription manager include. */
+#include "subscription_manager.h"
+
+/**
+ * @brief What happens to a publish matched while the queue of its subscriber
+ * is full or no buffer is free.
+ */
+typedef enum SubscriptionDispatcherOverflow
+{
+    eSubscriptionDispatcherDropNewest = 0, /**< Drop the incoming publish. */
+    eSubscriptionDispatcherDropOldest = 1, /**< Drop the oldest publish queued to the subscriber. */
+    eSubscriptionDispatcherBlock = 2       /**< Block the coreMQTT-Agent task for a bounded time, then drop the incoming publish. */
+} SubscriptionDispatcherOverflow_t;
+
+/**
+ * @brief Counters of a subscriber.
+ */
+typedef struct SubscriptionDispatcherStats
+{
+    uint32_t ulQueued;          /**< Publishes queued to the worker task. */
+    uint32_t ulDelivered;       /**< Publishes handed to the callback. */
+    uint32_t ulDropped;         /**< Publishes dropped by the overflow policy. */
+    uint32_t ulTooLarge;        /**< Publishes dropped as larger than a buffer. */
+    uint32_t ulQueueHighWater;  /**< Most publishes queued at once. */
+    uint32_t ulMaxWaitUs;       /**< Longest time a publish waited in the queue. */
+} SubscriptionDispatcherStats_t;
+
+/**
+ * @brief A subscriber with a worker task, see pxSubscriptionDispatcherCreate().
+ */
+typedef struct SubscriptionDispatcher SubscriptionDispatcher_t;
+
+/**
+ * @brief Initialize the buffer pool shared by the subscribers. Must be called
+ * once before any other function.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xSubscriptionDispatcherInit( void );
+
+/**
+ * @brief Create a subscriber and its worker task. Subscribers are never
+ * deleted, so they are meant to be created once by long-lived tasks.
+ *
+ * @param[in] pcName Name of the worker task.
+ * @param[in] uxQueueLength Publishes queued to the subscriber at most.
+ * @param[in] eOverflow What to do with publishes matched while the queue is
+ * full or no buffer is free.
+ * @param[in] pxCallback Callback run by the worker task for each publish.
+ * @param[in] pvContext Context passed to pxCallback.
+ *
+ * @return The subscriber, or NULL if out of memory.
+ */
+SubscriptionDispatcher_t * pxSubscriptionDispatcherCreate( const char * pcName,
+                                                           UBaseType_t uxQueueLength,
+                                                           SubscriptionDispatcherOverflow_t eOverflow,
+                                                           IncomingPubCallback_t pxCallback,
+                                                           void * pvContext );
+
+/**
+ * @brief Incoming publish callback copying the publish to the queue of a
+ * subscriber. Register it with addSubscription() in place of the callback of
+ * the subscriber, with the subscriber as context.
+ *
+ * @param[in] pvIncomingPublishCallbackContext The subscriber.
+ * @param[in] pxPublishInfo Deserialized publish.
+ */
+void vSubscriptionDispatcherCallback( void * pvIncomingPublishCallbackContext,
+                                      MQTTPublishInfo_t * pxPublishInfo );
+
+/**
+ * @brief Copy the counters of a subscriber.
+ *
+ * @param[in] pxDispatcher Subscriber to read.
+ * @param[out] pxStats Where to copy the counters.
+ */
+void vSubscriptionDispatcherGetStats( SubscriptionDispatcher_t * pxDispatcher,
+                                      SubscriptionDispatcherStats_t * pxStats );
+
+#endif /* SUBSCRIPTION_DISPATCHER_H */
@@ -30,20 +30,1208 @@
  */
 
 /* Standard includes. */
+#include <stdlib.h>
 #include <string.h>
 
+/* ESP-IDF sdkconfig include. */
+#include <sdkconfig.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
 /* Subscription manager header include. */
 #include "subscription_manager.h"
 
+/**
+ * @brief Cross-check every dispatch of the index against the linear matcher,
+ * and log the publishes on which they disagree.
+ */
+#ifndef SUBSCRIPTION_MANAGER_VERIFY_INDEX
+    #ifdef CONFIG_GRI_SUBSCRIPTION_MANAGER_VERIFY_INDEX
+        #define SUBSCRIPTION_MANAGER_VERIFY_INDEX    1
+    #else
+        #define SUBSCRIPTION_MANAGER_VERIFY_INDEX    0
+    #endif
+#endif
+
+/**
+ * @brief Number of 32-bit words in a set of elements.
+ */
+#define ELEMENT_SET_WORDS    ( ( SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS + 31U ) / 32U )
+
+/**
+ * @brief FNV-1a 32-bit offset basis and prime.
+ */
+#define FNV_OFFSET_BASIS     ( 2166136261UL )
+#define FNV_PRIME            ( 16777619UL )
+
+/**
+ * @brief Round a size up to the alignment of a pointer.
+ */
+#define ALIGN_SIZE( xSize )        ( ( ( xSize ) + sizeof( void * ) - 1U ) & ~( sizeof( void * ) - 1U ) )
+
+/**
+ * @brief Space taken in the arena by a topic filter of a given length.
+ */
+#define FILTER_SIZE( usLength )    ALIGN_SIZE( sizeof( SubscriptionArenaFilter_t ) + ( usLength ) + 1U )
+
+/**
+ * @brief A chunk of the arena of a list, followed by the filters.
+ */
+typedef struct subscriptionArenaChunk
+{
+    struct subscriptionArenaChunk * pxNext; /**< Next chunk, filled earlier. */
+    size_t xSize;                           /**< Bytes for filters. */
+    size_t xUsed;                           /**< Bytes given to filters. */
+    uint32_t ulLive;                        /**< Filters of the chunk still referenced. */
+} SubscriptionArenaChunk_t;
+
+/**
+ * @brief Header of a topic filter in the arena, followed by the filter and a
+ * terminating 0.
+ */
+typedef struct subscriptionArenaFilter
+{
+    SubscriptionArenaChunk_t * pxChunk; /**< Chunk holding the filter. */
+    uint32_t ulRefs;                    /**< Elements and retains referencing the filter, 0 if the slot is free. */
+    uint32_t ulSlotSize;                /**< Bytes of the slot, header included. */
+    uint16_t usLength;                  /**< Length of the filter. */
+} SubscriptionArenaFilter_t;
+
+/**
+ * @brief First filter of a chunk.
+ */
+#define CHUNK_FILTERS( pxChunk )    ( ( uint8_t * ) ( pxChunk ) + ALIGN_SIZE( sizeof( SubscriptionArenaChunk_t ) ) )
+
+/**
+ * @brief FNV-1a hash of a topic or topic filter.
+ */
+static uint32_t prvHashTopic( const char * pcTopic,
+                              uint16_t usTopicLength )
+{
+    uint32_t ulHash = FNV_OFFSET_BASIS;
+    uint16_t i;
+
+    for( i = 0U; i < usTopicLength; i++ )
+    {
+        ulHash ^= ( uint8_t ) pcTopic[ i ];
+        ulHash *= FNV_PRIME;
+    }
+
+    return ulHash;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Find the end of the topic level starting at usStart.
+ */
+static uint16_t prvLevelEnd( const char * pcString,
+                             uint16_t usLength,
+                             uint16_t usStart )
+{
+    uint16_t usEnd = usStart;
+
+    while( ( usEnd < usLength ) && ( pcString[ usEnd ] != '/' ) )
+    {
+        usEnd++;
+    }
+
+    return usEnd;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Count the levels of a topic filter which can be held in the index.
+ *
+ * @return Number of levels, or 0 if a wildcard does not occupy a whole level,
+ * '#' is not the last level, or the filter is deeper than the index.
+ */
+static uint16_t prvIndexableLevels( const char * pcFilter,
+                                    uint16_t usFilterLength,
+                                    bool * pxWildcard )
+{
+    uint16_t usStart = 0U, usEnd, usLevels = 0U, i;
+    bool xValid = true;
+
+    *pxWildcard = false;
+
+    do
+    {
+        usEnd = prvLevelEnd( pcFilter, usFilterLength, usStart );
+
+        for( i = usStart; i < usEnd; i++ )
+        {
+            if( ( pcFilter[ i ] == '+' ) || ( pcFilter[ i ] == '#' ) )
+            {
+                *pxWildcard = true;
+
+                if( ( usEnd - usStart ) != 1U )
+                {
+                    xValid = false;
+                }
+                else if( ( pcFilter[ i ] == '#' ) && ( usEnd != usFilterLength ) )
+                {
+                    xValid = false;
+                }
+            }
+        }
+
+        usLevels++;
+        usStart = usEnd + 1U;
+    } while( xValid && ( usEnd < usFilterLength ) );
+
+    if( !xValid || ( usLevels > SUBSCRIPTION_MANAGER_MAX_INDEX_DEPTH ) )
+    {
+        usLevels = 0U;
+    }
+
+    return usLevels;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Find the child of a node standing for a level.
+ *
+ * @param[in] xCreate Whether to create the child if it does not exist.
+ *
+ * @return The child, 0 if it does not exist and was not created.
+ */
+static uint16_t prvChild( SubscriptionTable_t * pxTable,
+                          uint16_t usNode,
+                          const char * pcLevel,
+                          uint16_t usLevelLength,
+                          bool xCreate )
+{
+    SubscriptionIndexNode_t * pxNode = &( pxTable->pxNodes[ usNode ] );
+    uint16_t * pusLink;
+    uint16_t usChild;
+
+    if( ( usLevelLength == 1U ) && ( pcLevel[ 0 ] == '+' ) )
+    {
+        pusLink = &( pxNode->usPlusChild );
+    }
+    else if( ( usLevelLength == 1U ) && ( pcLevel[ 0 ] == '#' ) )
+    {
+        pusLink = &( pxNode->usHashChild );
+    }
+    else
+    {
+        pusLink = &( pxNode->usFirstChild );
+
+        while( ( *pusLink != 0U ) &&
+               ( ( pxTable->pxNodes[ *pusLink ].usLevelLength != usLevelLength ) ||
+                 ( memcmp( pxTable->pxNodes[ *pusLink ].pcLevel, pcLevel, usLevelLength ) != 0 ) ) )
+        {
+            pusLink = &( pxTable->pxNodes[ *pusLink ].usNextSibling );
+        }
+    }
+
+    usChild = *pusLink;
+
+    if( ( usChild == 0U ) && xCreate )
+    {
+        /* Reuse a freed node before a fresh one. */
+        if( pxTable->usFreeNodes != 0U )
+        {
+            usChild = pxTable->usFreeNodes;
+            pxTable->usFreeNodes = pxTable->pxNodes[ usChild ].usNextSibling;
+        }
+        else
+        {
+            usChild = ++( pxTable->usFreshNodes );
+        }
+
+        memset( &( pxTable->pxNodes[ usChild ] ), 0x00, sizeof( SubscriptionIndexNode_t ) );
+        pxTable->pxNodes[ usChild ].pcLevel = pcLevel;
+        pxTable->pxNodes[ usChild ].usLevelLength = usLevelLength;
+        pxTable->pxNodes[ usChild ].usParent = usNode;
+        *pusLink = usChild;
+    }
+
+    return usChild;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Unlink a node without references from its parent and free it.
+ */
+static void prvFreeNode( SubscriptionTable_t * pxTable,
+                         uint16_t usNode )
+{
+    SubscriptionIndexNode_t * pxParent = &( pxTable->pxNodes[ pxTable->pxNodes[ usNode ].usParent ] );
+    uint16_t * pusLink;
+
+    if( pxParent->usPlusChild == usNode )
+    {
+        pxParent->usPlusChild = 0U;
+    }
+    else if( pxParent->usHashChild == usNode )
+    {
+        pxParent->usHashChild = 0U;
+    }
+    else
+    {
+        pusLink = &( pxParent->usFirstChild );
+
+        while( *pusLink != usNode )
+        {
+            pusLink = &( pxTable->pxNodes[ *pusLink ].usNextSibling );
+        }
+
+        *pusLink = pxTable->pxNodes[ usNode ].usNextSibling;
+    }
+
+    pxTable->pxNodes[ usNode ].usNextSibling = pxTable->usFreeNodes;
+    pxTable->usFreeNodes = usNode;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Add an element to the hash table if its filter has no wildcard, else
+ * to the index, or to the elements matched linearly if its filter cannot be
+ * indexed or the index is full.
+ */
+static void prvIndexElement( SubscriptionTable_t * pxTable,
+                             uint16_t usElement )
+{
+    SubscriptionElement_t * pxElement = &( pxTable->pxElements[ usElement ] );
+    const char * pcFilter = pxElement->pcSubscriptionFilterString;
+    uint16_t usFilterLength = pxElement->usFilterStringLength;
+    uint16_t usLevels, usMissing = 0U, usNode = 0U, usStart = 0U, usEnd, i;
+    uint16_t usFreeNodes = ( uint16_t ) ( pxTable->usNodeCapacity - 1U - pxTable->usFreshNodes );
+    uint16_t * pusBucket;
+    bool xWildcard;
+
+    usLevels = prvIndexableLevels( pcFilter, usFilterLength, &xWildcard );
+
+    if( !xWildcard )
+    {
+        pxElement->ulFilterHash = prvHashTopic( pcFilter, usFilterLength );
+        pusBucket = &( pxTable->pusBuckets[ pxElement->ulFilterHash & pxTable->usBucketMask ] );
+        pxElement->xHashed = true;
+        pxElement->usIndexNode = 0U;
+        pxElement->usNextAtNode = *pusBucket;
+        *pusBucket = ( uint16_t ) ( usElement + 1U );
+    }
+    else
+    {
+        /* Count the nodes to create, and the free ones, before changing anything. */
+        for( i = 0U; i < usLevels; i++ )
+        {
+            usEnd = prvLevelEnd( pcFilter, usFilterLength, usStart );
+            usNode = ( ( usNode != 0U ) || ( i == 0U ) ) ? prvChild( pxTable, usNode, &( pcFilter[ usStart ] ), usEnd - usStart, false ) : 0U;
+
+            if( usNode == 0U )
+            {
+                usMissing++;
+            }
+
+            usStart = usEnd + 1U;
+        }
+
+        for( usNode = pxTable->usFreeNodes; usNode != 0U; usNode = pxTable->pxNodes[ usNode ].usNextSibling )
+        {
+            usFreeNodes++;
+        }
+
+        if( ( usLevels == 0U ) || ( usMissing > usFreeNodes ) )
+        {
+            pxElement->usIndexNode = 0U;
+            pxTable->usLinearElements++;
+        }
+        else
+        {
+            usNode = 0U;
+            usStart = 0U;
+
+            for( i = 0U; i < usLevels; i++ )
+            {
+                usEnd = prvLevelEnd( pcFilter, usFilterLength, usStart );
+                usNode = prvChild( pxTable, usNode, &( pcFilter[ usStart ] ), usEnd - usStart, true );
+                pxTable->pxNodes[ usNode ].usRefs++;
+                usStart = usEnd + 1U;
+            }
+
+            pxElement->usIndexNode = usNode;
+            pxElement->usNextAtNode = pxTable->pxNodes[ usNode ].usFirstElement;
+            pxTable->pxNodes[ usNode ].usFirstElement = ( uint16_t ) ( usElement + 1U );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Remove an element from the hash table or the index, freeing the
+ * nodes no other element goes through.
+ */
+static void prvUnindexElement( SubscriptionTable_t * pxTable,
+                               uint16_t usElement )
+{
+    SubscriptionElement_t * pxElement = &( pxTable->pxElements[ usElement ] );
+    uint16_t usNode = pxElement->usIndexNode, usParent;
+    uint16_t * pusLink;
+
+    if( pxElement->xHashed )
+    {
+        pusLink = &( pxTable->pusBuckets[ pxElement->ulFilterHash & pxTable->usBucketMask ] );
+
+        while( *pusLink != ( uint16_t ) ( usElement + 1U ) )
+        {
+            pusLink = &( pxTable->pxElements[ *pusLink - 1U ].usNextAtNode );
+        }
+
+        *pusLink = pxElement->usNextAtNode;
+    }
+    else if( usNode == 0U )
+    {
+        pxTable->usLinearElements--;
+    }
+    else
+    {
+        pusLink = &( pxTable->pxNodes[ usNode ].usFirstElement );
+
+        while( *pusLink != ( uint16_t ) ( usElement + 1U ) )
+        {
+            pusLink = &( pxTable->pxElements[ *pusLink - 1U ].usNextAtNode );
+        }
+
+        *pusLink = pxElement->usNextAtNode;
+
+        while( usNode != 0U )
+        {
+            usParent = pxTable->pxNodes[ usNode ].usParent;
+
+            if( --( pxTable->pxNodes[ usNode ].usRefs ) == 0U )
+            {
+                prvFreeNode( pxTable, usNode );
+            }
+
+            usNode = usParent;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Point the levels of the nodes an element goes through into the
+ * filter of the element, which is known to be in scope.
+ */
+static void prvRepointElement( SubscriptionTable_t * pxTable,
+                               uint16_t usElement )
+{
+    SubscriptionElement_t * pxElement = &( pxTable->pxElements[ usElement ] );
+    uint16_t usNode = pxElement->usIndexNode;
+    uint16_t usEnd = pxElement->usFilterStringLength, usStart;
+
+    /* Walk up from the last level. */
+    while( usNode != 0U )
+    {
+        usStart = usEnd;
+
+        while( ( usStart > 0U ) && ( pxElement->pcSubscriptionFilterString[ usStart - 1U ] != '/' ) )
+        {
+            usStart--;
+        }
+
+        pxTable->pxNodes[ usNode ].pcLevel = &( pxElement->pcSubscriptionFilterString[ usStart ] );
+        usNode = pxTable->pxNodes[ usNode ].usParent;
+        usEnd = ( usStart > 0U ) ? ( uint16_t ) ( usStart - 1U ) : 0U;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Add the elements whose filter has no wildcard and is equal to a topic
+ * to a set of elements.
+ */
+static void prvMatchHashed( const SubscriptionTable_t * pxTable,
+                            const MQTTPublishInfo_t * pxPublishInfo,
+                            uint32_t * pulSet )
+{
+    uint32_t ulHash = prvHashTopic( pxPublishInfo->pTopicName, pxPublishInfo->topicNameLength );
+    uint16_t usElement = pxTable->pusBuckets[ ulHash & pxTable->usBucketMask ];
+    const SubscriptionElement_t * pxElement;
+
+    while( usElement != 0U )
+    {
+        pxElement = &( pxTable->pxElements[ usElement - 1U ] );
+
+        if( ( pxElement->ulFilterHash == ulHash ) &&
+            ( pxElement->usFilterStringLength == pxPublishInfo->topicNameLength ) &&
+            ( memcmp( pxElement->pcSubscriptionFilterString, pxPublishInfo->pTopicName, pxPublishInfo->topicNameLength ) == 0 ) )
+        {
+            pulSet[ ( usElement - 1U ) / 32U ] |= 1UL << ( ( usElement - 1U ) % 32U );
+        }
+
+        usElement = pxElement->usNextAtNode;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Add the elements ending at a node whose filter matches a topic to a
+ * set of elements.
+ *
+ * The index only holds filters with wildcards, which are confirmed with
+ * MQTT_MatchTopic(). It also applies the rule that wildcards at the first
+ * level do not match topics starting with '$'.
+ */
+static void prvCollectNode( const SubscriptionTable_t * pxTable,
+                            uint16_t usNode,
+                            const MQTTPublishInfo_t * pxPublishInfo,
+                            uint32_t * pulSet )
+{
+    uint16_t usElement = pxTable->pxNodes[ usNode ].usFirstElement;
+    bool xMatch;
+
+    while( usElement != 0U )
+    {
+        xMatch = false;
+        MQTT_MatchTopic( pxPublishInfo->pTopicName,
+                         pxPublishInfo->topicNameLength,
+                         pxTable->pxElements[ usElement - 1U ].pcSubscriptionFilterString,
+                         pxTable->pxElements[ usElement - 1U ].usFilterStringLength,
+                         &xMatch );
+
+        if( xMatch )
+        {
+            pulSet[ ( usElement - 1U ) / 32U ] |= 1UL << ( ( usElement - 1U ) % 32U );
+        }
+
+        usElement = pxTable->pxElements[ usElement - 1U ].usNextAtNode;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Collect the elements whose filter matches a topic into a set, by
+ * walking the index along the levels of the topic.
+ */
+static void prvMatchIndex( const SubscriptionTable_t * pxTable,
+                           const MQTTPublishInfo_t * pxPublishInfo,
+                           uint32_t * pulSet )
+{
+    /* Each level pops one node and pushes at most two, the level and '+'. */
+    uint16_t usStackNode[ SUBSCRIPTION_MANAGER_MAX_INDEX_DEPTH + 2U ];
+    uint16_t usStackStart[ SUBSCRIPTION_MANAGER_MAX_INDEX_DEPTH + 2U ];
+    uint32_t ulDepth = 0U;
+    const char * pcTopic = pxPublishInfo->pTopicName;
+    uint16_t usTopicLength = pxPublishInfo->topicNameLength;
+    uint16_t usNode, usStart, usEnd, usChild;
+
+    usStackNode[ ulDepth ] = 0U;
+    usStackStart[ ulDepth ] = 0U;
+    ulDepth++;
+
+    while( ulDepth > 0U )
+    {
+        ulDepth--;
+        usNode = usStackNode[ ulDepth ];
+        usStart = usStackStart[ ulDepth ];
+
+        /* '#' also matches the parent level. */
+        if( pxTable->pxNodes[ usNode ].usHashChild != 0U )
+        {
+            prvCollectNode( pxTable, pxTable->pxNodes[ usNode ].usHashChild, pxPublishInfo, pulSet );
+        }
+
+        if( usStart > usTopicLength )
+        {
+            /* Every level of the topic was consumed. */
+            prvCollectNode( pxTable, usNode, pxPublishInfo, pulSet );
+        }
+        else
+        {
+            usEnd = prvLevelEnd( pcTopic, usTopicLength, usStart );
+
+            usChild = pxTable->pxNodes[ usNode ].usPlusChild;
+
+            if( usChild != 0U )
+            {
+                usStackNode[ ulDepth ] = usChild;
+                usStackStart[ ulDepth ] = usEnd + 1U;
+                ulDepth++;
+            }
+
+            usChild = prvChild( ( SubscriptionTable_t * ) pxTable, usNode, &( pcTopic[ usStart ] ), usEnd - usStart, false );
+
+            if( usChild != 0U )
+            {
+                usStackNode[ ulDepth ] = usChild;
+                usStackStart[ ulDepth ] = usEnd + 1U;
+                ulDepth++;
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Add the elements matched linearly whose filter matches a topic to a
+ * set of elements.
+ *
+ * @param[in] xAll Match every element, not only those left out of the hash
+ * table and the index.
+ */
+static void prvMatchLinear( const SubscriptionTable_t * pxTable,
+                            const MQTTPublishInfo_t * pxPublishInfo,
+                            bool xAll,
+                            uint32_t * pulSet )
+{
+    uint32_t ulIndex;
+    bool isMatched;
+
+    for( ulIndex = 0U; ulIndex < pxTable->usCapacity; ulIndex++ )
+    {
+        if( ( pxTable->pxElements[ ulIndex ].usFilterStringLength > 0 ) &&
+            ( xAll || ( ( pxTable->pxElements[ ulIndex ].usIndexNode == 0U ) && !pxTable->pxElements[ ulIndex ].xHashed ) ) )
+        {
+            isMatched = false;
+            MQTT_MatchTopic( pxPublishInfo->pTopicName,
+                             pxPublishInfo->topicNameLength,
+                             pxTable->pxElements[ ulIndex ].pcSubscriptionFilterString,
+                             pxTable->pxElements[ ulIndex ].usFilterStringLength,
+                             &isMatched );
+
+            if( isMatched == true )
+            {
+                pulSet[ ulIndex / 32U ] |= 1UL << ( ulIndex % 32U );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Collect the elements of a table whose filter matches a topic into a
+ * set of elements.
+ */
+static void prvMatchTable( const SubscriptionTable_t * pxTable,
+                           const MQTTPublishInfo_t * pxPublishInfo,
+                           uint32_t * pulSet )
+{
+    prvMatchHashed( pxTable, pxPublishInfo, pulSet );
+
+    /* The index is empty unless a filter has a wildcard. */
+    if( ( pxTable->pxNodes[ 0 ].usFirstChild != 0U ) ||
+        ( pxTable->pxNodes[ 0 ].usPlusChild != 0U ) ||
+        ( pxTable->pxNodes[ 0 ].usHashChild != 0U ) )
+    {
+        prvMatchIndex( pxTable, pxPublishInfo, pulSet );
+    }
+
+    if( pxTable->usLinearElements > 0U )
+    {
+        prvMatchLinear( pxTable, pxPublishInfo, false, pulSet );
+    }
+
+    #if SUBSCRIPTION_MANAGER_VERIFY_INDEX
+    {
+        uint32_t ulExpected[ ELEMENT_SET_WORDS ] = { 0 };
+
+        prvMatchLinear( pxTable, pxPublishInfo, true, ulExpected );
+
+        if( memcmp( ulExpected, pulSet, sizeof( ulExpected ) ) != 0 )
+        {
+            LogError( ( "Index and linear matcher disagree on topic %.*s.",
+                        pxPublishInfo->topicNameLength,
+                        pxPublishInfo->pTopicName ) );
+            memcpy( pulSet, ulExpected, sizeof( ulExpected ) );
+        }
+    }
+    #endif /* SUBSCRIPTION_MANAGER_VERIFY_INDEX */
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Number of index nodes of a table of a given capacity.
+ *
+ * One node per distinct topic level prefix of the wildcard filters, plus the
+ * root. Exact filters are hashed instead, so beyond 16 subscriptions about one
+ * in four filters is assumed to have a wildcard. Filters which do not fit are
+ * matched linearly.
+ */
+static uint16_t prvNodeCapacity( uint16_t usCapacity )
+{
+    uint32_t ulNodes = ( usCapacity * 6U ) + 1U;
+
+    if( usCapacity > 16U )
+    {
+        ulNodes = ( 16U * 6U ) + ( ( ( usCapacity - 16U ) * 3U ) / 2U ) + 1U;
+    }
+
+    return ( uint16_t ) ulNodes;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Number of hash buckets of a table of a given capacity, a power of two
+ * keeping at most one exact filter per bucket on average.
+ */
+static uint16_t prvBucketCount( uint16_t usCapacity )
+{
+    uint16_t usBuckets = 16U;
+
+    while( usBuckets < usCapacity )
+    {
+        usBuckets <<= 1;
+    }
+
+    return usBuckets;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Size of the allocation of a table of a given capacity.
+ */
+static size_t prvTableBytes( uint16_t usCapacity )
+{
+    return ALIGN_SIZE( sizeof( SubscriptionTable_t ) ) +
+           ( usCapacity * sizeof( SubscriptionElement_t ) ) +
+           ( prvNodeCapacity( usCapacity ) * sizeof( SubscriptionIndexNode_t ) ) +
+           ( prvBucketCount( usCapacity ) * sizeof( uint16_t ) );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Allocate a table, with its elements, nodes and buckets.
+ *
+ * @return The table, whose content is to be set, or NULL if out of memory.
+ */
+static SubscriptionTable_t * prvAllocateTable( uint16_t usCapacity )
+{
+    SubscriptionTable_t * pxTable = malloc( prvTableBytes( usCapacity ) );
+
+    if( pxTable == NULL )
+    {
+        LogError( ( "Failed to allocate a table of %u subscriptions.",
+                    ( unsigned int ) usCapacity ) );
+    }
+    else
+    {
+        pxTable->usCapacity = usCapacity;
+        pxTable->usNodeCapacity = prvNodeCapacity( usCapacity );
+        pxTable->usBucketMask = ( uint16_t ) ( prvBucketCount( usCapacity ) - 1U );
+        pxTable->pxElements = ( SubscriptionElement_t * ) ( ( uint8_t * ) pxTable + ALIGN_SIZE( sizeof( SubscriptionTable_t ) ) );
+        pxTable->pxNodes = ( SubscriptionIndexNode_t * ) &( pxTable->pxElements[ usCapacity ] );
+        pxTable->pusBuckets = ( uint16_t * ) &( pxTable->pxNodes[ pxTable->usNodeCapacity ] );
+    }
+
+    return pxTable;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Empty a table.
+ */
+static void prvResetTable( SubscriptionTable_t * pxTable )
+{
+    memset( pxTable->pxElements, 0x00, pxTable->usCapacity * sizeof( SubscriptionElement_t ) );
+    memset( &( pxTable->pxNodes[ 0 ] ), 0x00, sizeof( SubscriptionIndexNode_t ) );
+    memset( pxTable->pusBuckets, 0x00, ( pxTable->usBucketMask + 1U ) * sizeof( uint16_t ) );
+    pxTable->usElementsInUse = 0U;
+    pxTable->usFreshNodes = 0U;
+    pxTable->usFreeNodes = 0U;
+    pxTable->usLinearElements = 0U;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Copy a table into one of the same capacity.
+ */
+static void prvCopyTable( SubscriptionTable_t * pxTable,
+                          const SubscriptionTable_t * pxSource )
+{
+    memcpy( pxTable->pxElements, pxSource->pxElements, pxTable->usCapacity * sizeof( SubscriptionElement_t ) );
+    memcpy( pxTable->pxNodes, pxSource->pxNodes, ( pxSource->usFreshNodes + 1U ) * sizeof( SubscriptionIndexNode_t ) );
+    memcpy( pxTable->pusBuckets, pxSource->pusBuckets, ( pxTable->usBucketMask + 1U ) * sizeof( uint16_t ) );
+    pxTable->usElementsInUse = pxSource->usElementsInUse;
+    pxTable->usFreshNodes = pxSource->usFreshNodes;
+    pxTable->usFreeNodes = pxSource->usFreeNodes;
+    pxTable->usLinearElements = pxSource->usLinearElements;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Copy the elements of a table into a larger one, at the same
+ * positions, and index them again for the size of the larger table.
+ */
+static void prvRebuildTable( SubscriptionTable_t * pxTable,
+                             const SubscriptionTable_t * pxSource )
+{
+    SubscriptionElement_t * pxElement;
+    uint16_t i;
+
+    prvResetTable( pxTable );
+
+    for( i = 0U; i < pxSource->usCapacity; i++ )
+    {
+        if( pxSource->pxElements[ i ].usFilterStringLength > 0U )
+        {
+            pxElement = &( pxTable->pxElements[ i ] );
+            *pxElement = pxSource->pxElements[ i ];
+            pxElement->usIndexNode = 0U;
+            pxElement->usNextAtNode = 0U;
+            pxElement->xHashed = false;
+            prvIndexElement( pxTable, i );
+        }
+    }
+
+    pxTable->usElementsInUse = pxSource->usElementsInUse;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Copy a topic filter into the arena of a list.
+ *
+ * The filter takes the first free slot large enough for it, as the filters
+ * of a device tend to have similar lengths. Otherwise it is appended to the
+ * chunk filled first, and a new chunk is taken when it is full. A filter
+ * longer than a chunk gets a chunk of its own, which does not replace the one
+ * being filled.
+ *
+ * @return The copy, with one reference, or NULL if out of memory.
+ */
+static const char * prvArenaAdd( SubscriptionList_t * pxSubscriptionList,
+                                 const char * pcFilter,
+                                 uint16_t usLength )
+{
+    SubscriptionArenaChunk_t * pxChunk;
+    SubscriptionArenaFilter_t * pxFilter = NULL;
+    size_t xSize = FILTER_SIZE( usLength );
+    size_t xChunkSize = ( xSize > SUBSCRIPTION_MANAGER_ARENA_CHUNK_SIZE ) ? xSize : SUBSCRIPTION_MANAGER_ARENA_CHUNK_SIZE;
+    size_t xOffset;
+    char * pcCopy = NULL;
+
+    for( pxChunk = pxSubscriptionList->pxArena; ( pxChunk != NULL ) && ( pxFilter == NULL ); pxChunk = pxChunk->pxNext )
+    {
+        for( xOffset = 0U; xOffset < pxChunk->xUsed; xOffset += pxFilter->ulSlotSize )
+        {
+            pxFilter = ( SubscriptionArenaFilter_t * ) ( CHUNK_FILTERS( pxChunk ) + xOffset );
+
+            /* Readers may be retaining other filters of the chunk. */
+            if( ( __atomic_load_n( &( pxFilter->ulRefs ), __ATOMIC_SEQ_CST ) == 0U ) &&
+                ( pxFilter->ulSlotSize >= xSize ) )
+            {
+                break;
+            }
+        }
+
+        if( xOffset >= pxChunk->xUsed )
+        {
+            pxFilter = NULL;
+        }
+        else
+        {
+            pxChunk->ulLive++;
+        }
+    }
+
+    pxChunk = pxSubscriptionList->pxArena;
+
+    if( pxFilter != NULL )
+    {
+        /* Reuse the free slot. */
+    }
+    else if( ( pxChunk == NULL ) || ( ( pxChunk->xSize - pxChunk->xUsed ) < xSize ) )
+    {
+        pxChunk = malloc( ALIGN_SIZE( sizeof( SubscriptionArenaChunk_t ) ) + xChunkSize );
+
+        if( pxChunk == NULL )
+        {
+            LogError( ( "Failed to allocate %u bytes for topic filters.",
+                        ( unsigned int ) xChunkSize ) );
+        }
+        else
+        {
+            pxChunk->xSize = xChunkSize;
+            pxChunk->xUsed = 0U;
+            pxChunk->ulLive = 0U;
+
+            if( ( xChunkSize > SUBSCRIPTION_MANAGER_ARENA_CHUNK_SIZE ) && ( pxSubscriptionList->pxArena != NULL ) )
+            {
+                pxChunk->pxNext = pxSubscriptionList->pxArena->pxNext;
+                pxSubscriptionList->pxArena->pxNext = pxChunk;
+            }
+            else
+            {
+                pxChunk->pxNext = pxSubscriptionList->pxArena;
+                pxSubscriptionList->pxArena = pxChunk;
+            }
+        }
+    }
+
+    if( ( pxFilter == NULL ) && ( pxChunk != NULL ) )
+    {
+        pxFilter = ( SubscriptionArenaFilter_t * ) ( CHUNK_FILTERS( pxChunk ) + pxChunk->xUsed );
+        pxFilter->pxChunk = pxChunk;
+        pxFilter->ulSlotSize = ( uint32_t ) xSize;
+        pxChunk->xUsed += xSize;
+        pxChunk->ulLive++;
+    }
+
+    if( pxFilter != NULL )
+    {
+        __atomic_store_n( &( pxFilter->ulRefs ), 1U, __ATOMIC_SEQ_CST );
+        pxFilter->usLength = usLength;
+        pcCopy = ( char * ) ( pxFilter + 1 );
+        memcpy( pcCopy, pcFilter, usLength );
+        pcCopy[ usLength ] = '\0';
+    }
+
+    return pcCopy;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Add a reference to a filter of the arena.
+ *
+ * This is atomic, as filters may be retained by dispatches while a writer
+ * releases others.
+ */
+static void prvArenaRetain( const char * pcFilter )
+{
+    SubscriptionArenaFilter_t * pxFilter = ( ( SubscriptionArenaFilter_t * ) pcFilter ) - 1;
+
+    ( void ) __atomic_add_fetch( &( pxFilter->ulRefs ), 1U, __ATOMIC_SEQ_CST );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Drop a reference to a filter of the arena, by the writer of the list
+ * once no dispatch may read it.
+ *
+ * The space of the filter is given back with the chunk, once the other
+ * filters of the chunk are released too. The chunk being filled is kept and
+ * filled again from its start.
+ */
+static void prvArenaRelease( SubscriptionList_t * pxSubscriptionList,
+                             const char * pcFilter )
+{
+    SubscriptionArenaFilter_t * pxFilter = ( ( SubscriptionArenaFilter_t * ) pcFilter ) - 1;
+    SubscriptionArenaChunk_t * pxChunk = pxFilter->pxChunk;
+    SubscriptionArenaChunk_t ** ppxLink = &( pxSubscriptionList->pxArena );
+
+    if( ( __atomic_sub_fetch( &( pxFilter->ulRefs ), 1U, __ATOMIC_SEQ_CST ) == 0U ) &&
+        ( --( pxChunk->ulLive ) == 0U ) )
+    {
+        if( pxChunk == pxSubscriptionList->pxArena )
+        {
+            pxChunk->xUsed = 0U;
+        }
+        else
+        {
+            while( *ppxLink != pxChunk )
+            {
+                ppxLink = &( ( *ppxLink )->pxNext );
+            }
+
+            *ppxLink = pxChunk->pxNext;
+            free( pxChunk );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Register a reader of the published table of a list.
+ *
+ * The reader counts itself on the table it found published, then checks the
+ * table is still published. Otherwise a writer may be about to reuse it, so
+ * the reader steps back and tries again.
+ *
+ * @return Index of the table, to pass to prvReleaseTable().
+ */
+static uint32_t prvAcquireTable( SubscriptionList_t * pxSubscriptionList )
+{
+    uint32_t ulTable;
+
+    for( ; ; )
+    {
+        ulTable = __atomic_load_n( &( pxSubscriptionList->ulPublished ), __ATOMIC_SEQ_CST );
+        ( void ) __atomic_fetch_add( &( pxSubscriptionList->ulReaders[ ulTable ] ), 1U, __ATOMIC_SEQ_CST );
+
+        if( __atomic_load_n( &( pxSubscriptionList->ulPublished ), __ATOMIC_SEQ_CST ) == ulTable )
+        {
+            break;
+        }
+
+        ( void ) __atomic_fetch_sub( &( pxSubscriptionList->ulReaders[ ulTable ] ), 1U, __ATOMIC_SEQ_CST );
+    }
+
+    return ulTable;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Unregister a reader of a table.
+ */
+static void prvReleaseTable( SubscriptionList_t * pxSubscriptionList,
+                             uint32_t ulTable )
+{
+    ( void ) __atomic_fetch_sub( &( pxSubscriptionList->ulReaders[ ulTable ] ), 1U, __ATOMIC_SEQ_CST );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Become the writer of a list.
+ */
+static void prvLockWriter( SubscriptionList_t * pxSubscriptionList )
+{
+    /* Writers are rare, so wait for one another by polling. */
+    while( __atomic_test_and_set( &( pxSubscriptionList->xWriting ), __ATOMIC_ACQUIRE ) )
+    {
+        vTaskDelay( 1 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Become the writer of a list, and copy its published table into the
+ * other one to be changed.
+ *
+ * No dispatch reads the other table: the previous writer waited for them to
+ * finish, and later ones step back as it is not published. It is thus
+ * reallocated if the table has to grow, or has grown since it was published.
+ *
+ * @param[in] usAdded Number of elements about to be added.
+ *
+ * @return The table to change, or NULL if the list is empty and nothing is
+ * added, or out of memory.
+ */
+static SubscriptionTable_t * prvBeginWrite( SubscriptionList_t * pxSubscriptionList,
+                                            uint16_t usAdded )
+{
+    uint32_t ulPublished, ulCapacity = 0U;
+    SubscriptionTable_t * pxPublished;
+    SubscriptionTable_t * pxTable;
+
+    prvLockWriter( pxSubscriptionList );
+
+    ulPublished = pxSubscriptionList->ulPublished;
+    pxPublished = pxSubscriptionList->pxTables[ ulPublished ];
+    pxTable = pxSubscriptionList->pxTables[ 1U - ulPublished ];
+
+    if( pxPublished != NULL )
+    {
+        ulCapacity = pxPublished->usCapacity;
+
+        if( ( uint32_t ) pxPublished->usElementsInUse + usAdded > ulCapacity )
+        {
+            ulCapacity = pxPublished->usElementsInUse + usAdded;
+        }
+    }
+    else
+    {
+        ulCapacity = usAdded;
+    }
+
+    if( ulCapacity > 0U )
+    {
+        ulCapacity = ( ( ulCapacity + SUBSCRIPTION_MANAGER_GROWTH - 1U ) / SUBSCRIPTION_MANAGER_GROWTH ) * SUBSCRIPTION_MANAGER_GROWTH;
+
+        if( ulCapacity > SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS )
+        {
+            ulCapacity = SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS;
+        }
+
+        if( ( pxTable != NULL ) && ( pxTable->usCapacity != ulCapacity ) )
+        {
+            free( pxTable );
+            pxTable = NULL;
+        }
+
+        if( pxTable == NULL )
+        {
+            pxTable = prvAllocateTable( ( uint16_t ) ulCapacity );
+            pxSubscriptionList->pxTables[ 1U - ulPublished ] = pxTable;
+        }
+    }
+
+    if( pxTable == NULL )
+    {
+        /* Nothing to write. */
+    }
+    else if( pxPublished == NULL )
+    {
+        prvResetTable( pxTable );
+    }
+    else if( pxPublished->usCapacity == pxTable->usCapacity )
+    {
+        prvCopyTable( pxTable, pxPublished );
+    }
+    else
+    {
+        prvRebuildTable( pxTable, pxPublished );
+    }
+
+    return pxTable;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Publish the table changed by the writer of a list, and wait for the
+ * dispatches reading the previous table to finish.
+ */
+static void prvPublishTable( SubscriptionList_t * pxSubscriptionList )
+{
+    uint32_t ulPrevious = pxSubscriptionList->ulPublished;
+
+    __atomic_store_n( &( pxSubscriptionList->ulPublished ), 1U - ulPrevious, __ATOMIC_SEQ_CST );
+    pxSubscriptionList->ulVersions++;
+
+    /* Afterwards, the filters removed from the list are not read anymore,
+     * and the previous table can be written. */
+    while( __atomic_load_n( &( pxSubscriptionList->ulReaders[ ulPrevious ] ), __ATOMIC_SEQ_CST ) != 0U )
+    {
+        vTaskDelay( 1 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Let the next writer of a list in.
+ */
+static void prvEndWrite( SubscriptionList_t * pxSubscriptionList )
+{
+    __atomic_clear( &( pxSubscriptionList->xWriting ), __ATOMIC_RELEASE );
+}
+
+/*-----------------------------------------------------------*/
 
-bool addSubscription( SubscriptionElement_t * pxSubscriptionList,
-                      const char * pcTopicFilterString,
-                      uint16_t usTopicFilterLength,
-                      IncomingPubCallback_t pxIncomingPublishCallback,
-                      void * pvIncomingPublishCallbackContext )
+/**
+ * @brief Remove the elements subscribing a callback, or every callback, to a
+ * topic filter.
+ *
+ * @param[in] xAnyCallback Remove the elements of every callback.
+ * @param[out] pxLast Set to whether the last callback subscribed to the
+ * filter was removed. May be NULL.
+ *
+ * @return Number of elements removed.
+ */
+static uint32_t prvRemoveElements( SubscriptionList_t * pxSubscriptionList,
+                                   const char * pcTopicFilterString,
+                                   uint16_t usTopicFilterLength,
+                                   bool xAnyCallback,
+                                   IncomingPubCallback_t pxIncomingPublishCallback,
+                                   void * pvIncomingPublishCallbackContext,
+                                   bool * pxLast )
+{
+    uint32_t ulIndex = 0, ulRemoved = 0U, ulRemaining = 0U;
+    SubscriptionTable_t * pxTable;
+    SubscriptionElement_t * pxElements;
+    const char * pcFilterCopy = NULL;
+
+    pxTable = prvBeginWrite( pxSubscriptionList, 0U );
+
+    for( ulIndex = 0U; ( pxTable != NULL ) && ( ulIndex < pxTable->usCapacity ); ulIndex++ )
+    {
+        pxElements = pxTable->pxElements;
+
+        if( ( pxElements[ ulIndex ].usFilterStringLength != usTopicFilterLength ) ||
+            ( strncmp( pxElements[ ulIndex ].pcSubscriptionFilterString, pcTopicFilterString, usTopicFilterLength ) != 0 ) )
+        {
+            /* Another filter. */
+        }
+        else if( xAnyCallback ||
+                 ( ( pxElements[ ulIndex ].pxIncomingPublishCallback == pxIncomingPublishCallback ) &&
+                   ( pxElements[ ulIndex ].pvIncomingPublishCallbackContext == pvIncomingPublishCallbackContext ) ) )
+        {
+            /* The elements of a filter share its copy. */
+            pcFilterCopy = pxElements[ ulIndex ].pcSubscriptionFilterString;
+            prvUnindexElement( pxTable, ( uint16_t ) ulIndex );
+            memset( &( pxElements[ ulIndex ] ), 0x00, sizeof( SubscriptionElement_t ) );
+            pxTable->usElementsInUse--;
+            ulRemoved++;
+        }
+        else
+        {
+            ulRemaining++;
+        }
+    }
+
+    if( pxLast != NULL )
+    {
+        *pxLast = ( ulRemoved > 0U ) && ( ulRemaining == 0U );
+    }
+
+    if( ulRemoved > 0U )
+    {
+        /* Nodes shared with the removed filter may point into its copy, which
+         * is released below. */
+        for( ulIndex = 0U; ulIndex < pxTable->usCapacity; ulIndex++ )
+        {
+            if( pxTable->pxElements[ ulIndex ].usFilterStringLength > 0 )
+            {
+                prvRepointElement( pxTable, ( uint16_t ) ulIndex );
+            }
+        }
+
+        prvPublishTable( pxSubscriptionList );
+
+        for( ulIndex = 0U; ulIndex < ulRemoved; ulIndex++ )
+        {
+            prvArenaRelease( pxSubscriptionList, pcFilterCopy );
+        }
+    }
+
+    prvEndWrite( pxSubscriptionList );
+
+    return ulRemoved;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Add the element subscribing a callback to a topic filter.
+ *
+ * @param[out] pxFirst Set to whether no other callback was subscribed to the
+ * filter. May be NULL.
+ *
+ * @return `true` if the element was added or exists, `false` otherwise.
+ */
+static bool prvAddElement( SubscriptionList_t * pxSubscriptionList,
+                           const char * pcTopicFilterString,
+                           uint16_t usTopicFilterLength,
+                           IncomingPubCallback_t pxIncomingPublishCallback,
+                           void * pvIncomingPublishCallbackContext,
+                           bool * pxFirst )
 {
     int32_t lIndex = 0;
-    size_t xAvailableIndex = SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS;
+    size_t xAvailableIndex = 0U;
+    SubscriptionTable_t * pxTable;
+    SubscriptionElement_t * pxElements;
+    const char * pcFilterCopy = NULL;
+    bool xFirst = false;
     bool xReturnStatus = false;
 
     if( ( pxSubscriptionList == NULL ) ||
@@ -60,37 +1248,72 @@ bool addSubscription( SubscriptionElement_t * pxSubscriptionList,
     }
     else
     {
-        /* Start at end of array, so that we will insert at the first available index.
-         * Scans backwards to find duplicates. */
-        for( lIndex = ( int32_t ) SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS - 1; lIndex >= 0; lIndex-- )
+        pxTable = prvBeginWrite( pxSubscriptionList, 1U );
+
+        if( pxTable != NULL )
         {
-            if( pxSubscriptionList[ lIndex ].usFilterStringLength == 0 )
+            pxElements = pxTable->pxElements;
+            xAvailableIndex = pxTable->usCapacity;
+
+            /* Start at end of array, so that we will insert at the first available index.
+             * Scans backwards to find duplicates. */
+            for( lIndex = ( int32_t ) pxTable->usCapacity - 1; lIndex >= 0; lIndex-- )
             {
-                xAvailableIndex = lIndex;
+                if( pxElements[ lIndex ].usFilterStringLength == 0 )
+                {
+                    xAvailableIndex = lIndex;
+                }
+                else if( ( pxElements[ lIndex ].usFilterStringLength == usTopicFilterLength ) &&
+                         ( strncmp( pcTopicFilterString, pxElements[ lIndex ].pcSubscriptionFilterString, ( size_t ) usTopicFilterLength ) == 0 ) )
+                {
+                    /* Share the copy of the filter with the other callbacks. */
+                    pcFilterCopy = pxElements[ lIndex ].pcSubscriptionFilterString;
+
+                    /* If a subscription already exists, don't do anything. */
+                    if( ( pxElements[ lIndex ].pxIncomingPublishCallback == pxIncomingPublishCallback ) &&
+                        ( pxElements[ lIndex ].pvIncomingPublishCallbackContext == pvIncomingPublishCallbackContext ) )
+                    {
+                        LogWarn( ( "Subscription already exists.\n" ) );
+                        xAvailableIndex = pxTable->usCapacity;
+                        xReturnStatus = true;
+                        break;
+                    }
+                }
             }
-            else if( ( pxSubscriptionList[ lIndex ].usFilterStringLength == usTopicFilterLength ) &&
-                     ( strncmp( pcTopicFilterString, pxSubscriptionList[ lIndex ].pcSubscriptionFilterString, ( size_t ) usTopicFilterLength ) == 0 ) )
+
+            xFirst = ( pcFilterCopy == NULL );
+
+            if( xAvailableIndex < pxTable->usCapacity )
             {
-                /* If a subscription already exists, don't do anything. */
-                if( ( pxSubscriptionList[ lIndex ].pxIncomingPublishCallback == pxIncomingPublishCallback ) &&
-                    ( pxSubscriptionList[ lIndex ].pvIncomingPublishCallbackContext == pvIncomingPublishCallbackContext ) )
+                if( pcFilterCopy != NULL )
                 {
-                    LogWarn( ( "Subscription already exists.\n" ) );
-                    xAvailableIndex = SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS;
-                    xReturnStatus = true;
-                    break;
+                    prvArenaRetain( pcFilterCopy );
+                }
+                else
+                {
+                    pcFilterCopy = prvArenaAdd( pxSubscriptionList, pcTopicFilterString, usTopicFilterLength );
                 }
             }
-        }
 
-        if( xAvailableIndex < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS )
-        {
-            pxSubscriptionList[ xAvailableIndex ].pcSubscriptionFilterString = pcTopicFilterString;
-            pxSubscriptionList[ xAvailableIndex ].usFilterStringLength = usTopicFilterLength;
-            pxSubscriptionList[ xAvailableIndex ].pxIncomingPublishCallback = pxIncomingPublishCallback;
-            pxSubscriptionList[ xAvailableIndex ].pvIncomingPublishCallbackContext = pvIncomingPublishCallbackContext;
-            xReturnStatus = true;
+            if( ( xAvailableIndex < pxTable->usCapacity ) && ( pcFilterCopy != NULL ) )
+            {
+                pxElements[ xAvailableIndex ].pcSubscriptionFilterString = pcFilterCopy;
+                pxElements[ xAvailableIndex ].usFilterStringLength = usTopicFilterLength;
+                pxElements[ xAvailableIndex ].pxIncomingPublishCallback = pxIncomingPublishCallback;
+                pxElements[ xAvailableIndex ].pvIncomingPublishCallbackContext = pvIncomingPublishCallbackContext;
+                prvIndexElement( pxTable, ( uint16_t ) xAvailableIndex );
+                pxTable->usElementsInUse++;
+                prvPublishTable( pxSubscriptionList );
+                xReturnStatus = true;
+            }
         }
+
+        prvEndWrite( pxSubscriptionList );
+    }
+
+    if( pxFirst != NULL )
+    {
+        *pxFirst = xReturnStatus && xFirst;
     }
 
     return xReturnStatus;
@@ -98,11 +1321,159 @@ bool addSubscription( SubscriptionElement_t * pxSubscriptionList,
 
 /*-----------------------------------------------------------*/
 
-void removeSubscription( SubscriptionElement_t * pxSubscriptionList,
+bool addSubscription( SubscriptionList_t * pxSubscriptionList,
+                      const char * pcTopicFilterString,
+                      uint16_t usTopicFilterLength,
+                      IncomingPubCallback_t pxIncomingPublishCallback,
+                      void * pvIncomingPublishCallbackContext )
+{
+    return prvAddElement( pxSubscriptionList,
+                          pcTopicFilterString,
+                          usTopicFilterLength,
+                          pxIncomingPublishCallback,
+                          pvIncomingPublishCallbackContext,
+                          NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+bool addSharedSubscription( SubscriptionList_t * pxSubscriptionList,
+                            const char * pcTopicFilterString,
+                            uint16_t usTopicFilterLength,
+                            IncomingPubCallback_t pxIncomingPublishCallback,
+                            void * pvIncomingPublishCallbackContext,
+                            bool * pxFirst )
+{
+    bool xAdded = false;
+
+    if( pxFirst == NULL )
+    {
+        LogError( ( "Invalid parameter. pxFirst=%p.", pxFirst ) );
+    }
+    else
+    {
+        xAdded = prvAddElement( pxSubscriptionList,
+                                pcTopicFilterString,
+                                usTopicFilterLength,
+                                pxIncomingPublishCallback,
+                                pvIncomingPublishCallbackContext,
+                                pxFirst );
+    }
+
+    return xAdded;
+}
+
+/*-----------------------------------------------------------*/
+
+void removeSubscription( SubscriptionList_t * pxSubscriptionList,
                          const char * pcTopicFilterString,
                          uint16_t usTopicFilterLength )
 {
-    uint32_t ulIndex = 0;
+    if( ( pxSubscriptionList == NULL ) ||
+        ( pcTopicFilterString == NULL ) ||
+        ( usTopicFilterLength == 0U ) )
+    {
+        LogError( ( "Invalid parameter. pxSubscriptionList=%p, pcTopicFilterString=%p,"
+                    " usTopicFilterLength=%u.",
+                    pxSubscriptionList,
+                    pcTopicFilterString,
+                    ( unsigned int ) usTopicFilterLength ) );
+    }
+    else
+    {
+        ( void ) prvRemoveElements( pxSubscriptionList,
+                                    pcTopicFilterString,
+                                    usTopicFilterLength,
+                                    true,
+                                    NULL,
+                                    NULL,
+                                    NULL );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+bool removeSubscriptionCallback( SubscriptionList_t * pxSubscriptionList,
+                                 const char * pcTopicFilterString,
+                                 uint16_t usTopicFilterLength,
+                                 IncomingPubCallback_t pxIncomingPublishCallback,
+                                 void * pvIncomingPublishCallbackContext )
+{
+    bool xRemoved = false;
+
+    if( ( pxSubscriptionList == NULL ) ||
+        ( pcTopicFilterString == NULL ) ||
+        ( usTopicFilterLength == 0U ) ||
+        ( pxIncomingPublishCallback == NULL ) )
+    {
+        LogError( ( "Invalid parameter. pxSubscriptionList=%p, pcTopicFilterString=%p,"
+                    " usTopicFilterLength=%u, pxIncomingPublishCallback=%p.",
+                    pxSubscriptionList,
+                    pcTopicFilterString,
+                    ( unsigned int ) usTopicFilterLength,
+                    pxIncomingPublishCallback ) );
+    }
+    else
+    {
+        xRemoved = ( prvRemoveElements( pxSubscriptionList,
+                                        pcTopicFilterString,
+                                        usTopicFilterLength,
+                                        false,
+                                        pxIncomingPublishCallback,
+                                        pvIncomingPublishCallbackContext,
+                                        NULL ) > 0U );
+    }
+
+    return xRemoved;
+}
+
+/*-----------------------------------------------------------*/
+
+bool removeSharedSubscription( SubscriptionList_t * pxSubscriptionList,
+                               const char * pcTopicFilterString,
+                               uint16_t usTopicFilterLength,
+                               IncomingPubCallback_t pxIncomingPublishCallback,
+                               void * pvIncomingPublishCallbackContext,
+                               bool * pxLast )
+{
+    bool xRemoved = false;
+
+    if( ( pxSubscriptionList == NULL ) ||
+        ( pcTopicFilterString == NULL ) ||
+        ( usTopicFilterLength == 0U ) ||
+        ( pxIncomingPublishCallback == NULL ) ||
+        ( pxLast == NULL ) )
+    {
+        LogError( ( "Invalid parameter. pxSubscriptionList=%p, pcTopicFilterString=%p,"
+                    " usTopicFilterLength=%u, pxIncomingPublishCallback=%p, pxLast=%p.",
+                    pxSubscriptionList,
+                    pcTopicFilterString,
+                    ( unsigned int ) usTopicFilterLength,
+                    pxIncomingPublishCallback,
+                    pxLast ) );
+    }
+    else
+    {
+        xRemoved = ( prvRemoveElements( pxSubscriptionList,
+                                        pcTopicFilterString,
+                                        usTopicFilterLength,
+                                        false,
+                                        pxIncomingPublishCallback,
+                                        pvIncomingPublishCallbackContext,
+                                        pxLast ) > 0U );
+    }
+
+    return xRemoved;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t countSubscriptions( SubscriptionList_t * pxSubscriptionList,
+                             const char * pcTopicFilterString,
+                             uint16_t usTopicFilterLength )
+{
+    const SubscriptionElement_t * pxElements;
+    uint32_t ulElements = 0U, ulCount = 0U, i;
 
     if( ( pxSubscriptionList == NULL ) ||
         ( pcTopicFilterString == NULL ) ||
@@ -116,26 +1487,36 @@ void removeSubscription( SubscriptionElement_t * pxSubscriptionList,
     }
     else
     {
-        for( ulIndex = 0U; ulIndex < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS; ulIndex++ )
+        pxElements = acquireSubscriptions( pxSubscriptionList, &ulElements );
+
+        for( i = 0U; i < ulElements; i++ )
         {
-            if( pxSubscriptionList[ ulIndex ].usFilterStringLength == usTopicFilterLength )
+            if( ( pxElements[ i ].usFilterStringLength == usTopicFilterLength ) &&
+                ( strncmp( pxElements[ i ].pcSubscriptionFilterString, pcTopicFilterString, usTopicFilterLength ) == 0 ) )
             {
-                if( strncmp( pxSubscriptionList[ ulIndex ].pcSubscriptionFilterString, pcTopicFilterString, usTopicFilterLength ) == 0 )
-                {
-                    memset( &( pxSubscriptionList[ ulIndex ] ), 0x00, sizeof( SubscriptionElement_t ) );
-                }
+                ulCount++;
             }
         }
+
+        releaseSubscriptions( pxSubscriptionList, pxElements );
     }
+
+    return ulCount;
 }
 
 /*-----------------------------------------------------------*/
 
-bool handleIncomingPublishes( SubscriptionElement_t * pxSubscriptionList,
+bool handleIncomingPublishes( SubscriptionList_t * pxSubscriptionList,
                               MQTTPublishInfo_t * pxPublishInfo )
 {
-    uint32_t ulIndex = 0;
-    bool isMatched = false, publishHandled = false;
+    uint32_t ulMatched[ ELEMENT_SET_WORDS ];
+    IncomingPubCallback_t pxCallbacks[ SUBSCRIPTION_MANAGER_DISPATCH_BATCH ];
+    void * pvContexts[ SUBSCRIPTION_MANAGER_DISPATCH_BATCH ];
+    const SubscriptionTable_t * pxTable;
+    const SubscriptionElement_t * pxElement;
+    uint32_t ulIndex = 0, ulWord, ulTable, ulNext = 0U, ulCount, i;
+    bool xMore = true;
+    bool publishHandled = false;
 
     if( ( pxSubscriptionList == NULL ) ||
         ( pxPublishInfo == NULL ) )
@@ -146,25 +1527,238 @@ bool handleIncomingPublishes( SubscriptionElement_t * pxSubscriptionList,
     }
     else
     {
-        for( ulIndex = 0U; ulIndex < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS; ulIndex++ )
+        /* Callbacks are invoked in the order of the list, as the linear
+         * matcher did, a batch at a time. Matching is only repeated if more
+         * callbacks matched than fit in a batch. */
+        while( xMore )
         {
-            if( pxSubscriptionList[ ulIndex ].usFilterStringLength > 0 )
+            xMore = false;
+            ulCount = 0U;
+            memset( ulMatched, 0x00, sizeof( ulMatched ) );
+
+            ulTable = prvAcquireTable( pxSubscriptionList );
+            pxTable = pxSubscriptionList->pxTables[ ulTable ];
+
+            if( pxTable != NULL )
             {
-                MQTT_MatchTopic( pxPublishInfo->pTopicName,
-                                 pxPublishInfo->topicNameLength,
-                                 pxSubscriptionList[ ulIndex ].pcSubscriptionFilterString,
-                                 pxSubscriptionList[ ulIndex ].usFilterStringLength,
-                                 &isMatched );
+                prvMatchTable( pxTable, pxPublishInfo, ulMatched );
+            }
 
-                if( isMatched == true )
+            for( ulWord = ulNext / 32U; ( ulWord < ELEMENT_SET_WORDS ) && !xMore; ulWord++ )
+            {
+                while( ulMatched[ ulWord ] != 0U )
                 {
-                    pxSubscriptionList[ ulIndex ].pxIncomingPublishCallback( pxSubscriptionList[ ulIndex ].pvIncomingPublishCallbackContext,
-                                                                             pxPublishInfo );
-                    publishHandled = true;
+                    ulIndex = ( ulWord * 32U ) + ( uint32_t ) __builtin_ctz( ulMatched[ ulWord ] );
+                    ulMatched[ ulWord ] &= ulMatched[ ulWord ] - 1U;
+
+                    if( ulIndex < ulNext )
+                    {
+                        /* Invoked in an earlier batch. */
+                    }
+                    else if( ulCount == SUBSCRIPTION_MANAGER_DISPATCH_BATCH )
+                    {
+                        ulNext = ulIndex;
+                        xMore = true;
+                        break;
+                    }
+                    else
+                    {
+                        pxElement = &( pxTable->pxElements[ ulIndex ] );
+                        pxCallbacks[ ulCount ] = pxElement->pxIncomingPublishCallback;
+                        pvContexts[ ulCount ] = pxElement->pvIncomingPublishCallbackContext;
+                        ulCount++;
+                    }
                 }
             }
+
+            prvReleaseTable( pxSubscriptionList, ulTable );
+
+            /* The callbacks may change the list now. */
+            for( i = 0U; i < ulCount; i++ )
+            {
+                pxCallbacks[ i ]( pvContexts[ i ], pxPublishInfo );
+                publishHandled = true;
+            }
         }
     }
 
     return publishHandled;
 }
+
+/*-----------------------------------------------------------*/
+
+const SubscriptionElement_t * acquireSubscriptions( SubscriptionList_t * pxSubscriptionList,
+                                                    uint32_t * pulCount )
+{
+    const SubscriptionElement_t * pxElements = NULL;
+    const SubscriptionTable_t * pxTable;
+    uint32_t ulTable;
+
+    if( ( pxSubscriptionList == NULL ) || ( pulCount == NULL ) )
+    {
+        LogError( ( "Invalid parameter. pxSubscriptionList=%p, pulCount=%p.",
+                    pxSubscriptionList,
+                    pulCount ) );
+    }
+    else
+    {
+        ulTable = prvAcquireTable( pxSubscriptionList );
+        pxTable = pxSubscriptionList->pxTables[ ulTable ];
+        *pulCount = 0U;
+
+        if( pxTable == NULL )
+        {
+            /* Nothing to keep. */
+            prvReleaseTable( pxSubscriptionList, ulTable );
+        }
+        else
+        {
+            pxElements = pxTable->pxElements;
+            *pulCount = pxTable->usCapacity;
+        }
+    }
+
+    return pxElements;
+}
+
+/*-----------------------------------------------------------*/
+
+void releaseSubscriptions( SubscriptionList_t * pxSubscriptionList,
+                           const SubscriptionElement_t * pxElements )
+{
+    if( pxSubscriptionList == NULL )
+    {
+        LogError( ( "Invalid parameter. pxSubscriptionList=%p.",
+                    pxSubscriptionList ) );
+    }
+    else if( pxElements != NULL )
+    {
+        prvReleaseTable( pxSubscriptionList,
+                         ( ( pxSubscriptionList->pxTables[ 0 ] != NULL ) &&
+                           ( pxElements == pxSubscriptionList->pxTables[ 0 ]->pxElements ) ) ? 0U : 1U );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void retainSubscriptionFilter( SubscriptionList_t * pxSubscriptionList,
+                               const char * pcFilter )
+{
+    if( ( pxSubscriptionList == NULL ) || ( pcFilter == NULL ) )
+    {
+        LogError( ( "Invalid parameter. pxSubscriptionList=%p, pcFilter=%p.",
+                    pxSubscriptionList,
+                    pcFilter ) );
+    }
+    else
+    {
+        /* The acquired table keeps writers from releasing the filter. */
+        prvArenaRetain( pcFilter );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void releaseSubscriptionFilter( SubscriptionList_t * pxSubscriptionList,
+                                const char * pcFilter )
+{
+    if( ( pxSubscriptionList == NULL ) || ( pcFilter == NULL ) )
+    {
+        LogError( ( "Invalid parameter. pxSubscriptionList=%p, pcFilter=%p.",
+                    pxSubscriptionList,
+                    pcFilter ) );
+    }
+    else
+    {
+        prvLockWriter( pxSubscriptionList );
+        prvArenaRelease( pxSubscriptionList, pcFilter );
+        prvEndWrite( pxSubscriptionList );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void getSubscriptionMemory( SubscriptionList_t * pxSubscriptionList,
+                            SubscriptionMemory_t * pxMemory )
+{
+    const SubscriptionTable_t * pxTable;
+    const SubscriptionArenaChunk_t * pxChunk;
+    const SubscriptionArenaFilter_t * pxFilter;
+    size_t xOffset;
+    uint32_t i;
+
+    if( ( pxSubscriptionList == NULL ) || ( pxMemory == NULL ) )
+    {
+        LogError( ( "Invalid parameter. pxSubscriptionList=%p, pxMemory=%p.",
+                    pxSubscriptionList,
+                    pxMemory ) );
+    }
+    else
+    {
+        memset( pxMemory, 0x00, sizeof( SubscriptionMemory_t ) );
+
+        /* Only writers change the published table and the arena. */
+        prvLockWriter( pxSubscriptionList );
+
+        pxTable = pxSubscriptionList->pxTables[ pxSubscriptionList->ulPublished ];
+
+        if( pxTable != NULL )
+        {
+            pxMemory->ulSubscriptions = pxTable->usElementsInUse;
+            pxMemory->ulCapacity = pxTable->usCapacity;
+        }
+
+        for( i = 0U; i < 2U; i++ )
+        {
+            if( pxSubscriptionList->pxTables[ i ] != NULL )
+            {
+                pxMemory->ulTableBytes += ( uint32_t ) prvTableBytes( pxSubscriptionList->pxTables[ i ]->usCapacity );
+            }
+        }
+
+        for( pxChunk = pxSubscriptionList->pxArena; pxChunk != NULL; pxChunk = pxChunk->pxNext )
+        {
+            pxMemory->ulArenaBytes += ( uint32_t ) ( ALIGN_SIZE( sizeof( SubscriptionArenaChunk_t ) ) + pxChunk->xSize );
+
+            for( xOffset = 0U; xOffset < pxChunk->xUsed; xOffset += pxFilter->ulSlotSize )
+            {
+                pxFilter = ( const SubscriptionArenaFilter_t * ) ( CHUNK_FILTERS( pxChunk ) + xOffset );
+
+                if( __atomic_load_n( &( pxFilter->ulRefs ), __ATOMIC_SEQ_CST ) > 0U )
+                {
+                    pxMemory->ulFilters++;
+                    pxMemory->ulFilterBytes += pxFilter->ulSlotSize;
+                }
+            }
+        }
+
+        prvEndWrite( pxSubscriptionList );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void freeSubscriptionList( SubscriptionList_t * pxSubscriptionList )
+{
+    SubscriptionArenaChunk_t * pxChunk;
+
+    if( pxSubscriptionList == NULL )
+    {
+        LogError( ( "Invalid parameter. pxSubscriptionList=%p.",
+                    pxSubscriptionList ) );
+    }
+    else
+    {
+        free( pxSubscriptionList->pxTables[ 0 ] );
+        free( pxSubscriptionList->pxTables[ 1 ] );
+
+        while( pxSubscriptionList->pxArena != NULL )
+        {
+            pxChunk = pxSubscriptionList->pxArena;
+            pxSubscriptionList->pxArena = pxChunk->pxNext;
+            free( pxChunk );
+        }
+
+        memset( pxSubscriptionList, 0x00, sizeof( SubscriptionList_t ) );
+    }
+}
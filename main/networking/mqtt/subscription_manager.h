@@ -31,6 +31,9 @@
 #ifndef SUBSCRIPTION_MANAGER_H
 #define SUBSCRIPTION_MANAGER_H
 
+/* ESP-IDF sdkconfig include. */
+#include <sdkconfig.h>
+
 /* core MQTT include. */
 #include "core_mqtt.h"
 
@@ -39,7 +42,44 @@
  * simultaneously in a list.
  */
 #ifndef SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS
-    #define SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS    10U
+    #ifdef CONFIG_GRI_SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS
+        #define SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS    ( CONFIG_GRI_SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS )
+    #else
+        #define SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS    10U
+    #endif
+#endif
+
+/**
+ * @brief Number of subscriptions by which the tables of a list grow when they
+ * are full, up to SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS.
+ */
+#ifndef SUBSCRIPTION_MANAGER_GROWTH
+    #define SUBSCRIPTION_MANAGER_GROWTH    8U
+#endif
+
+/**
+ * @brief Size in bytes of the chunks of the arena the topic filters of a list
+ * are copied into. A longer filter gets a chunk of its own.
+ */
+#ifndef SUBSCRIPTION_MANAGER_ARENA_CHUNK_SIZE
+    #define SUBSCRIPTION_MANAGER_ARENA_CHUNK_SIZE    256U
+#endif
+
+/**
+ * @brief Maximum number of callbacks a dispatch collects from the published
+ * table before releasing it to invoke them. Further matches are collected in
+ * another round.
+ */
+#ifndef SUBSCRIPTION_MANAGER_DISPATCH_BATCH
+    #define SUBSCRIPTION_MANAGER_DISPATCH_BATCH    8U
+#endif
+
+/**
+ * @brief Maximum number of topic levels of a filter held in the topic filter
+ * index. Deeper filters are matched linearly.
+ */
+#ifndef SUBSCRIPTION_MANAGER_MAX_INDEX_DEPTH
+    #define SUBSCRIPTION_MANAGER_MAX_INDEX_DEPTH    16U
 #endif
 
 /**
@@ -54,14 +94,10 @@ typedef void (* IncomingPubCallback_t )( void * pvIncomingPublishCallbackContext
 /**
  * @brief An element in the list of subscriptions.
  *
- * This subscription manager implementation expects that the array of the
- * subscription elements used for storing subscriptions to be initialized to 0.
- *
  * @note This implementation allows multiple tasks to subscribe to the same topic.
  * In this case, another element is added to the subscription list, differing
- * in the intended publish callback. Also note that the topic filters are not
- * copied in the subscription manager and hence the topic filter strings need to
- * stay in scope until unsubscribed.
+ * in the intended publish callback. The topic filter is copied into the arena
+ * of the list, once for all the elements sharing it.
  */
 typedef struct subscriptionElement
 {
@@ -69,8 +105,104 @@ typedef struct subscriptionElement
     void * pvIncomingPublishCallbackContext;
     uint16_t usFilterStringLength;
     const char * pcSubscriptionFilterString;
+    uint32_t ulFilterHash;  /**< FNV-1a hash of the filter, for exact filters. */
+    uint16_t usIndexNode;   /**< Index node the filter ends at, 0 if the filter is hashed or matched linearly. */
+    uint16_t usNextAtNode;  /**< 1 + position of the next element ending at the same node or in the same bucket, 0 for none. */
+    bool xHashed;           /**< The filter has no wildcard and is in the hash table. */
 } SubscriptionElement_t;
 
+/**
+ * @brief A node of the topic filter index, standing for one topic level of
+ * one or more filters.
+ *
+ * Children of a node are the levels which may follow it. The '+' and '#'
+ * levels are kept apart from the other children, so matching a topic only
+ * follows the levels of the topic and the wildcards.
+ */
+typedef struct subscriptionIndexNode
+{
+    const char * pcLevel;     /**< Text of the level, inside one of the filters going through the node. */
+    uint16_t usLevelLength;   /**< Length of pcLevel. */
+    uint16_t usParent;        /**< Parent node. */
+    uint16_t usFirstChild;    /**< First child other than '+' and '#', 0 for none. */
+    uint16_t usNextSibling;   /**< Next child of the parent, or next free node. 0 for none. */
+    uint16_t usPlusChild;     /**< '+' child, 0 for none. */
+    uint16_t usHashChild;     /**< '#' child, 0 for none. */
+    uint16_t usFirstElement;  /**< 1 + position of the first element ending at the node, 0 for none. */
+    uint16_t usRefs;          /**< Elements whose filter goes through or ends at the node. */
+} SubscriptionIndexNode_t;
+
+/**
+ * @brief A version of the subscriptions of a list, with the index of their
+ * topic filters.
+ *
+ * Filters without wildcards, which are most of them, are kept in a hash table
+ * so an incoming publish finds them with a single lookup of its topic. Filters
+ * with wildcards are matched by walking the index one topic level at a time,
+ * which is skipped when there are none. The cost of a dispatch thus depends on
+ * the length of the topic rather than on the number of subscriptions. Filters
+ * which are not well formed, or do not fit in the index, are matched linearly
+ * with MQTT_MatchTopic().
+ *
+ * The elements, nodes and buckets are allocated with the table, and sized by
+ * its capacity.
+ */
+typedef struct subscriptionTable
+{
+    SubscriptionElement_t * pxElements;  /**< usCapacity elements. */
+    SubscriptionIndexNode_t * pxNodes;   /**< usNodeCapacity nodes. Node 0 is the root. */
+    uint16_t * pusBuckets;               /**< 1 + position of the first element of each bucket, 0 for none. */
+    uint16_t usCapacity;                 /**< Number of elements. */
+    uint16_t usNodeCapacity;             /**< Number of nodes. */
+    uint16_t usBucketMask;               /**< Number of buckets minus one, a power of two minus one. */
+    uint16_t usElementsInUse;            /**< Elements with a filter. */
+    uint16_t usFreshNodes;               /**< Nodes after the root ever used. */
+    uint16_t usFreeNodes;                /**< First node of the free list, 0 for none. */
+    uint16_t usLinearElements;           /**< Elements matched linearly. */
+} SubscriptionTable_t;
+
+/**
+ * @brief A list of subscriptions.
+ *
+ * Incoming publishes are dispatched from the published table without taking
+ * a lock. Adding or removing a subscription copies the published table into
+ * the other one, changes the copy and publishes it, then waits for the
+ * dispatches still reading the previous table to finish. Writers are
+ * serialized with each other, and may run in any task but not in an
+ * interrupt.
+ *
+ * The tables are allocated by the first subscription, and grow by
+ * SUBSCRIPTION_MANAGER_GROWTH subscriptions when full. Topic filters are
+ * copied into an arena of SUBSCRIPTION_MANAGER_ARENA_CHUNK_SIZE byte chunks,
+ * in which a filter subscribed with several callbacks is stored once. The
+ * space of a removed filter is given back with the last filter of its chunk.
+ *
+ * This subscription manager implementation expects the list to be
+ * initialized to 0.
+ */
+typedef struct subscriptionList
+{
+    SubscriptionTable_t * pxTables[ 2 ];     /**< The published table, and the one written next. NULL until allocated. */
+    uint32_t ulPublished;                    /**< Index of the published table. */
+    uint32_t ulReaders[ 2 ];                 /**< Dispatches reading each table. */
+    uint32_t ulVersions;                     /**< Number of tables published. */
+    struct subscriptionArenaChunk * pxArena; /**< Chunks of the arena, the one filled first. */
+    bool xWriting;                           /**< A writer holds the list. */
+} SubscriptionList_t;
+
+/**
+ * @brief Memory used by a list of subscriptions.
+ */
+typedef struct subscriptionMemory
+{
+    uint32_t ulSubscriptions; /**< Callbacks registered. */
+    uint32_t ulFilters;       /**< Distinct topic filters in the arena. */
+    uint32_t ulCapacity;      /**< Subscriptions the tables hold before growing. */
+    uint32_t ulTableBytes;    /**< Bytes allocated for the two tables. */
+    uint32_t ulArenaBytes;    /**< Bytes allocated for the arena. */
+    uint32_t ulFilterBytes;   /**< Bytes of the arena held by the filters, headers included. */
+} SubscriptionMemory_t;
+
 /**
  * @brief Add a subscription to the subscription list.
  *
@@ -78,45 +210,199 @@ typedef struct subscriptionElement
  * context-callback pairs. However, a single context-callback pair may only be
  * associated to the same topic filter once.
  *
- * @param[in] pxSubscriptionList  The pointer to the subscription list array.
- * @param[in] pcTopicFilterString Topic filter string of subscription.
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
+ * @param[in] pcTopicFilterString Topic filter string of subscription. It is
+ * copied, and may be released on return.
  * @param[in] usTopicFilterLength Length of topic filter string.
  * @param[in] pxIncomingPublishCallback Callback function for the subscription.
  * @param[in] pvIncomingPublishCallbackContext Context for the subscription callback.
  *
  * @return `true` if subscription added or exists, `false` if insufficient memory.
  */
-bool addSubscription( SubscriptionElement_t * pxSubscriptionList,
+bool addSubscription( SubscriptionList_t * pxSubscriptionList,
                       const char * pcTopicFilterString,
                       uint16_t usTopicFilterLength,
                       IncomingPubCallback_t pxIncomingPublishCallback,
                       void * pvIncomingPublishCallbackContext );
 
+/**
+ * @brief Add a subscription to a topic filter other callbacks may share, and
+ * tell whether it is the first.
+ *
+ * The answer is given under the lock of the writer, so of the tasks sharing
+ * a filter exactly one is told to send the SUBSCRIBE packet.
+ *
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
+ * @param[in] pcTopicFilterString Topic filter string of subscription. It is
+ * copied, and may be released on return.
+ * @param[in] usTopicFilterLength Length of topic filter string.
+ * @param[in] pxIncomingPublishCallback Callback function for the subscription.
+ * @param[in] pvIncomingPublishCallbackContext Context for the subscription callback.
+ * @param[out] pxFirst Set to `true` if no other callback was subscribed to the
+ * filter, so the broker has to be subscribed to it.
+ *
+ * @return `true` if subscription added or exists, `false` if insufficient memory.
+ */
+bool addSharedSubscription( SubscriptionList_t * pxSubscriptionList,
+                            const char * pcTopicFilterString,
+                            uint16_t usTopicFilterLength,
+                            IncomingPubCallback_t pxIncomingPublishCallback,
+                            void * pvIncomingPublishCallbackContext,
+                            bool * pxFirst );
+
 /**
  * @brief Remove a subscription from the subscription list.
  *
  * @note If the topic filter exists multiple times in the subscription list,
  * then every instance of the subscription will be removed.
  *
- * @param[in] pxSubscriptionList  The pointer to the subscription list array.
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
  * @param[in] pcTopicFilterString Topic filter of subscription.
  * @param[in] usTopicFilterLength Length of topic filter.
  */
-void removeSubscription( SubscriptionElement_t * pxSubscriptionList,
+void removeSubscription( SubscriptionList_t * pxSubscriptionList,
                          const char * pcTopicFilterString,
                          uint16_t usTopicFilterLength );
 
+/**
+ * @brief Remove the subscription of a single callback to a topic filter,
+ * leaving the other callbacks subscribed to it.
+ *
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
+ * @param[in] pcTopicFilterString Topic filter of subscription.
+ * @param[in] usTopicFilterLength Length of topic filter.
+ * @param[in] pxIncomingPublishCallback Callback function of the subscription.
+ * @param[in] pvIncomingPublishCallbackContext Context of the subscription callback.
+ *
+ * @return `true` if the subscription was removed, `false` if it did not exist.
+ */
+bool removeSubscriptionCallback( SubscriptionList_t * pxSubscriptionList,
+                                 const char * pcTopicFilterString,
+                                 uint16_t usTopicFilterLength,
+                                 IncomingPubCallback_t pxIncomingPublishCallback,
+                                 void * pvIncomingPublishCallbackContext );
+
+/**
+ * @brief Remove the subscription of a single callback to a topic filter
+ * other callbacks may share, and tell whether it was the last.
+ *
+ * The answer is given under the lock of the writer, so of the tasks sharing
+ * a filter exactly one is told to send the UNSUBSCRIBE packet.
+ *
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
+ * @param[in] pcTopicFilterString Topic filter of subscription.
+ * @param[in] usTopicFilterLength Length of topic filter.
+ * @param[in] pxIncomingPublishCallback Callback function of the subscription.
+ * @param[in] pvIncomingPublishCallbackContext Context of the subscription callback.
+ * @param[out] pxLast Set to `true` if no other callback is left subscribed to
+ * the filter, so the broker has to be unsubscribed from it.
+ *
+ * @return `true` if the subscription was removed, `false` if it did not exist.
+ */
+bool removeSharedSubscription( SubscriptionList_t * pxSubscriptionList,
+                               const char * pcTopicFilterString,
+                               uint16_t usTopicFilterLength,
+                               IncomingPubCallback_t pxIncomingPublishCallback,
+                               void * pvIncomingPublishCallbackContext,
+                               bool * pxLast );
+
+/**
+ * @brief Count the callbacks subscribed to a topic filter.
+ *
+ * The count may be stale as soon as it is returned. Use
+ * addSharedSubscription() and removeSharedSubscription() to decide whether a
+ * SUBSCRIBE or UNSUBSCRIBE packet is needed.
+ *
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
+ * @param[in] pcTopicFilterString Topic filter.
+ * @param[in] usTopicFilterLength Length of topic filter.
+ *
+ * @return Number of callbacks subscribed to the filter.
+ */
+uint32_t countSubscriptions( SubscriptionList_t * pxSubscriptionList,
+                             const char * pcTopicFilterString,
+                             uint16_t usTopicFilterLength );
+
 /**
  * @brief Handle incoming publishes by invoking the callbacks registered
  * for the incoming publish's topic filter.
  *
- * @param[in] pxSubscriptionList  The pointer to the subscription list array.
+ * @note The callbacks are invoked once the table they were matched in is
+ * released, so they may add or remove subscriptions. A callback may thus run
+ * once more if its subscription is removed by another task while the publish
+ * is dispatched.
+ *
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
  * @param[in] pxPublishInfo Info of incoming publish.
  *
  * @return `true` if an application callback could be invoked;
  *  `false` otherwise.
  */
-bool handleIncomingPublishes( SubscriptionElement_t * pxSubscriptionList,
+bool handleIncomingPublishes( SubscriptionList_t * pxSubscriptionList,
                               MQTTPublishInfo_t * pxPublishInfo );
 
+/**
+ * @brief Get the subscriptions of the published table of a list, which stays
+ * valid until released. So do the topic filters of the subscriptions.
+ *
+ * @note The list must not be written by the same task before the table is
+ * released, as the writer would wait for it forever.
+ *
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
+ * @param[out] pulCount Number of elements of the table.
+ *
+ * @return The elements of the table, NULL if the list never had a
+ * subscription. Free elements have a filter length of 0.
+ */
+const SubscriptionElement_t * acquireSubscriptions( SubscriptionList_t * pxSubscriptionList,
+                                                    uint32_t * pulCount );
+
+/**
+ * @brief Release the subscriptions got with acquireSubscriptions().
+ *
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
+ * @param[in] pxElements The elements returned by acquireSubscriptions().
+ */
+void releaseSubscriptions( SubscriptionList_t * pxSubscriptionList,
+                           const SubscriptionElement_t * pxElements );
+
+/**
+ * @brief Keep the copy of a topic filter in the arena after its
+ * subscriptions are removed, until released with releaseSubscriptionFilter().
+ *
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
+ * @param[in] pcFilter The filter of an element got with
+ * acquireSubscriptions(), before the elements are released.
+ */
+void retainSubscriptionFilter( SubscriptionList_t * pxSubscriptionList,
+                               const char * pcFilter );
+
+/**
+ * @brief Release a topic filter kept with retainSubscriptionFilter().
+ *
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
+ * @param[in] pcFilter The filter to release.
+ */
+void releaseSubscriptionFilter( SubscriptionList_t * pxSubscriptionList,
+                                const char * pcFilter );
+
+/**
+ * @brief Report the memory used by a list of subscriptions.
+ *
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
+ * @param[out] pxMemory Where to write the report.
+ */
+void getSubscriptionMemory( SubscriptionList_t * pxSubscriptionList,
+                            SubscriptionMemory_t * pxMemory );
+
+/**
+ * @brief Free the memory of a list of subscriptions, and set it back to 0.
+ *
+ * @note No task may use the list meanwhile, and filters retained with
+ * retainSubscriptionFilter() are freed too.
+ *
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
+ */
+void freeSubscriptionList( SubscriptionList_t * pxSubscriptionList );
+
 #endif /* SUBSCRIPTION_MANAGER_H */
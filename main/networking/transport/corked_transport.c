@@ -0,0 +1,495 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file corked_transport.c
+ * @brief Transport interface that gathers outgoing MQTT packets into fewer
+ * TLS records.
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <string.h>
+#include <sys/select.h>
+
+/* FreeRTOS includes. */
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+/* ESP-IDF includes. */
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_tls.h>
+
+/* Public functions include. */
+#include "corked_transport.h"
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief Reasons for writing the gathered data.
+ */
+typedef enum CorkedTransportFlushReason
+{
+    eFlushPacket,   /**< Uncorked; the packet is complete. */
+    eFlushFull,     /**< The buffer is full. */
+    eFlushIdle,     /**< No more packets are queued. */
+    eFlushDeadline  /**< The flush deadline expired. */
+} CorkedTransportFlushReason_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "corked_transport";
+
+/**
+ * @brief Corked transports by network context. coreMQTT hands the network
+ * context to the transport functions, which is owned by the application.
+ */
+static CorkedTransport_t * pxCorks[ corkedtransportconfigMAX_CONTEXTS ];
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Get the corked transport of a network context.
+ *
+ * @param[in] pxNetworkContext Network context.
+ *
+ * @return The corked transport, or NULL if none was initialized for it.
+ */
+static CorkedTransport_t * prvGetCork( NetworkContext_t * pxNetworkContext );
+
+/**
+ * @brief Block until the socket of the TLS connection can take more data.
+ *
+ * @param[in] pxCork Corked transport.
+ * @param[in] xTicksToWait Maximum time to wait.
+ *
+ * @return true if the socket is writable, false on timeout or error.
+ */
+static bool prvWaitWritable( CorkedTransport_t * pxCork,
+                             TickType_t xTicksToWait );
+
+/**
+ * @brief Write the gathered data to the TLS transport. Must be called with
+ * the mutex of the corked transport held.
+ *
+ * @param[in] pxCork Corked transport.
+ * @param[in] eReason Why the data is written, for the counters.
+ *
+ * @return true if all gathered data was written, false otherwise.
+ */
+static bool prvFlush( CorkedTransport_t * pxCork,
+                      CorkedTransportFlushReason_t eReason );
+
+/**
+ * @brief Copy data into the buffer, writing it out each time it fills up.
+ * Must be called with the mutex of the corked transport held.
+ *
+ * @param[in] pxCork Corked transport.
+ * @param[in] pvData Data to copy.
+ * @param[in] xDataLength Length of pvData.
+ *
+ * @return true if successful, false if a write failed.
+ */
+static bool prvAppend( CorkedTransport_t * pxCork,
+                       const void * pvData,
+                       size_t xDataLength );
+
+/**
+ * @brief Complete a packet handed over by coreMQTT: count it, and write the
+ * gathered data unless corked and still within the flush deadline. Must be
+ * called with the mutex of the corked transport held.
+ *
+ * @param[in] pxCork Corked transport.
+ *
+ * @return true if successful, false if a write failed.
+ */
+static bool prvEndPacket( CorkedTransport_t * pxCork );
+
+/**
+ * @brief esp_timer callback waking the writer once the first byte has waited
+ * corkedtransportconfigFLUSH_DEADLINE_US.
+ *
+ * @param[in] pvCork Corked transport.
+ */
+static void prvFlushTimerCallback( void * pvCork );
+
+/* Static function definitions ************************************************/
+
+static CorkedTransport_t * prvGetCork( NetworkContext_t * pxNetworkContext )
+{
+    CorkedTransport_t * pxCork = NULL;
+    int i;
+
+    for( i = 0; ( i < corkedtransportconfigMAX_CONTEXTS ) && ( pxCork == NULL ); i++ )
+    {
+        if( ( pxCorks[ i ] != NULL ) && ( pxCorks[ i ]->pxNetworkContext == pxNetworkContext ) )
+        {
+            pxCork = pxCorks[ i ];
+        }
+    }
+
+    return pxCork;
+}
+
+static bool prvWaitWritable( CorkedTransport_t * pxCork,
+                             TickType_t xTicksToWait )
+{
+    int lSockFd = -1;
+    fd_set xWriteSet;
+    struct timeval xTimeout;
+    uint32_t ulTimeoutMs = pdTICKS_TO_MS( xTicksToWait );
+    bool xRet = false;
+
+    if( esp_tls_get_conn_sockfd( pxCork->pxNetworkContext->pxTls, &lSockFd ) == ESP_OK )
+    {
+        FD_ZERO( &xWriteSet );
+        FD_SET( lSockFd, &xWriteSet );
+        xTimeout.tv_sec = ulTimeoutMs / 1000U;
+        xTimeout.tv_usec = ( ulTimeoutMs % 1000U ) * 1000U;
+
+        xRet = ( select( lSockFd + 1, NULL, &xWriteSet, NULL, &xTimeout ) > 0 );
+    }
+
+    return xRet;
+}
+
+static bool prvFlush( CorkedTransport_t * pxCork,
+                      CorkedTransportFlushReason_t eReason )
+{
+    size_t xSent = 0;
+    int32_t lRet;
+    TickType_t xStartTick = xTaskGetTickCount();
+    TickType_t xElapsed;
+
+    /* Whatever is written now no longer has a deadline. Stopping a timer
+     * that is not running fails harmlessly. */
+    ( void ) esp_timer_stop( pxCork->xFlushTimer );
+
+    while( ( pxCork->xWriteFailed == false ) && ( xSent < pxCork->xLength ) )
+    {
+        lRet = espTlsTransportSend( pxCork->pxNetworkContext,
+                                    &( pxCork->ucBuffer[ xSent ] ),
+                                    pxCork->xLength - xSent );
+
+        if( lRet > 0 )
+        {
+            xSent += ( size_t ) lRet;
+        }
+        else
+        {
+            /* The socket buffers are full; sleep in select() until the stack
+             * has room rather than retrying every tick. */
+            xElapsed = xTaskGetTickCount() - xStartTick;
+
+            if( ( lRet < 0 ) ||
+                ( xElapsed >= pxCork->pxNetworkContext->xTimeout ) ||
+                ( prvWaitWritable( pxCork, pxCork->pxNetworkContext->xTimeout - xElapsed ) == false ) )
+            {
+                /* Report the failure on the next send so coreMQTT tears down
+                 * the connection. */
+                ESP_LOGE( TAG, "Failed to write %u gathered bytes.", ( unsigned int ) pxCork->xLength );
+                pxCork->xWriteFailed = true;
+            }
+        }
+    }
+
+    if( ( xSent > 0 ) && ( pxCork->xWriteFailed == false ) )
+    {
+        pxCork->xStats.ulRecords++;
+        pxCork->xStats.ulBytes += xSent;
+
+        switch( eReason )
+        {
+            case eFlushFull:
+                pxCork->xStats.ulFlushFull++;
+                break;
+
+            case eFlushIdle:
+                pxCork->xStats.ulFlushIdle++;
+                break;
+
+            case eFlushDeadline:
+                pxCork->xStats.ulFlushDeadline++;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    pxCork->xLength = 0;
+
+    return !pxCork->xWriteFailed;
+}
+
+static bool prvAppend( CorkedTransport_t * pxCork,
+                       const void * pvData,
+                       size_t xDataLength )
+{
+    const uint8_t * pucData = ( const uint8_t * ) pvData;
+    size_t xChunk;
+    bool xRet = !pxCork->xWriteFailed;
+
+    while( xRet && ( xDataLength > 0 ) )
+    {
+        if( pxCork->xLength == sizeof( pxCork->ucBuffer ) )
+        {
+            xRet = prvFlush( pxCork, eFlushFull );
+        }
+        else
+        {
+            if( pxCork->xLength == 0 )
+            {
+                pxCork->llFirstByteTimeUs = esp_timer_get_time();
+
+                if( pxCork->xCorked )
+                {
+                    /* Fails harmlessly if a late callback already re-armed
+                     * the timer; the callback checks the deadline itself. */
+                    ( void ) esp_timer_start_once( pxCork->xFlushTimer,
+                                                   corkedtransportconfigFLUSH_DEADLINE_US );
+                }
+            }
+
+            xChunk = sizeof( pxCork->ucBuffer ) - pxCork->xLength;
+            xChunk = ( xChunk < xDataLength ) ? xChunk : xDataLength;
+
+            memcpy( &( pxCork->ucBuffer[ pxCork->xLength ] ), pucData, xChunk );
+            pxCork->xLength += xChunk;
+            pucData += xChunk;
+            xDataLength -= xChunk;
+        }
+    }
+
+    return xRet;
+}
+
+static bool prvEndPacket( CorkedTransport_t * pxCork )
+{
+    bool xRet = true;
+
+    pxCork->xStats.ulPackets++;
+
+    if( pxCork->xCorked == false )
+    {
+        xRet = prvFlush( pxCork, eFlushPacket );
+    }
+    else if( ( esp_timer_get_time() - pxCork->llFirstByteTimeUs ) >= corkedtransportconfigFLUSH_DEADLINE_US )
+    {
+        xRet = prvFlush( pxCork, eFlushDeadline );
+    }
+
+    return xRet;
+}
+
+static void prvFlushTimerCallback( void * pvCork )
+{
+    CorkedTransport_t * pxCork = ( CorkedTransport_t * ) pvCork;
+
+    /* Writing to TLS can block for as long as the send timeout, which must not
+     * happen on the shared esp_timer task. The writer flushes from
+     * vCorkedTransportPoll() once woken, as the deadline has passed by then. */
+    pxCork->xWakeHook( pxCork->pvWakeHookContext );
+}
+
+/* Public function definitions ************************************************/
+
+BaseType_t xCorkedTransportInit( CorkedTransport_t * pxCork,
+                                 NetworkContext_t * pxNetworkContext,
+                                 CorkedTransportWakeHook_t xWakeHook,
+                                 void * pvWakeHookContext )
+{
+    BaseType_t xRet = pdFAIL;
+    esp_timer_create_args_t xTimerArgs =
+    {
+        .callback        = prvFlushTimerCallback,
+        .arg             = ( void * ) pxCork,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name            = "cork_flush"
+    };
+    int i;
+
+    configASSERT( pxCork != NULL );
+    configASSERT( pxNetworkContext != NULL );
+    configASSERT( xWakeHook != NULL );
+
+    memset( pxCork, 0x00, sizeof( *pxCork ) );
+    pxCork->pxNetworkContext = pxNetworkContext;
+    pxCork->xWakeHook = xWakeHook;
+    pxCork->pvWakeHookContext = pvWakeHookContext;
+    pxCork->xMutex = xSemaphoreCreateMutexStatic( &( pxCork->xMutexStructure ) );
+
+    if( esp_timer_create( &xTimerArgs, &( pxCork->xFlushTimer ) ) != ESP_OK )
+    {
+        ESP_LOGE( TAG, "Failed to create the flush timer of a corked transport." );
+    }
+    else
+    {
+        for( i = 0; ( i < corkedtransportconfigMAX_CONTEXTS ) && ( xRet == pdFAIL ); i++ )
+        {
+            if( pxCorks[ i ] == NULL )
+            {
+                pxCorks[ i ] = pxCork;
+                xRet = pdPASS;
+            }
+        }
+
+        if( xRet == pdFAIL )
+        {
+            ESP_LOGE( TAG, "No room to register corked transport." );
+            ( void ) esp_timer_delete( pxCork->xFlushTimer );
+            pxCork->xFlushTimer = NULL;
+        }
+    }
+
+    return xRet;
+}
+
+void vCorkedTransportSetCorked( CorkedTransport_t * pxCork,
+                                bool xCorked )
+{
+    xSemaphoreTake( pxCork->xMutex, portMAX_DELAY );
+
+    if( xCorked == false )
+    {
+        /* The connection is going away; whatever was gathered is lost with
+         * it, just as data in the socket buffers would be. */
+        pxCork->xLength = 0;
+        ( void ) esp_timer_stop( pxCork->xFlushTimer );
+    }
+
+    pxCork->xCorked = xCorked;
+    pxCork->xWriteFailed = false;
+
+    xSemaphoreGive( pxCork->xMutex );
+}
+
+void vCorkedTransportPoll( void * pvCork,
+                           bool xIdle )
+{
+    CorkedTransport_t * pxCork = ( CorkedTransport_t * ) pvCork;
+
+    xSemaphoreTake( pxCork->xMutex, portMAX_DELAY );
+
+    if( pxCork->xLength > 0 )
+    {
+        if( xIdle )
+        {
+            ( void ) prvFlush( pxCork, eFlushIdle );
+        }
+        else if( ( esp_timer_get_time() - pxCork->llFirstByteTimeUs ) >= corkedtransportconfigFLUSH_DEADLINE_US )
+        {
+            ( void ) prvFlush( pxCork, eFlushDeadline );
+        }
+    }
+
+    xSemaphoreGive( pxCork->xMutex );
+}
+
+int32_t lCorkedTransportSend( NetworkContext_t * pxNetworkContext,
+                              const void * pvData,
+                              size_t xDataLength )
+{
+    CorkedTransport_t * pxCork = prvGetCork( pxNetworkContext );
+    int32_t lRet = -1;
+
+    if( pxCork == NULL )
+    {
+        lRet = espTlsTransportSend( pxNetworkContext, pvData, xDataLength );
+    }
+    else
+    {
+        xSemaphoreTake( pxCork->xMutex, portMAX_DELAY );
+
+        if( prvAppend( pxCork, pvData, xDataLength ) && prvEndPacket( pxCork ) )
+        {
+            lRet = ( int32_t ) xDataLength;
+        }
+
+        xSemaphoreGive( pxCork->xMutex );
+    }
+
+    return lRet;
+}
+
+int32_t lCorkedTransportWritev( NetworkContext_t * pxNetworkContext,
+                                TransportOutVector_t * pxIoVec,
+                                size_t xIoVecCount )
+{
+    CorkedTransport_t * pxCork = prvGetCork( pxNetworkContext );
+    size_t xTotal = 0;
+    size_t i;
+    bool xOk = true;
+    int32_t lRet = -1;
+
+    if( pxCork == NULL )
+    {
+        for( i = 0; ( i < xIoVecCount ) && xOk; i++ )
+        {
+            lRet = espTlsTransportSend( pxNetworkContext, pxIoVec[ i ].iov_base, pxIoVec[ i ].iov_len );
+            xOk = ( lRet == ( int32_t ) pxIoVec[ i ].iov_len );
+            xTotal += ( lRet > 0 ) ? ( size_t ) lRet : 0U;
+        }
+
+        lRet = ( xTotal > 0U ) ? ( int32_t ) xTotal : lRet;
+    }
+    else
+    {
+        xSemaphoreTake( pxCork->xMutex, portMAX_DELAY );
+
+        for( i = 0; ( i < xIoVecCount ) && xOk; i++ )
+        {
+            xOk = prvAppend( pxCork, pxIoVec[ i ].iov_base, pxIoVec[ i ].iov_len );
+            xTotal += pxIoVec[ i ].iov_len;
+        }
+
+        if( xOk && prvEndPacket( pxCork ) )
+        {
+            lRet = ( int32_t ) xTotal;
+        }
+
+        xSemaphoreGive( pxCork->xMutex );
+    }
+
+    return lRet;
+}
+
+void vCorkedTransportGetStats( CorkedTransport_t * pxCork,
+                               CorkedTransportStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    xSemaphoreTake( pxCork->xMutex, portMAX_DELAY );
+    *pxStats = pxCork->xStats;
+    xSemaphoreGive( pxCork->xMutex );
+}
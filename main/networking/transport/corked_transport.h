@@ -0,0 +1,175 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file corked_transport.h
+ * @brief Transport interface that gathers outgoing MQTT packets into fewer
+ * TLS records.
+ *
+ * Each write to the TLS transport becomes at least one TLS record, with its
+ * own header, authentication tag and usually TCP segment. coreMQTT writes a
+ * packet as several vectors, and the coreMQTT-Agent writes each queued command
+ * as it is dequeued, so small packets would each span several records.
+ *
+ * The corked transport copies the vectors of a packet, and of consecutive
+ * packets while the connection is corked, into one buffer. The buffer is
+ * written as one record when it is full, when the agent has no more commands
+ * queued, or when the first byte has waited longer than
+ * corkedtransportconfigFLUSH_DEADLINE_US. The deadline is kept by a one-shot
+ * esp_timer, which only wakes the writer through a hook; the data is always
+ * written from the writer's own task by vCorkedTransportPoll().
+ */
+#ifndef CORKED_TRANSPORT_H
+#define CORKED_TRANSPORT_H
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+/* ESP-IDF includes. */
+#include <esp_timer.h>
+
+/* Transport interface include. */
+#include "transport_interface.h"
+
+/* Network transport include. */
+#include "network_transport.h"
+
+/* Configurations include. */
+#include "corked_transport_config.h"
+
+/**
+ * @brief Counters describing how outgoing packets were written.
+ */
+typedef struct CorkedTransportStats
+{
+    uint32_t ulPackets;         /**< Packets handed to the transport by coreMQTT. */
+    uint32_t ulRecords;         /**< Writes made to the TLS transport, each at least one record. */
+    uint32_t ulBytes;           /**< Bytes written to the TLS transport. */
+    uint32_t ulFlushFull;       /**< Writes made because the buffer was full. */
+    uint32_t ulFlushIdle;       /**< Writes made because no more commands were queued. */
+    uint32_t ulFlushDeadline;   /**< Writes made because the flush deadline expired. */
+} CorkedTransportStats_t;
+
+/**
+ * @brief Called from the esp_timer task when gathered data reaches the flush
+ * deadline. Must not block; it should only make the writer task call
+ * vCorkedTransportPoll() soon.
+ *
+ * @param[in] pvContext Context given to xCorkedTransportInit().
+ */
+typedef void ( * CorkedTransportWakeHook_t )( void * pvContext );
+
+/**
+ * @brief State of the corked transport of one network context.
+ */
+typedef struct CorkedTransport
+{
+    NetworkContext_t * pxNetworkContext;
+    SemaphoreHandle_t xMutex;
+    StaticSemaphore_t xMutexStructure;
+    esp_timer_handle_t xFlushTimer;
+    CorkedTransportWakeHook_t xWakeHook;
+    void * pvWakeHookContext;
+    bool xCorked;
+    bool xWriteFailed;
+    size_t xLength;
+    int64_t llFirstByteTimeUs;
+    uint8_t ucBuffer[ corkedtransportconfigBUFFER_SIZE ];
+    CorkedTransportStats_t xStats;
+} CorkedTransport_t;
+
+/**
+ * @brief Initialize the corked transport of a network context.
+ *
+ * The transport starts uncorked: the vectors of a packet are still gathered
+ * into one record, but each packet is written immediately.
+ *
+ * @param[in] pxCork Corked transport to initialize.
+ * @param[in] pxNetworkContext Network context written to.
+ * @param[in] xWakeHook Called when gathered data reaches the flush deadline.
+ * @param[in] pvWakeHookContext Passed to xWakeHook.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xCorkedTransportInit( CorkedTransport_t * pxCork,
+                                 NetworkContext_t * pxNetworkContext,
+                                 CorkedTransportWakeHook_t xWakeHook,
+                                 void * pvWakeHookContext );
+
+/**
+ * @brief Cork or uncork the transport.
+ *
+ * Uncorking discards gathered data, and must be used whenever the TLS
+ * connection is torn down. Only cork once the MQTT connection is established,
+ * as MQTT_Connect() waits for the CONNACK without going idle.
+ *
+ * @param[in] pxCork Corked transport.
+ * @param[in] xCorked Whether consecutive packets are gathered.
+ */
+void vCorkedTransportSetCorked( CorkedTransport_t * pxCork,
+                                bool xCorked );
+
+/**
+ * @brief Write gathered data if the writer is idle or the flush deadline has
+ * expired.
+ *
+ * @param[in] pvCork Corked transport.
+ * @param[in] xIdle Whether no more packets are about to be written.
+ */
+void vCorkedTransportPoll( void * pvCork,
+                           bool xIdle );
+
+/**
+ * @brief Send function of the corked transport. Matches TransportSend_t.
+ */
+int32_t lCorkedTransportSend( NetworkContext_t * pxNetworkContext,
+                              const void * pvData,
+                              size_t xDataLength );
+
+/**
+ * @brief Vectored send function of the corked transport. Matches
+ * TransportWritev_t.
+ */
+int32_t lCorkedTransportWritev( NetworkContext_t * pxNetworkContext,
+                                TransportOutVector_t * pxIoVec,
+                                size_t xIoVecCount );
+
+/**
+ * @brief Copy the counters of a corked transport.
+ *
+ * @param[in] pxCork Corked transport.
+ * @param[out] pxStats Where to copy the counters.
+ */
+void vCorkedTransportGetStats( CorkedTransport_t * pxCork,
+                               CorkedTransportStats_t * pxStats );
+
+#endif /* CORKED_TRANSPORT_H */
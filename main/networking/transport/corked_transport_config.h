@@ -0,0 +1,51 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+#ifndef CORKED_TRANSPORT_CONFIG_H
+#define CORKED_TRANSPORT_CONFIG_H
+
+/* ESP-IDF sdkconfig include. */
+#include <sdkconfig.h>
+
+/**
+ * @brief Size in bytes of the buffer outgoing packets are gathered in. Bounds
+ * the size of the TLS records written.
+ */
+#define corkedtransportconfigBUFFER_SIZE           ( CONFIG_GRI_TRANSPORT_CORK_BUFFER_SIZE )
+
+/**
+ * @brief Time in microseconds after which gathered packets are written even
+ * though more packets are queued.
+ */
+#define corkedtransportconfigFLUSH_DEADLINE_US     ( CONFIG_GRI_TRANSPORT_CORK_FLUSH_DEADLINE_US )
+
+/**
+ * @brief Maximum number of network contexts that can be corked at once.
+ */
+#define corkedtransportconfigMAX_CONTEXTS          ( 2 )
+
+#endif /* CORKED_TRANSPORT_CONFIG_H */
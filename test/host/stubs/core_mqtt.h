@@ -0,0 +1,82 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2023 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file core_mqtt.h
+ * @brief Host stand-in for the parts of the coreMQTT API used by the modules
+ * built on the host.
+ */
+#ifndef CORE_MQTT_H
+#define CORE_MQTT_H
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define LogError( message )    do { printf( "[ERROR] " ); printf message; printf( "\n" ); } while( 0 )
+#define LogWarn( message )
+#define LogInfo( message )
+#define LogDebug( message )
+
+typedef enum MQTTStatus
+{
+    MQTTSuccess = 0,
+    MQTTBadParameter
+} MQTTStatus_t;
+
+typedef enum MQTTQoS
+{
+    MQTTQoS0 = 0,
+    MQTTQoS1 = 1,
+    MQTTQoS2 = 2
+} MQTTQoS_t;
+
+typedef struct MQTTPublishInfo
+{
+    MQTTQoS_t qos;
+    bool retain;
+    bool dup;
+    const char * pTopicName;
+    uint16_t topicNameLength;
+    const void * pPayload;
+    size_t payloadLength;
+} MQTTPublishInfo_t;
+
+/**
+ * @brief Whether a topic name matches a topic filter, with the semantics of
+ * coreMQTT's MQTT_MatchTopic(): '+' matches one level, empty levels included,
+ * '#' matches the parent level and any number of child levels, and topics
+ * starting with '$' are not matched by a leading wildcard.
+ */
+MQTTStatus_t MQTT_MatchTopic( const char * pTopicName,
+                              const uint16_t topicNameLength,
+                              const char * pTopicFilter,
+                              const uint16_t topicFilterLength,
+                              bool * pIsMatch );
+
+#endif /* CORE_MQTT_H */
@@ -0,0 +1,120 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2023 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file core_mqtt_host.c
+ * @brief Reference topic matcher standing in for coreMQTT's MQTT_MatchTopic().
+ *
+ * Only built when the coreMQTT sources of the esp-aws-iot submodule are not
+ * checked out. It is written from the MQTT 3.1.1 rules level by level,
+ * independently of the subscription manager, so the host tests still compare
+ * the manager against a second implementation.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+#include "core_mqtt.h"
+
+/**
+ * @brief Length of the level starting at a position of a topic name or filter.
+ */
+static uint16_t prvLevelLength( const char * pcString,
+                                uint16_t usLength,
+                                uint16_t usStart )
+{
+    uint16_t usEnd = usStart;
+
+    while( ( usEnd < usLength ) && ( pcString[ usEnd ] != '/' ) )
+    {
+        usEnd++;
+    }
+
+    return ( uint16_t ) ( usEnd - usStart );
+}
+
+MQTTStatus_t MQTT_MatchTopic( const char * pTopicName,
+                              const uint16_t topicNameLength,
+                              const char * pTopicFilter,
+                              const uint16_t topicFilterLength,
+                              bool * pIsMatch )
+{
+    MQTTStatus_t xStatus = MQTTSuccess;
+    uint32_t ulTopic = 0, ulFilter = 0;
+    uint16_t usTopicLevel, usFilterLevel;
+    bool xTopicDone = false, xFilterDone = false, xMatch = true;
+
+    if( ( pTopicName == NULL ) || ( topicNameLength == 0U ) ||
+        ( pTopicFilter == NULL ) || ( topicFilterLength == 0U ) || ( pIsMatch == NULL ) )
+    {
+        xStatus = MQTTBadParameter;
+    }
+    else if( ( pTopicName[ 0 ] == '$' ) &&
+             ( ( pTopicFilter[ 0 ] == '+' ) || ( pTopicFilter[ 0 ] == '#' ) ) )
+    {
+        *pIsMatch = false;
+    }
+    else
+    {
+        /* Each iteration compares one level; the positions are one past the
+         * end once the last level was consumed. */
+        while( xMatch && !xFilterDone )
+        {
+            usFilterLevel = prvLevelLength( pTopicFilter, topicFilterLength, ( uint16_t ) ulFilter );
+
+            if( ( usFilterLevel == 1U ) && ( pTopicFilter[ ulFilter ] == '#' ) )
+            {
+                /* Matches the parent level and everything below it. */
+                xFilterDone = true;
+                xTopicDone = true;
+            }
+            else if( xTopicDone )
+            {
+                xMatch = false;
+            }
+            else
+            {
+                usTopicLevel = prvLevelLength( pTopicName, topicNameLength, ( uint16_t ) ulTopic );
+
+                if( !( ( usFilterLevel == 1U ) && ( pTopicFilter[ ulFilter ] == '+' ) ) &&
+                    ( ( usFilterLevel != usTopicLevel ) ||
+                      ( memcmp( &pTopicFilter[ ulFilter ], &pTopicName[ ulTopic ], usFilterLevel ) != 0 ) ) )
+                {
+                    xMatch = false;
+                }
+
+                ulFilter += ( uint32_t ) usFilterLevel + 1U;
+                ulTopic += ( uint32_t ) usTopicLevel + 1U;
+                xFilterDone = ( ulFilter > topicFilterLength );
+                xTopicDone = ( ulTopic > topicNameLength );
+            }
+        }
+
+        *pIsMatch = xMatch && xTopicDone;
+    }
+
+    return xStatus;
+}
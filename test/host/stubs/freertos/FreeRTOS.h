@@ -0,0 +1,56 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2023 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file FreeRTOS.h
+ * @brief Host stand-in for the FreeRTOS types and macros used by the modules
+ * built on the host.
+ */
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+/* Standard includes. */
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int32_t    BaseType_t;
+typedef uint32_t   UBaseType_t;
+typedef uint32_t   TickType_t;
+
+#define pdFALSE               ( ( BaseType_t ) 0 )
+#define pdTRUE                ( ( BaseType_t ) 1 )
+#define pdFAIL                ( pdFALSE )
+#define pdPASS                ( pdTRUE )
+
+/* Ticks are milliseconds on the host. */
+#define portMAX_DELAY         ( ( TickType_t ) UINT32_MAX )
+#define portTICK_PERIOD_MS    ( ( TickType_t ) 1 )
+#define pdMS_TO_TICKS( x )    ( ( TickType_t ) ( x ) )
+
+#define configASSERT( x )     assert( x )
+
+#endif /* FREERTOS_H */
@@ -0,0 +1,71 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2023 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file semphr.h
+ * @brief Host stand-in for the FreeRTOS semaphore API used by the modules
+ * built on the host.
+ */
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+/* Standard includes. */
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+
+/**
+ * @brief Storage of a semaphore.
+ */
+typedef struct StaticSemaphore
+{
+    pthread_mutex_t xMutex;
+    pthread_cond_t xCondition;
+    UBaseType_t uxCount;
+    UBaseType_t uxMaxCount;
+} StaticSemaphore_t;
+
+typedef StaticSemaphore_t * SemaphoreHandle_t;
+
+/**
+ * @brief Create a counting semaphore in the storage given.
+ */
+SemaphoreHandle_t xSemaphoreCreateCountingStatic( UBaseType_t uxMaxCount,
+                                                  UBaseType_t uxInitialCount,
+                                                  StaticSemaphore_t * pxSemaphoreBuffer );
+
+/**
+ * @brief Take a semaphore, waiting up to a number of milliseconds.
+ */
+BaseType_t xSemaphoreTake( SemaphoreHandle_t xSemaphore,
+                           TickType_t xBlockTime );
+
+/**
+ * @brief Give a semaphore, up to its maximum count.
+ */
+BaseType_t xSemaphoreGive( SemaphoreHandle_t xSemaphore );
+
+#endif /* SEMAPHORE_H */
@@ -0,0 +1,152 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2023 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file freertos_host.c
+ * @brief FreeRTOS API used by the modules built on the host, implemented
+ * with POSIX threads.
+ */
+
+/* Standard includes. */
+#include <sched.h>
+#include <time.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+/**
+ * @brief Its address identifies the calling thread.
+ */
+static _Thread_local char cTaskIdentity;
+
+void vTaskDelay( TickType_t xTicksToDelay )
+{
+    struct timespec xDelay;
+
+    if( xTicksToDelay == 0U )
+    {
+        ( void ) sched_yield();
+    }
+    else
+    {
+        xDelay.tv_sec = ( time_t ) ( xTicksToDelay / 1000U );
+        xDelay.tv_nsec = ( long ) ( xTicksToDelay % 1000U ) * 1000000L;
+        ( void ) nanosleep( &xDelay, NULL );
+    }
+}
+
+TickType_t xTaskGetTickCount( void )
+{
+    struct timespec xNow;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &xNow );
+
+    return ( TickType_t ) ( ( ( uint64_t ) xNow.tv_sec * 1000U ) + ( ( uint64_t ) xNow.tv_nsec / 1000000U ) );
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle( void )
+{
+    return ( TaskHandle_t ) &cTaskIdentity;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCountingStatic( UBaseType_t uxMaxCount,
+                                                  UBaseType_t uxInitialCount,
+                                                  StaticSemaphore_t * pxSemaphoreBuffer )
+{
+    pthread_condattr_t xAttributes;
+
+    ( void ) pthread_mutex_init( &( pxSemaphoreBuffer->xMutex ), NULL );
+    ( void ) pthread_condattr_init( &xAttributes );
+    ( void ) pthread_condattr_setclock( &xAttributes, CLOCK_MONOTONIC );
+    ( void ) pthread_cond_init( &( pxSemaphoreBuffer->xCondition ), &xAttributes );
+    ( void ) pthread_condattr_destroy( &xAttributes );
+    pxSemaphoreBuffer->uxCount = uxInitialCount;
+    pxSemaphoreBuffer->uxMaxCount = uxMaxCount;
+
+    return pxSemaphoreBuffer;
+}
+
+BaseType_t xSemaphoreTake( SemaphoreHandle_t xSemaphore,
+                           TickType_t xBlockTime )
+{
+    struct timespec xDeadline;
+    BaseType_t xRet = pdFALSE;
+    int lError = 0;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &xDeadline );
+    xDeadline.tv_sec += ( time_t ) ( xBlockTime / 1000U );
+    xDeadline.tv_nsec += ( long ) ( xBlockTime % 1000U ) * 1000000L;
+
+    if( xDeadline.tv_nsec >= 1000000000L )
+    {
+        xDeadline.tv_sec++;
+        xDeadline.tv_nsec -= 1000000000L;
+    }
+
+    ( void ) pthread_mutex_lock( &( xSemaphore->xMutex ) );
+
+    while( ( xSemaphore->uxCount == 0U ) && ( xBlockTime > 0U ) && ( lError == 0 ) )
+    {
+        if( xBlockTime == portMAX_DELAY )
+        {
+            lError = pthread_cond_wait( &( xSemaphore->xCondition ), &( xSemaphore->xMutex ) );
+        }
+        else
+        {
+            lError = pthread_cond_timedwait( &( xSemaphore->xCondition ), &( xSemaphore->xMutex ), &xDeadline );
+        }
+    }
+
+    if( xSemaphore->uxCount > 0U )
+    {
+        xSemaphore->uxCount--;
+        xRet = pdTRUE;
+    }
+
+    ( void ) pthread_mutex_unlock( &( xSemaphore->xMutex ) );
+
+    return xRet;
+}
+
+BaseType_t xSemaphoreGive( SemaphoreHandle_t xSemaphore )
+{
+    BaseType_t xRet = pdFALSE;
+
+    ( void ) pthread_mutex_lock( &( xSemaphore->xMutex ) );
+
+    if( xSemaphore->uxCount < xSemaphore->uxMaxCount )
+    {
+        xSemaphore->uxCount++;
+        xRet = pdTRUE;
+        ( void ) pthread_cond_signal( &( xSemaphore->xCondition ) );
+    }
+
+    ( void ) pthread_mutex_unlock( &( xSemaphore->xMutex ) );
+
+    return xRet;
+}
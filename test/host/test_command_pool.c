@@ -0,0 +1,587 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2023 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file test_command_pool.c
+ * @brief Test and contention benchmark of the coreMQTT-Agent command pool.
+ *
+ * POSIX threads stand in for tasks registered as OTA and telemetry callers
+ * and for unregistered ones, and another thread stands in for the agent task,
+ * which releases the commands it was handed. The test checks:
+ * - exhaustion: the pool hands out each command once, then fails, waits for a
+ *   release when asked to, and times out;
+ * - quotas: a caller class cannot take more than its quota, even when
+ *   commands are free, nor starve the other classes;
+ * - wakeups: a release wakes a default waiter even while an OTA caller over
+ *   its quota waits too;
+ * - contention: callers of every class take, hand over and release commands
+ *   at once; no command is handed out twice, no class exceeds its quota, and
+ *   the counters balance once everything is released.
+ *
+ * Usage: test_command_pool [milliseconds of contention].
+ */
+
+/* Standard includes. */
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Command pool header include. */
+#include "core_mqtt_agent_command_pool.h"
+
+/* Preprocessor definitions ***************************************************/
+
+#define POOL_SIZE                      ( configMQTT_AGENT_COMMAND_POOL_SIZE )
+
+/* Workers per caller class. */
+#define POOL_WORKERS_PER_CALLER        ( 2U )
+#define POOL_WORKERS                   ( POOL_WORKERS_PER_CALLER * eMQTTAgentCommandPoolCallerCount )
+
+/* Commands a worker holds at once under contention. */
+#define POOL_BURST                     ( 3U )
+
+#define POOL_DEFAULT_DURATION_MS       ( 1000U )
+
+/* Releases made while an OTA caller over its quota waits, and how long the
+ * default waiter may take to get each one. */
+#define POOL_WAKEUP_ROUNDS             ( 8U )
+#define POOL_WAKEUP_MAX_MS             ( 300U )
+#define POOL_OVER_QUOTA_WAIT_MS        ( 600U )
+
+#define POOL_CHECK( x )                                                    \
+    do {                                                                   \
+        if( !( x ) )                                                       \
+        {                                                                  \
+            printf( "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x ); \
+            __atomic_fetch_add( &ulFailures, 1U, __ATOMIC_RELAXED );       \
+        }                                                                  \
+    } while( 0 )
+
+/* Struct definitions *********************************************************/
+
+typedef struct PoolWorker
+{
+    pthread_t xThread;
+    uint32_t ulId;
+    MQTTAgentCommandPoolCaller_t eCaller;
+    MQTTAgentCommand_t * pxHeld[ POOL_SIZE ];
+    uint32_t ulHeld;
+    uint32_t ulTakes;
+} PoolWorker_t;
+
+/* Global variables ***********************************************************/
+
+static const uint32_t ulQuotas[ eMQTTAgentCommandPoolCallerCount ] =
+{
+    [ eMQTTAgentCommandPoolCallerDefault ]   = POOL_SIZE,
+    [ eMQTTAgentCommandPoolCallerOta ]       = configMQTT_AGENT_COMMAND_POOL_OTA_QUOTA,
+    [ eMQTTAgentCommandPoolCallerTelemetry ] = configMQTT_AGENT_COMMAND_POOL_TELEMETRY_QUOTA
+};
+
+static PoolWorker_t xWorkers[ POOL_WORKERS ];
+
+static pthread_barrier_t xPhase;
+
+static uint32_t ulFailures;
+
+static uint32_t ulContentionMs = POOL_DEFAULT_DURATION_MS;
+
+static bool xStop;
+
+/* Set while a command is held, to catch a command handed out twice. */
+static uint32_t ulOwners[ POOL_SIZE ];
+
+/* Commands handed to the agent thread, which releases them. */
+static pthread_mutex_t xHandOverLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t xHandedOver = PTHREAD_COND_INITIALIZER;
+static MQTTAgentCommand_t * pxHandedOver[ POOL_SIZE ];
+static uint32_t ulHandedOver;
+static uint32_t ulAgentReleases;
+
+/* Threads of the wakeup test, only joined at the end so that no later
+ * thread can reuse their identity, as registrations are never removed. */
+static pthread_barrier_t xWakeupPhase;
+static pthread_barrier_t xWakeupRound;
+static PoolWorker_t xOverQuota = { .ulId = POOL_WORKERS + 1U, .eCaller = eMQTTAgentCommandPoolCallerOta };
+static PoolWorker_t xDefaultWaiter = { .ulId = POOL_WORKERS + 2U };
+
+/* Static function definitions ************************************************/
+
+static void prvOwn( MQTTAgentCommand_t * pxCommand,
+                    uint32_t ulOwner )
+{
+    uint32_t ulIndex = ulMQTTAgentCommandPoolGetIndex( pxCommand );
+
+    POOL_CHECK( ulIndex < POOL_SIZE );
+
+    if( ulIndex < POOL_SIZE )
+    {
+        POOL_CHECK( __atomic_exchange_n( &( ulOwners[ ulIndex ] ), ulOwner + 1U, __ATOMIC_RELAXED ) == 0U );
+        pxCommand->commandType = ulOwner;
+    }
+}
+
+static void prvRelease( MQTTAgentCommand_t * pxCommand,
+                        uint32_t ulOwner )
+{
+    uint32_t ulIndex = ulMQTTAgentCommandPoolGetIndex( pxCommand );
+
+    if( ulIndex < POOL_SIZE )
+    {
+        /* Nobody else wrote to the command while it was held. */
+        POOL_CHECK( pxCommand->commandType == ulOwner );
+        POOL_CHECK( __atomic_exchange_n( &( ulOwners[ ulIndex ] ), 0U, __ATOMIC_RELAXED ) == ulOwner + 1U );
+    }
+
+    POOL_CHECK( Agent_PoolReleaseCommand( pxCommand ) );
+}
+
+static void prvTakeAll( PoolWorker_t * pxWorker )
+{
+    MQTTAgentCommand_t * pxCommand;
+
+    do
+    {
+        pxCommand = Agent_PoolGetCommand( 0U );
+
+        if( pxCommand != NULL )
+        {
+            prvOwn( pxCommand, pxWorker->ulId );
+            pxWorker->pxHeld[ pxWorker->ulHeld++ ] = pxCommand;
+        }
+    } while( ( pxCommand != NULL ) && ( pxWorker->ulHeld < POOL_SIZE ) );
+}
+
+static void prvReleaseAll( PoolWorker_t * pxWorker )
+{
+    while( pxWorker->ulHeld > 0U )
+    {
+        prvRelease( pxWorker->pxHeld[ --( pxWorker->ulHeld ) ], pxWorker->ulId );
+    }
+}
+
+static void prvCheckQuotas( void )
+{
+    MQTTAgentCommandPoolStats_t xStats;
+    int i;
+
+    vMQTTAgentCommandPoolGetStats( &xStats );
+
+    for( i = 0; i < eMQTTAgentCommandPoolCallerCount; i++ )
+    {
+        POOL_CHECK( xStats.ulInUse[ i ] <= ulQuotas[ i ] );
+        POOL_CHECK( xStats.ulHighWater[ i ] <= ulQuotas[ i ] );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void * prvAgentThread( void * pvParameters )
+{
+    MQTTAgentCommand_t * pxCommand;
+
+    ( void ) pvParameters;
+
+    ( void ) pthread_mutex_lock( &xHandOverLock );
+
+    while( !xStop || ( ulHandedOver > 0U ) )
+    {
+        if( ulHandedOver == 0U )
+        {
+            ( void ) pthread_cond_wait( &xHandedOver, &xHandOverLock );
+        }
+        else
+        {
+            pxCommand = pxHandedOver[ --ulHandedOver ];
+            ( void ) pthread_mutex_unlock( &xHandOverLock );
+
+            prvRelease( pxCommand, pxCommand->commandType );
+            ulAgentReleases++;
+
+            ( void ) pthread_mutex_lock( &xHandOverLock );
+        }
+    }
+
+    ( void ) pthread_mutex_unlock( &xHandOverLock );
+
+    return NULL;
+}
+
+static void prvHandOver( MQTTAgentCommand_t * pxCommand )
+{
+    ( void ) pthread_mutex_lock( &xHandOverLock );
+    POOL_CHECK( ulHandedOver < POOL_SIZE );
+    pxHandedOver[ ulHandedOver++ ] = pxCommand;
+    ( void ) pthread_cond_signal( &xHandedOver );
+    ( void ) pthread_mutex_unlock( &xHandOverLock );
+}
+
+/*-----------------------------------------------------------*/
+
+static void * prvWorkerThread( void * pvParameters )
+{
+    PoolWorker_t * pxWorker = ( PoolWorker_t * ) pvParameters;
+    uint32_t ulSlot = pxWorker->ulId / eMQTTAgentCommandPoolCallerCount;
+    TickType_t xEnd;
+    MQTTAgentCommand_t * pxCommand;
+
+    if( pxWorker->eCaller != eMQTTAgentCommandPoolCallerDefault )
+    {
+        POOL_CHECK( xMQTTAgentCommandPoolRegisterTask( NULL, pxWorker->eCaller ) == pdPASS );
+    }
+
+    ( void ) pthread_barrier_wait( &xPhase );
+
+    /* Quotas: the first OTA and telemetry workers take all they can. */
+    if( ( ulSlot == 0U ) && ( pxWorker->eCaller != eMQTTAgentCommandPoolCallerDefault ) )
+    {
+        prvTakeAll( pxWorker );
+        POOL_CHECK( pxWorker->ulHeld == ulQuotas[ pxWorker->eCaller ] );
+        POOL_CHECK( !xMQTTAgentCommandPoolHasCapacity() );
+    }
+
+    ( void ) pthread_barrier_wait( &xPhase );
+
+    /* Then an unregistered one takes the rest of the pool. */
+    if( ( ulSlot == 0U ) && ( pxWorker->eCaller == eMQTTAgentCommandPoolCallerDefault ) )
+    {
+        prvTakeAll( pxWorker );
+        POOL_CHECK( pxWorker->ulHeld == POOL_SIZE - ulQuotas[ eMQTTAgentCommandPoolCallerOta ] -
+                    ulQuotas[ eMQTTAgentCommandPoolCallerTelemetry ] );
+        prvReleaseAll( pxWorker );
+    }
+
+    ( void ) pthread_barrier_wait( &xPhase );
+
+    /* Commands are free, but not within the quota of OTA and telemetry,
+     * whichever task of the class asks. */
+    if( pxWorker->eCaller == eMQTTAgentCommandPoolCallerDefault )
+    {
+        POOL_CHECK( xMQTTAgentCommandPoolHasCapacity() );
+    }
+    else
+    {
+        POOL_CHECK( !xMQTTAgentCommandPoolHasCapacity() );
+        POOL_CHECK( Agent_PoolGetCommand( 0U ) == NULL );
+    }
+
+    ( void ) pthread_barrier_wait( &xPhase );
+    prvReleaseAll( pxWorker );
+    ( void ) pthread_barrier_wait( &xPhase );
+
+    /* Contention: take a few commands with a short wait, more than the
+     * quotas and the pool allow for all workers, then release them or hand
+     * them to the agent, as a task sending a command does. */
+    xEnd = xTaskGetTickCount() + pdMS_TO_TICKS( ulContentionMs );
+
+    while( xTaskGetTickCount() < xEnd )
+    {
+        while( pxWorker->ulHeld < POOL_BURST )
+        {
+            /* Waiting while holding commands would deadlock the workers
+             * until the wait times out. */
+            pxCommand = Agent_PoolGetCommand( ( pxWorker->ulHeld == 0U ) ? 5U : 0U );
+
+            if( pxCommand == NULL )
+            {
+                break;
+            }
+
+            prvOwn( pxCommand, pxWorker->ulId );
+            pxWorker->pxHeld[ pxWorker->ulHeld++ ] = pxCommand;
+            pxWorker->ulTakes++;
+        }
+
+        prvCheckQuotas();
+        vTaskDelay( 0 );
+
+        while( pxWorker->ulHeld > 0U )
+        {
+            pxCommand = pxWorker->pxHeld[ --( pxWorker->ulHeld ) ];
+
+            if( ( pxWorker->ulHeld % 2U ) == 0U )
+            {
+                prvHandOver( pxCommand );
+            }
+            else
+            {
+                prvRelease( pxCommand, pxWorker->ulId );
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTestExhaustion( void )
+{
+    PoolWorker_t xMain = { .ulId = POOL_WORKERS };
+    MQTTAgentCommandPoolStats_t xStats;
+    MQTTAgentCommand_t xForeign;
+    MQTTAgentCommand_t * pxCommand;
+    TickType_t xStart;
+
+    prvTakeAll( &xMain );
+    POOL_CHECK( xMain.ulHeld == POOL_SIZE );
+    POOL_CHECK( !xMQTTAgentCommandPoolHasCapacity() );
+    POOL_CHECK( Agent_PoolGetCommand( 0U ) == NULL );
+    POOL_CHECK( !Agent_PoolReleaseCommand( &xForeign ) );
+    POOL_CHECK( ulMQTTAgentCommandPoolGetIndex( &xForeign ) == POOL_SIZE );
+
+    /* A wait times out. */
+    xStart = xTaskGetTickCount();
+    POOL_CHECK( Agent_PoolGetCommand( 30U ) == NULL );
+    POOL_CHECK( ( xTaskGetTickCount() - xStart ) >= pdMS_TO_TICKS( 30U ) );
+
+    vMQTTAgentCommandPoolGetStats( &xStats );
+    POOL_CHECK( xStats.ulInUse[ eMQTTAgentCommandPoolCallerDefault ] == POOL_SIZE );
+    POOL_CHECK( xStats.ulHighWater[ eMQTTAgentCommandPoolCallerDefault ] == POOL_SIZE );
+    POOL_CHECK( xStats.ulTaken[ eMQTTAgentCommandPoolCallerDefault ] == POOL_SIZE );
+    POOL_CHECK( xStats.ulExhausted[ eMQTTAgentCommandPoolCallerDefault ] == 2U );
+    POOL_CHECK( xStats.ulWaits[ eMQTTAgentCommandPoolCallerDefault ] == 1U );
+    POOL_CHECK( xStats.ulMaxWaitMs[ eMQTTAgentCommandPoolCallerDefault ] >= 30U );
+
+    /* A wait ends with a release by the agent. */
+    prvHandOver( xMain.pxHeld[ --xMain.ulHeld ] );
+    pxCommand = Agent_PoolGetCommand( 2000U );
+    POOL_CHECK( pxCommand != NULL );
+
+    if( pxCommand != NULL )
+    {
+        prvOwn( pxCommand, xMain.ulId );
+        xMain.pxHeld[ xMain.ulHeld++ ] = pxCommand;
+    }
+
+    prvReleaseAll( &xMain );
+}
+
+/*-----------------------------------------------------------*/
+
+static void * prvOverQuotaThread( void * pvParameters )
+{
+    PoolWorker_t * pxWorker = ( PoolWorker_t * ) pvParameters;
+
+    POOL_CHECK( xMQTTAgentCommandPoolRegisterTask( NULL, pxWorker->eCaller ) == pdPASS );
+    prvTakeAll( pxWorker );
+    POOL_CHECK( pxWorker->ulHeld == ulQuotas[ pxWorker->eCaller ] );
+    ( void ) pthread_barrier_wait( &xWakeupPhase );
+    ( void ) pthread_barrier_wait( &xWakeupPhase );
+
+    /* Woken by every release, but never within quota. */
+    POOL_CHECK( Agent_PoolGetCommand( POOL_OVER_QUOTA_WAIT_MS ) == NULL );
+
+    ( void ) pthread_barrier_wait( &xWakeupPhase );
+    prvReleaseAll( pxWorker );
+    ( void ) pthread_barrier_wait( &xWakeupPhase );
+
+    return NULL;
+}
+
+static void * prvDefaultWaiterThread( void * pvParameters )
+{
+    PoolWorker_t * pxWorker = ( PoolWorker_t * ) pvParameters;
+    MQTTAgentCommand_t * pxCommand;
+    TickType_t xStart;
+    uint32_t i;
+
+    ( void ) pthread_barrier_wait( &xWakeupPhase );
+    ( void ) pthread_barrier_wait( &xWakeupPhase );
+
+    for( i = 0; i < POOL_WAKEUP_ROUNDS; i++ )
+    {
+        ( void ) pthread_barrier_wait( &xWakeupRound );
+        xStart = xTaskGetTickCount();
+        pxCommand = Agent_PoolGetCommand( 2U * POOL_OVER_QUOTA_WAIT_MS );
+        POOL_CHECK( pxCommand != NULL );
+        POOL_CHECK( ( xTaskGetTickCount() - xStart ) < pdMS_TO_TICKS( POOL_WAKEUP_MAX_MS ) );
+
+        if( pxCommand != NULL )
+        {
+            prvOwn( pxCommand, pxWorker->ulId );
+            prvRelease( pxCommand, pxWorker->ulId );
+        }
+
+        ( void ) pthread_barrier_wait( &xWakeupRound );
+    }
+
+    ( void ) pthread_barrier_wait( &xWakeupPhase );
+    ( void ) pthread_barrier_wait( &xWakeupPhase );
+
+    return NULL;
+}
+
+static void prvTestWakeups( void )
+{
+    PoolWorker_t xMain = { .ulId = POOL_WORKERS };
+    MQTTAgentCommand_t * pxCommand;
+    uint32_t i;
+
+    configASSERT( pthread_barrier_init( &xWakeupPhase, NULL, 3U ) == 0 );
+    configASSERT( pthread_barrier_init( &xWakeupRound, NULL, 2U ) == 0 );
+    configASSERT( pthread_create( &( xOverQuota.xThread ), NULL, prvOverQuotaThread, &xOverQuota ) == 0 );
+    configASSERT( pthread_create( &( xDefaultWaiter.xThread ), NULL, prvDefaultWaiterThread, &xDefaultWaiter ) == 0 );
+
+    /* OTA holds its quota, and the rest of the pool is taken. */
+    ( void ) pthread_barrier_wait( &xWakeupPhase );
+    prvTakeAll( &xMain );
+    POOL_CHECK( xMain.ulHeld == POOL_SIZE - ulQuotas[ eMQTTAgentCommandPoolCallerOta ] );
+    ( void ) pthread_barrier_wait( &xWakeupPhase );
+
+    /* Each release must reach the default waiter, however the OTA waiter
+     * is scheduled. */
+    for( i = 0; i < POOL_WAKEUP_ROUNDS; i++ )
+    {
+        ( void ) pthread_barrier_wait( &xWakeupRound );
+        vTaskDelay( pdMS_TO_TICKS( 20U ) );
+        prvRelease( xMain.pxHeld[ --xMain.ulHeld ], xMain.ulId );
+        ( void ) pthread_barrier_wait( &xWakeupRound );
+
+        /* Take back what the default waiter released. */
+        pxCommand = Agent_PoolGetCommand( 0U );
+        POOL_CHECK( pxCommand != NULL );
+
+        if( pxCommand != NULL )
+        {
+            prvOwn( pxCommand, xMain.ulId );
+            xMain.pxHeld[ xMain.ulHeld++ ] = pxCommand;
+        }
+    }
+
+    ( void ) pthread_barrier_wait( &xWakeupPhase );
+    prvReleaseAll( &xMain );
+    ( void ) pthread_barrier_wait( &xWakeupPhase );
+}
+
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    MQTTAgentCommandPoolStats_t xStats;
+    pthread_t xAgent;
+    uint32_t ulTakes = 0, ulTaken = 0, ulBefore = 0, i;
+    TickType_t xStart, xElapsed;
+    PoolWorker_t xMain = { .ulId = POOL_WORKERS };
+
+    if( argc > 1 )
+    {
+        ulContentionMs = ( uint32_t ) strtoul( argv[ 1 ], NULL, 0 );
+    }
+
+    configASSERT( xMQTTAgentCommandPoolInit() == pdPASS );
+    configASSERT( pthread_create( &xAgent, NULL, prvAgentThread, NULL ) == 0 );
+
+    prvTestExhaustion();
+    prvTestWakeups();
+
+    configASSERT( pthread_barrier_init( &xPhase, NULL, POOL_WORKERS + 1U ) == 0 );
+
+    for( i = 0; i < POOL_WORKERS; i++ )
+    {
+        xWorkers[ i ].ulId = i;
+        xWorkers[ i ].eCaller = ( MQTTAgentCommandPoolCaller_t ) ( i % eMQTTAgentCommandPoolCallerCount );
+        configASSERT( pthread_create( &( xWorkers[ i ].xThread ), NULL, prvWorkerThread, &( xWorkers[ i ] ) ) == 0 );
+    }
+
+    /* Registration, the two quota phases, the check of the quotas. */
+    for( i = 0; i < 4U; i++ )
+    {
+        ( void ) pthread_barrier_wait( &xPhase );
+    }
+
+    vMQTTAgentCommandPoolGetStats( &xStats );
+    POOL_CHECK( xStats.ulHighWater[ eMQTTAgentCommandPoolCallerOta ] == ulQuotas[ eMQTTAgentCommandPoolCallerOta ] );
+    POOL_CHECK( xStats.ulHighWater[ eMQTTAgentCommandPoolCallerTelemetry ] == ulQuotas[ eMQTTAgentCommandPoolCallerTelemetry ] );
+    POOL_CHECK( xStats.ulExhausted[ eMQTTAgentCommandPoolCallerOta ] >= POOL_WORKERS_PER_CALLER + 1U );
+    POOL_CHECK( xStats.ulExhausted[ eMQTTAgentCommandPoolCallerTelemetry ] >= POOL_WORKERS_PER_CALLER + 1U );
+
+    for( i = 0; i < eMQTTAgentCommandPoolCallerCount; i++ )
+    {
+        ulBefore += xStats.ulTaken[ i ];
+    }
+
+    /* Contention. */
+    ( void ) pthread_barrier_wait( &xPhase );
+    xStart = xTaskGetTickCount();
+
+    for( i = 0; i < POOL_WORKERS; i++ )
+    {
+        ( void ) pthread_join( xWorkers[ i ].xThread, NULL );
+        ulTakes += xWorkers[ i ].ulTakes;
+    }
+
+    xElapsed = xTaskGetTickCount() - xStart;
+
+    ( void ) pthread_mutex_lock( &xHandOverLock );
+    xStop = true;
+    ( void ) pthread_cond_signal( &xHandedOver );
+    ( void ) pthread_mutex_unlock( &xHandOverLock );
+    ( void ) pthread_join( xAgent, NULL );
+
+    /* Everything was released, and the counters balance. */
+    vMQTTAgentCommandPoolGetStats( &xStats );
+
+    for( i = 0; i < eMQTTAgentCommandPoolCallerCount; i++ )
+    {
+        POOL_CHECK( xStats.ulInUse[ i ] == 0U );
+        POOL_CHECK( xStats.ulHighWater[ i ] <= ulQuotas[ i ] );
+        ulTaken += xStats.ulTaken[ i ];
+    }
+
+    POOL_CHECK( ulTaken - ulBefore == ulTakes );
+    POOL_CHECK( ulTakes > 0U );
+
+    prvTakeAll( &xMain );
+    POOL_CHECK( xMain.ulHeld == POOL_SIZE );
+    prvReleaseAll( &xMain );
+
+    ( void ) pthread_join( xOverQuota.xThread, NULL );
+    ( void ) pthread_join( xDefaultWaiter.xThread, NULL );
+
+    printf( "command_pool: %" PRIu32 " workers, %" PRIu32 " takes in %" PRIu32 " ms (%" PRIu32 " takes/s), "
+            "%" PRIu32 " released by the agent, waits default/ota/telemetry %" PRIu32 "/%" PRIu32 "/%" PRIu32
+            " max %" PRIu32 "/%" PRIu32 "/%" PRIu32 " ms, %" PRIu32 " failures.\n",
+            ( uint32_t ) POOL_WORKERS, ulTakes, ( uint32_t ) xElapsed,
+            ( xElapsed > 0U ) ? ( uint32_t ) ( ( uint64_t ) ulTakes * 1000U / xElapsed ) : 0U,
+            ulAgentReleases,
+            xStats.ulWaits[ eMQTTAgentCommandPoolCallerDefault ],
+            xStats.ulWaits[ eMQTTAgentCommandPoolCallerOta ],
+            xStats.ulWaits[ eMQTTAgentCommandPoolCallerTelemetry ],
+            xStats.ulMaxWaitMs[ eMQTTAgentCommandPoolCallerDefault ],
+            xStats.ulMaxWaitMs[ eMQTTAgentCommandPoolCallerOta ],
+            xStats.ulMaxWaitMs[ eMQTTAgentCommandPoolCallerTelemetry ],
+            ulFailures );
+
+    return ( ulFailures == 0U ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,254 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2023 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file test_dispatch_fuzz.c
+ * @brief Differential fuzz of the subscription manager dispatch.
+ *
+ * Each round subscribes random filters, with '+', '#', '$' levels and empty
+ * levels, then dispatches random topics through handleIncomingPublishes() and
+ * checks that each subscription was called exactly when MQTT_MatchTopic() says
+ * its filter matches. It is checked again after half of the filters are
+ * removed. MQTT_MatchTopic() is coreMQTT's own when the esp-aws-iot submodule
+ * is checked out, see CMakeLists.txt.
+ *
+ * Usage: test_dispatch_fuzz [seed [rounds]]. A seed of 0 picks one, which is
+ * printed so a failure can be replayed.
+ */
+
+/* Standard includes. */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Subscription manager header include. */
+#include "subscription_manager.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/* Subscriptions of each round. */
+#define FUZZ_FILTERS            ( 64U )
+
+/* Topics dispatched at each check. */
+#define FUZZ_TOPICS             ( 64U )
+
+/* Most levels of a filter or topic. */
+#define FUZZ_MAX_LEVELS         ( 5U )
+
+/* Size of a filter or topic, levels being 7 characters at most. */
+#define FUZZ_FILTER_LENGTH      ( 48U )
+
+/* Mismatches printed before the rest are only counted. */
+#define FUZZ_MAX_REPORTS        ( 8U )
+
+#define FUZZ_DEFAULT_ROUNDS     ( 500U )
+
+/* Global variables ***********************************************************/
+
+static uint32_t ulFuzzState;
+
+/* Times each subscription was called by the last dispatch. */
+static uint32_t ulCalls[ FUZZ_FILTERS ];
+
+static char cFilters[ FUZZ_FILTERS ][ FUZZ_FILTER_LENGTH ];
+static bool xSubscribed[ FUZZ_FILTERS ];
+static char cTopics[ FUZZ_TOPICS ][ FUZZ_FILTER_LENGTH ];
+
+/* Static function definitions ************************************************/
+
+static uint32_t prvFuzzRandom( void )
+{
+    ulFuzzState ^= ulFuzzState << 13;
+    ulFuzzState ^= ulFuzzState >> 17;
+    ulFuzzState ^= ulFuzzState << 5;
+
+    return ulFuzzState;
+}
+
+static void prvFuzzTopic( char * pcTopic,
+                          bool xWildcards )
+{
+    static const char * const pcLevels[] = { "$aws", "things", "dev0", "dev1", "streams", "a", "b", "" };
+    const uint32_t ulLevelCount = sizeof( pcLevels ) / sizeof( pcLevels[ 0 ] );
+    uint32_t ulLevels, ulChoice, i;
+    const char * pcLevel;
+    size_t xLength;
+
+    /* A single empty level is not a valid topic. */
+    do
+    {
+        ulLevels = 1U + ( prvFuzzRandom() % FUZZ_MAX_LEVELS );
+        xLength = 0;
+
+        for( i = 0; i < ulLevels; i++ )
+        {
+            ulChoice = prvFuzzRandom() % ( ulLevelCount + ( xWildcards ? 2U : 0U ) );
+
+            if( ulChoice < ulLevelCount )
+            {
+                pcLevel = pcLevels[ ulChoice ];
+            }
+            else if( ulChoice == ulLevelCount )
+            {
+                pcLevel = "+";
+            }
+            else
+            {
+                /* '#' must be the last level. */
+                pcLevel = "#";
+                ulLevels = i + 1U;
+            }
+
+            xLength += ( size_t ) snprintf( &( pcTopic[ xLength ] ),
+                                            FUZZ_FILTER_LENGTH - xLength,
+                                            "%s%s",
+                                            ( i > 0U ) ? "/" : "",
+                                            pcLevel );
+        }
+    } while( xLength == 0U );
+}
+
+static void prvFuzzCallback( void * pvIncomingPublishCallbackContext,
+                             MQTTPublishInfo_t * pxPublishInfo )
+{
+    ( void ) pxPublishInfo;
+
+    ( *( ( uint32_t * ) pvIncomingPublishCallbackContext ) )++;
+}
+
+static uint32_t prvCheckDispatch( SubscriptionList_t * pxList,
+                                  uint32_t ulSeed,
+                                  uint32_t * pulMismatches )
+{
+    MQTTPublishInfo_t xPublishInfo = { 0 };
+    uint32_t ulMatches = 0, ulExpected, i, j;
+    bool xMatch;
+
+    for( i = 0; i < FUZZ_TOPICS; i++ )
+    {
+        xPublishInfo.pTopicName = cTopics[ i ];
+        xPublishInfo.topicNameLength = ( uint16_t ) strlen( cTopics[ i ] );
+
+        memset( ulCalls, 0x00, sizeof( ulCalls ) );
+        handleIncomingPublishes( pxList, &xPublishInfo );
+
+        for( j = 0; j < FUZZ_FILTERS; j++ )
+        {
+            xMatch = false;
+
+            if( xSubscribed[ j ] )
+            {
+                ( void ) MQTT_MatchTopic( cTopics[ i ], xPublishInfo.topicNameLength,
+                                          cFilters[ j ], ( uint16_t ) strlen( cFilters[ j ] ), &xMatch );
+            }
+
+            ulExpected = xMatch ? 1U : 0U;
+            ulMatches += ulCalls[ j ];
+
+            if( ulCalls[ j ] != ulExpected )
+            {
+                ( *pulMismatches )++;
+
+                if( *pulMismatches <= FUZZ_MAX_REPORTS )
+                {
+                    printf( "Seed %" PRIu32 ": topic %s called the subscription to %s %" PRIu32 " times, expected %" PRIu32 ".\n",
+                            ulSeed, cTopics[ i ], cFilters[ j ], ulCalls[ j ], ulExpected );
+                }
+            }
+        }
+    }
+
+    return ulMatches;
+}
+
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    static SubscriptionList_t xList;
+    uint32_t ulSeed = ( argc > 1 ) ? ( uint32_t ) strtoul( argv[ 1 ], NULL, 0 ) : 0U;
+    uint32_t ulRounds = ( argc > 2 ) ? ( uint32_t ) strtoul( argv[ 2 ], NULL, 0 ) : FUZZ_DEFAULT_ROUNDS;
+    uint32_t ulMismatches = 0, ulMatches = 0, ulDispatches = 0, ulRound, ulPass, i;
+
+    if( ulSeed == 0U )
+    {
+        ulSeed = ( uint32_t ) time( NULL ) & 0x7FFFFFFFU;
+    }
+
+    /* xorshift32 is stuck at 0. */
+    ulFuzzState = ( ulSeed == 0U ) ? 1U : ulSeed;
+
+    for( ulRound = 0; ulRound < ulRounds; ulRound++ )
+    {
+        freeSubscriptionList( &xList );
+
+        /* Filters may repeat, each subscription has its own callback context. */
+        for( i = 0; i < FUZZ_FILTERS; i++ )
+        {
+            prvFuzzTopic( cFilters[ i ], true );
+            xSubscribed[ i ] = addSubscription( &xList, cFilters[ i ], ( uint16_t ) strlen( cFilters[ i ] ),
+                                                prvFuzzCallback, &( ulCalls[ i ] ) );
+
+            if( !xSubscribed[ i ] )
+            {
+                printf( "Seed %" PRIu32 ": failed to subscribe to %s.\n", ulSeed, cFilters[ i ] );
+                ulMismatches++;
+            }
+        }
+
+        for( i = 0; i < FUZZ_TOPICS; i++ )
+        {
+            prvFuzzTopic( cTopics[ i ], false );
+        }
+
+        for( ulPass = 0; ulPass < 2U; ulPass++ )
+        {
+            /* The second pass covers the removal of filters. */
+            for( i = 0; ( ulPass == 1U ) && ( i < FUZZ_FILTERS ); i += 2U )
+            {
+                if( xSubscribed[ i ] )
+                {
+                    ( void ) removeSubscriptionCallback( &xList, cFilters[ i ], ( uint16_t ) strlen( cFilters[ i ] ),
+                                                         prvFuzzCallback, &( ulCalls[ i ] ) );
+                    xSubscribed[ i ] = false;
+                }
+            }
+
+            ulMatches += prvCheckDispatch( &xList, ulSeed, &ulMismatches );
+            ulDispatches += FUZZ_TOPICS;
+        }
+    }
+
+    freeSubscriptionList( &xList );
+
+    printf( "dispatch_fuzz seed %" PRIu32 ": %" PRIu32 " rounds, %" PRIu32 " dispatches, %" PRIu32 " matches, %" PRIu32 " mismatches.\n",
+            ulSeed, ulRounds, ulDispatches, ulMatches, ulMismatches );
+
+    return ( ulMismatches == 0U ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,438 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2023 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file test_dispatch_stress.c
+ * @brief Stress test of subscriptions added and removed while publishes are
+ * dispatched.
+ *
+ * POSIX threads stand in for the tasks of the application:
+ * - dispatcher threads, standing in for the agent task and the dispatch
+ *   workers, call handleIncomingPublishes() in a loop, on the topic of a
+ *   subscription which is never removed and on the topics of the others;
+ * - subscriber threads add and remove subscriptions with exact and wildcard
+ *   filters, some longer than an arena chunk, and grow then shrink the list,
+ *   so tables are swapped and arena chunks are released under the
+ *   dispatchers;
+ * - a resubscribe thread walks the subscriptions as the resubscribe engine
+ *   does, keeping a filter with retainSubscriptionFilter() while it is
+ *   removed;
+ * - sharer threads join and leave one filter with addSharedSubscription()
+ *   and removeSharedSubscription(), as the sub/pub/unsub demo tasks do.
+ *
+ * Each dispatch of the unchanged subscription's topic must call it exactly
+ * once, and each join told it is the first must be matched by one leave told
+ * it is the last. Built under AddressSanitizer, a table or filter read after it was
+ * freed is reported; built under ThreadSanitizer, so is a data race.
+ *
+ * Usage: test_dispatch_stress [milliseconds].
+ */
+
+/* Standard includes. */
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Subscription manager header include. */
+#include "subscription_manager.h"
+
+/* Preprocessor definitions ***************************************************/
+
+#define STRESS_DISPATCHERS          ( 2U )
+#define STRESS_SUBSCRIBERS          ( 3U )
+#define STRESS_SHARERS              ( 3U )
+
+/* Subscriptions a subscriber adds at once to grow the list. */
+#define STRESS_BURST                ( 20U )
+
+#define STRESS_FILTER_LENGTH        ( SUBSCRIPTION_MANAGER_ARENA_CHUNK_SIZE + 64U )
+
+#define STRESS_DEFAULT_DURATION_MS  ( 1500U )
+
+/* Marks a valid callback context. */
+#define STRESS_CONTEXT_MAGIC        ( 0x5CB5CB5CUL )
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief Callback context of a subscription. Contexts stay valid for the
+ * whole test, as a callback may run once more after it is removed.
+ */
+typedef struct StressContext
+{
+    uint32_t ulMagic;
+    uint32_t ulCalls;
+} StressContext_t;
+
+/* Global variables ***********************************************************/
+
+static SubscriptionList_t xList;
+
+static const char * const pcFixedFilter = "stress/fixed";
+
+static StressContext_t xFixedContext = { STRESS_CONTEXT_MAGIC, 0 };
+
+static StressContext_t xSubscriberContexts[ STRESS_SUBSCRIBERS ];
+
+static const char * const pcSharedFilter = "stress/shared/+";
+
+static StressContext_t xSharerContexts[ STRESS_SHARERS ];
+
+static bool xStop;
+
+static uint32_t ulMissed;
+static uint32_t ulBadContexts;
+static uint32_t ulDispatches;
+static uint32_t ulWrites;
+static uint32_t ulWalks;
+static uint32_t ulFirsts;
+static uint32_t ulLasts;
+static uint32_t ulShared;
+
+/* Static function definitions ************************************************/
+
+static void prvCallback( void * pvIncomingPublishCallbackContext,
+                         MQTTPublishInfo_t * pxPublishInfo )
+{
+    StressContext_t * pxContext = ( StressContext_t * ) pvIncomingPublishCallbackContext;
+
+    if( ( pxPublishInfo->pTopicName == NULL ) ||
+        ( __atomic_load_n( &( pxContext->ulMagic ), __ATOMIC_RELAXED ) != STRESS_CONTEXT_MAGIC ) )
+    {
+        ( void ) __atomic_fetch_add( &ulBadContexts, 1U, __ATOMIC_RELAXED );
+    }
+
+    ( void ) __atomic_fetch_add( &( pxContext->ulCalls ), 1U, __ATOMIC_RELAXED );
+}
+
+static void prvFilter( char * pcFilter,
+                       uint32_t ulSubscriber,
+                       uint32_t ulVariant )
+{
+    switch( ulVariant % 4U )
+    {
+        case 0:
+            ( void ) snprintf( pcFilter, STRESS_FILTER_LENGTH, "stress/%" PRIu32 "/exact/%" PRIu32, ulSubscriber, ulVariant );
+            break;
+
+        case 1:
+            ( void ) snprintf( pcFilter, STRESS_FILTER_LENGTH, "stress/%" PRIu32 "/+/%" PRIu32, ulSubscriber, ulVariant );
+            break;
+
+        case 2:
+            ( void ) snprintf( pcFilter, STRESS_FILTER_LENGTH, "stress/#" );
+            break;
+
+        default:
+            /* Longer than a chunk, so it gets a chunk of its own. */
+            ( void ) snprintf( pcFilter, STRESS_FILTER_LENGTH, "stress/%" PRIu32 "/%0*" PRIu32,
+                               ulSubscriber, ( int ) SUBSCRIPTION_MANAGER_ARENA_CHUNK_SIZE, ulVariant );
+            break;
+    }
+}
+
+static void * prvDispatcherThread( void * pvParameters )
+{
+    MQTTPublishInfo_t xPublishInfo = { 0 };
+    char cTopic[ STRESS_FILTER_LENGTH ];
+    uint32_t ulCalls, i = 0;
+
+    ( void ) pvParameters;
+
+    while( !__atomic_load_n( &xStop, __ATOMIC_RELAXED ) )
+    {
+        if( ( i % 2U ) == 0U )
+        {
+            xPublishInfo.pTopicName = pcFixedFilter;
+            xPublishInfo.topicNameLength = ( uint16_t ) strlen( pcFixedFilter );
+
+            /* Other dispatchers call it too, so only count the calls of this
+             * thread's dispatch: the callback runs on the dispatching thread. */
+            ulCalls = __atomic_load_n( &( xFixedContext.ulCalls ), __ATOMIC_RELAXED );
+            ( void ) handleIncomingPublishes( &xList, &xPublishInfo );
+
+            if( __atomic_load_n( &( xFixedContext.ulCalls ), __ATOMIC_RELAXED ) == ulCalls )
+            {
+                ( void ) __atomic_fetch_add( &ulMissed, 1U, __ATOMIC_RELAXED );
+            }
+        }
+        else
+        {
+            prvFilter( cTopic, i % STRESS_SUBSCRIBERS, i % 7U );
+
+            /* A wildcard filter is not a topic; dispatch a topic it matches. */
+            if( strchr( cTopic, '+' ) != NULL )
+            {
+                *strchr( cTopic, '+' ) = 'x';
+            }
+            else if( strchr( cTopic, '#' ) != NULL )
+            {
+                ( void ) snprintf( cTopic, sizeof( cTopic ), "stress/any/level" );
+            }
+
+            xPublishInfo.pTopicName = cTopic;
+            xPublishInfo.topicNameLength = ( uint16_t ) strlen( cTopic );
+            ( void ) handleIncomingPublishes( &xList, &xPublishInfo );
+        }
+
+        i++;
+        ( void ) __atomic_fetch_add( &ulDispatches, 1U, __ATOMIC_RELAXED );
+    }
+
+    return NULL;
+}
+
+static void * prvSubscriberThread( void * pvParameters )
+{
+    uint32_t ulSubscriber = ( uint32_t ) ( uintptr_t ) pvParameters;
+    StressContext_t * pxContext = &( xSubscriberContexts[ ulSubscriber ] );
+    char cFilter[ STRESS_FILTER_LENGTH ];
+    uint32_t ulRound = 0, i;
+
+    while( !__atomic_load_n( &xStop, __ATOMIC_RELAXED ) )
+    {
+        if( ( ulRound % 8U ) == 7U )
+        {
+            /* Grow the list, then give the space back. */
+            for( i = 0; i < STRESS_BURST; i++ )
+            {
+                prvFilter( cFilter, ulSubscriber, i );
+                ( void ) addSubscription( &xList, cFilter, ( uint16_t ) strlen( cFilter ), prvCallback, pxContext );
+            }
+
+            for( i = 0; i < STRESS_BURST; i++ )
+            {
+                prvFilter( cFilter, ulSubscriber, i );
+                ( void ) removeSubscriptionCallback( &xList, cFilter, ( uint16_t ) strlen( cFilter ), prvCallback, pxContext );
+            }
+
+            ( void ) __atomic_fetch_add( &ulWrites, 2U * STRESS_BURST, __ATOMIC_RELAXED );
+        }
+        else
+        {
+            prvFilter( cFilter, ulSubscriber, ulRound );
+            ( void ) addSubscription( &xList, cFilter, ( uint16_t ) strlen( cFilter ), prvCallback, pxContext );
+            ( void ) removeSubscriptionCallback( &xList, cFilter, ( uint16_t ) strlen( cFilter ), prvCallback, pxContext );
+            ( void ) __atomic_fetch_add( &ulWrites, 2U, __ATOMIC_RELAXED );
+        }
+
+        ulRound++;
+    }
+
+    return NULL;
+}
+
+static void * prvResubscribeThread( void * pvParameters )
+{
+    const SubscriptionElement_t * pxElements;
+    const char * pcRetained;
+    uint32_t ulCount, ulLength, i;
+    size_t xSum = 0;
+
+    ( void ) pvParameters;
+
+    while( !__atomic_load_n( &xStop, __ATOMIC_RELAXED ) )
+    {
+        pcRetained = NULL;
+        ulLength = 0;
+        pxElements = acquireSubscriptions( &xList, &ulCount );
+
+        for( i = 0; ( pxElements != NULL ) && ( i < ulCount ); i++ )
+        {
+            if( pxElements[ i ].usFilterStringLength > 0U )
+            {
+                xSum += ( size_t ) pxElements[ i ].pcSubscriptionFilterString[ pxElements[ i ].usFilterStringLength - 1U ];
+
+                if( ( pcRetained == NULL ) && ( pxElements[ i ].pvIncomingPublishCallbackContext != &xFixedContext ) )
+                {
+                    pcRetained = pxElements[ i ].pcSubscriptionFilterString;
+                    ulLength = pxElements[ i ].usFilterStringLength;
+                    retainSubscriptionFilter( &xList, pcRetained );
+                }
+            }
+        }
+
+        if( pxElements != NULL )
+        {
+            releaseSubscriptions( &xList, pxElements );
+        }
+
+        /* The subscribers may remove the filter meanwhile; its copy stays
+         * readable until released. */
+        if( pcRetained != NULL )
+        {
+            vTaskDelay( 0 );
+
+            for( i = 0; i < ulLength; i++ )
+            {
+                xSum += ( size_t ) pcRetained[ i ];
+            }
+
+            releaseSubscriptionFilter( &xList, pcRetained );
+        }
+
+        ( void ) __atomic_fetch_add( &ulWalks, 1U, __ATOMIC_RELAXED );
+    }
+
+    return ( void * ) xSum;
+}
+
+static void * prvSharerThread( void * pvParameters )
+{
+    StressContext_t * pxContext = &( xSharerContexts[ ( uintptr_t ) pvParameters ] );
+    uint16_t usLength = ( uint16_t ) strlen( pcSharedFilter );
+    bool xFirst, xLast;
+
+    while( !__atomic_load_n( &xStop, __ATOMIC_RELAXED ) )
+    {
+        xFirst = false;
+        xLast = false;
+
+        if( addSharedSubscription( &xList, pcSharedFilter, usLength, prvCallback, pxContext, &xFirst ) )
+        {
+            ( void ) __atomic_fetch_add( xFirst ? &ulFirsts : &ulShared, 1U, __ATOMIC_RELAXED );
+            vTaskDelay( 0 );
+
+            if( removeSharedSubscription( &xList, pcSharedFilter, usLength, prvCallback, pxContext, &xLast ) && xLast )
+            {
+                ( void ) __atomic_fetch_add( &ulLasts, 1U, __ATOMIC_RELAXED );
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    uint32_t ulDurationMs = ( argc > 1 ) ? ( uint32_t ) strtoul( argv[ 1 ], NULL, 0 ) : STRESS_DEFAULT_DURATION_MS;
+    pthread_t xDispatchers[ STRESS_DISPATCHERS ];
+    pthread_t xSubscribers[ STRESS_SUBSCRIBERS ];
+    pthread_t xResubscriber;
+    pthread_t xSharers[ STRESS_SHARERS ];
+    SubscriptionMemory_t xMemory;
+    uint32_t ulFailures = 0, i;
+
+    for( i = 0; i < STRESS_SUBSCRIBERS; i++ )
+    {
+        xSubscriberContexts[ i ].ulMagic = STRESS_CONTEXT_MAGIC;
+    }
+
+    for( i = 0; i < STRESS_SHARERS; i++ )
+    {
+        xSharerContexts[ i ].ulMagic = STRESS_CONTEXT_MAGIC;
+    }
+
+    if( !addSubscription( &xList, pcFixedFilter, ( uint16_t ) strlen( pcFixedFilter ), prvCallback, &xFixedContext ) )
+    {
+        printf( "Failed to subscribe to %s.\n", pcFixedFilter );
+        ulFailures++;
+    }
+
+    for( i = 0; i < STRESS_DISPATCHERS; i++ )
+    {
+        configASSERT( pthread_create( &( xDispatchers[ i ] ), NULL, prvDispatcherThread, NULL ) == 0 );
+    }
+
+    for( i = 0; i < STRESS_SUBSCRIBERS; i++ )
+    {
+        configASSERT( pthread_create( &( xSubscribers[ i ] ), NULL, prvSubscriberThread, ( void * ) ( uintptr_t ) i ) == 0 );
+    }
+
+    configASSERT( pthread_create( &xResubscriber, NULL, prvResubscribeThread, NULL ) == 0 );
+
+    for( i = 0; i < STRESS_SHARERS; i++ )
+    {
+        configASSERT( pthread_create( &( xSharers[ i ] ), NULL, prvSharerThread, ( void * ) ( uintptr_t ) i ) == 0 );
+    }
+
+    vTaskDelay( pdMS_TO_TICKS( ulDurationMs ) );
+    __atomic_store_n( &xStop, true, __ATOMIC_RELAXED );
+
+    for( i = 0; i < STRESS_DISPATCHERS; i++ )
+    {
+        ( void ) pthread_join( xDispatchers[ i ], NULL );
+    }
+
+    for( i = 0; i < STRESS_SUBSCRIBERS; i++ )
+    {
+        ( void ) pthread_join( xSubscribers[ i ], NULL );
+    }
+
+    ( void ) pthread_join( xResubscriber, NULL );
+
+    for( i = 0; i < STRESS_SHARERS; i++ )
+    {
+        ( void ) pthread_join( xSharers[ i ], NULL );
+    }
+
+    /* Only the unchanged subscription is left. */
+    getSubscriptionMemory( &xList, &xMemory );
+
+    if( ( xMemory.ulSubscriptions != 1U ) || ( xMemory.ulFilters != 1U ) )
+    {
+        printf( "%" PRIu32 " subscriptions to %" PRIu32 " filters left, expected 1 to 1.\n",
+                xMemory.ulSubscriptions, xMemory.ulFilters );
+        ulFailures++;
+    }
+
+    if( ( ulMissed > 0U ) || ( ulBadContexts > 0U ) )
+    {
+        printf( "%" PRIu32 " dispatches missed the unchanged subscription, %" PRIu32 " callbacks got a bad context.\n",
+                ulMissed, ulBadContexts );
+        ulFailures++;
+    }
+
+    /* Otherwise two sharers both subscribed, or none unsubscribed. */
+    if( ulFirsts != ulLasts )
+    {
+        printf( "%" PRIu32 " joins of the shared filter were first, %" PRIu32 " leaves were last.\n",
+                ulFirsts, ulLasts );
+        ulFailures++;
+    }
+
+    if( ( ulDispatches == 0U ) || ( ulWrites == 0U ) || ( ulWalks == 0U ) || ( ulFirsts == 0U ) )
+    {
+        printf( "A thread made no progress.\n" );
+        ulFailures++;
+    }
+
+    printf( "dispatch_stress: %" PRIu32 " dispatches, %" PRIu32 " writes, %" PRIu32 " walks, %" PRIu32 " shared joins, %" PRIu32 " missed, %" PRIu32 " failures.\n",
+            ulDispatches, ulWrites, ulWalks, ulShared, ulMissed, ulFailures );
+
+    freeSubscriptionList( &xList );
+
+    return ( ulFailures == 0U ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
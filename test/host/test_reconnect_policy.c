@@ -0,0 +1,271 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2023 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file test_reconnect_policy.c
+ * @brief Test of the reconnect backoff policy.
+ *
+ * Steps the policy with the default curves of the configuration and checks:
+ * - the first delay of a class is its base delay;
+ * - each delay lies between the base and three times the previous delay,
+ *   capped to the maximum, and random numbers cover that whole range;
+ * - the largest jitter triples the delay until the maximum, where it stays,
+ *   including for a maximum close to UINT32_MAX;
+ * - a failure of another class restarts from the base of that class;
+ * - a reset, as on a successful connection, restarts from the base too.
+ *
+ * Usage: test_reconnect_policy [seed].
+ */
+
+/* Standard includes. */
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Reconnect policy header include. */
+#include "reconnect_policy.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/* Delays drawn by the jitter checks, per class. */
+#define POLICY_DRAWS    ( 20000U )
+
+#define POLICY_CHECK( x )                                                  \
+    do {                                                                   \
+        if( !( x ) )                                                       \
+        {                                                                  \
+            printf( "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x ); \
+            ulFailures++;                                                  \
+        }                                                                  \
+    } while( 0 )
+
+/* Global variables ***********************************************************/
+
+/* The defaults of the GRI_RETRY_* options. */
+static const ReconnectCurve_t xCurves[ eReconnectFailureCount ] =
+{
+    [ eReconnectFailureDns ]     = { 500U,  5000U  },
+    [ eReconnectFailureTcp ]     = { 500U,  5000U  },
+    [ eReconnectFailureTls ]     = { 1000U, 30000U },
+    [ eReconnectFailureConnack ] = { 2000U, 60000U }
+};
+
+static uint32_t ulFailures;
+
+static uint32_t ulRandomState;
+
+/* Static function definitions ************************************************/
+
+static uint32_t prvRandom( void )
+{
+    ulRandomState ^= ulRandomState << 13;
+    ulRandomState ^= ulRandomState >> 17;
+    ulRandomState ^= ulRandomState << 5;
+
+    return ulRandomState;
+}
+
+static uint32_t prvUpperMs( const ReconnectCurve_t * pxCurve,
+                            uint32_t ulPreviousMs )
+{
+    uint64_t ullUpperMs = ( uint64_t ) ulPreviousMs * 3U;
+
+    if( ullUpperMs > pxCurve->ulMaxMs )
+    {
+        ullUpperMs = pxCurve->ulMaxMs;
+    }
+
+    return ( ullUpperMs > pxCurve->ulBaseMs ) ? ( uint32_t ) ullUpperMs : pxCurve->ulBaseMs;
+}
+
+/**
+ * @brief Step a class with the largest jitter: each delay is the largest
+ * allowed, until the maximum.
+ */
+static void prvTestGrowth( const ReconnectCurve_t * pxCurves,
+                           ReconnectFailure_t eFailure )
+{
+    const ReconnectCurve_t * pxCurve = &( pxCurves[ eFailure ] );
+    ReconnectPolicy_t xPolicy;
+    uint32_t ulExpected = pxCurve->ulBaseMs, ulDelay, ulUpper, i;
+
+    vReconnectPolicyInit( &xPolicy, pxCurves );
+
+    for( i = 0; i < 40U; i++ )
+    {
+        ulUpper = prvUpperMs( pxCurve, ulExpected );
+
+        /* ulRandom modulo the range is the range itself. */
+        ulDelay = ulReconnectPolicyNextDelayMs( &xPolicy, eFailure, ( i == 0U ) ? UINT32_MAX : ulUpper - pxCurve->ulBaseMs );
+        POLICY_CHECK( ulDelay == ( ( i == 0U ) ? pxCurve->ulBaseMs : ulUpper ) );
+        POLICY_CHECK( xPolicy.ulAttempts == i + 1U );
+        ulExpected = ulDelay;
+    }
+
+    POLICY_CHECK( ulExpected == pxCurve->ulMaxMs );
+
+    /* The smallest jitter goes straight back to the base. */
+    POLICY_CHECK( ulReconnectPolicyNextDelayMs( &xPolicy, eFailure, 0U ) == pxCurve->ulBaseMs );
+}
+
+/**
+ * @brief Step a class with random jitter, checking the bounds of each delay
+ * and that the range is covered.
+ */
+static void prvTestJitter( ReconnectFailure_t eFailure )
+{
+    const ReconnectCurve_t * pxCurve = &( xCurves[ eFailure ] );
+    ReconnectPolicy_t xPolicy;
+    uint32_t ulPrevious, ulDelay, ulUpper, i;
+    uint32_t ulLowest = UINT32_MAX, ulHighest = 0;
+    uint32_t ulMargin = ( pxCurve->ulMaxMs - pxCurve->ulBaseMs ) / 20U;
+
+    vReconnectPolicyInit( &xPolicy, xCurves );
+    ulPrevious = ulReconnectPolicyNextDelayMs( &xPolicy, eFailure, prvRandom() );
+    POLICY_CHECK( ulPrevious == pxCurve->ulBaseMs );
+
+    for( i = 0; i < POLICY_DRAWS; i++ )
+    {
+        ulUpper = prvUpperMs( pxCurve, ulPrevious );
+        ulDelay = ulReconnectPolicyNextDelayMs( &xPolicy, eFailure, prvRandom() );
+
+        if( ( ulDelay < pxCurve->ulBaseMs ) || ( ulDelay > ulUpper ) )
+        {
+            printf( "%s delay %" PRIu32 " ms after %" PRIu32 " ms, outside [%" PRIu32 ", %" PRIu32 "].\n",
+                    pcReconnectPolicyFailureName( eFailure ), ulDelay, ulPrevious, pxCurve->ulBaseMs, ulUpper );
+            ulFailures++;
+        }
+
+        ulLowest = ( ulDelay < ulLowest ) ? ulDelay : ulLowest;
+        ulHighest = ( ulDelay > ulHighest ) ? ulDelay : ulHighest;
+        ulPrevious = ulDelay;
+    }
+
+    POLICY_CHECK( ulLowest <= pxCurve->ulBaseMs + ulMargin );
+    POLICY_CHECK( ulHighest >= pxCurve->ulMaxMs - ulMargin );
+    POLICY_CHECK( xPolicy.ulAttempts == POLICY_DRAWS + 1U );
+}
+
+static void prvTestClassSwitch( void )
+{
+    ReconnectPolicy_t xPolicy;
+    uint32_t i;
+
+    vReconnectPolicyInit( &xPolicy, xCurves );
+
+    for( i = 0; i < 5U; i++ )
+    {
+        ( void ) ulReconnectPolicyNextDelayMs( &xPolicy, eReconnectFailureTcp, UINT32_MAX - i );
+    }
+
+    POLICY_CHECK( xPolicy.ulLastDelayMs > xCurves[ eReconnectFailureTcp ].ulBaseMs );
+
+    /* The broker is now reached, but refuses the connection. */
+    POLICY_CHECK( ulReconnectPolicyNextDelayMs( &xPolicy, eReconnectFailureConnack, UINT32_MAX ) ==
+                  xCurves[ eReconnectFailureConnack ].ulBaseMs );
+    POLICY_CHECK( ulReconnectPolicyNextDelayMs( &xPolicy, eReconnectFailureTcp, UINT32_MAX ) ==
+                  xCurves[ eReconnectFailureTcp ].ulBaseMs );
+    POLICY_CHECK( xPolicy.ulAttempts == 7U );
+}
+
+static void prvTestReset( void )
+{
+    ReconnectPolicy_t xPolicy;
+    uint32_t i;
+
+    vReconnectPolicyInit( &xPolicy, xCurves );
+    POLICY_CHECK( xPolicy.ulAttempts == 0U );
+    POLICY_CHECK( xPolicy.ulLastDelayMs == 0U );
+
+    for( i = 0; i < 10U; i++ )
+    {
+        ( void ) ulReconnectPolicyNextDelayMs( &xPolicy, eReconnectFailureTls,
+                                               prvUpperMs( &( xCurves[ eReconnectFailureTls ] ), xPolicy.ulLastDelayMs ) -
+                                               xCurves[ eReconnectFailureTls ].ulBaseMs );
+    }
+
+    POLICY_CHECK( xPolicy.ulLastDelayMs == xCurves[ eReconnectFailureTls ].ulMaxMs );
+
+    /* Connected: the next failure of the same class starts over. */
+    vReconnectPolicyReset( &xPolicy );
+    POLICY_CHECK( xPolicy.ulAttempts == 0U );
+    POLICY_CHECK( ulReconnectPolicyNextDelayMs( &xPolicy, eReconnectFailureTls, UINT32_MAX ) ==
+                  xCurves[ eReconnectFailureTls ].ulBaseMs );
+    POLICY_CHECK( xPolicy.ulAttempts == 1U );
+}
+
+static void prvTestNames( void )
+{
+    POLICY_CHECK( strcmp( pcReconnectPolicyFailureName( eReconnectFailureDns ), "DNS" ) == 0 );
+    POLICY_CHECK( strcmp( pcReconnectPolicyFailureName( eReconnectFailureTcp ), "TCP" ) == 0 );
+    POLICY_CHECK( strcmp( pcReconnectPolicyFailureName( eReconnectFailureTls ), "TLS" ) == 0 );
+    POLICY_CHECK( strcmp( pcReconnectPolicyFailureName( eReconnectFailureConnack ), "CONNACK" ) == 0 );
+    POLICY_CHECK( strcmp( pcReconnectPolicyFailureName( eReconnectFailureCount ), "unknown" ) == 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    /* Three times the previous delay overflows 32 bits near the maximum. */
+    static const ReconnectCurve_t xWideCurves[ eReconnectFailureCount ] =
+    {
+        [ eReconnectFailureDns ]     = { 1000U, UINT32_MAX      },
+        [ eReconnectFailureTcp ]     = { 1000U, UINT32_MAX - 1U },
+        [ eReconnectFailureTls ]     = { 1U,    3U              },
+        [ eReconnectFailureConnack ] = { 7000U, 7000U           }
+    };
+    uint32_t ulSeed = ( argc > 1 ) ? ( uint32_t ) strtoul( argv[ 1 ], NULL, 0 ) : 1U;
+    int i;
+
+    if( ulSeed == 0U )
+    {
+        ulSeed = ( uint32_t ) time( NULL );
+    }
+
+    /* xorshift32 is stuck at 0. */
+    ulRandomState = ( ulSeed == 0U ) ? 1U : ulSeed;
+
+    prvTestNames();
+
+    for( i = 0; i < eReconnectFailureCount; i++ )
+    {
+        prvTestGrowth( xCurves, ( ReconnectFailure_t ) i );
+        prvTestGrowth( xWideCurves, ( ReconnectFailure_t ) i );
+        prvTestJitter( ( ReconnectFailure_t ) i );
+    }
+
+    prvTestClassSwitch();
+    prvTestReset();
+
+    printf( "reconnect_policy: seed %" PRIu32 ", %" PRIu32 " failures.\n", ulSeed, ulFailures );
+
+    return ( ulFailures == 0U ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,526 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2023 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file test_subscription_index.c
+ * @brief Differential test of the topic filter index of the subscription
+ * manager against MQTT_MatchTopic().
+ *
+ * The trie holding the wildcard filters and the hash table holding the exact
+ * ones are checked against a linear MQTT_MatchTopic() over a model of the
+ * subscriptions, while random subscriptions are added and removed:
+ * - known edge cases of the matching rules, checked against their expected
+ *   result as well;
+ * - whether addSharedSubscription() and removeSharedSubscription() report the
+ *   first and the last callback of a filter;
+ * - random filters built of '+', '#', '$'-prefixed levels, empty levels and
+ *   filters deeper than SUBSCRIPTION_MANAGER_MAX_INDEX_DEPTH, several
+ *   callbacks per filter, up to a full list.
+ *
+ * Usage: test_subscription_index [seed [operations]]. A seed of 0 picks one,
+ * which is printed so a failure can be replayed.
+ */
+
+/* Standard includes. */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Subscription manager header include. */
+#include "subscription_manager.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/* Callback contexts; a filter is subscribed at most once per context. */
+#define INDEX_CONTEXTS             ( 8U )
+
+/* Size of a filter or topic, 13 characters per level at most. */
+#define INDEX_FILTER_LENGTH        ( 256U )
+
+/* Most levels of a random filter or topic. */
+#define INDEX_MAX_LEVELS           ( SUBSCRIPTION_MANAGER_MAX_INDEX_DEPTH + 3U )
+
+/* Mismatches printed before the rest are only counted. */
+#define INDEX_MAX_REPORTS          ( 8U )
+
+#define INDEX_DEFAULT_OPERATIONS   ( 200000U )
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief A subscription as the model holds it.
+ */
+typedef struct ModelSubscription
+{
+    char cFilter[ INDEX_FILTER_LENGTH ];
+    uint32_t ulContext;
+    bool xLive;
+} ModelSubscription_t;
+
+/**
+ * @brief An edge case of the matching rules.
+ */
+typedef struct MatchCase
+{
+    const char * pcFilter;
+    const char * pcTopic;
+    bool xMatch;
+} MatchCase_t;
+
+/* Global variables ***********************************************************/
+
+static const MatchCase_t xMatchCases[] =
+{
+    { "a/b",         "a/b",          true  },
+    { "a/b",         "a/b/",         false },
+    { "a/b",         "a",            false },
+    { "a/+",         "a/",           true  },
+    { "a/+",         "a",            false },
+    { "a/+",         "a/b/c",        false },
+    { "+/+",         "/",            true  },
+    { "+",           "/x",           false },
+    { "+/x",         "/x",           true  },
+    { "a//b",        "a//b",         true  },
+    { "a/+/b",       "a//b",         true  },
+    { "#",           "a/b/c",        true  },
+    { "#",           "/",            true  },
+    { "a/#",         "a",            true  },
+    { "a/#",         "a/",           true  },
+    { "a/#",         "ab",           false },
+    { "a/b/#",       "a",            false },
+    { "+/#",         "a",            true  },
+    { "#",           "$aws/things",  false },
+    { "+/things",    "$aws/things",  false },
+    { "$aws/#",      "$aws/things",  true  },
+    { "$aws/+",      "$aws/things",  true  },
+    { "$aws/things", "$aws/things",  true  },
+    { "a/$aws",      "a/$aws",       true  },
+    { "a/+",         "a/$aws",       true  },
+};
+
+static const char * const pcLevels[] = { "$aws", "$SYS", "things", "dev0", "dev1", "a", "b", "", "jobs", "longer-level" };
+
+static ModelSubscription_t * pxModel;
+static uint32_t ulModelCount;
+
+/* Times each context was called by the last dispatch. */
+static uint32_t ulCalls[ INDEX_CONTEXTS ];
+
+static uint32_t ulRandomState;
+
+/* Static function definitions ************************************************/
+
+static uint32_t prvRandom( void )
+{
+    ulRandomState ^= ulRandomState << 13;
+    ulRandomState ^= ulRandomState >> 17;
+    ulRandomState ^= ulRandomState << 5;
+
+    return ulRandomState;
+}
+
+static void prvRandomTopic( char * pcTopic,
+                            bool xWildcards )
+{
+    const uint32_t ulLevelCount = sizeof( pcLevels ) / sizeof( pcLevels[ 0 ] );
+    uint32_t ulLevels, ulChoice, i;
+    const char * pcLevel;
+    size_t xLength;
+
+    /* Mostly short, sometimes deeper than the index. */
+    do
+    {
+        ulLevels = 1U + ( prvRandom() % ( ( ( prvRandom() % 8U ) == 0U ) ? INDEX_MAX_LEVELS : 4U ) );
+        xLength = 0;
+
+        for( i = 0; i < ulLevels; i++ )
+        {
+            /* Wildcards are one level in four of a filter. */
+            ulChoice = prvRandom() % ( xWildcards ? ( ulLevelCount + ( ulLevelCount / 3U ) ) : ulLevelCount );
+
+            if( ulChoice < ulLevelCount )
+            {
+                pcLevel = pcLevels[ ulChoice ];
+            }
+            else if( ( ulChoice % 2U ) == 0U )
+            {
+                pcLevel = "+";
+            }
+            else
+            {
+                /* '#' must be the last level. */
+                pcLevel = "#";
+                ulLevels = i + 1U;
+            }
+
+            xLength += ( size_t ) snprintf( &( pcTopic[ xLength ] ),
+                                            INDEX_FILTER_LENGTH - xLength,
+                                            "%s%s",
+                                            ( i > 0U ) ? "/" : "",
+                                            pcLevel );
+        }
+    } while( ( xLength == 0U ) || ( xLength >= INDEX_FILTER_LENGTH ) );
+}
+
+static void prvCallback( void * pvIncomingPublishCallbackContext,
+                         MQTTPublishInfo_t * pxPublishInfo )
+{
+    ( void ) pxPublishInfo;
+
+    ulCalls[ ( uintptr_t ) pvIncomingPublishCallbackContext ]++;
+}
+
+static uint32_t prvLiveSubscriptions( void )
+{
+    uint32_t ulLive = 0, i;
+
+    for( i = 0; i < ulModelCount; i++ )
+    {
+        ulLive += pxModel[ i ].xLive ? 1U : 0U;
+    }
+
+    return ulLive;
+}
+
+static ModelSubscription_t * prvFindModel( const char * pcFilter,
+                                           uint32_t ulContext )
+{
+    ModelSubscription_t * pxFound = NULL;
+    uint32_t i;
+
+    for( i = 0; ( i < ulModelCount ) && ( pxFound == NULL ); i++ )
+    {
+        if( pxModel[ i ].xLive && ( pxModel[ i ].ulContext == ulContext ) &&
+            ( strcmp( pxModel[ i ].cFilter, pcFilter ) == 0 ) )
+        {
+            pxFound = &( pxModel[ i ] );
+        }
+    }
+
+    return pxFound;
+}
+
+static void prvCompactModel( void )
+{
+    uint32_t ulKept = 0, i;
+
+    for( i = 0; i < ulModelCount; i++ )
+    {
+        if( pxModel[ i ].xLive )
+        {
+            pxModel[ ulKept++ ] = pxModel[ i ];
+        }
+    }
+
+    ulModelCount = ulKept;
+}
+
+/**
+ * @brief Dispatch a topic and compare the calls of each context with the
+ * model.
+ *
+ * @return Number of contexts called a wrong number of times.
+ */
+static uint32_t prvCheckTopic( SubscriptionList_t * pxList,
+                               const char * pcTopic )
+{
+    MQTTPublishInfo_t xPublishInfo = { 0 };
+    uint32_t ulExpected[ INDEX_CONTEXTS ] = { 0 };
+    uint32_t ulWrong = 0, i;
+    bool xMatch;
+
+    xPublishInfo.pTopicName = pcTopic;
+    xPublishInfo.topicNameLength = ( uint16_t ) strlen( pcTopic );
+
+    for( i = 0; i < ulModelCount; i++ )
+    {
+        xMatch = false;
+
+        if( pxModel[ i ].xLive )
+        {
+            ( void ) MQTT_MatchTopic( pcTopic, xPublishInfo.topicNameLength,
+                                      pxModel[ i ].cFilter, ( uint16_t ) strlen( pxModel[ i ].cFilter ), &xMatch );
+        }
+
+        ulExpected[ pxModel[ i ].ulContext ] += xMatch ? 1U : 0U;
+    }
+
+    memset( ulCalls, 0x00, sizeof( ulCalls ) );
+    ( void ) handleIncomingPublishes( pxList, &xPublishInfo );
+
+    for( i = 0; i < INDEX_CONTEXTS; i++ )
+    {
+        if( ulCalls[ i ] != ulExpected[ i ] )
+        {
+            ulWrong++;
+        }
+    }
+
+    return ulWrong;
+}
+
+/**
+ * @brief Check the matching rules on known cases, through the reference
+ * matcher and through the subscription manager.
+ *
+ * @return Number of failed cases.
+ */
+static uint32_t prvCheckMatchCases( void )
+{
+    static SubscriptionList_t xList;
+    const uint32_t ulCases = sizeof( xMatchCases ) / sizeof( xMatchCases[ 0 ] );
+    MQTTPublishInfo_t xPublishInfo = { 0 };
+    uint32_t ulFailures = 0, i;
+    bool xMatch;
+
+    for( i = 0; i < ulCases; i++ )
+    {
+        xMatch = !xMatchCases[ i ].xMatch;
+        ( void ) MQTT_MatchTopic( xMatchCases[ i ].pcTopic, ( uint16_t ) strlen( xMatchCases[ i ].pcTopic ),
+                                  xMatchCases[ i ].pcFilter, ( uint16_t ) strlen( xMatchCases[ i ].pcFilter ), &xMatch );
+
+        /* Alone, then among filters taking the other paths of the index. */
+        freeSubscriptionList( &xList );
+        ( void ) addSubscription( &xList, xMatchCases[ i ].pcFilter, ( uint16_t ) strlen( xMatchCases[ i ].pcFilter ),
+                                  prvCallback, ( void * ) 0 );
+        xPublishInfo.pTopicName = xMatchCases[ i ].pcTopic;
+        xPublishInfo.topicNameLength = ( uint16_t ) strlen( xMatchCases[ i ].pcTopic );
+        memset( ulCalls, 0x00, sizeof( ulCalls ) );
+        ( void ) handleIncomingPublishes( &xList, &xPublishInfo );
+
+        if( ( xMatch != xMatchCases[ i ].xMatch ) || ( ulCalls[ 0 ] != ( xMatchCases[ i ].xMatch ? 1U : 0U ) ) )
+        {
+            printf( "Filter %s on topic %s: expected %d, MQTT_MatchTopic() %d, subscription manager %" PRIu32 ".\n",
+                    xMatchCases[ i ].pcFilter, xMatchCases[ i ].pcTopic, xMatchCases[ i ].xMatch, xMatch, ulCalls[ 0 ] );
+            ulFailures++;
+        }
+    }
+
+    freeSubscriptionList( &xList );
+
+    return ulFailures;
+}
+
+/**
+ * @brief Check the first and last callbacks of a filter are reported by
+ * addSharedSubscription() and removeSharedSubscription().
+ *
+ * @return Number of failed checks.
+ */
+static uint32_t prvCheckSharedSubscriptions( void )
+{
+    static SubscriptionList_t xList;
+    const char * const pcShared = "shared/+";
+    const char * const pcOther = "shared/other";
+    const uint16_t usShared = ( uint16_t ) strlen( pcShared );
+    uint32_t ulFailures = 0;
+    bool xAdded, xRemoved, xFirst, xLast;
+
+    /* Another filter sharing the prefix does not count. */
+    ( void ) addSubscription( &xList, pcOther, ( uint16_t ) strlen( pcOther ), prvCallback, ( void * ) 0 );
+
+    xAdded = addSharedSubscription( &xList, pcShared, usShared, prvCallback, ( void * ) 1, &xFirst );
+    ulFailures += ( xAdded && xFirst ) ? 0U : 1U;
+
+    xAdded = addSharedSubscription( &xList, pcShared, usShared, prvCallback, ( void * ) 2, &xFirst );
+    ulFailures += ( xAdded && !xFirst ) ? 0U : 1U;
+
+    /* Adding a subscription again neither fails nor is first. */
+    xAdded = addSharedSubscription( &xList, pcShared, usShared, prvCallback, ( void * ) 1, &xFirst );
+    ulFailures += ( xAdded && !xFirst ) ? 0U : 1U;
+
+    xRemoved = removeSharedSubscription( &xList, pcShared, usShared, prvCallback, ( void * ) 1, &xLast );
+    ulFailures += ( xRemoved && !xLast ) ? 0U : 1U;
+
+    xLast = true;
+    xRemoved = removeSharedSubscription( &xList, pcShared, usShared, prvCallback, ( void * ) 1, &xLast );
+    ulFailures += ( !xRemoved && !xLast ) ? 0U : 1U;
+
+    xRemoved = removeSharedSubscription( &xList, pcShared, usShared, prvCallback, ( void * ) 2, &xLast );
+    ulFailures += ( xRemoved && xLast ) ? 0U : 1U;
+
+    /* Without callbacks left, the filter is first again. */
+    xAdded = addSharedSubscription( &xList, pcShared, usShared, prvCallback, ( void * ) 2, &xFirst );
+    ulFailures += ( xAdded && xFirst ) ? 0U : 1U;
+
+    if( ulFailures > 0U )
+    {
+        printf( "%" PRIu32 " shared subscription checks failed.\n", ulFailures );
+    }
+
+    freeSubscriptionList( &xList );
+
+    return ulFailures;
+}
+
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    static SubscriptionList_t xList;
+    uint32_t ulSeed = ( argc > 1 ) ? ( uint32_t ) strtoul( argv[ 1 ], NULL, 0 ) : 0U;
+    uint32_t ulOperations = ( argc > 2 ) ? ( uint32_t ) strtoul( argv[ 2 ], NULL, 0 ) : INDEX_DEFAULT_OPERATIONS;
+    uint32_t ulFailures = 0, ulChecks = 0, ulWrong, ulOperation, ulContext, ulChoice, ulCount, i;
+    char cFilter[ INDEX_FILTER_LENGTH ];
+    ModelSubscription_t * pxFound;
+    bool xAdded;
+
+    if( ulSeed == 0U )
+    {
+        ulSeed = ( uint32_t ) time( NULL ) & 0x7FFFFFFFU;
+    }
+
+    /* xorshift32 is stuck at 0. */
+    ulRandomState = ( ulSeed == 0U ) ? 1U : ulSeed;
+
+    ulFailures += prvCheckMatchCases();
+    ulFailures += prvCheckSharedSubscriptions();
+
+    /* Removed subscriptions stay in the model until it is compacted. */
+    pxModel = calloc( 2U * SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS, sizeof( ModelSubscription_t ) );
+
+    if( pxModel == NULL )
+    {
+        printf( "Failed to allocate the model.\n" );
+        ulFailures++;
+        ulOperations = 0;
+    }
+
+    for( ulOperation = 0; ( ulOperation < ulOperations ) && ( ulFailures < INDEX_MAX_REPORTS ); ulOperation++ )
+    {
+        if( ulModelCount == ( 2U * SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ) )
+        {
+            prvCompactModel();
+        }
+
+        ulChoice = prvRandom() % 8U;
+
+        if( ulChoice < 3U )
+        {
+            /* Subscribe, often to a filter already subscribed to. */
+            if( ( ulModelCount > 0U ) && ( ( prvRandom() % 3U ) == 0U ) )
+            {
+                strcpy( cFilter, pxModel[ prvRandom() % ulModelCount ].cFilter );
+            }
+            else
+            {
+                prvRandomTopic( cFilter, true );
+            }
+
+            ulContext = prvRandom() % INDEX_CONTEXTS;
+            pxFound = prvFindModel( cFilter, ulContext );
+            ulCount = prvLiveSubscriptions();
+            strcpy( pxModel[ ulModelCount ].cFilter, cFilter );
+            xAdded = addSubscription( &xList, cFilter, ( uint16_t ) strlen( cFilter ), prvCallback, ( void * ) ( uintptr_t ) ulContext );
+
+            /* The list copies the filter. */
+            memset( cFilter, 'X', sizeof( cFilter ) - 1U );
+
+            if( xAdded != ( ( pxFound != NULL ) || ( ulCount < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ) ) )
+            {
+                printf( "Seed %" PRIu32 ": adding subscription %" PRIu32 " returned %d.\n", ulSeed, ulCount + 1U, xAdded );
+                ulFailures++;
+            }
+            else if( xAdded && ( pxFound == NULL ) )
+            {
+                pxModel[ ulModelCount ].ulContext = ulContext;
+                pxModel[ ulModelCount ].xLive = true;
+                ulModelCount++;
+            }
+        }
+        else if( ( ulChoice < 5U ) && ( ulModelCount > 0U ) )
+        {
+            i = prvRandom() % ulModelCount;
+
+            if( pxModel[ i ].xLive )
+            {
+                strcpy( cFilter, pxModel[ i ].cFilter );
+                ulCount = 0;
+
+                for( ulContext = 0; ulContext < ulModelCount; ulContext++ )
+                {
+                    ulCount += ( pxModel[ ulContext ].xLive && ( strcmp( pxModel[ ulContext ].cFilter, cFilter ) == 0 ) ) ? 1U : 0U;
+                }
+
+                if( countSubscriptions( &xList, cFilter, ( uint16_t ) strlen( cFilter ) ) != ulCount )
+                {
+                    printf( "Seed %" PRIu32 ": %s has %" PRIu32 " subscriptions, counted %" PRIu32 ".\n", ulSeed, cFilter, ulCount,
+                            countSubscriptions( &xList, cFilter, ( uint16_t ) strlen( cFilter ) ) );
+                    ulFailures++;
+                }
+
+                if( ( prvRandom() % 4U ) == 0U )
+                {
+                    /* Every callback of the filter. */
+                    removeSubscription( &xList, cFilter, ( uint16_t ) strlen( cFilter ) );
+
+                    for( ulContext = 0; ulContext < ulModelCount; ulContext++ )
+                    {
+                        if( strcmp( pxModel[ ulContext ].cFilter, cFilter ) == 0 )
+                        {
+                            pxModel[ ulContext ].xLive = false;
+                        }
+                    }
+                }
+                else if( !removeSubscriptionCallback( &xList, cFilter, ( uint16_t ) strlen( cFilter ),
+                                                      prvCallback, ( void * ) ( uintptr_t ) pxModel[ i ].ulContext ) )
+                {
+                    printf( "Seed %" PRIu32 ": failed to remove a subscription to %s.\n", ulSeed, cFilter );
+                    ulFailures++;
+                }
+                else
+                {
+                    pxModel[ i ].xLive = false;
+                }
+            }
+        }
+        else
+        {
+            /* Topics built from the same levels, or a subscribed filter
+             * dispatched as a topic when it has no wildcard. */
+            prvRandomTopic( cFilter, false );
+            ulWrong = prvCheckTopic( &xList, cFilter );
+            ulChecks++;
+
+            if( ulWrong > 0U )
+            {
+                printf( "Seed %" PRIu32 ": topic %s called %" PRIu32 " contexts a wrong number of times.\n", ulSeed, cFilter, ulWrong );
+                ulFailures++;
+            }
+        }
+    }
+
+    printf( "subscription_index seed %" PRIu32 ": %" PRIu32 " operations, %" PRIu32 " topics checked, %" PRIu32 " subscriptions left, %" PRIu32 " failures.\n",
+            ulSeed, ulOperation, ulChecks, prvLiveSubscriptions(), ulFailures );
+
+    freeSubscriptionList( &xList );
+    free( pxModel );
+
+    return ( ulFailures == 0U ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}